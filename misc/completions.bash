@@ -140,6 +140,7 @@ _clifm ()
         --shotgun-file
         --si
         --sort-reverse
+        --startup-trace
         --stat
         --stat-full
         --tabmode
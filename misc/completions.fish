@@ -102,6 +102,7 @@ complete -c clifm -l share-selbox -d 'Make the Selection Box common to different
 complete -c clifm -l shotgun-file -r -d 'Set a custom configuration file for shotgun'
 complete -c clifm -l si -d 'Print sizes in powers of 1000 instead of 1024'
 complete -c clifm -l sort-reverse -d 'Sort in reverse order'
+complete -c clifm -l startup-trace -d 'Print the time spent in each startup step' -x -a 'text tsv'
 complete -c clifm -l stat -d 'Run the p command on FILE and exit'
 complete -c clifm -l stat-full -d 'Run the pp command on FILE and exit'
 complete -c clifm -l tabmode -r -d 'Set the tab completion mode' -x -a 'fzf fnf smenu standard'
@@ -0,0 +1,178 @@
+#!/bin/sh
+
+# startup-bench.sh
+# Author: L. Abramovich
+# License: GPL-2.0-or-later
+
+######################
+# DESCRIPTION
+######################
+#
+# Measure Clifm's startup time to catch regressions.
+#
+# A temporary home directory is populated with synthetic fixtures (a default
+# configuration and a directory holding FILES files, with mixed file types
+# and extensions), and 'clifm --list-and-quit' is run RUNS times against it.
+# Times are taken from Clifm's built-in startup tracer (--startup-trace=tsv),
+# so that process creation and the dynamic loader are excluded.
+#
+# Note: Clifm reads file names from standard input if it is not a terminal,
+# so this script must be run from a terminal (or via script(1)).
+#
+# The median time of each startup step is printed, followed by the median
+# total time.
+
+######################
+# USAGE
+######################
+#
+# startup-bench.sh [-n RUNS] [-f FILES] [-s FILE] [-c FILE] [-t PERCENT] [CLIFM]
+#
+# -n RUNS     Number of measured runs (default: 20)
+# -f FILES    Number of files in the listed directory (default: 2000)
+# -s FILE     Save the results to FILE (to be used later as baseline)
+# -c FILE     Compare the median total time with the baseline saved in FILE
+#             and exit with 1 if it is more than PERCENT slower
+# -t PERCENT  Regression threshold for -c (default: 10)
+# CLIFM       The clifm binary to benchmark (default: clifm in PATH)
+#
+# Example: check that a new build is not slower than the installed one:
+#
+#   ./startup-bench.sh -s /tmp/base.tsv clifm
+#   ./startup-bench.sh -c /tmp/base.tsv ./build/clifm
+
+runs=20
+files=2000
+save_file=""
+cmp_file=""
+threshold=10
+
+usage() {
+	printf "Usage: %s [-n RUNS] [-f FILES] [-s FILE] [-c FILE] \
+[-t PERCENT] [CLIFM]\n" "${0##*/}" >&2
+	exit 1
+}
+
+while getopts "n:f:s:c:t:h" opt; do
+	case "$opt" in
+		n) runs="$OPTARG" ;;
+		f) files="$OPTARG" ;;
+		s) save_file="$OPTARG" ;;
+		c) cmp_file="$OPTARG" ;;
+		t) threshold="$OPTARG" ;;
+		*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+clifm="${1:-clifm}"
+if ! type "$clifm" >/dev/null 2>&1; then
+	printf "%s: %s: Command not found\n" "${0##*/}" "$clifm" >&2
+	exit 1
+fi
+
+case "$runs$files$threshold" in
+	*[!0-9]*|"") usage ;;
+esac
+
+if ! [ -t 0 ]; then
+	printf "%s: Standard input is not a terminal\n" "${0##*/}" >&2
+	exit 1
+fi
+
+tmp="$(mktemp -d "${TMPDIR:-/tmp}/clifm-bench.XXXXXX")" || exit 1
+trap '[ -n "$tmp" ] && rm -rf -- "$tmp"' EXIT
+trap 'exit 1' HUP INT TERM
+
+# Synthetic fixtures
+fixture_home="$tmp/home"
+fixture_dir="$tmp/files"
+results="$tmp/results"
+mkdir -p "$fixture_home" "$fixture_dir" || exit 1
+
+i=0
+while [ "$i" -lt "$files" ]; do
+	case $((i % 8)) in
+		0) mkdir "$fixture_dir/dir$i" ;;
+		1) : > "$fixture_dir/file$i.c" ;;
+		2) : > "$fixture_dir/file$i.tar.gz" ;;
+		3) : > "$fixture_dir/.hidden$i" ;;
+		4) : > "$fixture_dir/script$i.sh"; chmod +x "$fixture_dir/script$i.sh" ;;
+		5) ln -s "file$((i - 4)).c" "$fixture_dir/link$i" ;;
+		6) ln -s "missing$i" "$fixture_dir/broken$i" ;;
+		*) : > "$fixture_dir/Image $i.png" ;;
+	esac
+	i=$((i + 1))
+done
+
+unset XDG_CONFIG_HOME
+
+bench_clifm() {
+	HOME="$fixture_home" "$clifm" --list-and-quit --color=always \
+		--startup-trace=tsv "$fixture_dir" 2>&1 >/dev/null
+}
+
+# The first run creates the default configuration files
+bench_clifm >/dev/null
+
+: > "$results"
+i=0
+while [ "$i" -lt "$runs" ]; do
+	if ! bench_clifm | grep '	' >> "$results"; then
+		printf "%s: %s: No startup trace (--startup-trace not \
+supported?)\n" "${0##*/}" "$clifm" >&2
+		exit 1
+	fi
+	i=$((i + 1))
+done
+
+# Print the median time of each step (in order of appearance), plus the
+# median total time.
+summary="$(sort -t '	' -k1,1 -k2,2n "$results" | awk -F '\t' '
+	NR == FNR { n[$1]++; t[$1, n[$1]] = $2; next }
+	!($1 in seen) { seen[$1] = 1; order[++steps] = $1 }
+	END {
+		for (s = 1; s <= steps; s++) {
+			k = order[s]
+			m = n[k] % 2 ? t[k, (n[k] + 1) / 2] \
+				: (t[k, n[k] / 2] + t[k, n[k] / 2 + 1]) / 2
+			printf "%s\t%.3f\n", k, m
+		}
+	}' - "$results")"
+
+# The total time of each run is the third field of its last line
+total="$(awk -F '\t' '
+	$1 == "list_files" { print $3 }' "$results" | sort -n | awk '
+	{ t[NR] = $1 }
+	END {
+		if (NR == 0) exit 1
+		printf "%.3f\n", NR % 2 ? t[(NR + 1) / 2] \
+			: (t[NR / 2] + t[NR / 2 + 1]) / 2
+	}')" || exit 1
+
+printf "%s\n" "$summary" | awk -F '\t' '{ printf "%-24s %10s\n", $1, $2 }'
+printf "%-24s %10s\n" "total" "$total"
+printf "(median of %s runs, %s files)\n" "$runs" "$files"
+
+if [ -n "$save_file" ]; then
+	{ printf "%s\n" "$summary"; printf "total\t%s\n" "$total"; } > "$save_file"
+fi
+
+if [ -n "$cmp_file" ]; then
+	base="$(awk -F '\t' '$1 == "total" { print $2 }' "$cmp_file")"
+	if [ -z "$base" ]; then
+		printf "%s: %s: No baseline total time\n" "${0##*/}" "$cmp_file" >&2
+		exit 1
+	fi
+
+	awk -v new="$total" -v base="$base" -v max="$threshold" 'BEGIN {
+		diff = base > 0 ? (new - base) * 100 / base : 0
+		printf "baseline: %.3f ms, current: %.3f ms (%+.1f%%)\n", base, new, diff
+		if (diff > max) {
+			printf "Startup regression: more than %d%% slower\n", max
+			exit 1
+		}
+	}' || exit 1
+fi
+
+exit 0
@@ -154,6 +154,7 @@
 #define LOPT_MOUNTS                 294
 #define LOPT_NAMES_LAST             295
 #define LOPT_LS                     296
+#define LOPT_STARTUP_TRACE          297
 
 /* Link long (--option) and short options (-o) for the getopt_long function. */
 static struct option const longopts[] = {
@@ -284,6 +285,7 @@ static struct option const longopts[] = {
 	{"shotgun-file", required_argument, 0, LOPT_SHOTGUN_FILE},
 	{"si", no_argument, 0, LOPT_SI},
 	{"smenutab", no_argument, 0, LOPT_SMENUTAB}, /* Deprecated */
+	{"startup-trace", optional_argument, 0, LOPT_STARTUP_TRACE},
 	{"stat", no_argument, 0, LOPT_STAT}, /* Positional params */
 	{"stat-full", no_argument, 0, LOPT_STAT_FULL}, /* Positional params */
 	{"stdtab", no_argument, 0, LOPT_STDTAB}, /* Deprecated */
@@ -702,7 +704,7 @@ get_home_sec_env(void)
 
 /* Return 1 if the size of the file FILENAME is <= MAX_SIZE (in KiB),
  * or 0 otherwise. */
-static int
+int
 preview_this_file(const char *filename, const char *max_size)
 {
 	errno = 0;
@@ -815,6 +817,42 @@ set_sort(const char *arg, const char *opt_str)
 	xargs.sort = conf.sort = n;
 }
 
+/* Get the path to the file FILE to be opened or previewed: file URIs are
+ * decoded (into BUF, whose size must be PATH_MAX + 1 bytes), and the file
+ * must exist. URL is set to 1 if FILE is a URL, or to 0 otherwise.
+ * Returns the path to the file, or NULL on error (errno is set). */
+char *
+get_open_preview_path(char *file, char *buf, int *url)
+{
+	char *fpath = file;
+	const size_t flen = strlen(file);
+	struct stat attr;
+
+	*url = 1;
+
+	if (IS_FILE_URI(fpath, flen)) {
+		if (strchr(file + FILE_URI_PREFIX_LEN, '%')) {
+			char *ptr = url_decode(file + FILE_URI_PREFIX_LEN);
+			xstrsncpy(buf, ptr ? ptr : file, PATH_MAX + 1);
+			free(ptr);
+			fpath = buf;
+		} else {
+			fpath = file + FILE_URI_PREFIX_LEN;
+		}
+
+		*url = 0;
+		return stat(fpath, &attr) == -1 ? NULL : fpath;
+	}
+
+	if (is_url(fpath) == FUNC_FAILURE) {
+		*url = 0;
+		if (*fpath != '~' && stat(fpath, &attr) == -1)
+			return NULL;
+	}
+
+	return fpath;
+}
+
 /* Open/preview FILE according to MODE: either PREVIEW_FILE or OPEN_FILE */
 __attribute__ ((noreturn))
 static void
@@ -840,40 +878,16 @@ open_preview_file(char *file, const int mode)
 	}
 
 	static char buf[PATH_MAX + 1];
-	char *fpath = file;
-	int url = 1;
+	int url = 0;
 	const int preview = mode == PREVIEW_FILE ? 1 : 0;
-	const size_t flen = strlen(file);
 
-	struct stat attr;
-	if (IS_FILE_URI(fpath, flen)) {
-		if (strchr(file + FILE_URI_PREFIX_LEN, '%')) {
-			char *ptr = url_decode(file + FILE_URI_PREFIX_LEN);
-			xstrsncpy(buf, ptr ? ptr : file, sizeof(buf));
-			free(ptr);
-			fpath = buf;
-		} else {
-			fpath = file + FILE_URI_PREFIX_LEN;
-		}
-
-		if (stat(fpath, &attr) == -1) {
-			xerror("%s: '%s': %s\n", PROGRAM_NAME, file, strerror(errno));
-			exit(errno);
-		}
-
-		url = 0;
-		goto RUN;
+	char *fpath = get_open_preview_path(file, buf, &url);
+	if (!fpath) {
+		const int saved_errno = errno;
+		xerror("%s: '%s': %s\n", PROGRAM_NAME, file, strerror(saved_errno));
+		exit(saved_errno);
 	}
 
-	if (is_url(fpath) == FUNC_FAILURE) {
-		url = 0;
-		if (*fpath != '~' && stat(fpath, &attr) == -1) {
-			xerror("%s: '%s': %s\n", PROGRAM_NAME, fpath, strerror(errno));
-			exit(errno);
-		}
-	}
-
-RUN:
 	xargs.open = preview == 1 ? 0 : 1;
 	xargs.preview = preview == 1 ? 1 : 0;
 	if (preview == 1)
@@ -1327,6 +1341,24 @@ set_color(const char *val, const char *opt_str)
 	}
 }
 
+#ifndef _BE_POSIX
+static void
+set_startup_trace(const char *val)
+{
+	if (!val || !*val || *val == '-') {
+		xargs.startup_trace = TRACE_TEXT; /* No value. Defaults to 'text'. */
+	} else if (*val == 't' && strcmp(val, "text") == 0) {
+		xargs.startup_trace = TRACE_TEXT;
+	} else if (*val == 't' && strcmp(val, "tsv") == 0) {
+		xargs.startup_trace = TRACE_TSV;
+	} else {
+		fprintf(stderr, _("%s: Invalid value '%s' for '--startup-trace'\n"
+			"Valid values are: 'text', 'tsv'.\n"), PROGRAM_NAME, val);
+		exit(EXIT_FAILURE);
+	}
+}
+#endif /* !_BE_POSIX */
+
 static void
 print_tabmode_deprecation_warning(const char *mode, const char *name)
 {
@@ -2122,6 +2154,8 @@ parse_cmdline_args(const int argc, char **argv)
 			set_smenutab(1); break;
 		case LOPT_SORT_REVERSE:
 			xargs.sort_reverse = conf.sort_reverse = 1; break;
+		case LOPT_STARTUP_TRACE:
+			set_startup_trace(optarg); break;
 		case LOPT_STAT: /* fallthrough */
 		case LOPT_STAT_FULL:
 			set_stat(optc); break;
@@ -12,8 +12,10 @@
 
 __BEGIN_DECLS
 
-void parse_cmdline_args(const int argc, char **argv);
+char *get_open_preview_path(char *file, char *buf, int *url);
 void get_data_dir(void);
+void parse_cmdline_args(const int argc, char **argv);
+int  preview_this_file(const char *filename, const char *max_size);
 int  set_start_path(void);
 
 __END_DECLS
@@ -38,6 +38,11 @@
 #include "misc.h"
 #include "spawn.h" /* launch_execv() */
 
+/* A directory modified less than this many nanoseconds before it was
+ * read might have been modified again (in the same timestamp tick) right
+ * after being read, without its modification time changing. */
+#define DIR_STAMP_RACY_NSEC 20000000LL /* 20ms */
+
 /* Open the file FILE with APP (if not NULL, or with the default associated
  * application otherwise). Returns the exit code returned by the opening
  * application. */
@@ -183,6 +188,19 @@ xregerror(const char *cmd_name, const char *pattern, const int errcode,
 	free(buf);
 }
 
+/* Update the 32-bit FNV-1a hash H (initially FNV1A_INIT) with the first
+ * LEN bytes of DATA. Used to checksum database and cache files. */
+uint32_t
+fnv1a_hash(uint32_t h, const char *data, const size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)data[i];
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
 /* Generate a hash of the string STR (case sensitively if CASE_SENTITIVE is
  * set to 1).
  * Based on the sdbm algorithm (see http://www.cse.yorku.ca/~oz/hash.html),
@@ -209,6 +227,25 @@ hashme(const char *restrict str, const int ignore_case)
 	return hash;
 }
 
+/* Return the power-of-two value closest to V + 1. */
+size_t
+next_pow2(size_t v)
+{
+	if (v == 0)
+		return 1;
+
+	v--;
+	v |= v >> 1;
+	v |= v >> 2;
+	v |= v >> 4;
+	v |= v >> 8;
+	v |= v >> 16;
+#if SIZE_MAX > UINT32_MAX
+	v |= v >> 32;
+#endif
+	return ++v;
+}
+
 #if defined(__sun) && defined(ST_BTIME)
 struct timespec
 get_birthtime(const char *filename)
@@ -250,6 +287,71 @@ gen_time_str(char *buf, const size_t size, const time_t curtime)
 	buf[1] = '\0';
 }
 
+/* Store the identity and modification time of the directory whose
+ * attributes are A (as returned by stat(2)) into STAMP. Call this right
+ * before reading the directory. */
+void
+set_dir_stamp(struct dir_stamp_t *stamp, const struct stat *a)
+{
+	struct timespec now;
+	if (clock_gettime(CLOCK_REALTIME, &now) == -1) {
+		stamp->valid = 0;
+		return;
+	}
+
+	stamp->dev = a->st_dev;
+	stamp->ino = a->st_ino;
+	stamp->mtime = a->st_mtime;
+#ifndef CLIFM_LEGACY
+	stamp->mtime_nsec = (long)a->MTIMNSEC;
+#else
+	stamp->mtime_nsec = 0;
+#endif /* !CLIFM_LEGACY */
+	stamp->scan_time = now.tv_sec;
+	stamp->scan_nsec = (long)now.tv_nsec;
+	stamp->valid = 1;
+}
+
+/* Return 1 if the directory whose attributes are A is the one described
+ * by STAMP and it has not been modified since then, or 0 otherwise. */
+int
+check_dir_stamp(const struct dir_stamp_t *stamp, const struct stat *a)
+{
+	if (stamp->valid == 0 || stamp->dev != a->st_dev
+	|| stamp->ino != a->st_ino || stamp->mtime != a->st_mtime)
+		return 0;
+
+#ifndef CLIFM_LEGACY
+	if (stamp->mtime_nsec != (long)a->MTIMNSEC)
+		return 0;
+#endif /* !CLIFM_LEGACY */
+
+	/* Filesystem timestamps are coarse: do not trust a stamp taken right
+	 * after the directory was modified. */
+	const long long age =
+		((long long)stamp->scan_time - (long long)stamp->mtime) * 1000000000LL
+		+ ((long long)stamp->scan_nsec - (long long)stamp->mtime_nsec);
+
+	return (age >= DIR_STAMP_RACY_NSEC);
+}
+
+/* Return the name of the file NAME, in the directory DIR, as passed to
+ * *at() functions together with a file descriptor for DIR. In legacy
+ * builds these functions ignore the file descriptor (see compat.h): the
+ * full path of the file is written into BUF, of size SIZE, and returned
+ * instead. */
+const char *
+get_at_name(const char *dir, const char *name, char *buf, const size_t size)
+{
+#ifndef CLIFM_LEGACY
+	UNUSED(dir); UNUSED(buf); UNUSED(size);
+	return name;
+#else
+	snprintf(buf, size, "%s/%s", dir, name);
+	return buf;
+#endif /* !CLIFM_LEGACY */
+}
+
 /* Store the fzf preview window border style to later fix coordinates if
  * needed (set_fzf_env_vars() in tabcomp.c) */
 void
@@ -756,6 +858,27 @@ gen_backup_file(const char *file, const int human)
 	return strdup(backup);
 }
 
+/* Write LEN bytes of DATA to the file descriptor FD, retrying on partial
+ * writes and interruptions. Returns FUNC_SUCCESS or FUNC_FAILURE. */
+int
+xwrite(const int fd, const void *data, size_t len)
+{
+	const char *p = data;
+
+	while (len > 0) {
+		const ssize_t ret = write(fd, p, len);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return FUNC_FAILURE;
+
+		p += ret;
+		len -= (size_t)ret;
+	}
+
+	return FUNC_SUCCESS;
+}
+
 /* Create directory DIR with permissions set to MODE (this latter modified
  * by a restrictive umask value: 077). */
 int
@@ -19,16 +19,23 @@
 # endif /* RL_READLINE_VERSION >= 0x0801 */
 #endif /* RL_READLINE_VERSION */
 
+/* Initial value for fnv1a_hash() */
+#define FNV1A_INIT 2166136261U
+
 __BEGIN_DECLS
 
 char *abbreviate_file_name(char *str);
+int  check_dir_stamp(const struct dir_stamp_t *stamp, const struct stat *a);
 void clear_term_img(void);
 char *construct_human_size(const off_t size);
 filesn_t count_dir(const char *dir, const int pop);
+uint32_t fnv1a_hash(uint32_t h, const char *data, const size_t len);
 char from_hex(const char c);
 char *gen_backup_file(const char *file, const int human);
 char *gen_date_suffix(const struct tm tm, const int human);
 void gen_time_str(char *buf, const size_t size, const time_t curtime);
+const char *get_at_name(const char *dir, const char *name, char *buf,
+	const size_t size);
 #if defined(__sun) && defined(ST_BTIME)
 struct timespec get_birthtime(const char *filename);
 #endif /* __sun && ST_BTIME */
@@ -44,6 +51,7 @@ char *make_filename_unique(const char *file);
 #if !defined(_POSIX_C_SOURCE) || _POSIX_C_SOURCE >= 199309L
 int  msleep(const long msec);
 #endif
+size_t next_pow2(size_t v);
 char *normalize_path(char *src, const size_t src_len);
 int  octal2int(const char *restrict str);
 int  open_config_file(char *app, char *file);
@@ -53,6 +61,7 @@ FILE *open_fappend(const char *name);
 void press_any_key_to_continue(const int init_newline);
 void print_file_name(char *fname, const int isdir, const struct stat *attr);
 void rl_ring_bell(void);
+void set_dir_stamp(struct dir_stamp_t *stamp, const struct stat *a);
 void set_fzf_preview_border_type(void);
 int  should_expand_eln(const char *text, char *cmd_name);
 char *url_encode(const char *str, const int file_uri, char *pool);
@@ -69,6 +78,7 @@ ssize_t xreadlink(const int fd, const char *restrict path, char *restrict buf,
 	const size_t bufsize);
 void xregerror(const char *cmd_name, const char *pattern, const int errcode,
 	const regex_t regexp, const int prompt_err);
+int  xwrite(const int fd, const void *data, size_t len);
 
 __END_DECLS
 
@@ -13,8 +13,11 @@
 # include <sys/capability.h>
 #endif /* __linux__ */
 #include <errno.h>
+#include <stddef.h> /* offsetof() */
 #include <string.h>
 #include <strings.h> /* str(n)casecmp() */
+#include <sys/mman.h> /* mmap(), munmap() */
+#include <unistd.h> /* close(), unlinkat() */
 
 /* Only used to check the readline version */
 #ifdef __OpenBSD__
@@ -25,7 +28,7 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 # include <readline/readline.h>
 #endif /* __OpenBSD__ */
 
-#include "aux.h"
+#include "aux.h" /* fnv1a_hash(), xmkdir(), xwrite() */
 #include "autocmds.h" /* update_autocmd_opts() */
 #include "checks.h"
 #include "colors.h"
@@ -263,7 +266,9 @@ remove_bold_attr(char *str)
 
 /* Return the color for the regular file FILENAME, whose attributes are A.
  * IF the color comes from the file extension, IS_EXT is updated to the length
- * of the color code (otherwise, it is set to zero). */
+ * of the color code (otherwise, it is set to zero). In this case, the
+ * returned value points to the escape sequence stored in the ext_colors
+ * array (see get_ext_color_seq()). */
 char *
 get_regfile_color(const char *filename, const struct stat *a, size_t *is_ext)
 {
@@ -284,19 +289,14 @@ get_regfile_color(const char *filename, const struct stat *a, size_t *is_ext)
 	if (!ext || ext == filename || *(ext - 1) == '/')
 		return color;
 
-	size_t color_len = 0;
-	const char *extcolor = get_ext_color(ext, &color_len);
-	if (!extcolor || color_len == 0 || color_len + 4 > sizeof(tmp_color))
+	size_t seq_len = 0;
+	char *extcolor = get_ext_color_seq(ext, &seq_len);
+	if (!extcolor || seq_len == 0)
 		return color;
 
-	*tmp_color = '\x1b'; tmp_color[1] = '[';
-	memcpy(tmp_color + 2, extcolor, color_len);
-	tmp_color[color_len + 2] = 'm';
-	tmp_color[color_len + 3] = '\0';
-
 	if (is_ext)
-		*is_ext = color_len + 3;
-	return tmp_color;
+		*is_ext = seq_len;
+	return extcolor;
 }
 
 /* Retrieve the color corresponding to dir FILENAME whose attributes are A.
@@ -628,98 +628,170 @@ END:
 }
 #endif /* !CLIFM_SUCKLESS */
 
-static int
-bcomp(const void *a, const void *b)
-{
-	const size_t pa = *(const size_t *)a;
-	const size_t pb_hash = ((const struct ext_t *)b)->hash;
+static size_t *ext_colors_table = NULL;
+static size_t ext_colors_table_mask = 0;
+static size_t ext_colors_table_size = 0;
+/* Number of conflicting extension definitions (see ext_colors_table_init()) */
+static size_t ext_colors_conflicts = 0;
 
-	if (pa < pb_hash) return (-1);
-	if (pa > pb_hash) return 1;
-    return 0;
-}
+/* If extension colors were loaded from the color scheme cache, both their
+ * strings and ext_colors_table point to this memory mapping of the cache
+ * file (see apply_cs_cache()). */
+static char *ext_colors_map = NULL;
+static size_t ext_colors_map_size = 0;
 
-/* Look for the hash HASH in the hash table for filename extensions.
- * Return a pointer to the corresponding color if found, or NULL.
- * If VAL_LEN isn't NULL, it is updated with the length of the returned value. */
-static char *
-check_ext_hash(const size_t hash, size_t *val_len)
+/* Return 1 if the extension names A and B are equal (case insensitively,
+ * just as hashes are computed for extension names), or 0 otherwise. */
+static inline int
+ext_name_eq(const char *a, const char *b)
 {
-	const struct ext_t *ptr = bsearch(&hash, ext_colors, ext_colors_n,
-		sizeof(struct ext_t), bcomp);
+	while (*a && TOLOWER(*a) == TOLOWER(*b)) {
+		a++;
+		b++;
+	}
 
-	if (!ptr || !ptr->value || !*ptr->value)
-		return NULL;
+	return (*a == *b);
+}
 
-	if (val_len)
-		*val_len = ptr->value_len;
+static void
+free_ext_colors_table(void)
+{
+	if (!ext_colors_map)
+		free(ext_colors_table);
+	ext_colors_table = NULL;
+	ext_colors_table_mask = ext_colors_table_size = 0;
+	ext_colors_conflicts = 0;
+}
 
-	return ptr->value;
+static void
+warn_ext_conflicts(void)
+{
+	err('w', PRINT_PROMPT, _("%s: File extension conflicts "
+		"found. Run 'cs check-ext' to see the details.\n"), PROGRAM_NAME);
 }
 
-/* Return the color code associated to the file extension EXT, updating
- * VAL_LEN, if not NULL, to the length of this color code. */
-static char *
-check_ext_string(const char *ext, size_t *val_len)
+/* Build an open-addressed lookup table mapping extension name hashes to an
+ * index in the ext_colors array (the approach is the same used for icons by
+ * ext_table_init() in listing.c).
+ *
+ * Unlike the icons table, keys here come from the user's color scheme, so
+ * that hash collisions cannot be ruled out: since the extension name is
+ * checked on every probe, two different extensions sharing the same hash
+ * just take two different slots, and lookups remain O(1) regardless.
+ *
+ * Entries are inserted in definition order: if an extension is defined more
+ * than once, only the last definition is preserved. If these definitions
+ * point to different colors, a warning is emitted (see 'cs check-ext').
+ * Returns FUNC_FAILURE if such a conflict is found, or FUNC_SUCCESS
+ * otherwise. */
+static int
+ext_colors_table_init(void)
 {
-	/* Hold extension names. NAME_MAX should be enough: no filename should
-	 * go beyond NAME_MAX, so it's pretty safe to assume that no file extension
-	 * will be larger than this. */
-	static char tmp_ext[NAME_MAX];
-	char *ptr = tmp_ext;
+	free_ext_colors_table();
 
-	size_t i;
-	for (i = 0; i < sizeof(tmp_ext) - 1 && ext[i]; i++)
-		tmp_ext[i] = TOLOWER(ext[i]);
-	tmp_ext[i] = '\0';
+	const size_t n = ext_colors_n;
+	if (!ext_colors || n == 0)
+		return FUNC_SUCCESS;
 
-	const size_t len = i;
+	const size_t needed = (size_t)((double)n / TABLE_LOAD_FACTOR) + 1;
+	size_t table_size = next_pow2(needed);
 
-	i = ext_colors_n;
-	for (; i-- > 0;) {
-		if (!ext_colors[i].name || !*ext_colors[i].name
-		|| ext_colors[i].len != len || *ptr != TOLOWER(*ext_colors[i].name))
-			continue;
+	/* Ensure table_size >= n+1 to guarantee at least one empty slot */
+	if (table_size <= n)
+		table_size = next_pow2(n + 1);
+
+	ext_colors_table_size = table_size;
+	ext_colors_table_mask = table_size - 1;
+
+	ext_colors_table = xnmalloc(table_size, sizeof(size_t));
 
-		const char *p = ptr + 1, *q = ext_colors[i].name + 1;
+	for (size_t i = 0; i < table_size; i++)
+		ext_colors_table[i] = SIZE_MAX;
 
-		size_t match = 1;
-		while (*p) {
-			if (*p != TOLOWER(*q)) {
-				match = 0;
+	int conflicts = 0;
+	for (size_t i = 0; i < n; i++) {
+		const size_t h = ext_colors[i].hash;
+		/* Mix, then mask */
+		size_t idx = (h * (size_t)HASH_MULTIPLIER) & ext_colors_table_mask;
+
+		while (ext_colors_table[idx] != SIZE_MAX) {
+			const struct ext_t *e = &ext_colors[ext_colors_table[idx]];
+			if (e->hash == h && ext_name_eq(e->name, ext_colors[i].name)) {
+				if (e->value_len != ext_colors[i].value_len
+				|| strcmp(e->value, ext_colors[i].value) != 0)
+					conflicts++;
 				break;
 			}
-			p++;
-			q++;
+			idx = (idx + 1) & ext_colors_table_mask;
 		}
 
-		if (match == 0 || *q != '\0')
-			continue;
+		ext_colors_table[idx] = i;
+	}
+
+	ext_colors_conflicts = (size_t)conflicts;
+	if (conflicts == 0)
+		return FUNC_SUCCESS;
+
+	warn_ext_conflicts();
+	return FUNC_FAILURE;
+}
+
+/* Return a pointer to the entry in the ext_colors array for the file
+ * extension EXT (including the leading dot), or NULL if not found. */
+static const struct ext_t *
+find_ext_color(const char *ext)
+{
+	if (!ext || !*ext || !*(++ext) || !ext_colors_table)
+		return NULL;
 
-		if (val_len)
-			*val_len = ext_colors[i].value_len;
+	const size_t hash = hashme(ext, 1);
+	size_t idx = (hash * (size_t)HASH_MULTIPLIER) & ext_colors_table_mask;
 
-		return ext_colors[i].value;
+	for (size_t i = 0; i < ext_colors_table_size; i++) {
+		const size_t val = ext_colors_table[idx];
+		if (val == SIZE_MAX)
+			return NULL; /* Not found */
+
+		const struct ext_t *e = &ext_colors[val];
+		if (e->hash == hash && ext_name_eq(e->name, ext))
+			return (e->value && *e->value) ? e : NULL;
+
+		idx = (idx + 1) & ext_colors_table_mask;
 	}
 
-	return NULL;
+	return NULL; /* Table exhausted. Not found. */
 }
 
 /* Return a pointer to the corresponding color code for the file
- * extension EXT (updating VAL_LEN to the length of this code).
- * The hash table is checked first if we have no hash conflicts. Otherwise,
- * a regular string comparison is performed to resolve it. */
+ * extension EXT (updating VAL_LEN to the length of this code). */
 char *
 get_ext_color(const char *ext, size_t *val_len)
 {
-	if (!ext || !*ext || !*(++ext) || ext_colors_n == 0)
+	const struct ext_t *e = find_ext_color(ext);
+	if (!e)
 		return NULL;
 
-	/* If the hash field at index 0 is set to zero, we have hash conflicts. */
-	if (ext_colors[0].hash != 0)
-		return check_ext_hash(hashme(ext, 1), val_len);
+	if (val_len)
+		*val_len = e->value_len;
 
-	return check_ext_string(ext, val_len);
+	return e->value;
+}
+
+/* Same as get_ext_color(), but return the full escape sequence (ready to be
+ * printed) instead of the bare color code. This string is built only once
+ * (when loading the color scheme) and can be shared by pointer as long as
+ * the current color scheme is not unloaded (see free_extension_colors()). */
+char *
+get_ext_color_seq(const char *ext, size_t *seq_len)
+{
+	const struct ext_t *e = find_ext_color(ext);
+	if (!e)
+		return NULL;
+
+	if (seq_len)
+		*seq_len = e->seq_len;
+
+	return e->seq;
 }
 
 #ifndef CLIFM_SUCKLESS
@@ -943,7 +1015,9 @@ print_ext_conflict(const char *a, const char *b)
 		printf(_("'%s' conflicts with '%s'\n"), a, b);
 }
 
-/* Make sure hashes for filename extensions do not conflict.
+/* Make sure filename extensions are not defined twice with different colors.
+ * Extensions sharing the same hash but having different names are not
+ * conflicts: they are resolved by ext_colors_table_init().
  * It returns FUNC_FAILURE in case of conflicts, or FUNC_SUCCESS otherwise. */
 static int
 list_ext_color_hash_conflicts(void)
@@ -952,7 +1026,8 @@ list_ext_color_hash_conflicts(void)
 
 	for (size_t i = 0; i < ext_colors_n; i++) {
 		for (size_t j = i + 1; j < ext_colors_n; j++) {
-			if (ext_colors[i].hash != ext_colors[j].hash)
+			if (ext_colors[i].hash != ext_colors[j].hash
+			|| !ext_name_eq(ext_colors[i].name, ext_colors[j].name))
 				continue;
 
 			if (ext_colors[i].value_len == ext_colors[j].value_len
@@ -1003,38 +1078,6 @@ print_colors_tip(const int stealth)
 	return FUNC_FAILURE;
 }
 
-/* Return FUNC_FAILURE if at least two equal extension hashes are found.
- * Otherwise, FUNC_SUCCESS is returned.
- * If a hash conflict is found, the hash field at index zero (of the ext_colors
- * struct) is set to 0 to indicate that we must use regular string comparison
- * (slower) instead of binary search.
- * The ext_colors struct must be sorted by hash. */
-static int
-check_ext_color_hash_conflicts(void)
-{
-	if (!ext_colors)
-		return FUNC_FAILURE;
-
-	for (size_t i = 0; i + 1 < ext_colors_n; i++) {
-		if (ext_colors[i].hash != ext_colors[i + 1].hash)
-			continue;
-
-		if (ext_colors[i].value_len == ext_colors[i + 1].value_len
-		&& strcmp(ext_colors[i].value, ext_colors[i + 1].value) == 0)
-			/* Two extensions with the same hash, but pointing to the
-			 * same color. Most likely a duplicate entry: let it be. */
-			continue;
-
-		ext_colors[0].hash = 0;
-		err('w', PRINT_PROMPT, _("%s: File extension conflicts "
-			"found. Run 'cs check-ext' to see the details.\n"),
-			PROGRAM_NAME);
-		return FUNC_FAILURE;
-	}
-
-	return FUNC_SUCCESS;
-}
-
 int
 cschemes_function(char **args)
 {
@@ -1458,8 +1501,19 @@ store_extension_line(char *line)
 	ext_colors[ext_colors_n].value_len = elen - 1;
 	ext_colors[ext_colors_n].hash = hashme(line, 1);
 
-	if (xargs.no_bold == 1)
+	if (xargs.no_bold == 1) {
 		remove_bold_attr(ext_colors[ext_colors_n].value);
+		ext_colors[ext_colors_n].value_len =
+			strlen(ext_colors[ext_colors_n].value);
+	}
+
+	/* Build the full escape sequence only once: it will be shared by all
+	 * files colored by this extension. */
+	const size_t slen = ext_colors[ext_colors_n].value_len + 3;
+	ext_colors[ext_colors_n].seq = xnmalloc(slen + 1, sizeof(char));
+	snprintf(ext_colors[ext_colors_n].seq, slen + 1, "\x1b[%sm",
+		ext_colors[ext_colors_n].value);
+	ext_colors[ext_colors_n].seq_len = slen;
 
 	*q = '=';
 	ext_colors_n++;
@@ -1467,16 +1521,29 @@ store_extension_line(char *line)
 	return FUNC_SUCCESS;
 }
 
-static void
+void
 free_extension_colors(void)
 {
-	for (size_t i = ext_colors_n; i-- > 0;) {
+	/* The current file list may still point to our escape sequences. */
+	unset_ext_colors();
+
+	/* Strings loaded from the color scheme cache are not allocated. */
+	for (size_t i = ext_colors_map ? 0 : ext_colors_n; i-- > 0;) {
 		free(ext_colors[i].name);
 		free(ext_colors[i].value);
+		free(ext_colors[i].seq);
 	}
 	free(ext_colors);
 	ext_colors = NULL;
 	ext_colors_n = 0;
+
+	free_ext_colors_table();
+
+	if (ext_colors_map) {
+		munmap(ext_colors_map, ext_colors_map_size);
+		ext_colors_map = NULL;
+		ext_colors_map_size = 0;
+	}
 }
 
 static void
@@ -1561,19 +1628,6 @@ set_extra_colors(void)
 	}
 }
 
-static int
-hash_sort(const void *a, const void *b)
-{
-	const struct ext_t *pa = (const struct ext_t *)a;
-	const struct ext_t *pb = (const struct ext_t *)b;
-
-	if (pa->hash > pb->hash)
-		return 1;
-	if (pa->hash < pb->hash)
-		return -1;
-	return 0;
-}
-
 void
 set_default_colors(void)
 {
@@ -1591,11 +1645,9 @@ set_default_colors(void)
 			? DEF_EXT_COLORS_256 : DEF_EXT_COLORS);
 	}
 
-	if (ext_colors && ext_colors_n > 0) {
-		qsort(ext_colors, ext_colors_n, sizeof(*ext_colors),
-			(QSFUNC *)hash_sort);
-		check_ext_color_hash_conflicts();
-	}
+	/* Already built if loaded from the color scheme cache */
+	if (!ext_colors_table)
+		ext_colors_table_init();
 
 	/* If a definition for TEMP exists in the color scheme file, BK_C should
 	 * have been set to this color in store_defintions(). If not, let's try
@@ -2205,6 +2257,562 @@ set_div_line(char *line)
 	xstrsncpy(div_line, tmp, sizeof(div_line));
 }
 
+/* Parse the color scheme line LINE, of length LINE_LEN. */
+static void
+parse_color_scheme_line(char *line, const ssize_t line_len, char **filecolors,
+	char **extcolors, char **ifacecolors)
+{
+	if (*line == 'd' && strncmp(line, "define ", 7) == 0) {
+		store_definition(line + 7);
+	}
+
+	else if (*line == 'P' && strncmp(line, "Prompt=", 7) == 0) {
+		set_cs_prompt(line + 7);
+	}
+
+	/* The following values override those set via the Prompt line
+	 * (provided it was set to a valid prompt name, as defined in the
+	 * prompts file). */
+	else if (*line == 'N' && strncmp(line, "Notifications=", 14) == 0) {
+		set_cs_prompt_noti(line + 14);
+	}
+
+	else if (xargs.warning_prompt == UNSET && *line == 'E'
+	&& strncmp(line, "EnableWarningPrompt=", 20) == 0) {
+		set_cs_enable_warning_prompt(line + 20);
+	}
+
+	else if (*line == 'W' && strncmp(line, "WarningPrompt=", 14) == 0) {
+		set_cs_warning_prompt_str(line + 14);
+	}
+
+	else if (*line == 'R' && strncmp(line, "RightPrompt=", 12) == 0) {
+		set_cs_right_prompt_str(line + 12);
+	}
+
+#ifndef _NO_FZF
+	else if (*line == 'F' && strncmp(line, "FzfTabOptions=", 14) == 0) {
+		set_cs_fzftabopts(line + 14);
+	}
+#endif /* !_NO_FZF */
+
+	else if (*line == 'D' && strncmp(line, "DividingLine=", 13) == 0) {
+		set_div_line(line + 13);
+	}
+
+	/* Interface colors */
+	else if (!*ifacecolors && *line == 'I'
+	&& strncmp(line, "InterfaceColors=", 16) == 0) {
+		set_cs_colors(line + 16, ifacecolors, (size_t)line_len - 16);
+	}
+
+	/* Filetype colors */
+	else if (!*filecolors && *line == 'F'
+	&& strncmp(line, "FiletypeColors=", 15) == 0) {
+		set_cs_colors(line + 15, filecolors, (size_t)line_len - 15);
+	}
+
+	/* File extension colors */
+	else if (xargs.lscolors != LS_COLORS_GNU && *line == 'E'
+	&& strncmp(line, "ExtColors=", 10) == 0) {
+		set_cs_extcolors(line, extcolors, line_len);
+	}
+
+#ifndef _NO_ICONS
+	/* Directory icon color */
+	else if (*line == 'D' && strncmp(line, "DirIconColor=", 13) == 0) {
+		set_cs_dir_icon_color(line);
+	}
+#endif /* !_NO_ICONS */
+
+	else if (date_shades.type == SHADE_TYPE_UNSET
+	&& *line == 'D' && strncmp(line, "DateShades=", 11) == 0) {
+		set_shades(line + 11, DATE_SHADES);
+	}
+
+	else {
+		if (size_shades.type == SHADE_TYPE_UNSET
+		&& *line == 'S' && strncmp(line, "SizeShades=", 11) == 0)
+			set_shades(line + 11, SIZE_SHADES);
+	}
+}
+
+/* Color scheme cache
+ *
+ * Loading a color scheme with thousands of extension colors (expanding
+ * and checking each color code, building escape sequences, and hashing
+ * extension names) takes time. Hence, once loaded, the result is stored
+ * in a cache file ($XDG_CACHE_HOME/clifm/colors/NAME.cache): extension
+ * colors (names, color codes, and escape sequences), the lookup table
+ * (ext_colors_table), and date and size shades. Remaining lines (color
+ * variables, file type and interface colors, prompt settings, and so on:
+ * just a few lines) are stored as is, to be parsed again when loading
+ * from the cache.
+ *
+ * The cache file is mapped into memory (mmap(2)), and extension colors
+ * point directly to it. It is valid as long as the identity, size, and
+ * modification time of the color scheme file, the number of terminal
+ * colors, and --no-bold do not change. It is not used if colors are also
+ * taken from the environment (e.g. LS_COLORS or CLIFM_EXT_COLORS). */
+
+#define CS_CACHE_MAGIC   "CLIFMCSC"
+#define CS_CACHE_VERSION 1
+
+/* Lines whose result is stored in the cache, instead of the line itself */
+#define CS_COMPILED_LINE(l) \
+	((*(l) == 'E' && strncmp((l), "ExtColors=", 10) == 0)       \
+	|| (*(l) == 'D' && strncmp((l), "DateShades=", 11) == 0)    \
+	|| (*(l) == 'S' && strncmp((l), "SizeShades=", 11) == 0))
+
+struct cs_cache_header_t {
+	char     magic[8];
+	uint32_t version;
+	uint32_t sum;       /* Checksum of the whole file (computed with sum = 0) */
+	uint32_t word_size; /* sizeof(size_t): the lookup table is mapped as is */
+	int32_t  term_colors;
+	int32_t  no_bold;
+	uint32_t ext_conflicts;
+	/* Color scheme file */
+	uint64_t src_dev;
+	uint64_t src_ino;
+	int64_t  src_size;
+	int64_t  src_mtime;
+	int64_t  src_mtime_nsec;
+	/* Sections (offsets are relative to the beginning of the file) */
+	uint64_t lines_off;   /* Lines stored as is (NUL terminated) */
+	uint64_t lines_len;
+	uint64_t ext_off;     /* Array of struct cs_cache_ext_t */
+	uint64_t ext_n;
+	uint64_t table_off;   /* ext_colors_table */
+	uint64_t table_size;
+	uint64_t strings_off; /* Extension names, values, and sequences */
+	uint64_t strings_len;
+	struct shades_t date_shades;
+	struct shades_t size_shades;
+	uint8_t  date_shades_old_style;
+	uint8_t  size_shades_old_style;
+};
+
+struct cs_cache_ext_t {
+	uint64_t hash;
+	uint32_t name_off; /* Offsets in the strings section */
+	uint32_t name_len;
+	uint32_t value_off;
+	uint32_t value_len;
+	uint32_t seq_off;
+	uint32_t seq_len;
+};
+
+/* The color scheme file being parsed, to be cached by write_cs_cache() */
+static struct {
+	char file[PATH_MAX + 1];
+	char name[NAME_MAX + 1]; /* Color scheme name */
+	struct stat attr; /* Attributes of FILE when it was read */
+	struct timespec read_time;
+	char *lines;
+	size_t lines_len;
+	size_t lines_size;
+	int pending;
+	int pad0;
+} cs_src;
+
+/* A valid cache file mapped by load_cs_cache(), to be applied by
+ * apply_cs_cache() */
+static char *cs_cache_map = NULL;
+static size_t cs_cache_map_size = 0;
+
+/* Align OFF to 8 bytes */
+#define CS_ALIGN(off) (((off) + 7) & ~(size_t)7)
+
+/* Do not cache a color scheme file modified less than this many
+ * nanoseconds before being read (filesystem timestamps are coarse). */
+#define CS_CACHE_RACY_NSEC 20000000LL /* 20ms */
+
+static long
+get_mtime_nsec(const struct stat *a)
+{
+#ifndef CLIFM_LEGACY
+	return (long)a->MTIMNSEC;
+#else
+	UNUSED(a);
+	return 0;
+#endif /* !CLIFM_LEGACY */
+}
+
+/* Write the path to the cache file for the color scheme NAME, loaded from
+ * the file SRC, into BUF, creating the cache directory if CREATE is set.
+ * Since a color scheme may be found both in the local and in the system
+ * colors directory, the cache file name includes a hash of SRC. */
+static int
+get_cs_cache_file(const char *name, const char *src, char *buf,
+	const size_t size, const int create)
+{
+	const int se = (xargs.secure_env == 1 || xargs.secure_env_full == 1);
+	const char *p = se == 0 ? getenv("XDG_CACHE_HOME") : NULL;
+
+	char base[PATH_MAX + 1];
+	if (p && *p)
+		xstrsncpy(base, p, sizeof(base));
+	else if (user.home && *user.home)
+		snprintf(base, sizeof(base), "%s/.cache", user.home);
+	else
+		return FUNC_FAILURE;
+
+	if (create == 1) {
+		char dir[PATH_MAX + sizeof(PROGRAM_NAME) + 9];
+		xmkdir(base, S_IRWXU);
+		snprintf(dir, sizeof(dir), "%s/%s", base, PROGRAM_NAME);
+		xmkdir(dir, S_IRWXU);
+		snprintf(dir, sizeof(dir), "%s/%s/colors", base, PROGRAM_NAME);
+		xmkdir(dir, S_IRWXU);
+	}
+
+	snprintf(buf, size, "%s/%s/colors/%s-%08x.cache", base, PROGRAM_NAME,
+		name, (unsigned int)fnv1a_hash(FNV1A_INIT, src, strlen(src)));
+	return FUNC_SUCCESS;
+}
+
+/* Return FUNC_SUCCESS if the cache file MAP, of size SIZE, is sane and up
+ * to date with the color scheme file whose attributes are A, or
+ * FUNC_FAILURE otherwise. */
+static int
+check_cs_cache(const char *map, const size_t size, const struct stat *a)
+{
+	struct cs_cache_header_t h;
+	memcpy(&h, map, sizeof(h));
+
+	if (memcmp(h.magic, CS_CACHE_MAGIC, sizeof(h.magic)) != 0
+	|| h.version != CS_CACHE_VERSION || h.word_size != sizeof(size_t)
+	|| h.term_colors != term_caps.color || h.no_bold != xargs.no_bold
+	|| h.src_dev != (uint64_t)a->st_dev || h.src_ino != (uint64_t)a->st_ino
+	|| h.src_size != (int64_t)a->st_size
+	|| h.src_mtime != (int64_t)a->st_mtime
+	|| h.src_mtime_nsec != (int64_t)get_mtime_nsec(a))
+		return FUNC_FAILURE;
+
+	/* All sections must be inside the file */
+	if (h.lines_off > size || h.lines_len > size - h.lines_off
+	|| (h.lines_len > 0 && map[h.lines_off + h.lines_len - 1] != '\0')
+	|| h.ext_off > size
+	|| h.ext_n > (size - h.ext_off) / sizeof(struct cs_cache_ext_t)
+	|| h.table_off > size || h.table_off % sizeof(size_t) != 0
+	|| h.table_size > (size - h.table_off) / sizeof(size_t)
+	|| h.strings_off > size || h.strings_len > size - h.strings_off
+	|| (h.ext_n > 0 && (h.table_size <= h.ext_n
+	|| (h.table_size & (h.table_size - 1)) != 0)))
+		return FUNC_FAILURE;
+
+	const uint32_t sum = h.sum;
+	h.sum = 0;
+	if (fnv1a_hash(fnv1a_hash(FNV1A_INIT, (char *)&h, sizeof(h)),
+	map + sizeof(h), size - sizeof(h)) != sum)
+		return FUNC_FAILURE;
+
+	/* Make sure no extension or table entry points outside the file */
+	const char *strings = map + h.strings_off;
+	for (size_t i = 0; i < h.ext_n; i++) {
+		struct cs_cache_ext_t e;
+		memcpy(&e, map + h.ext_off + i * sizeof(e), sizeof(e));
+		if ((uint64_t)e.name_off + e.name_len >= h.strings_len
+		|| (uint64_t)e.value_off + e.value_len >= h.strings_len
+		|| (uint64_t)e.seq_off + e.seq_len >= h.strings_len
+		|| strings[e.name_off + e.name_len] != '\0'
+		|| strings[e.value_off + e.value_len] != '\0'
+		|| strings[e.seq_off + e.seq_len] != '\0')
+			return FUNC_FAILURE;
+	}
+
+	for (size_t i = 0; i < h.table_size; i++) {
+		size_t val;
+		memcpy(&val, map + h.table_off + i * sizeof(val), sizeof(val));
+		if (val != SIZE_MAX && val >= h.ext_n)
+			return FUNC_FAILURE;
+	}
+
+	return FUNC_SUCCESS;
+}
+
+/* Map the cache file for the color scheme NAME, loaded from the file SRC,
+ * whose attributes are A, if valid. Returns FUNC_SUCCESS or FUNC_FAILURE. */
+static int
+load_cs_cache(const char *name, const char *src, const struct stat *a)
+{
+	char file[PATH_MAX + NAME_MAX + 32];
+	if (get_cs_cache_file(name, src, file, sizeof(file), 0) != FUNC_SUCCESS)
+		return FUNC_FAILURE;
+
+	const int fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return FUNC_FAILURE;
+
+	struct stat c;
+	if (fstat(fd, &c) == -1
+	|| c.st_size < (off_t)sizeof(struct cs_cache_header_t)) {
+		close(fd);
+		return FUNC_FAILURE;
+	}
+
+	const size_t size = (size_t)c.st_size;
+	char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return FUNC_FAILURE;
+
+	if (check_cs_cache(map, size, a) != FUNC_SUCCESS) {
+		munmap(map, size);
+		return FUNC_FAILURE;
+	}
+
+	cs_cache_map = map;
+	cs_cache_map_size = size;
+	return FUNC_SUCCESS;
+}
+
+/* Parse again the lines stored as is in the cache file mapped by
+ * load_cs_cache(). */
+static void
+parse_cs_cache_lines(char **filecolors, char **extcolors, char **ifacecolors)
+{
+	struct cs_cache_header_t h;
+	memcpy(&h, cs_cache_map, sizeof(h));
+
+	const char *p = cs_cache_map + h.lines_off;
+	const char *end = p + h.lines_len;
+
+	while (p < end) {
+		const size_t len = strlen(p);
+		/* Lines are modified while being parsed: use a copy */
+		char *line = savestring(p, len);
+		parse_color_scheme_line(line, (ssize_t)len, filecolors, extcolors,
+			ifacecolors);
+		free(line);
+		p += len + 1;
+	}
+}
+
+/* Set extension colors and shades from the cache file mapped by
+ * load_cs_cache(). Extension colors point to the mapped file. */
+static void
+apply_cs_cache(void)
+{
+	struct cs_cache_header_t h;
+	memcpy(&h, cs_cache_map, sizeof(h));
+
+	date_shades = h.date_shades;
+	size_shades = h.size_shades;
+	date_shades_old_style = h.date_shades_old_style;
+	size_shades_old_style = h.size_shades_old_style;
+
+	free_extension_colors();
+
+	if (h.ext_n == 0) {
+		munmap(cs_cache_map, cs_cache_map_size);
+		cs_cache_map = NULL;
+		cs_cache_map_size = 0;
+		return;
+	}
+
+	ext_colors_map = cs_cache_map;
+	ext_colors_map_size = cs_cache_map_size;
+	cs_cache_map = NULL;
+	cs_cache_map_size = 0;
+
+	char *strings = ext_colors_map + h.strings_off;
+	ext_colors = xnmalloc((size_t)h.ext_n + 1, sizeof(struct ext_t));
+
+	for (size_t i = 0; i < h.ext_n; i++) {
+		struct cs_cache_ext_t e;
+		memcpy(&e, ext_colors_map + h.ext_off + i * sizeof(e), sizeof(e));
+		ext_colors[i].name = strings + e.name_off;
+		ext_colors[i].len = e.name_len;
+		ext_colors[i].value = strings + e.value_off;
+		ext_colors[i].value_len = e.value_len;
+		ext_colors[i].seq = strings + e.seq_off;
+		ext_colors[i].seq_len = e.seq_len;
+		ext_colors[i].hash = (size_t)e.hash;
+	}
+
+	ext_colors_n = (size_t)h.ext_n;
+	ext_colors[ext_colors_n] = (struct ext_t){0};
+
+	ext_colors_table = (size_t *)(void *)(ext_colors_map + h.table_off);
+	ext_colors_table_size = (size_t)h.table_size;
+	ext_colors_table_mask = ext_colors_table_size - 1;
+
+	ext_colors_conflicts = h.ext_conflicts;
+	if (ext_colors_conflicts > 0)
+		warn_ext_conflicts();
+}
+
+/* Store LINE, of length LEN, to be written as is into the cache file. */
+static void
+add_cs_cache_line(const char *line, const size_t len)
+{
+	if (cs_src.lines_len + len + 1 > cs_src.lines_size) {
+		cs_src.lines_size = cs_src.lines_len + len + 1 + 1024;
+		cs_src.lines = xnrealloc(cs_src.lines, cs_src.lines_size,
+			sizeof(char));
+	}
+
+	memcpy(cs_src.lines + cs_src.lines_len, line, len);
+	cs_src.lines[cs_src.lines_len + len] = '\0';
+	cs_src.lines_len += len + 1;
+}
+
+static void
+clear_cs_src(void)
+{
+	free(cs_src.lines);
+	cs_src.lines = NULL;
+	cs_src.lines_len = cs_src.lines_size = 0;
+	cs_src.pending = 0;
+}
+
+/* Build the cache file for the color scheme just loaded from the color
+ * scheme file (see read_color_scheme_file()) into BUF. Returns the size of
+ * the cache file, or 0 on error. */
+static size_t
+build_cs_cache(char **buf)
+{
+	struct cs_cache_header_t h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CS_CACHE_MAGIC, sizeof(h.magic));
+	h.version = CS_CACHE_VERSION;
+	h.word_size = (uint32_t)sizeof(size_t);
+	h.term_colors = (int32_t)term_caps.color;
+	h.no_bold = (int32_t)xargs.no_bold;
+	h.ext_conflicts = (uint32_t)ext_colors_conflicts;
+	h.src_dev = (uint64_t)cs_src.attr.st_dev;
+	h.src_ino = (uint64_t)cs_src.attr.st_ino;
+	h.src_size = (int64_t)cs_src.attr.st_size;
+	h.src_mtime = (int64_t)cs_src.attr.st_mtime;
+	h.src_mtime_nsec = (int64_t)get_mtime_nsec(&cs_src.attr);
+	h.date_shades = date_shades;
+	h.size_shades = size_shades;
+	h.date_shades_old_style = (uint8_t)date_shades_old_style;
+	h.size_shades_old_style = (uint8_t)size_shades_old_style;
+
+	const size_t ext_n = ext_colors_table ? ext_colors_n : 0;
+	size_t strings_len = 0;
+	for (size_t i = 0; i < ext_n; i++) {
+		strings_len += ext_colors[i].len + ext_colors[i].value_len
+			+ ext_colors[i].seq_len + 3;
+	}
+
+	if (strings_len > UINT32_MAX)
+		return 0;
+
+	h.lines_off = CS_ALIGN(sizeof(h));
+	h.lines_len = cs_src.lines_len;
+	h.ext_off = CS_ALIGN(h.lines_off + h.lines_len);
+	h.ext_n = ext_n;
+	h.table_off = CS_ALIGN(h.ext_off + ext_n * sizeof(struct cs_cache_ext_t));
+	h.table_size = ext_n > 0 ? ext_colors_table_size : 0;
+	h.strings_off = h.table_off + h.table_size * sizeof(size_t);
+	h.strings_len = strings_len;
+
+	const size_t size = (size_t)(h.strings_off + h.strings_len);
+	char *b = xcalloc(size, sizeof(char));
+
+	if (h.lines_len > 0)
+		memcpy(b + h.lines_off, cs_src.lines, h.lines_len);
+	if (h.table_size > 0) {
+		memcpy(b + h.table_off, ext_colors_table,
+			h.table_size * sizeof(size_t));
+	}
+
+	char *s = b + h.strings_off;
+	uint32_t off = 0;
+	for (size_t i = 0; i < ext_n; i++) {
+		struct cs_cache_ext_t e;
+		memset(&e, 0, sizeof(e));
+		e.hash = (uint64_t)ext_colors[i].hash;
+		e.name_len = (uint32_t)ext_colors[i].len;
+		e.value_len = (uint32_t)ext_colors[i].value_len;
+		e.seq_len = (uint32_t)ext_colors[i].seq_len;
+
+		e.name_off = off;
+		memcpy(s + off, ext_colors[i].name, e.name_len);
+		off += e.name_len + 1;
+		e.value_off = off;
+		memcpy(s + off, ext_colors[i].value, e.value_len);
+		off += e.value_len + 1;
+		e.seq_off = off;
+		memcpy(s + off, ext_colors[i].seq, e.seq_len);
+		off += e.seq_len + 1;
+
+		memcpy(b + h.ext_off + i * sizeof(e), &e, sizeof(e));
+	}
+
+	memcpy(b, &h, sizeof(h));
+	h.sum = fnv1a_hash(FNV1A_INIT, b, size);
+	memcpy(b + offsetof(struct cs_cache_header_t, sum), &h.sum,
+		sizeof(h.sum));
+
+	*buf = b;
+	return size;
+}
+
+/* Return 1 if the color scheme file, whose current attributes are A, was
+ * not modified since it was read, or 0 otherwise. A file modified right
+ * before being read is not trusted either: it could have been modified
+ * again, in the same timestamp tick, while being read. */
+static int
+cs_src_unchanged(const struct stat *a)
+{
+	const struct stat *b = &cs_src.attr;
+	const long mtime_nsec = get_mtime_nsec(a);
+
+	if (a->st_dev != b->st_dev || a->st_ino != b->st_ino
+	|| a->st_size != b->st_size || a->st_mtime != b->st_mtime
+	|| mtime_nsec != get_mtime_nsec(b))
+		return 0;
+
+	const long long age =
+		((long long)cs_src.read_time.tv_sec - (long long)a->st_mtime)
+		* 1000000000LL + ((long long)cs_src.read_time.tv_nsec - mtime_nsec);
+
+	return (age >= CS_CACHE_RACY_NSEC);
+}
+
+/* Write the cache file for the color scheme just loaded, provided the
+ * color scheme file was not modified while being read. */
+static void
+write_cs_cache(void)
+{
+	struct stat a;
+	if (stat(cs_src.file, &a) == -1 || cs_src_unchanged(&a) == 0)
+		return;
+
+	char file[PATH_MAX + NAME_MAX + 32];
+	if (get_cs_cache_file(cs_src.name, cs_src.file, file, sizeof(file), 1)
+	!= FUNC_SUCCESS)
+		return;
+
+	char *buf = NULL;
+	const size_t size = build_cs_cache(&buf);
+	if (size == 0)
+		return;
+
+	char tmp_file[sizeof(file) + 7];
+	snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", file);
+
+	const int fd = mkstemp(tmp_file);
+	if (fd == -1) {
+		free(buf);
+		return;
+	}
+
+	const int ret = xwrite(fd, buf, size);
+	free(buf);
+
+	if (close(fd) == -1 || ret != FUNC_SUCCESS
+	|| renameat(XAT_FDCWD, tmp_file, XAT_FDCWD, file) == -1)
+		unlinkat(XAT_FDCWD, tmp_file, 0);
+}
+
+#undef CS_ALIGN
+
 /* Get color lines from the configuration file */
 static int
 read_color_scheme_file(const char *colorscheme, char **filecolors,
@@ -2251,6 +2859,30 @@ read_color_scheme_file(const char *colorscheme, char **filecolors,
 		reset_iface_colors();
 	}
 
+	/* The cache holds the result of loading the color scheme file alone. */
+	clear_cs_src();
+	const int cacheable = (xargs.lscolors <= 0 && !*filecolors
+		&& !*extcolors && !*ifacecolors
+		&& date_shades.type == SHADE_TYPE_UNSET
+		&& size_shades.type == SHADE_TYPE_UNSET
+		&& fstat(fileno(fp_colors), &attr) != -1);
+
+	const char *name = colorscheme ? colorscheme : "default";
+	if (cacheable == 1
+	&& load_cs_cache(name, colorscheme_file, &attr) == FUNC_SUCCESS) {
+		fclose(fp_colors);
+		parse_cs_cache_lines(filecolors, extcolors, ifacecolors);
+		return FUNC_SUCCESS;
+	}
+
+	if (cacheable == 1
+	&& clock_gettime(CLOCK_REALTIME, &cs_src.read_time) != -1) {
+		xstrsncpy(cs_src.file, colorscheme_file, sizeof(cs_src.file));
+		xstrsncpy(cs_src.name, name, sizeof(cs_src.name));
+		cs_src.attr = attr;
+		cs_src.pending = 1;
+	}
+
 	char *line = NULL;
 	size_t line_size = 0;
 	ssize_t line_len = 0;
@@ -2264,79 +2896,11 @@ read_color_scheme_file(const char *colorscheme, char **filecolors,
 			line_len--;
 		}
 
-		if (*line == 'd' && strncmp(line, "define ", 7) == 0) {
-			store_definition(line + 7);
-		}
-
-		else if (*line == 'P' && strncmp(line, "Prompt=", 7) == 0) {
-			set_cs_prompt(line + 7);
-		}
+		if (cs_src.pending == 1 && !CS_COMPILED_LINE(line))
+			add_cs_cache_line(line, (size_t)line_len);
 
-		/* The following values override those set via the Prompt line
-		 * (provided it was set to a valid prompt name, as defined in the
-		 * prompts file). */
-		else if (*line == 'N' && strncmp(line, "Notifications=", 14) == 0) {
-			set_cs_prompt_noti(line + 14);
-		}
-
-		else if (xargs.warning_prompt == UNSET && *line == 'E'
-		&& strncmp(line, "EnableWarningPrompt=", 20) == 0) {
-			set_cs_enable_warning_prompt(line + 20);
-		}
-
-		else if (*line == 'W' && strncmp(line, "WarningPrompt=", 14) == 0) {
-			set_cs_warning_prompt_str(line + 14);
-		}
-
-		else if (*line == 'R' && strncmp(line, "RightPrompt=", 12) == 0) {
-			set_cs_right_prompt_str(line + 12);
-		}
-
-#ifndef _NO_FZF
-		else if (*line == 'F' && strncmp(line, "FzfTabOptions=", 14) == 0) {
-			set_cs_fzftabopts(line + 14);
-		}
-#endif /* !_NO_FZF */
-
-		else if (*line == 'D' && strncmp(line, "DividingLine=", 13) == 0) {
-			set_div_line(line + 13);
-		}
-
-		/* Interface colors */
-		else if (!*ifacecolors && *line == 'I'
-		&& strncmp(line, "InterfaceColors=", 16) == 0) {
-			set_cs_colors(line + 16, ifacecolors, (size_t)line_len - 16);
-		}
-
-		/* Filetype colors */
-		else if (!*filecolors && *line == 'F'
-		&& strncmp(line, "FiletypeColors=", 15) == 0) {
-			set_cs_colors(line + 15, filecolors, (size_t)line_len - 15);
-		}
-
-		/* File extension colors */
-		else if (xargs.lscolors != LS_COLORS_GNU && *line == 'E'
-		&& strncmp(line, "ExtColors=", 10) == 0) {
-			set_cs_extcolors(line, extcolors, line_len);
-		}
-
-#ifndef _NO_ICONS
-		/* Directory icon color */
-		else if (*line == 'D' && strncmp(line, "DirIconColor=", 13) == 0) {
-			set_cs_dir_icon_color(line);
-		}
-#endif /* !_NO_ICONS */
-
-		else if (date_shades.type == SHADE_TYPE_UNSET
-		&& *line == 'D' && strncmp(line, "DateShades=", 11) == 0) {
-			set_shades(line + 11, DATE_SHADES);
-		}
-
-		else {
-			if (size_shades.type == SHADE_TYPE_UNSET
-			&& *line == 'S' && strncmp(line, "SizeShades=", 11) == 0)
-				set_shades(line + 11, SIZE_SHADES);
-		}
+		parse_color_scheme_line(line, line_len, filecolors, extcolors,
+			ifacecolors);
 	}
 
 	free(line);
@@ -2509,6 +3073,11 @@ set_colors(const char *colorscheme, const int check_env)
 #endif /* CLIFM_SUCKLESS */
 	/* Split the color lines into substrings (one per color) */
 
+#ifndef CLIFM_SUCKLESS
+	if (cs_cache_map)
+		apply_cs_cache(); /* Extension colors loaded from the cache */
+	else
+#endif /* !CLIFM_SUCKLESS */
 	if (!extcolors) {
 		/* Unload current extension colors */
 		if (ext_colors_n > 0)
@@ -2543,6 +3112,13 @@ set_colors(const char *colorscheme, const int check_env)
 	if (xargs.no_bold == 1)
 		disable_bold();
 
+#ifndef CLIFM_SUCKLESS
+	if (cs_src.pending == 1) {
+		write_cs_cache();
+		clear_cs_src();
+	}
+#endif /* !CLIFM_SUCKLESS */
+
 	return FUNC_SUCCESS;
 }
 
@@ -2803,18 +3379,17 @@ print_ext_colors(void)
 	if (cols <= 0)
 		cols = 1;
 
-	/* The ext_colors array is sorted by name hashes (to perform binary
-	 * searches for file extension colors). But here we want to group
-	 * extensions by color. */
-	qsort(ext_colors, ext_colors_n, sizeof(*ext_colors),
-		(QSFUNC *)color_sort);
+	/* The ext_colors array is indexed by ext_colors_table, so that we cannot
+	 * reorder it. Sort a copy instead, to group extensions by color. */
+	struct ext_t *ext = xnmalloc(ext_colors_n, sizeof(struct ext_t));
+	memcpy(ext, ext_colors, ext_colors_n * sizeof(struct ext_t));
+	qsort(ext, ext_colors_n, sizeof(*ext), (QSFUNC *)color_sort);
 
 	int n = 1;
 
 	for (size_t i = 0; i < ext_colors_n; i++) {
-		const int pad = l - (int)ext_colors[i].len;
-		printf("\x1b[%sm*.%s%s%*s", ext_colors[i].value,
-			ext_colors[i].name, NC, pad, "");
+		const int pad = l - (int)ext[i].len;
+		printf("\x1b[%sm*.%s%s%*s", ext[i].value, ext[i].name, NC, pad, "");
 		if (n == cols) {
 			n = 1;
 			putchar('\n');
@@ -2825,8 +3400,7 @@ print_ext_colors(void)
 
 	printf("%s\n", df_c);
 
-	qsort(ext_colors, ext_colors_n, sizeof(*ext_colors),
-		(QSFUNC *)hash_sort);
+	free(ext);
 }
 
 static void
@@ -32,6 +32,7 @@
 #include "navigation.h"
 #include "sort.h" /* num_to_sort_name() */
 #include "spawn.h"
+#include "trace.h" /* startup_trace() */
 
 /* Predefined time styles */
 #define ISO_TIME           "%Y-%m-%d"
@@ -620,6 +621,11 @@ dump_config(void)
 #endif /* !_NO_FZF */
 		DUMP_CONFIG_STR_NO_QUOTE);
 
+#ifndef _NO_TAGS
+	n = DEF_TAGS_DB;
+	print_config_value("TagsDatabase", &conf.tags_db, &n, DUMP_CONFIG_BOOL);
+#endif /* !_NO_TAGS */
+
 	s = DEF_TERM_CMD;
 	print_config_value("TerminalCmd", conf.term, s, DUMP_CONFIG_STR);
 
@@ -1790,13 +1796,14 @@ create_main_config_file(char *file)
 
 	    "# Set the default copy command. Available options are:\n\
 # 0: 'cp -Rp', 1: 'cp -Rp' (force), 2: 'advcp -gRp', 3: 'advcp -gRp' (force),\n\
-# 4: 'wcp', and 5: 'rsync -avP'\n\
-# Note: 2-5 include a progress bar\n\
+# 4: 'wcp', 5: 'rsync -avP', and 6: built-in (parallel, in-process copy)\n\
+# Note: 2-6 include a progress bar\n\
 ;cpCmd=%d\n\n"
 
 	    "# Set the default move command. Available options are:\n\
-# 0: 'mv', 1: 'mv' (force), 2: 'advmv -g', and 3: 'advmv -g' (force)\n\
-# Note: 2 and 3 include a progress bar\n\
+# 0: 'mv', 1: 'mv' (force), 2: 'advmv -g', 3: 'advmv -g' (force), and\n\
+# 4: built-in (in-process: files in other filesystems are copied in parallel)\n\
+# Note: 2-4 include a progress bar\n\
 ;mvCmd=%d\n\n"
 
 		"# If set to true, the 'r' command will never prompt before removals.\n\
@@ -1901,6 +1908,10 @@ create_main_config_file(char *file)
 		"# Automatically purge the jump database from non-existing directories.\n\
 ;PurgeJumpDB=%s\n\n"
 
+	    "# Keep a copy of the tags directory in tags/.tags.db, so that tags are\n\
+# loaded faster. If disabled, tag directories are read every time.\n\
+;TagsDatabase=%s\n\n"
+
 	    "# Allow external, shell commands.\n\
 ;ExternalCommands=%s\n\n"
 
@@ -1936,6 +1947,7 @@ create_main_config_file(char *file)
 		DEF_MIN_JUMP_RANK,
 		DEF_MAX_JUMP_TOTAL_RANK,
 		DEF_PURGE_JUMPDB == 1 ? "true" : "false",
+		DEF_TAGS_DB == 1 ? "true" : "false",
 		DEF_EXT_CMD_OK == 1 ? "true" : "false",
 		DEF_FAST_MAGIC == 1 ? "true" : "false",
 		DEF_CD_ON_QUIT == 1 ? "true" : "false"
@@ -4061,6 +4073,12 @@ read_config(void)
 		}
 #endif /* !_NO_FZF */
 
+#ifndef _NO_TAGS
+		else if (*line == 'T' && strncmp(line, "TagsDatabase=", 13) == 0) {
+			set_config_bool_value(line + 13, &conf.tags_db);
+		}
+#endif /* !_NO_TAGS */
+
 		else if (*line == 'T' && strncmp(line, "TermTitle=", 10) == 0) {
 			set_term_title_value(line + 10);
 		}
@@ -4534,6 +4552,7 @@ init_config(void)
 
 	define_config_file_names();
 	create_config_files(just_listing);
+	startup_trace("create_config_files");
 
 	if (config_ok == 0) {
 		undef_config_file_names();
@@ -4543,7 +4562,9 @@ init_config(void)
 
 #ifndef CLIFM_SUCKLESS
 	cschemes_n = get_colorschemes();
+	startup_trace("get_colorschemes");
 	read_config();
+	startup_trace("read_config");
 #else
 	xstrsncpy(div_line, DEF_DIV_LINE, sizeof(div_line));
 #endif /* !CLIFM_SUCKLESS */
@@ -4553,10 +4574,13 @@ init_config(void)
 	if (!conf.ptime_str)
 		set_ptime_style_env();
 
-	if (just_listing == 0)
+	if (just_listing == 0) {
 		load_prompts();
+		startup_trace("load_prompts");
+	}
 
-	check_colors();
+	check_colors(); /* Calls set_colors() */
+	startup_trace("set_colors");
 
 	if (xargs.secure_env == 1 || xargs.secure_env_full == 1)
 		check_config_files_integrity();
@@ -290,6 +290,44 @@ quit_func(char **args, const int exit_status)
 	exit(exit_status);
 }
 
+/* Move the window of listed files (if MaxFiles is set) according to ARG:
+ * 'next'/'prev' (one page forward/backward), 'first', 'last', or
+ * 'goto' (the page containing the ELN ELN). g_list_offset is adjusted to
+ * fit the list of files by get_list_window() when listing. */
+static int
+scroll_list_window(const char *arg, const char *eln)
+{
+	if (conf.max_files == UNSET || conf.max_files == 0) {
+		xerror(_("%s: Max files is not set\n"), PROGRAM_NAME);
+		return (exit_code = FUNC_FAILURE);
+	}
+
+	const filesn_t max = (filesn_t)conf.max_files;
+
+	if (*arg == 'n') {
+		if (g_list_offset + max < g_files_num)
+			g_list_offset += max;
+	} else if (*arg == 'p') {
+		g_list_offset = g_list_offset > max ? g_list_offset - max : 0;
+	} else if (*arg == 'f') {
+		g_list_offset = 0;
+	} else if (*arg == 'l') {
+		g_list_offset = g_files_num;
+	} else {
+		const filesn_t n = (eln && is_number(eln)) ? xatof(eln) : -1;
+		if (n <= 0 || n > g_files_num) {
+			xerror(_("%s: %s: No such ELN\n"), PROGRAM_NAME, eln ? eln : "");
+			return (exit_code = FUNC_FAILURE);
+		}
+		g_list_offset = ((n - 1) / max) * max;
+	}
+
+	if (conf.autols == 1)
+		reload_dirlist();
+
+	return FUNC_SUCCESS;
+}
+
 static int
 set_max_files(char **args)
 {
@@ -303,8 +341,14 @@ set_max_files(char **args)
 
 	if (IS_HELP(args[1])) { puts(_(MF_USAGE)); return FUNC_SUCCESS;	}
 
+	if (strcmp(args[1], "next") == 0 || strcmp(args[1], "prev") == 0
+	|| strcmp(args[1], "first") == 0 || strcmp(args[1], "last") == 0
+	|| strcmp(args[1], "goto") == 0)
+		return scroll_list_window(args[1], args[2]);
+
 	if (*args[1] == 'u' && strcmp(args[1], "unset") == 0) {
 		conf.max_files = UNSET;
+		g_list_offset = 0;
 		if (conf.autols == 1) reload_dirlist();
 		print_reload_msg(NULL, NULL, _("Max files unset\n"));
 		goto SUCCESS;
@@ -312,6 +356,7 @@ set_max_files(char **args)
 
 	if (*args[1] == '0' && !args[1][1]) {
 		conf.max_files = 0;
+		g_list_offset = 0;
 		if (conf.autols == 1) reload_dirlist();
 		print_reload_msg(NULL, NULL, _("Max files set to %d\n"), conf.max_files);
 		goto SUCCESS;
@@ -324,6 +369,7 @@ set_max_files(char **args)
 	}
 
 	conf.max_files = (int)inum;
+	g_list_offset = 0; /* Pages of the old size are meaningless now */
 	if (conf.autols == 1) reload_dirlist();
 	print_reload_msg(NULL, NULL, _("Max files set to %d\n"), conf.max_files);
 
@@ -1549,6 +1595,9 @@ set_cp_cmd(char **cmd, int *cp_force)
 	case CP_WCP: n = DEFAULT_WCP_CMD; break;
 	case CP_RSYNC: n = DEFAULT_RSYNC_CMD; break;
 	case CP_CP_FORCE: n = DEFAULT_CP_CMD_FORCE; *cp_force = 1; break;
+	/* The built-in engine is run by cp_mv_file(): the command name is only
+	 * used to tell copies from moves. */
+	case CP_BUILTIN: /* fallthrough */
 	case CP_CP: /* fallthrough */
 	default: n = DEFAULT_CP_CMD; break;
 	}
@@ -1579,6 +1628,7 @@ set_mv_cmd(char **cmd, int *mv_force)
 	case MV_ADVMV: n = DEFAULT_ADVMV_CMD; break;
 	case MV_ADVMV_FORCE: n = DEFAULT_ADVMV_CMD_FORCE; *mv_force = 1; break;
 	case MV_MV_FORCE: n = DEFAULT_MV_CMD_FORCE; *mv_force = 1; break;
+	case MV_BUILTIN: /* fallthrough */
 	case MV_MV: /* fallthrough */
 	default: n = DEFAULT_MV_CMD; break;
 	}
@@ -2564,6 +2614,10 @@ run_profile_line(char *cmd)
 	&& sanitize_cmd(cmd, SNT_PROFILE) != FUNC_SUCCESS)
 		return;
 
+	/* Commands may need aliases, actions, and the list of programs in
+	 * PATH, otherwise loaded after the first listing. */
+	load_cmds_data();
+
 	args_n = 0;
 	char **cmds = parse_input_str(cmd);
 	if (!cmds)
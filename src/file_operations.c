@@ -27,7 +27,7 @@ set_max_confirm_files */
 #include "colors.h"
 #include "file_operations.h"
 #include "history.h"
-#include "init.h" /* get_sel_files() */
+#include "init.h" /* get_sel_files(), load_file_templates() */
 #include "listing.h"
 #include "messages.h"
 #include "mime.h"
@@ -37,6 +37,7 @@ set_max_confirm_files */
 #include "safe_names.h" /* validate_filename */
 #include "selection.h"
 #include "spawn.h"
+#include "xcopy.h" /* xcopy_files(), xremove_files() */
 
 /* Struct to store information about files to be removed via the 'r' command. */
 struct rm_info {
@@ -376,6 +377,7 @@ extract_template_name_from_filename(char *basename, int *t_auto)
 static int
 find_template(const char *name)
 {
+	load_file_templates();
 	if (!file_templates)
 		return 0;
 
@@ -395,6 +397,7 @@ find_template(const char *name)
 static int
 create_from_template(char *abs_path, char *basename)
 {
+	load_file_templates();
 	if (!file_templates || !templates_dir || !*templates_dir
 	|| !abs_path || !*abs_path || !basename || !*basename)
 		return 0;
@@ -1841,7 +1844,18 @@ cp_mv_file(char **args, const int copy_and_rename, const int force)
 	if (!tcmd)
 		return FUNC_FAILURE;
 
-	ret = launch_execv((const char **)tcmd, FOREGROUND, E_NOFLAG);
+	const int is_mv = IS_MVCMD(args[0]);
+	if ((is_mv == 1 && conf.mv_cmd == MV_BUILTIN)
+	|| (is_mv == 0 && conf.cp_cmd == CP_BUILTIN)) {
+		/* Skip the command name (plus options) and the end of options
+		 * marker (--) */
+		size_t i = 1;
+		while (tcmd[i] && strcmp(tcmd[i], "--") != 0)
+			i++;
+		ret = xcopy_files(tcmd[i] ? tcmd + i + 1 : tcmd + i, is_mv);
+	} else {
+		ret = launch_execv((const char **)tcmd, FOREGROUND, E_NOFLAG);
+	}
 
 	for (size_t i = 0; tcmd[i]; i++)
 		free(tcmd[i]);
@@ -1871,12 +1885,12 @@ cp_mv_file(char **args, const int copy_and_rename, const int force)
 
 /* Print the list of files removed via the most recent call to the 'r' command */
 static void
-list_removed_files(struct rm_info *info, const size_t start, const int cwd)
+list_removed_files(struct rm_info *info, const int cwd)
 {
 	size_t i, c = 0;
 
 	struct stat a;
-	for (i = start; info[i].name; i++) {
+	for (i = 0; info[i].name; i++) {
 		if (lstat(info[i].name, &a) == -1 && errno == ENOENT)
 			c++;
 	}
@@ -1894,12 +1908,12 @@ list_removed_files(struct rm_info *info, const size_t start, const int cwd)
 /* Print files to be removed and ask the user for confirmation.
  * Returns 0 if no or 1 if yes. */
 static int
-rm_confirm(const struct rm_info *info, const size_t start, const int have_dirs)
+rm_confirm(const struct rm_info *info, const int have_dirs)
 {
 	const size_t max = get_max_confirm_files();
 
 	size_t total = 0;
-	for (size_t i = start; info[i].name; i++)
+	for (size_t i = 0; info[i].name; i++)
 		total++;
 
 	char prompt_msg[128];
@@ -1914,7 +1928,7 @@ rm_confirm(const struct rm_info *info, const size_t start, const int have_dirs)
 
 	size_t count = 0;
 
-	for (size_t i = start; info[i].name; i++) {
+	for (size_t i = 0; info[i].name; i++) {
 		if (++count > max)
 			continue;
 
@@ -1933,13 +1947,12 @@ rm_confirm(const struct rm_info *info, const size_t start, const int have_dirs)
 }
 
 static int
-check_rm_files(const struct rm_info *info, const size_t start,
-	const char *errname)
+check_rm_files(const struct rm_info *info, const char *errname)
 {
 	struct stat a;
 	int ret = FUNC_SUCCESS;
 
-	for (size_t i = start; info[i].name; i++) {
+	for (size_t i = 0; info[i].name; i++) {
 		if (lstat(info[i].name, &a) == -1)
 			continue;
 
@@ -1986,9 +1999,10 @@ remove_files(char **args)
 	const size_t num = i > 0 ? (size_t)i - 1 : (size_t)i;
 
 	struct stat a;
-	char **rm_cmd = xnmalloc(num + 4, sizeof(char *));
-	/* Let's keep information about files to be removed. */
-	struct rm_info *info = xnmalloc(num + 4, sizeof(struct rm_info));
+	/* Files to be removed (as consumed by xremove_files()), plus
+	 * information about each of them (indexed the same way). */
+	char **files = xnmalloc(num + 1, sizeof(char *));
+	struct rm_info *info = xnmalloc(num + 1, sizeof(struct rm_info));
 
 	int j, have_dirs = 0;
 	int rm_force = conf.rm_force == 1 ? 1 : 0;
@@ -1997,10 +2011,7 @@ remove_files(char **args)
 	if (i == 2)
 		rm_force = 1;
 
-	for (j = 3; args[i]; i++) {
-		/* Let's start storing filenames in 3: 0 is for 'rm', and 1
-		 * and 2 for parameters, including end of parameters (--). */
-
+	for (j = 0; args[i]; i++) {
 		/* If we have a symlink to dir ending with a slash, stat(2) takes it
 		 * as a directory, and then rm(1) complains that cannot remove it,
 		 * because "Is a directory". So, let's remove the ending slash:
@@ -2022,8 +2033,8 @@ remove_files(char **args)
 		}
 
 		if (lstat(tmp, &a) != -1) {
-			rm_cmd[j] = strdup(tmp);
-			info[j] = fill_rm_info_struct(&rm_cmd[j], &a);
+			files[j] = strdup(tmp);
+			info[j] = fill_rm_info_struct(&files[j], &a);
 			if (info[j].dir == 1)
 				have_dirs++;
 			j++;
@@ -2035,30 +2046,28 @@ remove_files(char **args)
 		free(tmp);
 	}
 
-	rm_cmd[j] = info[j].name = NULL;
+	files[j] = info[j].name = NULL;
 
-	if (j == 3) { /* No file to be deleted */
-		free(rm_cmd);
+	if (j == 0) { /* No file to be deleted */
+		free(files);
 		free(info);
 		return FUNC_FAILURE;
 	}
 
-	if (rm_force == 1 && errs > 0 && j > 3 && conf.autols == 1)
+	if (rm_force == 1 && errs > 0 && j > 0 && conf.autols == 1)
 		press_any_key_to_continue(0);
 
-	if (rm_force == 0 && rm_confirm(info, 3, have_dirs) == 0)
+	if (rm_force == 0 && rm_confirm(info, have_dirs) == 0)
 		goto END;
 
 	/* Make sure that files to be removed have not changed between the
 	 * beginning of the operation and the user confirmation. */
-	if (check_rm_files(info, 3, err_name) == FUNC_FAILURE)
+	if (check_rm_files(info, err_name) == FUNC_FAILURE)
 		goto END;
 
-	rm_cmd[0] = "rm";
-	rm_cmd[1] = have_dirs >= 1 ? "-rf" : "-f";
-	rm_cmd[2] = "--";
-
-	exit_status = launch_execv((const char **)rm_cmd, FOREGROUND, E_NOFLAG);
+	/* Files are removed in-process (like 'rm -rf'), in parallel for
+	 * directories (see xcopy.c). */
+	exit_status = xremove_files(files, err_name);
 	if (exit_status != FUNC_SUCCESS) {
 #ifndef BSD_KQUEUE
 		if (num > 1 && conf.autols == 1) /* Only if we have multiple files */
@@ -2073,12 +2082,12 @@ remove_files(char **args)
 	if (is_sel > 0 && exit_status == FUNC_SUCCESS)
 		deselect_all();
 
-	list_removed_files(info, 3, cwd);
+	list_removed_files(info, cwd);
 
 END:
-	for (i = 3; rm_cmd[i]; i++)
-		free(rm_cmd[i]);
-	free(rm_cmd);
+	for (i = 0; files[i]; i++)
+		free(files[i]);
+	free(files);
 
 	free(info);
 	return exit_status;
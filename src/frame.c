@@ -0,0 +1,232 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* frame.c -- compose the file list into a single output buffer */
+
+/* The listing functions (list_files_horizontal(), list_files_vertical(), and
+ * print_long_mode(), in listing.c) used to write each entry to stdout via
+ * several printf(3)/fputs(3)/putchar(3) calls. Since stdout is line buffered
+ * when connected to a terminal, this meant at least one write(2) per line,
+ * plus parsing long format strings for each entry.
+ *
+ * Instead, the whole screen (or pager page) is now composed into a single
+ * growable buffer (the frame) by appending precomputed strings (mostly
+ * escape sequences), and then written at once with write(2). This reduces
+ * flickering, especially over slow connections (e.g. SSH).
+ *
+ * Usage: frame_start(), frame_puts(), frame_putc(), ..., frame_end().
+ * frame_flush() writes the current content of the frame (if any) without
+ * ending it: call it before reading user input (e.g. the pager).
+ * When no frame is active, all frame_* functions write to stdout. */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h> /* write(2) */
+
+#include "frame.h"
+#include "mem.h" /* xnrealloc() */
+
+#define FRAME_INIT_SIZE (64 * 1024)
+/* Do not let the frame grow beyond this size: flush it instead. This is
+ * only relevant when listing huge directories without the pager. */
+#define FRAME_MAX_SIZE  (1024 * 1024)
+
+static struct {
+	char  *buf;
+	size_t len;
+	size_t size;
+	int    active;
+	int    pad0;
+} frame = {NULL, 0, 0, 0, 0};
+
+/* Make sure the frame has room for at least NEEDED more bytes. */
+static void
+frame_reserve(const size_t needed)
+{
+	if (frame.len + needed <= frame.size)
+		return;
+
+	if (frame.len > 0 && frame.len + needed > FRAME_MAX_SIZE) {
+		frame_flush();
+		if (needed <= frame.size)
+			return;
+	}
+
+	size_t new_size = frame.size > 0 ? frame.size : FRAME_INIT_SIZE;
+	while (new_size < frame.len + needed)
+		new_size *= 2;
+
+	frame.buf = xnrealloc(frame.buf, new_size, sizeof(char));
+	frame.size = new_size;
+}
+
+/* Start composing a new frame. Whatever is pending in stdout is flushed
+ * first to keep the output in order. */
+void
+frame_start(void)
+{
+	fflush(stdout);
+	frame.len = 0;
+	frame.active = 1;
+}
+
+/* Write the current content of the frame to STDOUT_FILENO. */
+void
+frame_flush(void)
+{
+	const char *p = frame.buf;
+	size_t rem = frame.len;
+
+	while (rem > 0) {
+		const ssize_t ret = write(STDOUT_FILENO, p, rem);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		p += ret;
+		rem -= (size_t)ret;
+	}
+
+	frame.len = 0;
+}
+
+/* Flush the current frame and go back to writing directly to stdout. */
+void
+frame_end(void)
+{
+	if (frame.active == 0)
+		return;
+
+	frame_flush();
+	frame.active = 0;
+}
+
+void
+frame_free(void)
+{
+	free(frame.buf);
+	frame.buf = NULL;
+	frame.len = frame.size = 0;
+	frame.active = 0;
+}
+
+void
+frame_write(const char *str, const size_t len)
+{
+	if (frame.active == 0) {
+		fwrite(str, sizeof(char), len, stdout);
+		return;
+	}
+
+	frame_reserve(len);
+	memcpy(frame.buf + frame.len, str, len);
+	frame.len += len;
+}
+
+void
+frame_puts(const char *str)
+{
+	if (!str || !*str)
+		return;
+
+	if (frame.active == 0) {
+		fputs(str, stdout);
+		return;
+	}
+
+	frame_write(str, strlen(str));
+}
+
+void
+frame_putc(const char c)
+{
+	if (frame.active == 0) {
+		putchar(c);
+		return;
+	}
+
+	frame_reserve(1);
+	frame.buf[frame.len++] = c;
+}
+
+/* Append N spaces to the frame. */
+void
+frame_spaces(int n)
+{
+	if (n <= 0)
+		return;
+
+	if (frame.active == 0) {
+		while (--n >= 0)
+			putchar(' ');
+		return;
+	}
+
+	frame_reserve((size_t)n);
+	memset(frame.buf + frame.len, ' ', (size_t)n);
+	frame.len += (size_t)n;
+}
+
+/* Append the number N, right aligned to PAD columns (same as "%*jd"). */
+void
+frame_num(const intmax_t n, const int pad)
+{
+	char buf[32]; /* Large enough for INTMAX_MIN plus NUL */
+	char *p = buf + sizeof(buf);
+	uintmax_t u = n < 0 ? (uintmax_t)0 - (uintmax_t)n : (uintmax_t)n;
+
+	do {
+		*--p = (char)('0' + (u % 10));
+		u /= 10;
+	} while (u > 0);
+
+	if (n < 0)
+		*--p = '-';
+
+	const size_t len = (size_t)(buf + sizeof(buf) - p);
+	if (pad > 0 && (size_t)pad > len)
+		frame_spaces(pad - (int)len);
+
+	frame_write(p, len);
+}
+
+/* Append a formatted string to the frame. Prefer the functions above
+ * whenever possible: no format string needs to be parsed. */
+void
+frame_printf(const char *format, ...)
+{
+	va_list ap;
+
+	if (frame.active == 0) {
+		va_start(ap, format);
+		vprintf(format, ap);
+		va_end(ap);
+		return;
+	}
+
+	va_start(ap, format);
+	const int len = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+
+	if (len <= 0)
+		return;
+
+	frame_reserve((size_t)len + 1);
+
+	va_start(ap, format);
+	const int ret = vsnprintf(frame.buf + frame.len,
+		frame.size - frame.len, format, ap);
+	va_end(ap);
+
+	if (ret > 0)
+		frame.len += (size_t)ret;
+}
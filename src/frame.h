@@ -0,0 +1,30 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* frame.h */
+
+#ifndef CLIFM_FRAME_H
+#define CLIFM_FRAME_H
+
+#include <stdint.h> /* intmax_t */
+
+__BEGIN_DECLS
+
+void frame_end(void);
+void frame_flush(void);
+void frame_free(void);
+void frame_num(const intmax_t n, const int pad);
+void frame_printf(const char *format, ...);
+void frame_putc(const char c);
+void frame_puts(const char *str);
+void frame_spaces(int n);
+void frame_start(void);
+void frame_write(const char *str, const size_t len);
+
+__END_DECLS
+
+#endif /* CLIFM_FRAME_H */
@@ -125,6 +125,7 @@
 
 #include <limits.h>
 #include <regex.h>
+#include <stdint.h> /* SIZE_MAX, UINT32_MAX */
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>  /* S_BLKSIZE */
@@ -616,6 +617,10 @@ extern time_t curdir_mtime;
 #define COLOR_ALWAYS 1
 #define COLOR_AUTO   2
 
+/* Values for --startup-trace (xargs.startup_trace) */
+#define TRACE_TEXT 1
+#define TRACE_TSV  2
+
 /* Values for SafeFilenames (conf.safe_filenames) */
 #define SAFENAMES_NOCHECK 0 /* The check is disabled */
 #define SAFENAMES_BASIC   1 /* Only basic checks are performed */
@@ -701,13 +706,15 @@ extern time_t curdir_mtime;
 #define CP_ADVCP_FORCE   3 /* advcp -gRp */
 #define CP_WCP           4 /* wcp */
 #define CP_RSYNC         5 /* rsync -avP */
-#define CP_CMD_AVAILABLE 6
+#define CP_BUILTIN       6 /* Built-in copy engine (xcopy.c) */
+#define CP_CMD_AVAILABLE 7
 
 #define MV_MV            0 /* mv */
 #define MV_MV_FORCE      1 /* mv */
 #define MV_ADVMV         2 /* advmv -g */
 #define MV_ADVMV_FORCE   3 /* advmv -g */
-#define MV_CMD_AVAILABLE 4
+#define MV_BUILTIN       4 /* Built-in copy engine (xcopy.c) */
+#define MV_CMD_AVAILABLE 5
 
 /* Macros for LinkCreationMode */
 #define LNK_CREAT_LITERAL  0 /* Like ln -s */
@@ -1082,6 +1089,22 @@ extern time_t curdir_mtime;
 #define IS_HELP(s) (*(s) == '-' && (((s)[1] == 'h' && !(s)[2]) \
 	|| strcmp((s), "--help") == 0))
 
+/* Open-addressed hash tables (see ext_table_init() in listing.c) */
+#define TABLE_LOAD_FACTOR 0.75
+/* 0.75: Do not allow the table to be loaded beyond 75% (i.e. make sure there
+ * is always at least 25% free slots). This value balances space vs. probe
+ * length for linear probing: keeps average probe counts low (good cache/branch
+ * behavior) while using memory efficiently. */
+
+/* Multiplicative mixing constant (Knuth for 32-bit, Fibonacci for 64-bit),
+ * used to quickly scramble hashes before masking; improves bit diffusion
+ * for power-of-two tables. */
+#if SIZE_MAX > UINT32_MAX
+# define HASH_MULTIPLIER 11400714819323198485ULL /* 64-bit Fibonacci constant */
+#else
+# define HASH_MULTIPLIER 2654435761ULL /* Knuth's 32-bit constant */
+#endif
+
 #ifndef NO_PLURALIZATION
 /* This is bad for translations, but better than nothing. */
 # define FILE_STR(n) ((n) == 1 ? _("file") : _("files"))
@@ -1107,6 +1130,7 @@ extern time_t curdir_mtime;
 #define FILESN_MAX SSIZE_MAX
 typedef ssize_t filesn_t;
 extern filesn_t g_files_num;
+extern filesn_t g_list_offset;
 
 #ifndef _NO_MAGIC
 extern magic_t g_magic_mime_type_cookie;
@@ -1234,6 +1258,7 @@ struct config_t {
 	int splash_screen;
 	int suggest_filetype_color;
 	int suggestions;
+	int tags_db;
 	int term_title;
 	int time_follows_sort;
 	int timestamp_mark;
@@ -1360,9 +1385,6 @@ struct groups_t {
 	int pad0;
 };
 
-extern struct groups_t *sys_users;
-extern struct groups_t *sys_groups;
-
 struct human_size_t {
 	char   str[MAX_HUMAN_SIZE + 6];
 	size_t len;
@@ -1376,7 +1398,7 @@ struct fileinfo {
 	struct groups_t uid_i;
 	struct groups_t gid_i;
 	char *color;
-	char *ext_color;
+	char *ext_color; /* Points to ext_colors[].seq (not malloc'ed) */
 	char *ext_name;
 	char *icon;
 	char *icon_color;
@@ -1405,6 +1427,7 @@ struct fileinfo {
 	int user_access; /* Read-exec for dirs and read for files */
 	int symlink;
 	int sel;
+	int tagged;
 	int xattr;
 	int du_status; /* Exit status of du(1) for dir full sizes */
 	int utf8;      /* Name contains at least one UTF-8 character */
@@ -1441,7 +1464,8 @@ extern devino_t *sel_devino;
 
 typedef struct {
     size_t cap;           /* Power of two */
-    size_t size;          /* Number of occupied slots */
+    size_t size;          /* Number of keys */
+    size_t deleted;       /* Number of deleted slots (tombstones) */
     unsigned char *state; /* 0 empty, 1 occupied, 2 deleted (not used when rebuilding) */
     devino_t *keys;       /* Only valid when state[i] == 1 */
 } devino_set_t;
@@ -1582,6 +1606,7 @@ struct param_t {
 	int sort;
 	int sort_reverse;
 	int splash_screen;
+	int startup_trace;
 	int stat;
 	int stealth_mode;
 #ifndef _NO_SUGGESTIONS
@@ -1664,6 +1689,7 @@ struct stats_t {
 	size_t other_writable;
 	size_t sticky;
 	size_t extended;
+	size_t tagged;
 	size_t unknown;
 	size_t unstat; /* Non-statable file */
 	size_t excluded; /* Files not displayed */
@@ -1682,6 +1708,42 @@ struct stats_t {
 
 extern struct stats_t stats;
 
+/* A few macros for nano-second precision: the nanoseconds field of the
+ * access, status change, and modification times in a struct stat. */
+#ifndef CLIFM_LEGACY
+# if defined(__NetBSD__) || defined(__APPLE__)
+#  define ATIMNSEC st_atimespec.tv_nsec
+#  define CTIMNSEC st_ctimespec.tv_nsec
+#  define MTIMNSEC st_mtimespec.tv_nsec
+# else
+#  define ATIMNSEC st_atim.tv_nsec
+#  define CTIMNSEC st_ctim.tv_nsec
+#  define MTIMNSEC st_mtim.tv_nsec
+# endif /* __NetBSD__ || __APPLE__ */
+#else
+/* Let's use any valid value: it won't be used anyway */
+# define ATIMNSEC st_atime
+# define CTIMNSEC st_ctime
+# define MTIMNSEC st_mtime
+#endif /* !CLIFM_LEGACY */
+
+/* Identity and modification time of a directory, taken right before
+ * reading it. Used to tell whether a copy of the directory contents
+ * (e.g. the file_info array) is still up to date. */
+struct dir_stamp_t {
+	dev_t  dev;
+	ino_t  ino;
+	time_t mtime;
+	long   mtime_nsec;
+	time_t scan_time;
+	long   scan_nsec;
+	int    valid;
+	int    pad0;
+};
+
+/* Stamp of the directory whose files are loaded into file_info. */
+extern struct dir_stamp_t listing_stamp;
+
 struct sort_t {
 	const char *name;
 	int num;
@@ -1805,8 +1867,10 @@ extern struct paths_t *paths;
 struct ext_t {
 	char  *name;
 	char  *value;
+	char  *seq; /* Full escape sequence: "\x1b[VALUEm" */
 	size_t len; /* Name length */
 	size_t value_len;
+	size_t seq_len;
 	size_t hash;
 };
 extern struct ext_t *ext_colors;
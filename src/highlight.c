@@ -18,6 +18,7 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 #endif /* __OpenBSD__ */
 
 #include "checks.h"
+#include "mem.h" /* xnrealloc() */
 
 /* Macros for single and double quotes */
 #define Q_SINGLE 0
@@ -42,84 +43,63 @@ change_word_color(const char *_last_word, const int offset, const char *color)
 	fputs("\x1b[?25h", stdout);
 } */
 
-/* Get the appropriate color for the character at position POS in the string
- * STR and print the color if SET_COLOR is set to 1 (in which case NULL is
- * returned); otherwise, just return a pointer to the corresponding color.
- * This function is used to colorize input, history entries, and accepted
- * suggestions. */
-char *
-rl_highlight(const char *str, const size_t pos, const int flag)
+/* Highlighting state after coloring a given char of the input line */
+struct hl_state_t {
+	char *color;          /* Current color (cur_color) */
+	unsigned char quote[2]; /* Single and double quotes count (0-2) */
+	unsigned char space;  /* Whether a space has been found */
+	unsigned char pad0;
+};
+
+/* The state of each char of the input line as last colored by
+ * recolorize_line(). Since the color of a char only depends on the chars
+ * preceding it, states are valid as long as the beginning of the line does
+ * not change: only chars after the first modified one need to be colored
+ * again (see get_valid_states()). */
+static struct {
+	char *line;           /* Copy of the colored line */
+	struct hl_state_t *st;
+	char *init_color;     /* Color at the beginning of the line */
+	size_t len;           /* Number of valid states */
+	size_t size;          /* Allocated states */
+} hl_cache = {NULL, NULL, NULL, 0, 0};
+
+/* Update the quotes count Q with the char at position POS in STR. */
+static void
+update_quotes(const char *str, const size_t pos, unsigned char *q)
 {
-	char *cl = NULL;
-	/* PREV is 0 when there is no previous char (STR[POS] is the first one) */
-	char prev = pos > 0 ? str[pos - 1] : 0;
-	char c = *(str + pos);
-
-	if (wrong_cmd == 1 && cur_color == wp_c && rl_end == 0) {
-		fputs(tx_c, stdout); fflush(stdout);
-		rl_redisplay();
-	}
-
-	if ((rl_end == 0 && c == KEY_BACKSPACE) || prev == '\\') {
-		if (prev == '\\')
-			goto END;
-		cl = tx_c;
-		goto END;
+	if (str[pos] == '\'') {
+		if (q[Q_DOUBLE] == 1 || (pos > 0 && str[pos - 1] == '\\'))
+			return;
+		q[Q_SINGLE]++;
+		if (q[Q_SINGLE] > 2)
+			q[Q_SINGLE] = 1;
+	} else {
+		if (str[pos] == '"') {
+			if (q[Q_SINGLE] == 1 || (pos > 0 && str[pos - 1] == '\\'))
+				return;
+			q[Q_DOUBLE]++;
+			if (q[Q_DOUBLE] > 2)
+				q[Q_DOUBLE] = 1;
+		}
 	}
+}
 
-	if (cur_color == hc_c)
-		goto END;
-
-	const char *sp = strchr(rl_line_buffer, ' ');
-	if (cur_color == wp_c && !sp)
-		goto END;
+/* Return the color for the char at position POS in the string STR, given
+ * the current color CUR, the quotes count Q of the line up to POS, and
+ * whether a space has been found in the line (SPACE). Returns NULL if the
+ * current color should not be changed. */
+static char *
+get_char_color(const char *str, const size_t pos, const char *cur,
+	const unsigned char *q, const int space)
+{
+	char *cl = NULL;
+	/* PREV is 0 when there is no previous char (STR[POS] is the first one) */
+	const char prev = pos > 0 ? str[pos - 1] : 0;
+	const char c = str[pos];
 
-/*	if (*rl_line_buffer != ';' && *rl_line_buffer != ':'
-	&& cur_color != hq_c && c >= '0' && c <= '9') {
-		if (prev == ' ' || prev == 0 || cur_color == hn_c || rl_end == 1) {
-			char *a = strchr(str + pos, ' ');
-			if (a) {
-				*a = '\0';
-				if (is_number(str + pos))
-					cl = hn_c;
-				*a = ' ';
-			} else {
-				cl = hn_c;
-			}
-			goto END;
-		} else {
-			char cc = c;
-			*(str + pos) = '\0';
-			int ret = is_internal_cmd(str, PARAM_FNAME_NUM, 0, 0);
-			*(str + pos) = cc;
-			if (ret) {
-				cl = hn_c;
-				goto END;
-			}
-		}
-	} */
-
-	size_t quote[2] = {0};
-	size_t i;
-	for (i = 0; i < (size_t)rl_point; i++) {
-		if (rl_line_buffer[i] == '\'') {
-			if (quote[Q_DOUBLE] == 1
-			|| (i > 0 && rl_line_buffer[i - 1] == '\\'))
-				continue;
-			quote[Q_SINGLE]++;
-			if (quote[Q_SINGLE] > 2)
-				quote[Q_SINGLE] = 1;
-		} else {
-			if (rl_line_buffer[i] == '"') {
-				if (quote[Q_SINGLE] == 1
-				|| (i > 0 && rl_line_buffer[i - 1] == '\\'))
-					continue;
-				quote[Q_DOUBLE]++;
-				if (quote[Q_DOUBLE] > 2)
-					quote[Q_DOUBLE] = 1;
-			}
-		}
-	}
+	if (prev == '\\' || cur == hc_c || (cur == wp_c && space == 0))
+		return NULL;
 
 	if (prev != 0) {
 		switch (prev) {
@@ -127,11 +107,11 @@ rl_highlight(const char *str, const size_t pos, const int flag)
 		case ']': /* fallthrough */
 		case '}': cl = tx_c; break;
 		case '\'':
-			if (cur_color == hq_c && quote[Q_SINGLE] == 2)
+			if (cur == hq_c && q[Q_SINGLE] == 2)
 				cl = tx_c;
 			break;
 		case '"':
-			if (cur_color == hq_c && quote[Q_DOUBLE] == 2)
+			if (cur == hq_c && q[Q_DOUBLE] == 2)
 				cl = tx_c;
 			break;
 		default: break;
@@ -149,55 +129,84 @@ rl_highlight(const char *str, const size_t pos, const int flag)
 	case '7': /* fallthrough */
 	case '8': /* fallthrough */
 	case '9':
-		if (cur_color != hq_c)
+		if (cur != hq_c)
 			cl = hn_c;
 		break;
 	case ' ':
-		if (cur_color != hq_c && cur_color != hc_c)
+		if (cur != hq_c && cur != hc_c)
 			cl = tx_c;
 		break;
-	case '/': cl = (cur_color != hq_c) ? hd_c : cl; break;
+	case '/': cl = (cur != hq_c) ? hd_c : cl; break;
 	case '\'': /* fallthrough */
 	case '"': cl = hq_c; break;
 	case KEY_ENTER: cl = tx_c; break;
 	case '~': /* fallthrough */
-	case '*': cl = (cur_color != hq_c) ? he_c : cl; break;
+	case '*': cl = (cur != hq_c) ? he_c : cl; break;
 	case '=': /* fallthrough */
 	case '(': /* fallthrough */
 	case ')': /* fallthrough */
 	case '[': /* fallthrough */
 	case ']': /* fallthrough */
 	case '{': /* fallthrough */
-	case '}': cl = (cur_color != hq_c) ? hb_c : cl; break;
+	case '}': cl = (cur != hq_c) ? hb_c : cl; break;
 	case '|': /* fallthrough */
 	case '&': /* fallthrough */
-	case ';': cl = (cur_color != hq_c) ? hs_c : cl; break;
-	case '\\': cl = (cur_color != hq_c) ? hw_c : cl; break;
+	case ';': cl = (cur != hq_c) ? hs_c : cl; break;
+	case '\\': cl = (cur != hq_c) ? hw_c : cl; break;
 	case '<': /* fallthrough */
-	case '>': cl = (cur_color != hq_c) ? hr_c : cl; break;
-	case '$': cl = (cur_color != hq_c) ? hv_c : cl; break;
+	case '>': cl = (cur != hq_c) ? hr_c : cl; break;
+	case '$': cl = (cur != hq_c) ? hv_c : cl; break;
 	case '-':
 		if (prev == ' ' || prev == 0)
-			cl = (cur_color != hq_c) ? hp_c : NULL;
+			cl = (cur != hq_c) ? hp_c : NULL;
 		break;
 	case '#':
 		if (prev == ' ' || prev == 0)
-			cl = (cur_color != hq_c) ? hc_c : NULL;
+			cl = (cur != hq_c) ? hc_c : NULL;
 		else
 			cl = tx_c;
 		break;
 	default:
-		if (cur_color != hq_c && cur_color != hc_c
-		&& cur_color != hv_c && cur_color != hp_c)
+		if (cur != hq_c && cur != hc_c && cur != hv_c && cur != hp_c)
 			cl = tx_c;
 		break;
 	}
 
-	if (cur_color == hq_c) {
-		if (quote[Q_SINGLE] == 1 || quote[Q_DOUBLE] == 1)
-			cl = NULL;
+	if (cur == hq_c && (q[Q_SINGLE] == 1 || q[Q_DOUBLE] == 1))
+		cl = NULL;
+
+	return cl;
+}
+
+/* Get the appropriate color for the character at position POS in the string
+ * STR and print the color if SET_COLOR is set to 1 (in which case NULL is
+ * returned); otherwise, just return a pointer to the corresponding color.
+ * This function is used to colorize input, history entries, and accepted
+ * suggestions. */
+char *
+rl_highlight(const char *str, const size_t pos, const int flag)
+{
+	char *cl = NULL;
+
+	if (wrong_cmd == 1 && cur_color == wp_c && rl_end == 0) {
+		fputs(tx_c, stdout); fflush(stdout);
+		rl_redisplay();
+	}
+
+	if (rl_end == 0 && str[pos] == KEY_BACKSPACE
+	&& (pos == 0 || str[pos - 1] != '\\')) {
+		cl = tx_c;
+		goto END;
 	}
 
+	/* Quotes are counted in the input line up to the cursor position */
+	unsigned char quote[2] = {0};
+	for (size_t i = 0; i < (size_t)rl_point; i++)
+		update_quotes(rl_line_buffer, i, quote);
+
+	cl = get_char_color(str, pos, cur_color, quote,
+		strchr(rl_line_buffer, ' ') != NULL);
+
 END:
 	if (flag == SET_COLOR) {
 		if (cl && cl != cur_color) {
@@ -212,7 +221,110 @@ END:
 	return cl;
 }
 
-/* Recolorize current input line starting from rl_point */
+/* Make room for N states in the highlighting cache. */
+static void
+resize_hl_cache(const size_t n)
+{
+	if (n <= hl_cache.size)
+		return;
+
+	hl_cache.size = n + 256;
+	hl_cache.st = xnrealloc(hl_cache.st, hl_cache.size,
+		sizeof(struct hl_state_t));
+}
+
+/* Compute (and cache) the state of the chars in LINE from position START
+ * up to END (not included), starting from the state ST. ST is updated to
+ * the state after the last char. */
+static void
+lex_line(const char *line, const size_t start, const size_t end,
+	struct hl_state_t *st)
+{
+	resize_hl_cache(end);
+
+	for (size_t i = start; i < end; i++) {
+		char *cl = get_char_color(line, i, st->color, st->quote, st->space);
+		if (cl)
+			st->color = cl;
+		update_quotes(line, i, st->quote);
+		if (line[i] == ' ')
+			st->space = 1;
+
+		hl_cache.st[i] = *st;
+	}
+}
+
+/* Return the number of cached states still valid for the line LINE,
+ * whose length is LEN, given the initial color INIT_COLOR. */
+static size_t
+get_valid_states(const char *line, const size_t len, char *init_color)
+{
+	if (!hl_cache.line || hl_cache.init_color != init_color)
+		return 0;
+
+	size_t n = 0;
+	const size_t max = len < hl_cache.len ? len : hl_cache.len;
+	while (n < max && line[n] == hl_cache.line[n])
+		n++;
+
+	return n;
+}
+
+/* Get the highlighting state right before the char at position POS in
+ * the current line (whose length is LEN), coloring the line up to POS if
+ * not cached. */
+static void
+get_state_at(const size_t pos, const size_t len, struct hl_state_t *st)
+{
+	const size_t valid = get_valid_states(rl_line_buffer, len, cur_color);
+
+	if (pos > 0 && valid >= pos) {
+		*st = hl_cache.st[pos - 1];
+	} else if (valid > 0) { /* Color from the last valid state onward */
+		*st = hl_cache.st[valid - 1];
+		lex_line(rl_line_buffer, valid, pos, st);
+	} else {
+		*st = (struct hl_state_t){0};
+		st->color = cur_color;
+		lex_line(rl_line_buffer, 0, pos, st);
+	}
+
+	hl_cache.init_color = cur_color;
+	hl_cache.len = pos;
+}
+
+/* Insert the LEN bytes at STR into the input line and display them
+ * (using the current terminal color). */
+static void
+insert_run(char *str, const size_t len)
+{
+	if (len == 0)
+		return;
+
+	const char c = str[len];
+	str[len] = '\0';
+	rl_insert_text(str);
+	str[len] = c;
+	rl_redisplay();
+}
+
+/* Free the highlighting cache */
+void
+free_hl_cache(void)
+{
+	free(hl_cache.line);
+	free(hl_cache.st);
+	hl_cache.line = NULL;
+	hl_cache.st = NULL;
+	hl_cache.init_color = NULL;
+	hl_cache.len = hl_cache.size = 0;
+}
+
+/* Recolorize current input line starting from rl_point.
+ * States (colors) of chars before the modified part of the line are taken
+ * from the highlighting cache. Chars from the cursor position onward are
+ * colored again and redisplayed, one run of chars of the same color at
+ * a time. */
 void
 recolorize_line(void)
 {
@@ -225,30 +337,28 @@ recolorize_line(void)
 		fputs(tx_c, stdout);
 	}
 
-	int bk_point = rl_point;
+	const int bk_point = rl_point;
 	if (rl_point > 0 && rl_point != rl_end)
 		rl_point--;
 
-	/* Get the current color up to the current cursor position */
-	size_t i;
-	char *cl = NULL;
-	for (i = 0; i < (size_t)rl_point; i++) {
-		cl = rl_highlight(rl_line_buffer, i, INFORM_COLOR);
-		if (cl)
-			cur_color = cl;
-	}
-
-	if (cl)
-		fputs(cl, stdout);
-
 	if (rl_point == 0 && rl_end == 0) {
+		free_hl_cache();
 		UNHIDE_CURSOR;
 		return;
 	}
 
-	int end_bk = rl_end;
-	int start = rl_point > 0 ? rl_point - 1 : 0;
-	char *ss = rl_copy_text(start, rl_end);
+	const int end_bk = rl_end;
+	const int start = rl_point > 0 ? rl_point - 1 : 0;
+
+	/* Get the color (state) right before START */
+	struct hl_state_t st;
+	get_state_at((size_t)start, (size_t)rl_end, &st);
+	if (st.color != cur_color) {
+		cur_color = st.color;
+		fputs(cur_color, stdout);
+	}
+
+	char *line = savestring(rl_line_buffer, (size_t)rl_end);
 	rl_delete_text(start, rl_end);
 	rl_point = rl_end = start;
 
@@ -256,37 +366,36 @@ recolorize_line(void)
 		/* First char of a non-empty recolored line (recovering from wrong cmd) */
 		rl_redisplay();
 
-	i = 0;
-
-	size_t l = 0;
-
-	if (!ss || !*ss)
+	const size_t len = (size_t)end_bk;
+	if (!line[start])
 		goto EXIT;
 
-	/* Loop through each char from cursor position onward and colorize it. */
-	char t[PATH_MAX + 1];
-	for (;ss[i]; i++) {
-		rl_highlight(ss, i, SET_COLOR);
-		/* Redisplay the current char with the appropriate color */
-		if ((signed char)ss[i] < 0) {
-			t[l++] = ss[i];
-
-			if ((signed char)ss[i + 1] >= 0) {
-				t[l] = '\0';
-				l = 0;
-				rl_insert_text(t);
-				rl_redisplay();
-			}
-			continue;
+	/* Color each char from START onward, and redisplay runs of chars of the
+	 * same color. Colors are changed only at the beginning of a char (not
+	 * in the middle of a UTF-8 sequence). */
+	size_t run = (size_t)start;
+	for (size_t i = (size_t)start; i < len; i++) {
+		lex_line(line, i, i + 1, &st);
+
+		if (st.color != cur_color && ((unsigned char)line[i] & 0xC0) != 0x80) {
+			insert_run(line + run, i - run);
+			run = i;
+			cur_color = st.color;
+			fputs(cur_color, stdout);
 		}
-		t[0] = ss[i];
-		t[1] = '\0';
-		rl_insert_text(t);
-		rl_redisplay();
+	}
+
+	insert_run(line + run, len - run);
+
+	if (st.color != cur_color) {
+		cur_color = st.color;
+		fputs(cur_color, stdout);
 	}
 
 EXIT:
-	free(ss);
+	free(hl_cache.line);
+	hl_cache.line = line;
+	hl_cache.len = len;
 	rl_point = bk_point;
 	UNHIDE_CURSOR;
 }
@@ -12,6 +12,7 @@
 
 __BEGIN_DECLS
 
+void free_hl_cache(void);
 char *rl_highlight(char *str, const size_t pos, const int flag);
 void recolorize_line(void);
 
@@ -0,0 +1,213 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* idcache.c -- cache user and group names */
+
+/* User and group names (used by the long view and to sort by owner/group)
+ * are resolved lazily: the first time a UID/GID is seen, its name is
+ * looked up via getpwuid_r(3)/getgrgid_r(3) and stored in a small
+ * open-addressed hash table (same approach as ext_table_init() in
+ * listing.c, except that these tables grow as new IDs are inserted).
+ * IDs without a name are cached as well (name is NULL), so that each ID is
+ * resolved only once.
+ *
+ * This replaces loading the whole passwd and group databases at startup
+ * (via getpwent(3)/getgrent(3)), which is slow on systems with lots of
+ * accounts (e.g. LDAP/SSSD), and scanning them for each listed file. */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <grp.h>    /* getgrgid_r() */
+#include <pwd.h>    /* getpwuid_r() */
+#include <string.h> /* strlen() */
+
+#include "aux.h"    /* next_pow2(), xnmalloc() */
+#include "idcache.h"
+
+#define ID_CACHE_INIT_SIZE 16
+/* Initial size of the buffer used by getpwuid_r(3) and getgrgid_r(3). If
+ * not enough, it is doubled up to ID_BUF_MAX_SIZE. */
+#define ID_BUF_INIT_SIZE 1024
+#define ID_BUF_MAX_SIZE  (1024 * 1024)
+
+struct id_entry_t {
+	char  *name; /* NULL if the ID has no name */
+	size_t namlen;
+	id_t   id;
+	int    used;
+};
+
+struct id_cache_t {
+	struct id_entry_t *table;
+	size_t mask;
+	size_t n; /* Number of used slots */
+};
+
+static struct id_cache_t users = {NULL, 0, 0};
+static struct id_cache_t groups = {NULL, 0, 0};
+
+/* Return the slot for the ID ID in the cache C: either the slot holding
+ * this ID, or the empty slot where it should be inserted. */
+static struct id_entry_t *
+id_cache_slot(const struct id_cache_t *c, const id_t id)
+{
+	/* Mix, then mask */
+	size_t idx = ((size_t)id * (size_t)HASH_MULTIPLIER) & c->mask;
+
+	while (c->table[idx].used == 1 && c->table[idx].id != id)
+		idx = (idx + 1) & c->mask;
+
+	return &c->table[idx];
+}
+
+/* Make sure there is room in the cache C for one more entry. */
+static void
+id_cache_reserve(struct id_cache_t *c)
+{
+	const size_t size = c->table ? c->mask + 1 : 0;
+	if (c->table && (double)(c->n + 1) <= (double)size * TABLE_LOAD_FACTOR)
+		return;
+
+	const size_t new_size = size > 0 ? next_pow2(size + 1)
+		: ID_CACHE_INIT_SIZE;
+	struct id_cache_t new_c = {NULL, new_size - 1, c->n};
+	new_c.table = xcalloc(new_size, sizeof(struct id_entry_t));
+
+	for (size_t i = 0; i < size; i++) {
+		if (c->table[i].used == 1)
+			*id_cache_slot(&new_c, c->table[i].id) = c->table[i];
+	}
+
+	free(c->table);
+	*c = new_c;
+}
+
+static void
+id_cache_free(struct id_cache_t *c)
+{
+	if (!c->table)
+		return;
+
+	for (size_t i = 0; i <= c->mask; i++)
+		free(c->table[i].name);
+
+	free(c->table);
+	*c = (struct id_cache_t){NULL, 0, 0};
+}
+
+/* Return a copy of the name of the user whose UID is UID, or NULL if
+ * not found. */
+static char *
+lookup_user_name(const uid_t uid)
+{
+#if defined(__ANDROID__)
+	UNUSED(uid);
+	return NULL;
+#else
+# ifndef __HAIKU__
+	/* Some systems (BSD) may have multiple UIDs 0 (e.g.: "root" and "toor").
+	 * This is known as a root alias. Let's always use "root" for UID 0
+	 * (this is what stat(1), ls(1), and most file managers do). */
+	if (uid == 0)
+		return savestring("root", 4);
+# endif /* !__HAIKU__ */
+
+	struct passwd pw;
+	struct passwd *res = NULL;
+	size_t size = ID_BUF_INIT_SIZE;
+	char *buf = xnmalloc(size, sizeof(char));
+
+	int ret;
+	while ((ret = getpwuid_r(uid, &pw, buf, size, &res)) == ERANGE
+	&& size < ID_BUF_MAX_SIZE) {
+		size *= 2;
+		buf = xnrealloc(buf, size, sizeof(char));
+	}
+
+	char *name = (ret == 0 && res && res->pw_name)
+		? savestring(res->pw_name, strlen(res->pw_name)) : NULL;
+
+	free(buf);
+	return name;
+#endif /* __ANDROID__ */
+}
+
+/* Return a copy of the name of the group whose GID is GID, or NULL if
+ * not found. */
+static char *
+lookup_group_name(const gid_t gid)
+{
+	struct group gr;
+	struct group *res = NULL;
+	size_t size = ID_BUF_INIT_SIZE;
+	char *buf = xnmalloc(size, sizeof(char));
+
+	int ret;
+	while ((ret = getgrgid_r(gid, &gr, buf, size, &res)) == ERANGE
+	&& size < ID_BUF_MAX_SIZE) {
+		size *= 2;
+		buf = xnrealloc(buf, size, sizeof(char));
+	}
+
+	char *name = (ret == 0 && res && res->gr_name)
+		? savestring(res->gr_name, strlen(res->gr_name)) : NULL;
+
+	free(buf);
+	return name;
+}
+
+/* Return the name of the user whose UID is UID (or NULL if this UID has no
+ * name), storing its length in NAMLEN. The returned string is owned by the
+ * cache: it must not be freed, and it is valid until free_id_cache(). */
+char *
+get_user_name(const uid_t uid, size_t *namlen)
+{
+	struct id_entry_t *e = users.table
+		? id_cache_slot(&users, (id_t)uid) : NULL;
+
+	if (!e || e->used == 0) {
+		id_cache_reserve(&users);
+		e = id_cache_slot(&users, (id_t)uid);
+		e->name = lookup_user_name(uid);
+		e->namlen = e->name ? strlen(e->name) : 0;
+		e->id = (id_t)uid;
+		e->used = 1;
+		users.n++;
+	}
+
+	*namlen = e->namlen;
+	return e->name;
+}
+
+/* Same as get_user_name(), but for the group whose GID is GID. */
+char *
+get_group_name(const gid_t gid, size_t *namlen)
+{
+	struct id_entry_t *e = groups.table
+		? id_cache_slot(&groups, (id_t)gid) : NULL;
+
+	if (!e || e->used == 0) {
+		id_cache_reserve(&groups);
+		e = id_cache_slot(&groups, (id_t)gid);
+		e->name = lookup_group_name(gid);
+		e->namlen = e->name ? strlen(e->name) : 0;
+		e->id = (id_t)gid;
+		e->used = 1;
+		groups.n++;
+	}
+
+	*namlen = e->namlen;
+	return e->name;
+}
+
+void
+free_id_cache(void)
+{
+	id_cache_free(&users);
+	id_cache_free(&groups);
+}
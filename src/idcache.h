@@ -0,0 +1,21 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* idcache.h */
+
+#ifndef CLIFM_IDCACHE_H
+#define CLIFM_IDCACHE_H
+
+__BEGIN_DECLS
+
+void free_id_cache(void);
+char *get_group_name(const gid_t gid, size_t *namlen);
+char *get_user_name(const uid_t uid, size_t *namlen);
+
+__END_DECLS
+
+#endif /* CLIFM_IDCACHE_H */
@@ -10,8 +10,8 @@
 #include "helpers.h"
 
 #include <errno.h>
-#include <grp.h> /* getgrouplist(), getgrent(), setgrent(), endgrent() */
-#include <pwd.h> /* getpwent(), setpwent(), endpwent() */
+#include <grp.h> /* getgrouplist() */
+#include <pwd.h> /* getpwuid() */
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -37,7 +37,7 @@
 
 #include "autocmds.h" /* reset_opts() */
 #include "aux.h"
-#include "checks.h" /* truncate_file(), is_number() */
+#include "checks.h" /* truncate_file(), is_number(), check_third_party_cmds() */
 #include "config.h"
 #include "jump.h" /* add_to_jumpdb() */
 #include "misc.h"
@@ -45,9 +45,11 @@
 #include "prompt.h" /* set_prompt_options() */
 #include "sanitize.h"
 #include "selection.h"
-#include "selset.h" /* devino_set_(destroy,init,insert) */
+#include "selset.h" /* devino_set_*(), sel_index_clear() */
 #include "sort.h"
 #include "spawn.h"
+#include "tags.h" /* build_tags_index() */
+#include "trace.h" /* startup_trace() */
 
 /* We need this for get_user_groups() */
 #if !defined(NGROUPS_MAX)
@@ -249,6 +251,7 @@ init_conf_struct(void)
 	conf.splash_screen = UNSET;
 	conf.suggest_filetype_color = DEF_SUG_FILETYPE_COLOR;
 	conf.suggestions = UNSET;
+	conf.tags_db = DEF_TAGS_DB;
 	conf.term_title = DEF_TERM_TITLE;
 	conf.time_follows_sort = DEF_TIME_FOLLOWS_SORT;
 	conf.timestamp_mark = DEF_TIMESTAMP_MARK;
@@ -281,94 +284,6 @@ init_conf_struct(void)
 	init_shades();
 }
 
-static void
-get_sysusers(void)
-{
-	if (sys_users || xargs.stat > 0 || prop_fields.ids != PROP_ID_NAME
-	|| (xargs.list_and_quit == 1 && conf.long_view != 1))
-		return;
-
-#if defined(__ANDROID__)
-	return;
-#else
-	/* It may happen (for example on DragonFly) that the passwd database
-	 * is not properly rewound (for whatever reason). Let's make sure it is. */
-	setpwent();
-	size_t n = 0;
-	while (getpwent())
-		n++;
-
-	if (n == 0) {
-		endpwent();
-		sys_users = NULL;
-		return;
-	}
-
-	setpwent();
-	sys_users = xnmalloc(n + 1, sizeof(struct groups_t));
-
-	struct passwd *p;
-	n = 0;
-	while ((p = getpwent())) {
-#ifndef __HAIKU__
-		/* Some systems (BSD) may have multiple UIDs 0 (e.g.: "root" and "toor").
-		 * This is known as a root alias. Let's always use "root" for UID 0
-		 * (this is what stat(1), ls(1), and most file managers do). */
-		const char *name = p->pw_uid == 0 ? "root" : p->pw_name;
-#else
-		const char *name = p->pw_name;
-#endif /* !__HAIKU__ */
-		const size_t namlen = strlen(name);
-		sys_users[n].name = savestring(name, namlen);
-		sys_users[n].namlen = namlen;
-		sys_users[n++].id = p->pw_uid;
-	}
-
-	endpwent();
-	sys_users[n].name = NULL;
-	sys_users[n].namlen = 0;
-	sys_users[n].id = 0;
-#endif /* __ANDROID__ */
-}
-
-static void
-get_sysgroups(void)
-{
-	if (sys_groups || prop_fields.ids != PROP_ID_NAME
-	|| prop_fields.no_group == 1 || xargs.stat > 0
-	|| (xargs.list_and_quit == 1 && conf.long_view != 1))
-		return;
-
-	setgrent();
-
-	size_t n = 0;
-	while (getgrent())
-		n++;
-
-	if (n == 0) {
-		endgrent();
-		sys_groups = NULL;
-		return;
-	}
-
-	setgrent();
-	sys_groups = xnmalloc(n + 1, sizeof(struct groups_t));
-
-	const struct group *g;
-	n = 0;
-	while ((g = getgrent())) {
-		const size_t namlen = strlen(g->gr_name);
-		sys_groups[n].name = savestring(g->gr_name, namlen);
-		sys_groups[n].namlen = namlen;
-		sys_groups[n++].id = g->gr_gid;
-	}
-
-	endgrent();
-	sys_groups[n].name = NULL;
-	sys_groups[n].namlen = 0;
-	sys_groups[n].id = 0;
-}
-
 void
 set_prop_fields(const char *line)
 {
@@ -422,14 +337,9 @@ set_prop_fields(const char *line)
 		prop_fields.len += conf.prop_fields_gap;
 	if (prop_fields.links != 0)
 		prop_fields.len += conf.prop_fields_gap;
-	if (prop_fields.ids != 0) {
+	if (prop_fields.ids != 0)
 		prop_fields.len += conf.prop_fields_gap
 			+ (prop_fields.no_group == 0); /* Space between user and group */
-		if (prop_fields.ids == PROP_ID_NAME) {
-			get_sysusers();
-			get_sysgroups();
-		}
-	}
 	/* The length of the date field is calculated by check_time_str() */
 }
 
@@ -942,6 +852,10 @@ load_tags(void)
 	free(t);
 
 	tags[tags_n] = NULL;
+
+#ifndef _NO_TAGS
+	build_tags_index();
+#endif /* !_NO_TAGS */
 }
 
 /* Make sure no entry in the directory history is absent in the jump database.
@@ -1553,9 +1467,16 @@ set_templates_dir(void)
 	return buf;
 }
 
+/* Load the list of file templates. Since templates are only used by the
+ * 'n' command (and its completion), this is done on first use. */
 void
 load_file_templates(void)
 {
+	static int templates_loaded = 0;
+	if (templates_loaded == 1)
+		return;
+	templates_loaded = 1;
+
 	templates_dir = set_templates_dir();
 	if (!templates_dir || !*templates_dir)
 		return;
@@ -1733,7 +1654,7 @@ unset_xargs(void)
  * If DO_STAT is set, fstatat is called to get inode and device number of
  * each selected file . Otherwise, the values are taken from the sel_elements
  * struct itself. */
-static int
+int
 set_sel_devino(const int do_stat)
 {
 	free(sel_devino);
@@ -1775,70 +1696,34 @@ get_sel_files(void)
 	if (selfile_ok == 0 || config_ok == 0 || !sel_file)
 		return FUNC_FAILURE;
 
-	const size_t selnbk = sel_n;
 	/* First, clear the sel array, in case it was already used. */
 	if (sel_n > 0) {
 		for (size_t i = sel_n; i-- > 0;)
 			free(sel_elements[i].name);
 	}
 	sel_n = 0;
+	sel_index_clear();
 
 	/* Open the tmp sel file and load its contents into the sel array. */
 	int fd;
 	FILE *fp = open_fread(sel_file, &fd);
-	/*  sel_elements = xcalloc(1, sizeof(char *)); */
-	if (!fp)
+	if (!fp) {
+		sel_file_synced();
 		return FUNC_FAILURE;
-
-	struct stat a;
-	/* Since this file contains only paths, PATH_MAX should be enough. */
-	char line[PATH_MAX + 1]; *line = '\0';
-	while (fgets(line, (int)sizeof(line), fp) != NULL) {
-		size_t len = *line ? strnlen(line, sizeof(line)) : 0;
-		if (len == 0) continue;
-
-		if (line[len - 1] == '\n') {
-			len--;
-			line[len] = '\0';
-		}
-
-		/* Remove the ending slash: fstatat() won't take a symlink to dir as
-		 * a symlink (but as a dir), if the filename ends with a slash. */
-		if (len > 1 && line[len - 1] == '/')
-			line[--len] = '\0';
-
-		if (!*line || *line == '#' || len == 0)
-			continue;
-
-		char *l = line;
-		if (IS_FILE_URI(l, len)) l += FILE_URI_PREFIX_LEN;
-		char *file = url_decode(l);
-
-		if (!file || fstatat(XAT_FDCWD, file, &a, AT_SYMLINK_NOFOLLOW) == -1) {
-			free(file);
-			continue;
-		}
-
-		sel_elements = xnrealloc(sel_elements, sel_n + 2, sizeof(struct sel_t));
-		sel_elements[sel_n].name = file;
-		sel_elements[sel_n].dev = a.st_dev;
-		sel_elements[sel_n].ino = a.st_ino;
-		sel_elements[sel_n++].size = (off_t)UNSET;
-
-		sel_elements[sel_n].name = NULL;
-		sel_elements[sel_n].size = (off_t)UNSET;
 	}
 
+	const size_t dropped = read_sel_file(fp);
 	fclose(fp);
 
 	if (sel_n > 0)
 		set_sel_devino(0);
 
-	/* If previous and current number of selected files don't match (mostly
-	 * because some selected files were removed), recreate the selections
-	 * file to reflect the current state. */
-	if (selnbk != sel_n)
+	/* If some selected files could not be loaded (mostly because they were
+	 * removed), recreate the selections file to reflect the current state. */
+	if (dropped > 0)
 		save_sel();
+	else
+		sel_file_synced();
 
 	return FUNC_SUCCESS;
 }
@@ -2371,6 +2256,37 @@ get_aliases(void)
 	fclose(fp);
 }
 
+/* Load actions (plugins) and aliases, get the list of programs in PATH,
+ * and check for third-party programs. None of these is needed to list
+ * files: main() calls this function right after the first listing, unless
+ * they are needed before (e.g. to run commands from the profile file). */
+void
+load_cmds_data(void)
+{
+	static int cmds_data_loaded = 0;
+	if (cmds_data_loaded == 1)
+		return;
+	cmds_data_loaded = 1;
+
+	load_actions();
+	startup_trace("load_actions");
+	get_aliases();
+	startup_trace("get_aliases");
+
+	/* Get the list of available programs in PATH to be used by the
+	 * custom TAB-completion function (tab_complete(), in tabcomp.c). */
+	get_path_programs();
+	startup_trace("get_path_programs");
+
+	/* Check third-party programs availability: finders (fzf, fnf, smenu),
+	 * udevil, and udisks2. */
+	check_third_party_cmds();
+#ifndef _NO_FZF
+	check_completion_mode();
+#endif /* _NO_FZF */
+	startup_trace("check_third_party_cmds");
+}
+
 static void
 write_dirhist(char *line, ssize_t len)
 {
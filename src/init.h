@@ -36,6 +36,7 @@ void init_workspaces(void);
 void init_workspaces_opts(void);
 int  load_actions(void);
 int  load_bookmarks(void);
+void load_cmds_data(void);
 int  load_dirhist(void);
 void load_file_templates(void);
 void load_jumpdb(void);
@@ -45,6 +46,7 @@ int  load_remotes(void);
 void load_tags(void);
 int  restore_shell(void);
 void set_prop_fields(const char *line);
+int  set_sel_devino(const int do_stat);
 void unset_xargs(void);
 
 __END_DECLS
@@ -60,21 +60,32 @@
 #include "checks.h"
 #include "colors.h"
 #include "dothidden.h" /* load_dothidden, check_dothidden, free_dothidden */
+#include "frame.h"     /* frame_start(), frame_puts(), frame_end() */
 #include "fs_events.h" /* set_events_checker */
 #ifndef _NO_ICONS
 # include "icons.h"
 #endif /* !_NO_ICONS */
-#include "init.h" /* get_sel_files () */
+#include "idcache.h" /* get_user_name(), get_group_name() */
 #include "messages.h"
 #include "misc.h"
 #include "properties.h" /* print_analysis_stats() */
 #include "long_view.h"  /* print_entry_props() */
 #include "sanitize.h"
+#include "selection.h" /* sync_sel_files() */
 #include "selset.h" /* devino_set_contains */
 #include "sort.h"
 #include "spawn.h"
+#include "tags.h" /* is_tagged_file() */
+#include "trace.h" /* startup_trace(), print_startup_trace() */
 #include "xdu.h"        /* dir_size() */
 
+#ifdef LIST_SPEED_TEST
+/* Time spent looking up extension colors (and number of lookups) by
+ * load_regfile_info() during the last call to list_dir(). */
+static double ext_lookup_secs = 0;
+static size_t ext_lookups = 0;
+#endif /* LIST_SPEED_TEST */
+
 /* Macros for the return value of the pager_run function */
 #define PAGER_RET_OK   0
 #define PAGER_RET_BACK 1
@@ -299,42 +310,9 @@ get_dir_icon(const filesn_t n)
 	}
 }
 
-#define TABLE_LOAD_FACTOR 0.75
-/* 0.75: Do not allow the table to be loaded beyond 75% (i.e. make sure there
- * is always at least 25% free slots). This value balances space vs. probe
- * length for linear probing: keeps average probe counts low (good cache/branch
- * behavior) while using memory efficiently. */
-
-/* Multiplicative mixing constant (Knuth for 32-bit, Fibonacci for 64-bit),
- * used to quickly scramble hashes before masking; improves bit diffusion
- * for power-of-two tables. */
-#if SIZE_MAX > UINT32_MAX
-# define HASH_MULTIPLIER 11400714819323198485ULL /* 64-bit Fibonacci constant */
-#else
-# define HASH_MULTIPLIER 2654435761ULL /* Knuth's 32-bit constant */
-#endif
-
 static size_t ext_table_mask = 0;
 static size_t ext_table_size = 0;
 
-/* Return the power-of-two value closest to V + 1. */
-static size_t
-next_pow2(size_t v) {
-	if (v == 0)
-		return 1;
-
-	v--;
-	v |= v >> 1;
-	v |= v >> 2;
-	v |= v >> 4;
-	v |= v >> 8;
-	v |= v >> 16;
-#if SIZE_MAX > UINT32_MAX
-	v |= v >> 32;
-#endif
-	return ++v;
-}
-
 /* Build an open-addressed lookup table mapping extension name hashes (in
  * ext_icons_hashes[]) to an index in icon_ext[].
  *
@@ -862,6 +840,29 @@ print_dir_cmds(void)
 		printf("%s%s%s %s\n", dn_c, ptr, df_c, history[i].cmd);
 }
 
+/* If MaxFiles is set, only a window of MaxFiles entries, starting at
+ * g_list_offset, is listed (and only these entries are taken into account
+ * to compute the layout). Return the index of the first listed entry, and
+ * store in LAST the index following the last listed entry.
+ * g_list_offset is adjusted, if needed, to fit the current list of files. */
+filesn_t
+get_list_window(filesn_t *last)
+{
+	if (conf.max_files == UNSET || (filesn_t)conf.max_files >= g_files_num) {
+		*last = g_files_num;
+		return 0;
+	}
+
+	const filesn_t max = (filesn_t)conf.max_files;
+	if (g_list_offset > g_files_num - max)
+		g_list_offset = g_files_num - max;
+	if (g_list_offset < 0)
+		g_list_offset = 0;
+
+	*last = g_list_offset + max;
+	return g_list_offset;
+}
+
 static int
 post_listing(DIR *dir, const int reset_pager, const int autocmd_ret)
 {
@@ -870,8 +871,11 @@ post_listing(DIR *dir, const int reset_pager, const int autocmd_ret)
 	if (dir && closedir(dir) == -1)
 		return FUNC_FAILURE;
 
-	if (xargs.list_and_quit == 1)
+	if (xargs.list_and_quit == 1) {
+		startup_trace("list_files");
+		print_startup_trace();
 		exit(exit_code);
+	}
 
 	if (conf.pager_once == 0) {
 		if (reset_pager == 1 && (conf.pager < 2
@@ -885,8 +889,14 @@ post_listing(DIR *dir, const int reset_pager, const int autocmd_ret)
 	const size_t s_files = (size_t)g_files_num;
 
 	if (g_pager_quit == 0 && conf.max_files != UNSET
-	&& g_files_num > (filesn_t)conf.max_files)
-		printf("... (%d/%zu)\n", conf.max_files, s_files);
+	&& g_files_num > (filesn_t)conf.max_files) {
+		filesn_t last = 0;
+		const filesn_t first = get_list_window(&last);
+		if (first == 0 || last <= first) /* Nothing listed if MaxFiles is 0 */
+			printf("... (%zd/%zu)\n", last - first, s_files);
+		else
+			printf("... (%zd-%zd/%zu)\n", first + 1, last, s_files);
+	}
 
 	print_div_line();
 
@@ -943,7 +953,8 @@ post_listing(DIR *dir, const int reset_pager, const int autocmd_ret)
  * What's missing? It only goes downwards. To go backwards, use the
  * terminal scrollback function */
 static int
-run_pager(const int columns_n, int *reset_pager, filesn_t *i, size_t *counter)
+pager_prompt(const int columns_n, int *reset_pager, filesn_t *i,
+	size_t *counter)
 {
 	fputs(PAGER_LABEL, stdout);
 
@@ -1018,6 +1029,18 @@ run_pager(const int columns_n, int *reset_pager, filesn_t *i, size_t *counter)
 	return PAGER_RET_OK;
 }
 
+/* Write the part of the list composed so far before prompting the user.
+ * The frame is resumed afterwards (frame_start() flushes whatever the pager
+ * printed to stdout, keeping the output in order). */
+static int
+run_pager(const int columns_n, int *reset_pager, filesn_t *i, size_t *counter)
+{
+	frame_end();
+	const int ret = pager_prompt(columns_n, reset_pager, i, counter);
+	frame_start();
+	return ret;
+}
+
 static int
 has_file_type_char(const filesn_t i)
 {
@@ -1038,23 +1061,21 @@ has_file_type_char(const filesn_t i)
 }
 
 static void
-get_longest_filename(const filesn_t n, const size_t eln_len)
+get_longest_filename(const size_t eln_len)
 {
 	const int conf_no_eln = conf.no_eln;
 	const int checks_classify = checks.classify;
 	const int conf_file_counter = conf.file_counter;
 	const int conf_colorize = conf.colorize;
-	const int conf_listing_mode = conf.listing_mode;
-	const int conf_max_files = conf.max_files;
 
-	const filesn_t c_max_files = (filesn_t)conf_max_files;
-	filesn_t i = (conf_max_files != UNSET && c_max_files < n) ? c_max_files : n;
+	filesn_t i = 0;
+	const filesn_t first = get_list_window(&i);
 	filesn_t longest_index = -1;
 
 	const size_t max = checks.min_name_trunc == 1
 		? (size_t)conf.min_name_trunc : (size_t)conf.max_name_len;
 
-	while (--i >= 0) {
+	while (--i >= first) {
 		file_info[i].eln_n = conf_no_eln == 1 ? -1 : DIGINUM(i + 1);
 
 		size_t file_len = file_info[i].len;
@@ -1081,9 +1102,7 @@ get_longest_filename(const filesn_t n, const size_t eln_len)
 
 		if (total_len > longest.name_len) {
 			longest_index = i;
-			if (conf_listing_mode == VERTLIST || conf_max_files == UNSET
-			|| i < c_max_files)
-				longest.name_len = total_len;
+			longest.name_len = total_len;
 		}
 	}
 
@@ -1183,6 +1202,11 @@ get_ind_char(const filesn_t index, char **ind_chr)
 		return li_cb;
 	}
 
+	if (file_info[index].tagged == 1) {
+		*ind_chr = term_caps.unicode == 1 ? TAGGED_STR_U : TAGGED_STR;
+		return mi_c;
+	}
+
 	if (file_info[index].symlink == 1 && checks.lnk_char == 1) {
 		*ind_chr = term_caps.unicode == 1 ? LINK_STR_U : LINK_STR;
 		return lc_c;
@@ -1215,8 +1239,8 @@ compute_maxes(void)
 {
 	struct maxes_t maxes = {0};
 
-	filesn_t i = xargs.max_files > 0 ? (filesn_t)xargs.max_files
-		: (conf.max_files > 0 ? conf.max_files : g_files_num);
+	filesn_t i = 0;
+	const filesn_t first = get_list_window(&i);
 
 	const int conf_file_counter = conf.file_counter;
 	const int prop_fields_size = prop_fields.size;
@@ -1225,10 +1249,7 @@ compute_maxes(void)
 	const int prop_fields_links = prop_fields.links;
 	const int prop_fields_blocks = prop_fields.blocks;
 
-	if (i > g_files_num)
-		i = g_files_num;
-
-	while (--i >= 0) {
+	while (--i >= first) {
 		int t = 0;
 		if (file_info[i].dir == 1 && conf_file_counter == 1) {
 			t = DIGINUM_BIG(file_info[i].filesn);
@@ -1320,6 +1341,51 @@ compute_maxes(void)
 	return maxes;
 }
 
+/* Same as MOVE_CURSOR_RIGHT(), but appending to the current frame. */
+static void
+frame_move_right(const int n)
+{
+	frame_puts("\x1b[");
+	frame_num(n, 0);
+	frame_putc('C');
+}
+
+/* Append the ELN of the file at index I, right aligned to PAD columns. */
+static void
+frame_eln(const filesn_t i, const int pad)
+{
+	frame_puts(el_c);
+	frame_num((intmax_t)i + 1, pad);
+	frame_puts(df_c);
+}
+
+/* Append the truncated name W of the file at index I, followed by the
+ * truncation indicator and, if the extension was preserved (TRUNC_EXT), the
+ * file extension. If COLORS is set, the indicator is colored (tt_c). */
+static void
+frame_trunc_name(const filesn_t i, const struct wtrunc_t *wtrunc,
+	const wchar_t *w, const int colors)
+{
+	frame_printf("%ls", w);
+	if (wtrunc->diff > 0)
+		frame_puts(gen_diff_str(wtrunc->diff));
+
+	if (colors == 1) {
+		frame_puts("\x1b[0m");
+		frame_puts(tt_c);
+		frame_putc(TRUNC_FILE_CHR);
+		frame_puts("\x1b[0m");
+		if (wtrunc->type == TRUNC_EXT) {
+			frame_puts(file_info[i].color);
+			frame_puts(file_info[i].ext_name);
+		}
+	} else {
+		frame_putc(TRUNC_FILE_CHR);
+		if (wtrunc->type == TRUNC_EXT)
+			frame_puts(file_info[i].ext_name);
+	}
+}
+
 static void
 print_long_mode(int *reset_pager, const int eln_len)
 {
@@ -1346,18 +1412,16 @@ print_long_mode(int *reset_pager, const int eln_len)
 	g_pager_quit = g_pager_help = 0;
 
 	/* Cache conf struct values for faster access. */
-	const filesn_t conf_max_files = conf.max_files;
 	const int conf_no_eln = conf.no_eln;
 
-	filesn_t i;
-	const filesn_t f = g_files_num; /* Cache global variable. */
+	filesn_t i, f = 0;
+	const filesn_t first = get_list_window(&f);
 	const size_t s_term_lines = term_lines > 2 ? (size_t)(term_lines - 2) : 0;
 	size_t pager_counter = 0;
 
-	for (i = 0; i < f; i++) {
-		if (conf_max_files != UNSET && i == conf_max_files)
-			break;
+	frame_start();
 
+	for (i = first; i < f; i++) {
 		if (conf.pager == 1 || (*reset_pager == 0 && conf.pager > 1
 		&& g_files_num >= (filesn_t)conf.pager)) {
 			if (pager_counter > s_term_lines) {
@@ -1381,19 +1445,21 @@ print_long_mode(int *reset_pager, const int eln_len)
 		char *ind_chr = NULL;
 		const char *ind_chr_color = get_ind_char(i, &ind_chr);
 
-		if (conf_no_eln == 0) {
-			printf("%s%*zd%s%s%s%s", el_c, eln_len, i + 1, df_c,
-				ind_chr_color, ind_chr, df_c);
-		} else {
-			printf("%s%s%s", ind_chr_color, ind_chr, df_c);
-		}
+		if (conf_no_eln == 0)
+			frame_eln(i, eln_len);
+
+		frame_puts(ind_chr_color);
+		frame_puts(ind_chr);
+		frame_puts(df_c);
 
 		/* Print the remaining part of the entry. */
 		print_entry_props(&file_info[i], &maxes, have_xattr);
 	}
 
 	if (g_pager_quit == 1)
-		printf("... (%zd/%zd)\n", i, g_files_num);
+		frame_printf("... (%zd/%zd)\n", i, g_files_num);
+
+	frame_end();
 }
 
 /* Return the minimal number of columns we can use for the current list
@@ -1416,8 +1482,11 @@ get_columns(void)
 		n = 1;
 
 	/* If we have only three files, we don't want four columns. */
-	if (n > (size_t)g_files_num)
-		n = (size_t)g_files_num > 0 ? (size_t)g_files_num : 1;
+	filesn_t last = 0;
+	const filesn_t first = get_list_window(&last);
+	const filesn_t listed = last - first;
+	if (n > (size_t)listed)
+		n = listed > 0 ? (size_t)listed : 1;
 
 	return n;
 }
@@ -1545,83 +1614,39 @@ print_entry_color(int *ind_char, const filesn_t i, const int pad,
 
 	struct wtrunc_t wtrunc = (struct wtrunc_t){0};
 	const void *ptr = construct_filename(i, &wtrunc, max_namelen);
-	const wchar_t *w = wtrunc.type > 0 ? (const wchar_t *)ptr : NULL;
-	const char *n = wtrunc.type == 0 ? (const char *)ptr : NULL;
-
-	const char *trunc_diff = wtrunc.diff > 0 ? gen_diff_str(wtrunc.diff) : "";
 
 	char *ind_chr = NULL;
 	const char *ind_chr_color = get_ind_char(i, &ind_chr);
 
-	const int trunc = wtrunc.type;
-	const char *ext_color = trunc == TRUNC_EXT ? file_info[i].color : "";
-	const char *ext_name  = trunc == TRUNC_EXT ? file_info[i].ext_name : "";
+	if (checks.list_format == ICONS_ELN || checks.list_format == NO_ICONS_ELN)
+		frame_eln(i, pad);
+
+	frame_puts(ind_chr_color);
+	frame_puts(ind_chr);
+	frame_puts(df_c);
 
-	switch (checks.list_format) {
 #ifndef _NO_ICONS
-	case ICONS_NO_ELN:
-		if (trunc > 0) {
-			printf("%s%s%s%s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
-				ind_chr_color, ind_chr, df_c,
-				file_info[i].icon_color, file_info[i].icon,
-				checks.icons_gap, file_info[i].color, w,
-				trunc_diff, tt_c, TRUNC_FILE_CHR,
-				ext_color, ext_name, end_color);
-		} else {
-			printf("%s%s%s%s%s%s%s%s%s", ind_chr_color, ind_chr, df_c,
-				file_info[i].icon_color, file_info[i].icon,
-				checks.icons_gap, file_info[i].color, n, end_color);
-		}
-		break;
-	case ICONS_ELN:
-		if (trunc > 0) {
-			printf("%s%*jd%s%s%s%s%s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
-				el_c, pad, (intmax_t)i + 1, df_c, ind_chr_color, ind_chr,
-				df_c, file_info[i].icon_color, file_info[i].icon,
-				checks.icons_gap, file_info[i].color, w,
-				trunc_diff, tt_c, TRUNC_FILE_CHR,
-				ext_color, ext_name, end_color);
-		} else {
-			printf("%s%*jd%s%s%s%s%s%s%s%s%s%s", el_c, pad,
-				(intmax_t)i + 1, df_c, ind_chr_color, ind_chr, df_c,
-				file_info[i].icon_color, file_info[i].icon,
-				checks.icons_gap, file_info[i].color, n, end_color);
-		}
-		break;
-#endif /* !_NO_ICONS */
-	case NO_ICONS_NO_ELN:
-		if (trunc > 0) {
-			printf("%s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s", ind_chr_color,
-				ind_chr, df_c, file_info[i].color, w, trunc_diff,
-				tt_c, TRUNC_FILE_CHR, ext_color, ext_name, end_color);
-		} else {
-			printf("%s%s%s%s%s%s", ind_chr_color, ind_chr,
-				df_c, file_info[i].color, n, end_color);
-		}
-		break;
-	case NO_ICONS_ELN:
-		if (trunc > 0) {
-			printf("%s%*jd%s%s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
-				el_c, pad, (intmax_t)i + 1, df_c, ind_chr_color, ind_chr,
-				df_c, file_info[i].color, w,
-				trunc_diff, tt_c, TRUNC_FILE_CHR,
-				ext_color, ext_name, end_color);
-		} else {
-			printf("%s%*jd%s%s%s%s%s%s%s", el_c, pad, (intmax_t)i + 1,
-				df_c, ind_chr_color, ind_chr, df_c,
-				file_info[i].color, n, end_color);
-		}
-		break;
-	default: break;
+	if (checks.list_format == ICONS_ELN || checks.list_format == ICONS_NO_ELN) {
+		frame_puts(file_info[i].icon_color);
+		frame_puts(file_info[i].icon);
+		frame_puts(checks.icons_gap);
 	}
+#endif /* !_NO_ICONS */
+
+	frame_puts(file_info[i].color);
+	if (wtrunc.type > 0)
+		frame_trunc_name(i, &wtrunc, (const wchar_t *)ptr, 1);
+	else
+		frame_puts((const char *)ptr);
+	frame_puts(end_color);
 
 	if (end_color == fc_c) {
 		/* We have a directory and classification is on: append directory
 		 * indicator and file counter. */
-		putchar(DIR_CHR);
+		frame_putc(DIR_CHR);
 		if (file_info[i].filesn > 0 && conf.file_counter == 1)
-			fputs(xitoa(file_info[i].filesn), stdout);
-		fputs(df_c, stdout);
+			frame_puts(xitoa(file_info[i].filesn));
+		frame_puts(df_c);
 	}
 
 	if (wtrunc.wname) /* This is NULL most of the time. */
@@ -1634,102 +1659,69 @@ print_entry_nocolor(int *ind_char, const filesn_t i, const int pad,
 {
 	struct wtrunc_t wtrunc = (struct wtrunc_t){0};
 	const void *ptr = construct_filename(i, &wtrunc, max_namelen);
-	const wchar_t *w = wtrunc.type > 0 ? (const wchar_t *)ptr : NULL;
-	const char *n = wtrunc.type == 0 ? (const char *)ptr : NULL;
 
-	const char *trunc_diff = wtrunc.diff > 0 ? gen_diff_str(wtrunc.diff) : "";
 	char *ind_chr = NULL;
 	(void)get_ind_char(i, &ind_chr);
 
-	switch (checks.list_format) {
+	if (checks.list_format == ICONS_ELN || checks.list_format == NO_ICONS_ELN)
+		frame_eln(i, pad);
+
+	frame_puts(ind_chr);
+
 #ifndef _NO_ICONS
-	case ICONS_NO_ELN:
-		if (wtrunc.type > 0) {
-			printf("%s%s%s%ls%s%c%s", ind_chr, file_info[i].icon,
-				checks.icons_gap, w, trunc_diff,
-				TRUNC_FILE_CHR, wtrunc.type == TRUNC_EXT
-				? file_info[i].ext_name : "");
-		} else {
-			printf("%s%s%s%s", ind_chr, file_info[i].icon,
-				checks.icons_gap, n);
-		}
-		break;
-	case ICONS_ELN:
-		if (wtrunc.type > 0) {
-			printf("%s%*jd%s%s%s%s%ls%s%c%s", el_c, pad, (intmax_t)i + 1,
-				df_c, ind_chr, file_info[i].icon, checks.icons_gap,
-				w, trunc_diff, TRUNC_FILE_CHR,
-				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "");
-		} else {
-			printf("%s%*jd%s%s%s%s%s", el_c, pad, (intmax_t)i + 1, df_c,
-				ind_chr, file_info[i].icon,	checks.icons_gap, n);
-		}
-		break;
-#endif /* !_NO_ICONS */
-	case NO_ICONS_NO_ELN:
-		if (wtrunc.type > 0) {
-			printf("%s%ls%s%c%s", ind_chr, w,
-				trunc_diff, TRUNC_FILE_CHR,
-				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "");
-		} else {
-			printf("%s%s", ind_chr, n);
-		}
-		break;
-	case NO_ICONS_ELN:
-		if (wtrunc.type > 0) {
-			printf("%s%*jd%s%s%ls%s%c%s", el_c, pad, (intmax_t)i + 1,
-				df_c, ind_chr, w, trunc_diff, TRUNC_FILE_CHR,
-				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "");
-		} else {
-			printf("%s%*jd%s%s%s", el_c, pad, (intmax_t)i + 1,
-				df_c, ind_chr, n);
-		}
-		break;
-	default: break;
+	if (checks.list_format == ICONS_ELN || checks.list_format == ICONS_NO_ELN) {
+		frame_puts(file_info[i].icon);
+		frame_puts(checks.icons_gap);
 	}
+#endif /* !_NO_ICONS */
+
+	if (wtrunc.type > 0)
+		frame_trunc_name(i, &wtrunc, (const wchar_t *)ptr, 0);
+	else
+		frame_puts((const char *)ptr);
 
 	if (conf.classify == 1) {
 		/* Append file type indicator */
 		switch (file_info[i].type) {
 		case DT_DIR:
 			*ind_char = 0;
-			putchar(DIR_CHR);
+			frame_putc(DIR_CHR);
 			if (file_info[i].filesn > 0 && conf.file_counter == 1)
-				fputs(xitoa(file_info[i].filesn), stdout);
+				frame_puts(xitoa(file_info[i].filesn));
 			break;
 
 		case DT_LNK:
 			if (file_info[i].color == or_c) {
-				putchar(BRK_LNK_CHR);
+				frame_putc(BRK_LNK_CHR);
 			} else if (file_info[i].dir == 1) {
 				*ind_char = 0;
-				putchar(DIR_CHR);
+				frame_putc(DIR_CHR);
 				if (file_info[i].filesn > 0 && conf.file_counter == 1)
-					fputs(xitoa(file_info[i].filesn), stdout);
+					frame_puts(xitoa(file_info[i].filesn));
 			} else {
-				putchar(LINK_CHR);
+				frame_putc(LINK_CHR);
 			}
 			break;
 
 		case DT_REG:
 			if (file_info[i].exec == 1)
-				putchar(EXEC_CHR);
+				frame_putc(EXEC_CHR);
 			else
 				*ind_char = 0;
 			break;
 
-		case DT_BLK: putchar(BLK_CHR); break;
-		case DT_CHR: putchar(CHR_CHR); break;
+		case DT_BLK: frame_putc(BLK_CHR); break;
+		case DT_CHR: frame_putc(CHR_CHR); break;
 #ifdef SOLARIS_DOORS
-		case DT_DOOR: putchar(DOOR_CHR); break;
+		case DT_DOOR: frame_putc(DOOR_CHR); break;
 //		case DT_PORT: break;
 #endif /* SOLARIS_DOORS */
-		case DT_FIFO: putchar(FIFO_CHR); break;
-		case DT_SOCK: putchar(SOCK_CHR); break;
+		case DT_FIFO: frame_putc(FIFO_CHR); break;
+		case DT_SOCK: frame_putc(SOCK_CHR); break;
 #ifdef S_IFWHT
-		case DT_WHT: putchar(WHT_CHR); break;
+		case DT_WHT: frame_putc(WHT_CHR); break;
 #endif /* S_IFWHT */
-		case DT_UNKNOWN: putchar(UNK_CHR); break;
+		case DT_UNKNOWN: frame_putc(UNK_CHR); break;
 		default: *ind_char = 0;
 		}
 	}
@@ -1747,76 +1739,35 @@ print_entry_color_light(int *ind_char, const filesn_t i,
 
 	struct wtrunc_t wtrunc = (struct wtrunc_t){0};
 	const void *ptr = construct_filename(i, &wtrunc, max_namelen);
-	const wchar_t *w = wtrunc.type > 0 ? (const wchar_t *)ptr : NULL;
-	const char *n = wtrunc.type == 0 ? (const char *)ptr : NULL;
-
-	const char *trunc_diff = wtrunc.diff > 0 ? gen_diff_str(wtrunc.diff) : "";
 
-	const int trunc = wtrunc.type;
-	const char *ext_color = trunc == TRUNC_EXT ? file_info[i].color : "";
-	const char *ext_name  = trunc == TRUNC_EXT ? file_info[i].ext_name : "";
+	if (checks.list_format == ICONS_ELN || checks.list_format == NO_ICONS_ELN) {
+		frame_eln(i, pad);
+		frame_putc(' ');
+	}
 
-	switch (checks.list_format) {
 #ifndef _NO_ICONS
-	case ICONS_NO_ELN:
-		if (trunc > 0) {
-			printf("%s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
-				file_info[i].icon_color, file_info[i].icon,
-				checks.icons_gap, file_info[i].color, w,
-				trunc_diff, tt_c, TRUNC_FILE_CHR,
-				ext_color, ext_name, end_color);
-		} else {
-			printf("%s%s%s%s%s%s", file_info[i].icon_color,
-				file_info[i].icon, checks.icons_gap,
-				file_info[i].color, n, end_color);
-		}
-		break;
-	case ICONS_ELN:
-		if (trunc > 0) {
-			printf("%s%*jd%s %s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
-				el_c, pad, (intmax_t)i + 1, df_c, file_info[i].icon_color,
-				file_info[i].icon, checks.icons_gap, file_info[i].color,
-				w, trunc_diff, tt_c, TRUNC_FILE_CHR,
-				ext_color, ext_name, end_color);
-		} else {
-			printf("%s%*jd%s %s%s%s%s%s%s", el_c, pad, (intmax_t)i + 1,
-				df_c, file_info[i].icon_color, file_info[i].icon,
-				checks.icons_gap, file_info[i].color, n, end_color);
-		}
-		break;
-#endif /* !_NO_ICONS */
-	case NO_ICONS_NO_ELN:
-		if (trunc > 0) {
-			printf("%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
-				file_info[i].color, w,
-				trunc_diff, tt_c, TRUNC_FILE_CHR,
-				ext_color, ext_name, end_color);
-		} else {
-			printf("%s%s%s", file_info[i].color, n, end_color);
-		}
-		break;
-	case NO_ICONS_ELN:
-		if (trunc > 0) {
-			printf("%s%*jd%s %s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
-				el_c, pad, (intmax_t)i + 1, df_c, file_info[i].color,
-				w, trunc_diff, tt_c, TRUNC_FILE_CHR,
-				ext_color, ext_name, end_color);
-		} else {
-			printf("%s%*jd%s %s%s%s", el_c, pad, (intmax_t)i + 1, df_c,
-				file_info[i].color, n, end_color);
-		}
-		break;
-	default: break;
+	if (checks.list_format == ICONS_ELN || checks.list_format == ICONS_NO_ELN) {
+		frame_puts(file_info[i].icon_color);
+		frame_puts(file_info[i].icon);
+		frame_puts(checks.icons_gap);
 	}
+#endif /* !_NO_ICONS */
+
+	frame_puts(file_info[i].color);
+	if (wtrunc.type > 0)
+		frame_trunc_name(i, &wtrunc, (const wchar_t *)ptr, 1);
+	else
+		frame_puts((const char *)ptr);
+	frame_puts(end_color);
 
 	if (file_info[i].dir == 1 && conf.classify == 1) {
-		putchar(DIR_CHR);
+		frame_putc(DIR_CHR);
 		if (file_info[i].filesn > 0 && conf.file_counter == 1)
-			fputs(xitoa(file_info[i].filesn), stdout);
+			frame_puts(xitoa(file_info[i].filesn));
 	}
 
 	if (end_color == fc_c)
-		fputs(df_c, stdout);
+		frame_puts(df_c);
 
 	if (wtrunc.wname) /* This is NULL most of the time. */
 		free(wtrunc.wname);
@@ -1828,76 +1779,46 @@ print_entry_nocolor_light(int *ind_char, const filesn_t i,
 {
 	struct wtrunc_t wtrunc = (struct wtrunc_t){0};
 	const void *ptr = construct_filename(i, &wtrunc, max_namelen);
-	const wchar_t *w = wtrunc.type > 0 ? (const wchar_t *)ptr : NULL;
-	const char *n = wtrunc.type == 0 ? (const char *)ptr : NULL;
 
-	const char *trunc_diff = wtrunc.diff > 0 ? gen_diff_str(wtrunc.diff) : "";
+	if (checks.list_format == ICONS_ELN || checks.list_format == NO_ICONS_ELN) {
+		frame_eln(i, pad);
+		frame_putc(' ');
+	}
 
-	switch (checks.list_format) {
 #ifndef _NO_ICONS
-	case ICONS_NO_ELN:
-		if (wtrunc.type > 0) {
-			printf("%s%s%ls%s%c%s", file_info[i].icon,
-				checks.icons_gap, w, trunc_diff, TRUNC_FILE_CHR,
-				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "");
-		} else {
-			printf("%s%s%s", file_info[i].icon, checks.icons_gap, n);
-		}
-		break;
-	case ICONS_ELN:
-		if (wtrunc.type > 0) {
-			printf("%s%*jd%s %s%s%ls%s%c%s", el_c, pad, (intmax_t)i + 1,
-				df_c, file_info[i].icon, checks.icons_gap, w,
-				trunc_diff, TRUNC_FILE_CHR, wtrunc.type == TRUNC_EXT
-				? file_info[i].ext_name : "");
-		} else {
-			printf("%s%*jd%s %s%s%s", el_c, pad, (intmax_t)i + 1, df_c,
-				file_info[i].icon, checks.icons_gap, n);
-		}
-		break;
-#endif /* !_NO_ICONS */
-	case NO_ICONS_NO_ELN:
-		if (wtrunc.type > 0) {
-			printf("%ls%s%c%s", w, trunc_diff, TRUNC_FILE_CHR,
-				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "");
-		} else {
-			fputs(file_info[i].name, stdout);
-		}
-		break;
-	case NO_ICONS_ELN:
-		if (wtrunc.type > 0) {
-			printf("%s%*jd%s %ls%s%c%s", el_c, pad, (intmax_t)i + 1,
-				df_c, w, trunc_diff, TRUNC_FILE_CHR,
-				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "");
-		} else {
-			printf("%s%*jd%s %s", el_c, pad, (intmax_t)i + 1, df_c, n);
-		}
-		break;
-	default: break;
+	if (checks.list_format == ICONS_ELN || checks.list_format == ICONS_NO_ELN) {
+		frame_puts(file_info[i].icon);
+		frame_puts(checks.icons_gap);
 	}
+#endif /* !_NO_ICONS */
+
+	if (wtrunc.type > 0)
+		frame_trunc_name(i, &wtrunc, (const wchar_t *)ptr, 0);
+	else
+		frame_puts((const char *)ptr);
 
 	if (conf.classify == 1) {
 		switch (file_info[i].type) {
 		case DT_DIR:
 			*ind_char = 0;
-			putchar(DIR_CHR);
+			frame_putc(DIR_CHR);
 			if (file_info[i].filesn > 0 && conf.file_counter == 1)
-				fputs(xitoa(file_info[i].filesn), stdout);
+				frame_puts(xitoa(file_info[i].filesn));
 			break;
 
-		case DT_BLK: putchar(BLK_CHR); break;
-		case DT_CHR: putchar(CHR_CHR); break;
+		case DT_BLK: frame_putc(BLK_CHR); break;
+		case DT_CHR: frame_putc(CHR_CHR); break;
 #ifdef SOLARIS_DOORS
-		case DT_DOOR: putchar(DOOR_CHR); break;
+		case DT_DOOR: frame_putc(DOOR_CHR); break;
 //		case DT_DOOR: break;
 #endif /* SOLARIS_DOORS */
-		case DT_FIFO: putchar(FIFO_CHR); break;
-		case DT_LNK: putchar(LINK_CHR); break;
-		case DT_SOCK: putchar(SOCK_CHR); break;
+		case DT_FIFO: frame_putc(FIFO_CHR); break;
+		case DT_LNK: frame_putc(LINK_CHR); break;
+		case DT_SOCK: frame_putc(SOCK_CHR); break;
 #ifdef S_IFWHT
-		case DT_WHT: putchar(WHT_CHR); break;
+		case DT_WHT: frame_putc(WHT_CHR); break;
 #endif /* S_IFWHT */
-		case DT_UNKNOWN: putchar(UNKNOWN_CHR); break;
+		case DT_UNKNOWN: frame_putc(UNKNOWN_CHR); break;
 		default: *ind_char = 0; break;
 		}
 	}
@@ -1942,125 +1863,127 @@ calc_item_length(const int eln_len, const int icon_len, const filesn_t i)
 	return (size_t)item_len;
 }
 
+/* Return the floor of the base 2 logarithm of N (N > 0). */
+static inline size_t
+floor_log2(size_t n)
+{
+	size_t k = 0;
+	while (n >>= 1)
+		k++;
+	return k;
+}
+
+/* Return the length of the longest entry in the range [L, R) (R > L),
+ * using the sparse table ST (see get_longest_per_col()). N is the number
+ * of entries. */
+static inline size_t
+range_max_len(const uint16_t *st, const size_t n, const size_t l,
+	const size_t r)
+{
+	const size_t k = floor_log2(r - l);
+	const uint16_t a = st[k * n + l];
+	const uint16_t b = st[k * n + r - ((size_t)1 << k)];
+	return (size_t)(a > b ? a : b);
+}
+
+/* Return the number of terminal columns taken by the list of N files
+ * printed in COLS columns (the last one may be partially filled). If
+ * LONGEST_PER_COL is not NULL, the length of the longest entry of each
+ * column is stored there. */
+static size_t
+get_layout_width(const uint16_t *st, const size_t n, const size_t cols,
+	size_t *longest_per_col)
+{
+	const size_t rows = n / cols + (n % cols != 0);
+	size_t used_cols = 0;
+
+	for (size_t c = 0; c * rows < n; c++) {
+		const size_t end = (c + 1) * rows < n ? (c + 1) * rows : n;
+		const size_t len = range_max_len(st, n, c * rows, end);
+		if (longest_per_col)
+			longest_per_col[c] = len;
+		used_cols += len + COLUMNS_GAP;
+	}
+
+	return used_cols;
+}
+
+/* Compute the layout of the list of files (FILES_N entries starting at
+ * index FIRST) in vertical mode: the largest number of columns fitting in
+ * the terminal is stored in COLUMNS_N, the corresponding number of rows in
+ * ROWS, and the length of the longest entry of each column is returned.
+ *
+ * A sparse table is built over the length of each entry (ST[k * N + i]
+ * holds the longest entry in the range [i, i + 2^k)), so that the width of
+ * each column is computed in constant time. This allows us to binary
+ * search the number of columns: the whole computation takes
+ * O(N log N + C log C) (C being the number of columns), instead of
+ * rescanning the whole list for each candidate number of columns. */
 static size_t *
-get_longest_per_col(size_t *columns_n, filesn_t *rows, const filesn_t files_n)
+get_longest_per_col(size_t *columns_n, filesn_t *rows, const filesn_t first,
+	const filesn_t files_n)
 {
-	if (conf.columned == 0) {
+	if (conf.columned == 0 || files_n <= 0) {
 		*columns_n = 1;
-		*rows = g_files_num;
+		*rows = files_n > 0 ? files_n : 0;
 		size_t *longest_per_col = xnmalloc(2, sizeof(size_t));
 		longest_per_col[0] = term_cols;
 		return longest_per_col;
 	}
 
-	size_t used_cols = 0;
-	size_t longest_index = 0;
-
-	if (*columns_n == 0)
-		*columns_n = 1;
-	if (*rows <= 0)
-		*rows = 1;
-
-	/* Make enough room to hold columns information. We'll never get more
-	 * columns for the current file list than the number of terminal columns. */
-	size_t *longest_per_col = xnmalloc((size_t)term_cols + 1, sizeof(size_t));
-
-	/* Hold info about the previous columns state */
-	size_t *prev_longest_per_col = NULL;
-	filesn_t prev_rows = *rows;
-
-	const int longest_eln = conf.no_eln != 1 ? DIGINUM(files_n + 1) : 1;
+	const size_t n = (size_t)files_n;
+	const int longest_eln = conf.no_eln != 1 ? DIGINUM(first + files_n + 1) : 1;
 	const int icon_len = (conf.icons == 1 ? ICON_LEN : 0);
 
-#define LONGEST_PLUS_GAP (longest_per_col[longest_index] + COLUMNS_GAP)
-
-	while (1) {
-		/* Calculate the number of rows that will be in each column except
-		 * possibly for a short column on the right. */
-		*rows = files_n / (filesn_t)*columns_n
-			+ (files_n % (filesn_t)*columns_n != 0);
+	const size_t levels = floor_log2(n) + 1;
+	uint16_t *st = xnmalloc(levels * n, sizeof(uint16_t));
 
-		/* Get longest filename per column */
-		filesn_t i;
-		filesn_t counter = 1;
-		size_t longest_name_len = 0;
-
-		/* Cache the value referenced by the pointer once here instead of
-		 * dereferencing it hundreds of times in the below for-loop. */
-		const filesn_t cached_rows = *rows;
-
-		for (i = 0; i < files_n; i++) {
-			size_t len = 0;
-			if (file_info[i].total_entry_len > 0) {
-				len = file_info[i].total_entry_len;
-			} else {
-				len = file_info[i].total_entry_len =
-					calc_item_length(longest_eln, icon_len, i);
-			}
-
-			if (len > longest_name_len)
-				longest_name_len = len;
-
-			if (counter == cached_rows) {
-				counter = 1;
-				longest_per_col[longest_index] = longest_name_len;
-				used_cols += LONGEST_PLUS_GAP;
-				longest_index++;
-				longest_name_len = 0;
-			} else {
-				counter++;
-			}
-		}
-
-		/* Count last column as well: If the number of files in the last
-		 * column is less than the number of rows (in which case
-		 * LONGEST_NAME_LEN is bigger than zero), the longest name in this
-		 * column isn't taken into account: let's do it here. */
-		if (longest_name_len > 0) {
-			longest_per_col[longest_index] = longest_name_len;
-			used_cols += LONGEST_PLUS_GAP;
-		} else {
-			if (longest_index > 0)
-				longest_index--;
-			else
-				break;
-		}
-
-		const int rest = (int)term_cols - (int)used_cols;
-
-		if ((*rows == 1 && (filesn_t)*columns_n + 1 >= files_n)
-		|| rest < (int)LONGEST_PLUS_GAP) {
-			if (rest < 0 && *columns_n > 1) {
-				if (!prev_longest_per_col)
-					return longest_per_col;
-
-				(*columns_n)--;
-				*rows = prev_rows;
-				free(longest_per_col);
-				return prev_longest_per_col;
-			} else {
-				break;
-			}
-		}
-
-		/* Keep a copy of the current state, in case the next iteration
-		 * returns too many columns, in which case the current state is
-		 * what we want. */
-		prev_rows = *rows;
-		free(prev_longest_per_col);
-		prev_longest_per_col = xnmalloc(*columns_n + 1, sizeof(size_t));
-		memcpy(prev_longest_per_col, longest_per_col,
-			(*columns_n + 1) * sizeof(size_t));
-
-		/* There is space left for one more column: increase columns_n. */
-		(*columns_n)++;
-		longest_index = 0;
-		used_cols = 0;
+	for (size_t i = 0; i < n; i++) {
+		const filesn_t j = first + (filesn_t)i;
+		if (file_info[j].total_entry_len == 0)
+			file_info[j].total_entry_len =
+				calc_item_length(longest_eln, icon_len, j);
+
+		const size_t len = file_info[j].total_entry_len;
+		st[i] = len > UINT16_MAX ? UINT16_MAX : (uint16_t)len;
+	}
+
+	for (size_t k = 1; k < levels; k++) {
+		const size_t half = (size_t)1 << (k - 1);
+		const uint16_t *prev = st + (k - 1) * n;
+		uint16_t *cur = st + k * n;
+		for (size_t i = 0; i + (half << 1) <= n; i++)
+			cur[i] = prev[i] > prev[i + half] ? prev[i] : prev[i + half];
+	}
+
+	/* Every column takes at least 1 + COLUMNS_GAP terminal columns. */
+	size_t lo = 1;
+	size_t hi = (size_t)term_cols / (1 + COLUMNS_GAP);
+	if (hi > n)
+		hi = n;
+
+	/* Largest number of columns fitting in the terminal. One column is
+	 * used if even a single column does not fit. */
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo + 1) / 2;
+		if (get_layout_width(st, n, mid, NULL) <= (size_t)term_cols)
+			lo = mid;
+		else
+			hi = mid - 1;
 	}
 
-#undef LONGEST_PLUS_GAP
+	/* Several numbers of columns may result in the same number of rows:
+	 * use the number of columns actually filled. */
+	const size_t r = n / lo + (n % lo != 0);
+	const size_t cols = n / r + (n % r != 0);
+
+	size_t *longest_per_col = xnmalloc(cols + 1, sizeof(size_t));
+	get_layout_width(st, n, cols, longest_per_col);
+	longest_per_col[cols] = 0;
 
-	free(prev_longest_per_col);
+	free(st);
+	*columns_n = cols;
+	*rows = (filesn_t)r;
 	return longest_per_col;
 }
 
@@ -2071,13 +1994,10 @@ pad_filename_new(const filesn_t i, const int termcap_move_right,
 	const int diff = ((int)longest_in_col + COLUMNS_GAP)
 		- ((int)file_info[i].total_entry_len + (conf.no_eln == 1));
 
-	if (termcap_move_right == 1) {
-		MOVE_CURSOR_RIGHT(diff);
-	} else {
-		int j = diff;
-		while (--j >= 0)
-			putchar(' ');
-	}
+	if (termcap_move_right == 1)
+		frame_move_right(diff);
+	else
+		frame_spaces(diff);
 }
 #endif /* TIGHT_COLUMNS */
 
@@ -2098,13 +2018,10 @@ pad_filename(const int ind_char, const filesn_t i, const int eln_len,
 	}
 
 	const int diff = (int)longest.name_len - cur_len;
-	if (termcap_move_right == 1) {
-		MOVE_CURSOR_RIGHT(diff + 1);
-	} else {
-		int j = diff + 1;
-		while (--j >= 0)
-			putchar(' ');
-	}
+	if (termcap_move_right == 1)
+		frame_move_right(diff + 1);
+	else
+		frame_spaces(diff + 1);
 }
 
 /* List files horizontally:
@@ -2113,9 +2030,8 @@ pad_filename(const int ind_char, const filesn_t i, const int eln_len,
 static void
 list_files_horizontal(int *reset_pager, const int eln_len, size_t columns_n)
 {
-	const filesn_t nn = (conf.max_files != UNSET
-		&& (filesn_t)conf.max_files < g_files_num)
-		? (filesn_t)conf.max_files : g_files_num;
+	filesn_t nn = 0;
+	const filesn_t first = get_list_window(&nn);
 
 /*	size_t *longest_per_col = get_longest_per_col(&columns_n, nn);
 	size_t cur_col = 0; */
@@ -2140,7 +2056,9 @@ list_files_horizontal(int *reset_pager, const int eln_len, size_t columns_n)
 	g_pager_quit = g_pager_help = 0;
 	size_t pager_counter = 0;
 
-	for (i = 0; i < nn; i++) {
+	frame_start();
+
+	for (i = first; i < nn; i++) {
 		/* If current entry is in the last column, we need to print a
 		 * new line char. */
 		size_t bcur_cols = cur_cols;
@@ -2200,7 +2118,7 @@ list_files_horizontal(int *reset_pager, const int eln_len, size_t columns_n)
 			cur_col++; */
 			pad_filename(ind_char, i, eln_len, termcap_move_right);
 		} else {
-			putchar('\n');
+			frame_putc('\n');
 //			cur_col = 0;
 		}
 	}
@@ -2208,9 +2126,11 @@ list_files_horizontal(int *reset_pager, const int eln_len, size_t columns_n)
 END:
 //	free(longest_per_col);
 	if (last_column == 0)
-		putchar('\n');
+		frame_putc('\n');
 	if (g_pager_quit == 1)
-		printf("... (%zd/%zd)\n", i, g_files_num);
+		frame_printf("... (%zd/%zd)\n", i, g_files_num);
+
+	frame_end();
 }
 
 /* List files vertically, like ls(1) would
@@ -2219,15 +2139,16 @@ END:
 static void
 list_files_vertical(int *reset_pager, const int eln_len, size_t num_columns)
 {
-	/* Total number of files to be listed. */
-	const filesn_t total_files = (conf.max_files != UNSET
-		&& (filesn_t)conf.max_files < g_files_num)
-		? (filesn_t)conf.max_files : g_files_num;
+	/* Total number of files to be listed. FILE_INDEX (below) is relative
+	 * to FIRST, the index of the first listed entry. */
+	filesn_t last = 0;
+	const filesn_t first = get_list_window(&last);
+	const filesn_t total_files = last - first;
 
 #ifdef TIGHT_COLUMNS
 	filesn_t num_rows = 0;
 	size_t *longest_per_col =
-		get_longest_per_col(&num_columns, &num_rows, total_files);
+		get_longest_per_col(&num_columns, &num_rows, first, total_files);
 	size_t cur_col = 0;
 #else
 	/* How many lines (rows) do we need to print TOTAL_FILES files? */
@@ -2267,6 +2188,8 @@ list_files_vertical(int *reset_pager, const int eln_len, size_t num_columns)
 	g_pager_quit = g_pager_help = 0;
 	size_t pager_counter = 0;
 
+	frame_start();
+
 	for ( ; ; i++) {
 		/* Copy current values to restore them if necessary. */
 		filesn_t backup_row_index = row_index;
@@ -2290,13 +2213,13 @@ list_files_vertical(int *reset_pager, const int eln_len, size_t num_columns)
 
 		int ind_char = (conf_classify != 0);
 
-		if (file_index >= total_files || !file_info[file_index].name) {
+		if (file_index >= total_files || !file_info[first + file_index].name) {
 			if (last_column == 1) {
 				/* Last column is empty. E.g.:
 				 * 1 file  3 file3  5 file5
 				 * 2 file2 4 file4  HERE
 				 * ... */
-				putchar('\n');
+				frame_putc('\n');
 #ifdef TIGHT_COLUMNS
 				cur_col = 0;
 #endif
@@ -2349,29 +2272,28 @@ list_files_vertical(int *reset_pager, const int eln_len, size_t num_columns)
 			 * #    PRINT THE CURRENT ENTRY    #
 			 * ################################# */
 
-		const int fc = file_info[file_index].dir != 1 ? int_longest_fc_len : 0;
+		const filesn_t n = first + file_index;
+		const int fc = file_info[n].dir != 1 ? int_longest_fc_len : 0;
 		/* Displayed filename will be truncated to MAX_NAMELEN. */
 		const int max_namelen = conf_max_name_len + fc;
 
-		file_info[file_index].eln_n = conf_no_eln == 1
-			? -1 : DIGINUM(file_index + 1);
+		file_info[n].eln_n = conf_no_eln == 1 ? -1 : DIGINUM(n + 1);
 
-		print_entry_function(&ind_char, file_index, eln_len, max_namelen);
+		print_entry_function(&ind_char, n, eln_len, max_namelen);
 
 		if (last_column == 0) {
 #ifdef TIGHT_COLUMNS
-			pad_filename_new(file_index, termcap_move_right,
-				longest_per_col[cur_col]);
+			pad_filename_new(n, termcap_move_right, longest_per_col[cur_col]);
 			cur_col++;
 #else
-			pad_filename(ind_char, file_index, eln_len, termcap_move_right);
+			pad_filename(ind_char, n, eln_len, termcap_move_right);
 #endif
 		} else {
 			/* Last column is populated. Example:
 			 * 1 file  3 file3  5 file5HERE
 			 * 2 file2 4 file4  6 file6HERE
 			 * ... */
-			putchar('\n');
+			frame_putc('\n');
 #ifdef TIGHT_COLUMNS
 			cur_col = 0;
 #endif
@@ -2383,9 +2305,11 @@ END:
 	free(longest_per_col);
 #endif
 	if (last_column == 0)
-		putchar('\n');
+		frame_putc('\n');
 	if (g_pager_quit == 1)
-		printf("... (%zd/%zd)\n", i, g_files_num);
+		frame_printf("... (%zd/%zd)\n", i, g_files_num);
+
+	frame_end();
 }
 
 /* Execute commands in either AUTOCMD_DIR_IN_FILE or AUTOCMD_DIR_OUT_FILE files.
@@ -2507,9 +2431,12 @@ exclude_file_type_light(const unsigned char type)
 /* Returns FUNC_SUCCESS if the file with mode MODE and LINKS number
  * of links must be excluded from the file list, or FUNC_FAILURE. */
 static int
-exclude_file_type(const char *restrict name, const mode_t mode,
-	const nlink_t links, const off_t size)
+exclude_file_type(const char *restrict name, const struct stat *attr)
 {
+	const mode_t mode = attr->st_mode;
+	const nlink_t links = attr->st_nlink;
+	const off_t size = attr->st_size;
+
 /* ADD: C = Files with capabilities */
 
 	if (!filter.str[1])
@@ -2536,6 +2463,9 @@ exclude_file_type(const char *restrict name, const mode_t mode,
 #endif /* SOLARIS_DOORS */
 	case 'p': if (S_ISFIFO(mode)) match = 1; break;
 	case 's': if (S_ISSOCK(mode)) match = 1; break;
+#ifndef _NO_TAGS
+	case 'T': if (is_tagged_file(attr->st_dev, attr->st_ino)) match = 1; break;
+#endif /* !_NO_TAGS */
 
 	case 'g': if (mode & S_ISGID) match = 1; break; /* SGID */
 	case 'h': if (links > 1 && !S_ISDIR(mode)) match = 1; break;
@@ -2574,28 +2504,16 @@ init_default_file_info(void)
 	default_file_info.size = 1;
 }
 
+/* Names are resolved lazily and cached (see idcache.c). */
 static inline void
 set_id_names(const filesn_t n)
 {
-	size_t i;
+	file_info[n].uid_i.name =
+		get_user_name(file_info[n].uid, &file_info[n].uid_i.namlen);
 
-	if (sys_users) {
-		for (i = 0; sys_users[i].name; i++) {
-			if (file_info[n].uid != sys_users[i].id)
-				continue;
-			file_info[n].uid_i.name = sys_users[i].name;
-			file_info[n].uid_i.namlen = sys_users[i].namlen;
-		}
-	}
-
-	if (sys_groups) {
-		for (i = 0; sys_groups[i].name; i++) {
-			if (file_info[n].gid != sys_groups[i].id)
-				continue;
-			file_info[n].gid_i.name = sys_groups[i].name;
-			file_info[n].gid_i.namlen = sys_groups[i].namlen;
-		}
-	}
+	if (prop_fields.no_group == 0 || conf.sort == SGRP)
+		file_info[n].gid_i.name =
+			get_group_name(file_info[n].gid, &file_info[n].gid_i.namlen);
 }
 
 /* Construct human readable sizes for all files in the current directory
@@ -2648,6 +2566,25 @@ construct_human_sizes(void)
 	}
 }
 
+/* Stamp the directory DIR, about to be read into the file_info array, so
+ * that other parts of the program (e.g. tab completion) can tell whether
+ * the list of files is still an exact copy of the directory contents. */
+static void
+stamp_listed_dir(DIR *dir)
+{
+	struct stat a;
+#ifndef CLIFM_LEGACY
+	const int fd = dirfd(dir);
+	if (fd == -1 || fstat(fd, &a) == -1)
+#else /* dirfd() is a dummy (see compat.h) */
+	UNUSED(dir);
+	if (stat(workspaces[cur_ws].path, &a) == -1)
+#endif /* !CLIFM_LEGACY */
+		listing_stamp.valid = 0;
+	else
+		set_dir_stamp(&listing_stamp, &a);
+}
+
 #define LIST_SCANNING_MSG "Scanning... "
 static void
 print_scanning_message(void)
@@ -2747,6 +2684,7 @@ list_dir_light(const int autocmd_ret)
 		check_autocmd_files();
 
 	set_events_checker();
+	stamp_listed_dir(dir);
 
 	errno = 0;
 	longest.name_len = 0;
@@ -2971,16 +2909,16 @@ list_dir_light(const int autocmd_ret)
 		goto END;
 	}
 
-	const int eln_len = conf.no_eln == 1 ? 0
-		: ((conf.max_files != UNSET && g_files_num > (filesn_t)conf.max_files)
-		? DIGINUM(conf.max_files) : DIGINUM(g_files_num));
+	filesn_t last_listed = 0;
+	(void)get_list_window(&last_listed);
+	const int eln_len = conf.no_eln == 1 ? 0 : DIGINUM(last_listed);
 
 	if (conf.sort != SNONE)
 		ENTSORT(file_info, (size_t)n, entrycmp);
 
 	/* Get the longest filename */
 	if (conf.columned == 1 || conf.long_view == 1)
-		get_longest_filename(n, (size_t)eln_len);
+		get_longest_filename((size_t)eln_len);
 
 	/* Get possible number of columns for the dirlist screen */
 	const size_t columns_n = (conf.pager_view == PAGER_AUTO
@@ -3109,8 +3047,7 @@ set_link_target_color(const char *name, const struct stat *attr,
 		if (!color) {
 			file_info[i].color = fi_c;
 		} else if (clen > 0) { /* We have an extension color */
-			file_info[i].ext_color = savestring(color, clen);
-			file_info[i].color = file_info[i].ext_color;
+			file_info[i].ext_color = file_info[i].color = color;
 		} else {
 			file_info[i].color = color;
 		}
@@ -3217,6 +3154,10 @@ load_file_gral_info(const struct stat *a, const filesn_t n, struct stat *parent_
 	file_info[n].linkn = a->st_nlink;
 	file_info[n].mode = a->st_mode;
 	file_info[n].sel = check_seltag(a->st_dev, a->st_ino, a->st_nlink, n);
+#ifndef _NO_TAGS
+	if ((file_info[n].tagged = is_tagged_file(a->st_dev, a->st_ino)) == 1)
+		stats.tagged++;
+#endif /* !_NO_TAGS */
 	file_info[n].size = FILE_TYPE_NON_ZERO_SIZE(a->st_mode) ? FILE_SIZE(*a) : 0;
 	file_info[n].uid = a->st_uid;
 	file_info[n].gid = a->st_gid;
@@ -3482,18 +3423,22 @@ load_regfile_info(const mode_t mode, const filesn_t n)
 		get_ext_icon(ext, n);
 #endif /* !_NO_ICONS */
 
-	size_t color_len = 0;
-	const char *extcolor =
-		override_color == 1 ? get_ext_color(ext, &color_len) : NULL;
-	if (!extcolor)
-		return;
+#ifdef LIST_SPEED_TEST
+	struct timespec t1, t2;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+#endif /* LIST_SPEED_TEST */
 
-	char *t = xnmalloc(color_len + 4, sizeof(char));
-	*t = '\x1b'; t[1] = '[';
-	memcpy(t + 2, extcolor, color_len);
-	t[color_len + 2] = 'm';
-	t[color_len + 3] = '\0';
-	file_info[n].ext_color = file_info[n].color = t;
+	char *extcolor = override_color == 1 ? get_ext_color_seq(ext, NULL) : NULL;
+
+#ifdef LIST_SPEED_TEST
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	ext_lookup_secs += (double)(t2.tv_sec - t1.tv_sec)
+		+ (double)(t2.tv_nsec - t1.tv_nsec) * 1e-9;
+	ext_lookups++;
+#endif /* LIST_SPEED_TEST */
+
+	if (extcolor)
+		file_info[n].ext_color = file_info[n].color = extcolor;
 }
 
 static int
@@ -3511,24 +3456,6 @@ vt_stat(const int fd, char *restrict path, struct stat *attr)
 	return 0;
 }
 
-/* If the selections file was modified since the last check, reload selections. */
-static void
-check_sel_files(void)
-{
-	static time_t selfile_mtime_last = 0;
-	struct stat a;
-
-	if (!sel_file || stat(sel_file, &a) == -1) {
-		get_sel_files();
-		selfile_mtime_last = 0;
-	} else {
-		if (a.st_mtime != selfile_mtime_last) {
-			get_sel_files();
-			selfile_mtime_last = a.st_mtime;
-		}
-	}
-}
-
 /* List files in the current working directory. Uses file type colors
  * and columns. Return 0 on success or 1 on error. */
 int
@@ -3548,7 +3475,8 @@ list_dir(void)
 		/* Hide the cursor to minimize flickering: it will be unhidden immediately
 		 * before printing the next prompt (prompt.c) */
 		HIDE_CURSOR;
-		check_sel_files();
+		/* Apply changes to the selections file made by other instances */
+		sync_sel_files();
 	}
 
 	int autocmd_ret = 0;
@@ -3563,6 +3491,10 @@ list_dir(void)
 		g_dir_out = 0;
 	}
 
+	/* Always start listing from the first entry in a new directory. */
+	if (dir_changed == 1)
+		g_list_offset = 0;
+
 	if (conf.clear_screen > 0) {
 		/* For some reason we need to clear the screen twice to prevent
 		 * a garbage first line when scrolling up. */
@@ -3576,6 +3508,7 @@ list_dir(void)
 		(stdin_tmp_dir && strcmp(stdin_tmp_dir, workspaces[cur_ws].path) == 0);
 
 	stats = (struct stats_t){0}; /* Reset the stats struct */
+	listing_stamp.valid = 0; /* Set by stamp_listed_dir() */
 	init_checks_struct();
 	init_default_file_info();
 
@@ -3612,6 +3545,7 @@ list_dir(void)
 	}
 
 	set_events_checker();
+	stamp_listed_dir(dir);
 
 	const int fd = dirfd(dir);
 	if (fd == -1) {
@@ -3701,8 +3635,7 @@ list_dir(void)
 		} else {
 			/* Filter files according to file type. */
 			if ((checks_filter_type == 1
-			&& exclude_file_type(ename, attr.st_mode, attr.st_nlink,
-			attr.st_size) == FUNC_SUCCESS)
+			&& exclude_file_type(ename, &attr) == FUNC_SUCCESS)
 			/* Filter non-directory files. */
 			|| (conf_only_dirs == 1 && !S_ISDIR(attr.st_mode)
 			&& (conf_follow_symlinks == 0 || !S_ISLNK(attr.st_mode)
@@ -3826,9 +3759,9 @@ list_dir(void)
 		goto END;
 	}
 
-	const int eln_len = conf.no_eln == 1 ? 0
-		: ((conf.max_files != UNSET && g_files_num > (filesn_t)conf.max_files)
-		? DIGINUM(conf.max_files) : DIGINUM(g_files_num));
+	filesn_t last_listed = 0;
+	(void)get_list_window(&last_listed);
+	const int eln_len = conf.no_eln == 1 ? 0 : DIGINUM(last_listed);
 
 		/* #############################################
 		 * #    SORT FILES ACCORDING TO SORT METHOD    #
@@ -3844,7 +3777,7 @@ list_dir(void)
 	/* Get the longest filename. */
 	if (conf.columned == 1 || conf.long_view == 1
 	|| conf.pager_view != PAGER_AUTO)
-		get_longest_filename(n, (size_t)eln_len);
+		get_longest_filename((size_t)eln_len);
 
 	/* Get the number of columns required to print all filenames. */
 	const size_t columns_n = (conf.pager_view == PAGER_AUTO
@@ -3894,6 +3827,10 @@ END:
 	double secs = (double)(t2.tv_sec - t1.tv_sec)
 		+ (double)(t2.tv_nsec - t1.tv_nsec) * 1e-9;
 	printf("list_dir time: %f\n", secs);
+	printf("ext colors lookup time: %f (%zu lookups)\n",
+		ext_lookup_secs, ext_lookups);
+	ext_lookup_secs = 0;
+	ext_lookups = 0;
 #endif /* LIST_SPEED_TEST */
 
 	return exit_code;
@@ -3902,19 +3839,37 @@ END:
 void
 free_dirlist(void)
 {
+	listing_stamp.valid = 0;
+
 	if (!file_info || g_files_num == 0)
 		return;
 
 	filesn_t i = g_files_num;
-	while (--i >= 0) {
+	while (--i >= 0)
 		free(file_info[i].name);
-		free(file_info[i].ext_color);
-	}
 
 	free(file_info);
 	file_info = NULL;
 }
 
+/* Extension colors in the file list point to escape sequences stored in the
+ * ext_colors array (see get_ext_color_seq() in colors.c). Reset them to the
+ * regular file color before this array is freed (e.g., when switching color
+ * schemes), so that no dangling pointer is left behind. */
+void
+unset_ext_colors(void)
+{
+	if (!file_info || g_files_num == 0)
+		return;
+
+	for (filesn_t i = g_files_num; i-- > 0;) {
+		if (!file_info[i].ext_color)
+			continue;
+		file_info[i].color = fi_c;
+		file_info[i].ext_color = NULL;
+	}
+}
+
 void
 reload_dirlist(void)
 {
@@ -13,9 +13,11 @@
 __BEGIN_DECLS
 
 void free_dirlist(void);
+filesn_t get_list_window(filesn_t *last);
 int  list_dir(void);
 void reload_dirlist(void);
 void refresh_screen(void);
+void unset_ext_colors(void);
 
 #ifndef _NO_ICONS
 void *print_file_icon(const char *name, const struct stat *a,
@@ -15,6 +15,8 @@
 #include "aux.h"    /* xitoa() */
 #include "checks.h" /* check_file_access() */
 #include "colors.h" /* remove_bold_attr() */
+#include "frame.h"  /* frame_puts(), frame_putc(), frame_write() */
+#include "listing.h" /* get_list_window() */
 #include "long_view.h" /* macros */
 #include "misc.h"   /* gen_diff_str() */
 #include "properties.h" /* get_color_age, get_color_size, get_file_perms */
@@ -111,9 +113,8 @@ construct_and_print_filename(const struct fileinfo *props,
 		plen = wc_xstrlen(wname);
 	}
 
-	const filesn_t n = (conf.max_files > UNSET
-		&& g_files_num > (filesn_t)conf.max_files)
-		? (filesn_t)conf.max_files : g_files_num;
+	filesn_t n = 0;
+	(void)get_list_window(&n);
 
 	size_t cur_len = (conf.no_eln == 0 ? (size_t)DIGINUM(n) : 0) + 1 + plen
 		+ (conf.icons == 1 ? (size_t)ICON_LEN : 0);
@@ -152,54 +153,48 @@ construct_and_print_filename(const struct fileinfo *props,
 	if (pad < 0)
 		pad = 0;
 
-	if (trunc == 0) {
-		printf("%s%s%s%s%s%s%s%-*s%s  ",
-			(conf.colorize == 1 && conf.icons == 1) ? props->icon_color : "",
-			conf.icons == 1 ? props->icon : "", conf.icons == 1 ? " " : "",
-			df_c, conf.colorize == 1 ? props->color : "", name,
-			conf.light_mode == 1 ? "\x1b[0m" : df_c, pad, "", df_c);
-
-		free(wname);
-		return;
+	if (conf.colorize == 1 && conf.icons == 1)
+		frame_puts(props->icon_color);
+	if (conf.icons == 1) {
+		frame_puts(props->icon);
+		frame_putc(' ');
 	}
-
-	const char *trunc_diff = diff > 0 ? gen_diff_str(diff) : "";
-	static char trunc_s[2] = {0};
-	trunc_s[0] = TRUNC_FILE_CHR;
-
-	/* I hate using two almost identical pieces of code, but this allows us
-	 * to use mbstowcs only for UTF-8 names and printing non-UTF8 directly,
-	 * without conversion (which makes the whole thing faster).
-	 * NOTE: The only difference between the two printf calls is the filename:
-	 * %ls (pointer to wchar_t string) or %s (pointer to char string). Any
-	 * modification must be applied to both calls to keep output consistent. */
-	if (props->utf8 == 1) {
-		printf("%s%s%s%s%s%ls%s%s%-*s%s\x1b[0m%s%s\x1b[0m%s%s%s  ",
-			(conf.colorize == 1 && conf.icons == 1) ? props->icon_color : "",
-			conf.icons == 1 ? props->icon : "", conf.icons == 1 ? " " : "", df_c,
-			conf.colorize == 1 ? props->color : "",
-			g_wcs_name_buf, trunc_diff,
-			conf.light_mode == 1 ? "\x1b[0m" : df_c, pad, "", df_c,
-			trunc > 0 ? tt_c : "", trunc_s,
-			trunc == TRUNC_EXT ? props->color : "",
-			trunc == TRUNC_EXT ? ext_name : "",
-			trunc == TRUNC_EXT ? df_c : "");
-	} else {
-		printf("%s%s%s%s%s%s%s%s%-*s%s\x1b[0m%s%s\x1b[0m%s%s%s  ",
-			(conf.colorize == 1 && conf.icons == 1) ? props->icon_color : "",
-			conf.icons == 1 ? props->icon : "", conf.icons == 1 ? " " : "", df_c,
-			conf.colorize == 1 ? props->color : "",
-			name, trunc_diff,
-			conf.light_mode == 1 ? "\x1b[0m" : df_c, pad, "", df_c,
-			trunc > 0 ? tt_c : "", trunc_s,
-			trunc == TRUNC_EXT ? props->color : "",
-			trunc == TRUNC_EXT ? ext_name : "",
-			trunc == TRUNC_EXT ? df_c : "");
+	frame_puts(df_c);
+	if (conf.colorize == 1)
+		frame_puts(props->color);
+
+	/* Print non-UTF-8 names directly, without conversion: mbstowcs(3) is
+	 * only used for truncated UTF-8 names. */
+	if (trunc > 0 && props->utf8 == 1)
+		frame_printf("%ls", g_wcs_name_buf);
+	else
+		frame_puts(name);
+
+	if (trunc > 0 && diff > 0)
+		frame_puts(gen_diff_str(diff));
+
+	frame_puts(conf.light_mode == 1 ? "\x1b[0m" : df_c);
+	frame_spaces(pad);
+	frame_puts(df_c);
+
+	if (trunc > 0) {
+		frame_puts("\x1b[0m");
+		frame_puts(tt_c);
+		frame_putc(TRUNC_FILE_CHR);
+		frame_puts("\x1b[0m");
+		if (trunc == TRUNC_EXT) {
+			frame_puts(props->color);
+			frame_puts(ext_name);
+			frame_puts(df_c);
+		}
 
 		/* Reinsert the character removed when truncating the string. */
-		name[trunc_point] = truncated_char;
+		if (props->utf8 != 1)
+			name[trunc_point] = truncated_char;
 	}
 
+	frame_write("  ", 2);
+
 	free(wname);
 }
 
@@ -662,16 +657,15 @@ print_entry_props(const struct fileinfo *props, const struct maxes_t *maxes,
 			buf[len++] = ' ';
 	}
 
-	buf[len] = '\0';
-	fputs(buf, stdout);
+	frame_write(buf, len);
 
 	if (conf.names_last == 1) {
-		putchar(' ');
-		if (conf.prop_fields_gap > 1) putchar(' ');
+		frame_putc(' ');
+		if (conf.prop_fields_gap > 1) frame_putc(' ');
 		construct_and_print_filename(props, maxes->name);
 	}
 
-	putchar('\n');
+	frame_putc('\n');
 
 	return FUNC_SUCCESS;
 }
@@ -25,11 +25,13 @@
 #include "jump.h"
 #include "keybinds.h"
 #include "listing.h"
-#include "mimetypes.h" /* load_user_mimetypes() */
 #include "misc.h"
 #ifndef _NO_PROFILES
 # include "profiles.h"
 #endif /* !_NO_PROFILES */
+#if !defined(_NO_LIRA) && !defined(_NO_FZF)
+# include "previewd.h" /* preview_client() */
+#endif /* !_NO_LIRA && !_NO_FZF */
 #include "prompt.h"
 #include "properties.h" /* do_stat_and_exit() */
 #include "readline.h"
@@ -39,6 +41,7 @@
 #endif /* SECURITY_PARANOID */
 #include "selset.h" /* devino_set_init() */
 #include "term.h" /* set_term_title() */
+#include "trace.h" /* startup_trace() */
 
 /* Globals */
 
@@ -60,6 +63,7 @@ devino_set_t sel_set = {0};
 struct suggestions_t suggestion = {0};
 #endif /* !_NO_SUGGESTIONS */
 struct stats_t stats = {0};
+struct dir_stamp_t listing_stamp = {0};
 struct autocmds_t *autocmds = NULL;
 struct opts_t opts = {0};
 struct opts_t workspace_opts[MAX_WS];
@@ -78,8 +82,6 @@ struct ext_t *ext_colors = NULL;
 #ifdef LINUX_FSINFO
 struct ext_mnt_t *ext_mnt = NULL;
 #endif /* LINUX_FSINFO */
-struct groups_t *sys_users = NULL;
-struct groups_t *sys_groups = NULL;
 struct dircmds_t dir_cmds = {UNSET, 0};
 struct pmsgs_t *messages = NULL;
 struct mime_t *user_mimetypes = NULL;
@@ -194,6 +196,8 @@ int
 	wrong_cmd = 0;
 
 filesn_t g_files_num = 0;
+/* Index of the first listed entry when MaxFiles is set (see mf) */
+filesn_t g_list_offset = 0;
 
 size_t
 	actions_n = 0,
@@ -765,6 +769,7 @@ const struct nameslist_t param_str[] = {
 	{"profile rename", 14},
 	{"prompt edit", 11},
 	{"prompt list", 11},
+	{"prompt modules", 14},
 	{"prompt reload", 13},
 	{"prompt set", 10},
 	{"prompt unset", 12},
@@ -1105,6 +1110,14 @@ print_splash_screen(void)
 	}
 }
 
+static inline void
+init_dirhist(void)
+{
+	load_dirhist();
+	add_to_dirhist(workspaces[cur_ws].path);
+	startup_trace("load_dirhist");
+}
+
 static inline void
 check_working_directory(void)
 {
@@ -1206,7 +1219,7 @@ static inline void
 set_pledge(void)
 {
 	if (pledge("stdio rpath wpath cpath dpath fattr "
-	"chown flock getpw tty proc exec", NULL) == -1) {
+	"chown flock getpw tty proc exec unix", NULL) == -1) {
 		fprintf(stderr, "%s: pledge: %s\n", PROGRAM_NAME, strerror(errno));
 		exit(errno);
 	}
@@ -1263,6 +1276,15 @@ main(int argc, char *argv[])
 		exit(EINVAL);
 	}
 
+#if !defined(_NO_LIRA) && !defined(_NO_FZF)
+	/* Previewing files from fzf: let the preview server (if any) do it,
+	 * skipping initialization altogether. */
+	if (argc > 2 && strcmp(argv[1], "--preview") == 0)
+		preview_client(argc, argv);
+#endif /* !_NO_LIRA && !_NO_FZF */
+
+	startup_trace("start");
+
 	/* Make sure all initialization is made with restrictive permissions. */
 	const mode_t old_mask = umask(0077); /* flawfinder: ignore */
 
@@ -1305,6 +1327,7 @@ main(int argc, char *argv[])
 	 * Command line arguments will override initialization values (init_config). */
 	if (argc > 1)
 		parse_cmdline_args(argc, argv);
+	startup_trace("parse_cmdline_args");
 	/* parse_cmdline_args is executed before init_config() because, if
 	 * specified (-P option), it sets the value of alt_profile, which
 	 * is then checked by init_config(). */
@@ -1313,15 +1336,18 @@ main(int argc, char *argv[])
 #endif /* SECURITY_PARANOID */
 
 	check_term(); /* Let's check terminal capabilities. */
+	startup_trace("check_term");
 
 	/* Get paths from PATH environment variable. These paths will be
 	 * used later by get_path_programs (for the autocomplete function)
 	 * and is_cmd_in_path(). */
 	path_n = get_path_env(1);
 	cdpath_n = get_cdpath();
+	startup_trace("get_path_env");
 
 	check_env_filter();
 	get_data_dir();
+	startup_trace("get_data_dir");
 
 	/* Initialize program paths and files, set options from the config
 	 * file, if they were not already set via external arguments, and
@@ -1329,6 +1355,7 @@ main(int argc, char *argv[])
 	 * per user basis. */
 	init_config();
 	check_options();
+	startup_trace("init_config");
 
 	if (xargs.stat > 0) /* Running with --stat(-full). Print and exit. */
 		do_stat_and_exit(xargs.stat == FULL_STAT ? 1 : 0);
@@ -1338,65 +1365,75 @@ main(int argc, char *argv[])
 
 	set_sel_file();
 	create_tmp_files();
-	load_actions();
-	get_aliases();
 
-	/* Get the list of available programs in PATH to be used by the
-	 * custom TAB-completion function (tab_complete(), in tabcomp.c). */
-	get_path_programs();
-
-	/* Check third-party programs availability: finders (fzf, fnf, smenu),
-	 * udevil, and udisks2. */
-	check_third_party_cmds();
-#ifndef _NO_FZF
-	check_completion_mode();
-#endif /* _NO_FZF */
+	/* Full directory sizes depend on the du(1) flavor found in PATH */
+	if (conf.full_dir_size == 1)
+		load_cmds_data();
 
 	/* Initialize gettext() for translations. */
 #ifndef _NO_GETTEXT
 	init_gettext();
 #endif /* !_NO_GETTEXT */
+	startup_trace("init_gettext");
 
 	fputs(df_c, stdout);
 	fflush(stdout);
 
 	print_root_indicator();
 
+	/* Remotes are mounted before the first listing: the starting path may
+	 * be a mountpoint. Reading the remotes file is the only way to know
+	 * which remotes are to be automounted. */
 	load_remotes();
 	automount_remotes();
+	startup_trace("load_remotes");
 	print_splash_screen();
 	set_start_path();
 	check_working_directory();
 	set_term_title(workspaces[cur_ws].path);
 	exec_profile();
-	load_dirhist();
-	add_to_dirhist(workspaces[cur_ws].path);
+	startup_trace("exec_profile");
+	/* The directory history map is printed in the file list. */
+	if (conf.dirhist_map == 1)
+		init_dirhist();
 	get_sel_files();
+	startup_trace("get_sel_files");
+	/* Tagged files are marked in the file list. */
+	load_tags();
+	startup_trace("load_tags");
 
 	/* Start listing as soon as possible to speed up startup time. */
 	list_files();
+	startup_trace("list_files");
+
+	if (conf.dirhist_map != 1)
+		init_dirhist();
+
+	load_cmds_data();
 
 	shell = get_sys_shell();
 	create_kbinds_file();
-	load_file_templates();
 	load_bookmarks();
 	load_keybinds();
-	load_tags();
+	startup_trace("load_bookmarks");
 	load_jumpdb();
 	if (!jump_db || xargs.path == 1)
 		add_to_jumpdb(workspaces[cur_ws].path);
+	startup_trace("load_jumpdb");
 
 	init_shell();
 	initialize_readline();
 	get_prompt_cmds();
 	get_hostname();
 	set_env(0);
+	startup_trace("initialize_readline");
 
 	if (config_ok == 1)
 		init_history();
 
 	/* Store history in an array to be able to manipulate it. */
 	get_history();
+	startup_trace("get_history");
 
 #ifndef _NO_PROFILES
 	get_profile_names();
@@ -1404,7 +1441,7 @@ main(int argc, char *argv[])
 
 	load_pinned_dir();
 	init_workspaces_opts();
-	load_user_mimetypes();
+	print_startup_trace();
 
 	/* Restore user umask (if not set via Umask in the config file) */
 	if (conf.umask_set != 1)
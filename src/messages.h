@@ -481,7 +481,8 @@ Available file type characters:\n\
   t: Files with the sticky bit set (2)\n\
   u: SUID files (2)\n\
   g: SGID files (2)\n\
-  x: Executable files (2)\n\n\
+  x: Executable files (2)\n\
+  T: Tagged files (2)\n\n\
 (1) Only via tab completion\n\
 (2) Not available in light mode\n\n\
 Type '=<TAB>' to get the list of available file type filters.\n\n\
@@ -741,7 +742,19 @@ For example: 'i12'."
 #define MF_USAGE "Limit the number of listed files to NUM \
 (valid range: >= 0). Use 'unset' to remove the file limit.\n\n\
 \x1b[1mUSAGE\x1b[22m\n\
-  mf [NUM | unset]"
+  mf [NUM | unset | next | prev | first | last | goto ELN]\n\n\
+Only a window of NUM files is listed, so that huge directories can be\n\
+entered without printing all files. Use 'next' and 'prev' to scroll this\n\
+window one page forward or backward, 'first' and 'last' to go to the\n\
+beginning or the end of the list, and 'goto' to list the page containing\n\
+the file whose ELN is ELN.\n\n\
+\x1b[1mEXAMPLES\x1b[22m\n\
+- List only 100 files at a time\n\
+    mf 100\n\
+- List the next 100 files\n\
+    mf next\n\
+- List the page containing the file whose ELN is 1234\n\
+    mf goto 1234"
 
 #define MIME_USAGE "Manage opening applications\n\n\
 \x1b[1mUSAGE\x1b[22m\n\
@@ -976,7 +989,7 @@ Note: Use the 'oc' command to edit file ownership."
 
 #define PROMPT_USAGE "Change the current prompt\n\n\
 \x1b[1mUSAGE\x1b[22m\n\
-  prompt [set NAME | list | unset | edit [APP] | reload]\n\n\
+  prompt [set NAME | list | unset | edit [APP] | reload | modules]\n\n\
 \x1b[1mEXAMPLES\x1b[22m\n\
 - List available prompts\n\
     prompt list (or 'prompt set <TAB>' to select from a list)\n\
@@ -990,7 +1003,9 @@ Note: Use the 'oc' command to edit file ownership."
 - Set the default prompt\n\
     prompt unset\n\
 - Reload available prompts\n\
-    prompt reload\n\n\
+    prompt reload\n\
+- Print timing information about prompt modules\n\
+    prompt modules\n\n\
 Note: To permanently set a new prompt edit the current\n\
 color scheme file ('cs edit'), and set the Prompt field to\n\
 whatever prompt you like."
@@ -1574,6 +1589,7 @@ PropFields in the config file)\
 \n      --shotgun-file=FILE\t Set FILE as Shotgun's configuration file\
 \n      --si\t\t\t Display file sizes in powers of 1000 (SI units) instead of 1024\
 \n      --sort-reverse\t\t Sort in reverse order, e.g., z-a instead of a-z\
+\n      --startup-trace[=FORMAT]\t Print the time spent in each startup step (to stderr). FORMAT: 'text' (default) or 'tsv'\
 \n      --stat FILE...\t\t Display information for files and exit\
 \n      --stat-full FILE...\t Short for '--stat --dereference --total-size'\
 \n      --tabmode=MODE\t\t Set tab completion mode to one of 'fzf', 'fnf', 'smenu', or 'standard'\
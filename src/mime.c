@@ -38,6 +38,7 @@
 # include "aux.h" /* open_f* functions */
 # include "spawn.h" /* launch_execv() */
 #endif /* !_NO_LIRA */
+#include "mimetypes.h" /* load_user_mimetypes(), user_mimetypes_lookup() */
 
 #ifndef _NO_LIRA
 static char *err_name = NULL;
@@ -57,26 +58,14 @@ static char g_mime_source = XMAGIC_SRC_NONE;
 /* Return the MIME type associated to the current file based on its extension.
  * Associations are taken from ~/.mime.types (or $CLIFM_MIMETYPES_FILE) and
  * stored in the user_mimetypes struct by load_user_mimetypes() (mimetypes.c). */
-static char *
+static const char *
 check_user_mimetypes(const char *file)
 {
 	const char *ext = strrchr(file, '.');
 	if (!ext || ext == file || !*(++ext))
 		return NULL;
 
-	const size_t hash = hashme(ext, conf.ignore_case);
-
-	static filesn_t n = 0;
-	if (n == 0)
-		for (n = 0; user_mimetypes[n].mimetype; n++);
-
-	filesn_t i = n;
-	while (--i >= 0)
-		/* An extension name starting with NUL byte is duplicated. Skip it. */
-		if (hash == user_mimetypes[i].ext_hash && *user_mimetypes[i].ext)
-			return user_mimetypes[i].mimetype;
-
-	return NULL;
+	return user_mimetypes_lookup(hashme(ext, conf.ignore_case));
 }
 
 #define MIME_FALLBACK_NONE     0
@@ -217,6 +206,31 @@ get_mimetype_fallback(const char *file)
 #undef MIME_FALLBACK_XDG_MIME
 
 #ifndef _NO_MAGIC
+/* Load the libmagic database used to get either MIME types (if QUERY_MIME is
+ * set to 1) or text descriptions (otherwise), if not already loaded.
+ * Returns FUNC_SUCCESS on success or FUNC_FAILURE on error. */
+int
+load_magic_db(const int query_mime)
+{
+	magic_t *cookie = query_mime == 1 ? &g_magic_mime_type_cookie
+		: &g_magic_text_desc_cookie;
+
+	if (*cookie)
+		return FUNC_SUCCESS;
+
+	*cookie = magic_open(query_mime == 1
+		? (MAGIC_MIME_TYPE | MAGIC_ERROR) : MAGIC_ERROR);
+	if (!*cookie)
+		return FUNC_FAILURE;
+
+	if (magic_load(*cookie, NULL) == -1) {
+		magic_close(*cookie);
+		*cookie = NULL;
+		return FUNC_FAILURE;
+	}
+
+	return FUNC_SUCCESS;
+}
 
 /* Return the MIME type of FILE if QUERY_MIME is set to 1, or a text description
  * otherwise. NULL is returned in case of error.
@@ -229,14 +243,14 @@ get_mimetype_fallback(const char *file)
  * consult the shared MIME-info database, using either mimetype(1) or
  * xdg-mime(1), in this order. If none is available, this fourth check is
  * skipped. */
-char *
-xmagic(const char *file, const int query_mime)
+static char *
+query_magic(const char *file, const int query_mime)
 {
 	if (!file || !*file)
 		return NULL;
 
 	g_mime_source = XMAGIC_SRC_NONE;
-	if (query_mime == 1 && user_mimetypes) {
+	if (query_mime == 1 && load_user_mimetypes() == FUNC_SUCCESS) {
 		const char *mime = check_user_mimetypes(file);
 		if (mime) {
 			g_mime_source = XMAGIC_SRC_MIME_FILE;
@@ -254,27 +268,8 @@ xmagic(const char *file, const int query_mime)
 	}
 #endif /* NO_FAST_MAGIC */
 
-	if (query_mime == 1 && !g_magic_mime_type_cookie) {
-		g_magic_mime_type_cookie = magic_open(MAGIC_MIME_TYPE | MAGIC_ERROR);
-		if (!g_magic_mime_type_cookie)
-			return NULL;
-		if (magic_load(g_magic_mime_type_cookie, NULL) == -1) {
-			magic_close(g_magic_mime_type_cookie);
-			g_magic_mime_type_cookie = NULL;
-			return NULL;
-		}
-	} else {
-		if (query_mime == 0 && !g_magic_text_desc_cookie) {
-			g_magic_text_desc_cookie = magic_open(MAGIC_ERROR);
-			if (!g_magic_text_desc_cookie)
-				return NULL;
-			if (magic_load(g_magic_text_desc_cookie, NULL) == -1) {
-				magic_close(g_magic_text_desc_cookie);
-				g_magic_text_desc_cookie = NULL;
-				return NULL;
-			}
-		}
-	}
+	if (load_magic_db(query_mime) != FUNC_SUCCESS)
+		return NULL;
 
 	magic_t cookie = query_mime == 1 ? g_magic_mime_type_cookie
 		: g_magic_text_desc_cookie;
@@ -312,14 +307,14 @@ xmagic(const char *file, const int query_mime)
  * Return the MIME type if QUERY_MIME is set to 1, or a text description
  * otherwise.
  * NULL is returned in case of error. */
-char *
-xmagic(const char *file, const int query_mime)
+static char *
+query_magic(const char *file, const int query_mime)
 {
 	if (!file || !*file)
 		return NULL;
 
 	g_mime_source = XMAGIC_SRC_NONE;
-	if (query_mime == 1 && user_mimetypes) {
+	if (query_mime == 1 && load_user_mimetypes() == FUNC_SUCCESS) {
 		const char *mime = check_user_mimetypes(file);
 		if (mime) {
 			g_mime_source = XMAGIC_SRC_MIME_FILE;
@@ -420,6 +415,85 @@ ERROR:
 }
 #endif /* !_NO_MAGIC */
 
+/* Cache of MIME types. It is only enabled by the preview server (see
+ * previewd.c), which gets the MIME type of each file to be previewed before
+ * forking the process running the previewer, which then finds it here: in
+ * this way, a file previewed several times is inspected only once.
+ * Files are looked up by name, and an entry is valid only if the device,
+ * inode number, size, and modification time of the file did not change.
+ * This is a direct-mapped cache: a new entry just replaces the entry in the
+ * same slot, if any. */
+#define MIME_CACHE_SIZE 1024 /* Must be a power of 2 */
+
+struct mime_cache_t {
+	char  *file;
+	char  *mime;
+	dev_t  dev;
+	ino_t  ino;
+	off_t  size;
+	time_t mtime;
+	long   mtime_nsec;
+	char   source; /* Value of g_mime_source */
+	char   pad0[7];
+};
+
+static struct mime_cache_t *mime_cache = NULL;
+
+/* Enable the MIME types cache or, if already enabled, clear it. */
+void
+init_mime_cache(void)
+{
+	if (!mime_cache) {
+		mime_cache = xcalloc(MIME_CACHE_SIZE, sizeof(struct mime_cache_t));
+		return;
+	}
+
+	for (size_t i = 0; i < MIME_CACHE_SIZE; i++) {
+		free(mime_cache[i].file);
+		free(mime_cache[i].mime);
+	}
+
+	memset(mime_cache, 0, MIME_CACHE_SIZE * sizeof(struct mime_cache_t));
+}
+
+/* Same as query_magic(), but MIME types are taken from the cache, if
+ * enabled. */
+char *
+xmagic(const char *file, const int query_mime)
+{
+	struct stat a;
+	if (!mime_cache || query_mime != 1 || !file || !*file
+	|| stat(file, &a) == -1)
+		return query_magic(file, query_mime);
+
+	struct mime_cache_t *c =
+		&mime_cache[hashme(file, 0) & (MIME_CACHE_SIZE - 1)];
+
+	if (c->file && c->dev == a.st_dev && c->ino == a.st_ino
+	&& c->size == a.st_size && c->mtime == a.st_mtime
+	&& c->mtime_nsec == (long)a.MTIMNSEC && strcmp(c->file, file) == 0) {
+		g_mime_source = c->source;
+		return savestring(c->mime, strlen(c->mime));
+	}
+
+	char *mime = query_magic(file, query_mime);
+	if (!mime)
+		return NULL;
+
+	free(c->file);
+	free(c->mime);
+	c->file = savestring(file, strlen(file));
+	c->mime = savestring(mime, strlen(mime));
+	c->dev = a.st_dev;
+	c->ino = a.st_ino;
+	c->size = a.st_size;
+	c->mtime = a.st_mtime;
+	c->mtime_nsec = (long)a.MTIMNSEC;
+	c->source = g_mime_source;
+
+	return mime;
+}
+
 #ifndef _NO_LIRA
 /* Expand all environment variables in the string S.
  * Returns the expanded string or NULL on error. */
@@ -662,6 +736,122 @@ retrieve_app(char *line)
 	return NULL; /* No app was found */
 }
 
+/* Rules read from the MIME file, with their patterns already compiled, so
+ * that several files can be matched against them without reading the file
+ * and compiling the patterns each time. Only used by the preview server
+ * (see previewd.c): load them via load_mime_rules(). */
+struct mime_rule_t {
+	char   *cmds;
+	regex_t regex;
+	int     by_name; /* Match against the file name (N: or E: prefix) */
+	int     pad0;
+};
+
+static struct {
+	struct mime_rule_t *r;
+	char  *file; /* The MIME file the rules were read from */
+	size_t n;
+	off_t  size;
+	time_t mtime;
+	long   mtime_nsec;
+} mime_rules = {NULL, NULL, 0, 0, 0, 0};
+
+static void
+free_mime_rules(void)
+{
+	for (size_t i = 0; i < mime_rules.n; i++) {
+		free(mime_rules.r[i].cmds);
+		regfree(&mime_rules.r[i].regex);
+	}
+
+	free(mime_rules.r);
+	free(mime_rules.file);
+	mime_rules.r = NULL;
+	mime_rules.file = NULL;
+	mime_rules.n = 0;
+}
+
+/* Read and compile the rules in the current MIME file (mime_file), unless
+ * already loaded and the file did not change since then.
+ * Returns FUNC_SUCCESS on success or FUNC_FAILURE on error. */
+int
+load_mime_rules(void)
+{
+	struct stat a;
+	if (!mime_file || !*mime_file || stat(mime_file, &a) == -1) {
+		free_mime_rules();
+		return FUNC_FAILURE;
+	}
+
+	if (mime_rules.file && strcmp(mime_rules.file, mime_file) == 0
+	&& mime_rules.size == a.st_size && mime_rules.mtime == a.st_mtime
+	&& mime_rules.mtime_nsec == (long)a.MTIMNSEC)
+		return FUNC_SUCCESS;
+
+	free_mime_rules();
+
+	int fd = -1;
+	FILE *fp = open_fread(mime_file, &fd);
+	if (!fp)
+		return FUNC_FAILURE;
+
+	size_t line_size = 0;
+	char *line = NULL;
+
+	while (getline(&line, &line_size, fp) > 0) {
+		char *pattern = NULL;
+		char *cmds = NULL;
+
+		if (skip_line(line, &pattern, &cmds) == 1)
+			continue;
+
+		const int by_name = (*pattern == 'N' || *pattern == 'E')
+			&& pattern[1] == ':';
+
+		regex_t regex;
+		if (regcomp(&regex, by_name == 1 ? pattern + 2 : pattern, REG_NOSUB
+		| REG_EXTENDED | (by_name == 1 ? REG_ICASE : 0)) != 0)
+			continue;
+
+		mime_rules.r = xnrealloc(mime_rules.r, mime_rules.n + 1,
+			sizeof(struct mime_rule_t));
+		mime_rules.r[mime_rules.n].cmds = savestring(cmds, strlen(cmds));
+		mime_rules.r[mime_rules.n].regex = regex;
+		mime_rules.r[mime_rules.n].by_name = by_name;
+		mime_rules.n++;
+	}
+
+	free(line);
+	fclose(fp);
+
+	mime_rules.file = savestring(mime_file, strlen(mime_file));
+	mime_rules.size = a.st_size;
+	mime_rules.mtime = a.st_mtime;
+	mime_rules.mtime_nsec = (long)a.MTIMNSEC;
+
+	return FUNC_SUCCESS;
+}
+
+/* Same as get_app(), but using the compiled rules in MIME_RULES. */
+static char *
+get_app_from_rules(const char *mime, const char *filename)
+{
+	for (size_t i = 0; i < mime_rules.n; i++) {
+		const struct mime_rule_t *r = &mime_rules.r[i];
+		const char *str = r->by_name == 1 ? filename : mime;
+		if (!str || regexec(&r->regex, str, 0, NULL, 0) != 0)
+			continue;
+
+		g_mime_match = r->by_name == 0;
+
+		char *app = retrieve_app(r->cmds);
+		if (app)
+			return app;
+	}
+
+	return NULL;
+}
+
 /* Get application associated to a given MIME type or filename.
  * Returns the first matching line in the MIME file or NULL if none is
  * found. */
@@ -671,6 +861,9 @@ get_app(const char *mime, const char *filename)
 	if (!mime || !mime_file || !*mime_file)
 		return NULL;
 
+	if (mime_rules.file && strcmp(mime_rules.file, mime_file) == 0)
+		return get_app_from_rules(mime, filename);
+
 	int fd = -1;
 	FILE *fp = open_fread(mime_file, &fd);
 	if (!fp) {
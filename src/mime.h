@@ -18,6 +18,13 @@ int  mime_open_with(const char *filename, char **args);
 char **mime_open_with_tab(const char *filename, const char *prefix,
 	const int only_names);
 char *xmagic(const char *file, const int query_mime);
+void init_mime_cache(void);
+#ifndef _NO_MAGIC
+int  load_magic_db(const int query_mime);
+#endif /* !_NO_MAGIC */
+#ifndef _NO_LIRA
+int  load_mime_rules(void);
+#endif /* !_NO_LIRA */
 
 int  mime_open_multiple_files(char **files);
 
@@ -11,19 +11,95 @@
 
 #include <string.h> /* strdup, strlen, strchr, strtok */
 
-#include "aux.h" /* hashme() */
+#include "aux.h" /* hashme(), next_pow2() */
+#include "mimetypes.h"
 
 #define INIT_BUF_SIZE 2048
 
+static size_t *mimetypes_table = NULL;
+static size_t mimetypes_table_mask = 0;
+static size_t mimetypes_table_size = 0;
+static int mimetypes_loaded = 0;
+
+/* Build an open-addressed lookup table mapping extension name hashes (in
+ * user_mimetypes[]) to an index in user_mimetypes[]. N is the number of
+ * entries in user_mimetypes[]. The approach is the same used for icons by
+ * ext_table_init() in listing.c.
+ *
+ * Entries are inserted in file order: if an extension is duplicated (same
+ * hash), the former slot is overwritten, so that only the last one is
+ * preserved. */
 static void
-check_hash_conflicts(void)
+mimetypes_table_init(const size_t n)
 {
-	for (size_t i = 0; user_mimetypes[i].mimetype; i++) {
-		for (size_t j = i + 1; user_mimetypes[j].mimetype; j++) {
-			if (user_mimetypes[i].ext_hash == user_mimetypes[j].ext_hash)
-				*user_mimetypes[i].ext = '\0';
+	const size_t needed = (size_t)((double)n / TABLE_LOAD_FACTOR) + 1;
+	size_t table_size = next_pow2(needed);
+
+	/* Ensure table_size >= n+1 to guarantee at least one empty slot */
+	if (table_size <= n)
+		table_size = next_pow2(n + 1);
+
+	mimetypes_table_size = table_size;
+	mimetypes_table_mask = table_size - 1;
+
+	mimetypes_table = xnmalloc(table_size, sizeof(size_t));
+
+	for (size_t i = 0; i < table_size; i++)
+		mimetypes_table[i] = SIZE_MAX;
+
+	for (size_t i = 0; i < n; i++) {
+		const size_t h = user_mimetypes[i].ext_hash;
+		/* Mix, then mask */
+		size_t idx = (h * (size_t)HASH_MULTIPLIER) & mimetypes_table_mask;
+		while (mimetypes_table[idx] != SIZE_MAX
+		&& user_mimetypes[mimetypes_table[idx]].ext_hash != h)
+			idx = (idx + 1) & mimetypes_table_mask;
+		mimetypes_table[idx] = i;
+	}
+}
+
+/* Return the MIME type associated to the file extension whose hash is
+ * EXT_HASH, or NULL if not found. */
+const char *
+user_mimetypes_lookup(const size_t ext_hash)
+{
+	load_user_mimetypes();
+
+	if (!mimetypes_table || mimetypes_table_size == 0)
+		return NULL;
+
+	size_t idx = (ext_hash * (size_t)HASH_MULTIPLIER) & mimetypes_table_mask;
+
+	for (size_t i = 0; i < mimetypes_table_size; i++) {
+		const size_t val = mimetypes_table[idx];
+		if (val == SIZE_MAX)
+			return NULL; /* Not found */
+
+		if (user_mimetypes[val].ext_hash == ext_hash)
+			return user_mimetypes[val].mimetype;
+
+		idx = (idx + 1) & mimetypes_table_mask;
+	}
+
+	return NULL; /* Table exhausted. Not found. */
+}
+
+void
+free_user_mimetypes(void)
+{
+	if (user_mimetypes) {
+		for (size_t i = 0; user_mimetypes[i].mimetype; i++) {
+			free(user_mimetypes[i].ext);
+			free(user_mimetypes[i].mimetype);
 		}
+		free(user_mimetypes);
+		user_mimetypes = NULL;
 	}
+
+	free(mimetypes_table);
+	mimetypes_table = NULL;
+	mimetypes_table_mask = mimetypes_table_size = 0;
+	mimetypes_loaded = 0;
 }
 
 static FILE *
@@ -70,7 +146,7 @@ get_mimetypes_file(void)
 	return NULL;
 }
 
-static void
+static size_t
 parse_shared_mime_info_db(FILE *fp)
 {
 	size_t buf_size = INIT_BUF_SIZE;
@@ -147,7 +223,7 @@ parse_shared_mime_info_db(FILE *fp)
 	if (n == 0) {
 		free(user_mimetypes);
 		user_mimetypes = NULL;
-		return;
+		return 0;
 	}
 
 	user_mimetypes[n].mimetype = NULL;
@@ -159,10 +235,10 @@ parse_shared_mime_info_db(FILE *fp)
 			xnrealloc(user_mimetypes, n + 1, sizeof(struct mime_t));
 	}
 
-	check_hash_conflicts();
+	return n;
 }
 
-static void
+static size_t
 parse_mime_types_file(FILE *fp)
 {
 	size_t buf_size = INIT_BUF_SIZE;
@@ -220,7 +296,7 @@ parse_mime_types_file(FILE *fp)
 	if (n == 0) {
 		free(user_mimetypes);
 		user_mimetypes = NULL;
-		return;
+		return 0;
 	}
 
 	user_mimetypes[n].mimetype = NULL;
@@ -232,25 +308,31 @@ parse_mime_types_file(FILE *fp)
 			xnrealloc(user_mimetypes, n + 1, sizeof(struct mime_t));
 	}
 
-	check_hash_conflicts();
+	return n;
 }
 
 /* Extract extension to MIME-type mappings from the file specified by
  * get_mimetypes_file() and store them in the user_mimetypes global array.
  * Returns FUNC_SUCCESS in case of success or FUNC_FAILURE in case of error.
  *
- * If a duplicated extension is found in the resulting user_mimetypes array,
- * the first one is nullified by setting its first character to the NUL byte
- * (only the last one is preserved).
+ * A lookup table is built to get the MIME type associated to an extension
+ * in constant time (see user_mimetypes_lookup()). If a duplicated extension
+ * is found, only the last one is preserved.
  *
  * It can parse a MIME Types file format file (e.g., /etc/mime.types or
  * ~/.mime.types), also handling subtly different formats like those
  * found in /etc/nginx/mime.types and /usr/share/mime/globs.
  * Also, it supports Shared MIME-info XML databases, like
- * /usr/share/mime/packages/freedesktop.org.xml */
+ * /usr/share/mime/packages/freedesktop.org.xml
+ * Since this is only needed to open files, it is done on first use (see
+ * user_mimetypes_lookup()). */
 int
 load_user_mimetypes(void)
 {
+	if (mimetypes_loaded == 1)
+		return user_mimetypes ? FUNC_SUCCESS : FUNC_FAILURE;
+	mimetypes_loaded = 1;
+
 	FILE *fp = get_mimetypes_file();
 	if (!fp)
 		return FUNC_FAILURE;
@@ -265,12 +347,13 @@ load_user_mimetypes(void)
 	ungetc(c, fp);
 
 	/* Store mappings in the user_mimetypes global array. */
-	if (is_xml == 1)
-		parse_shared_mime_info_db(fp);
-	else
-		parse_mime_types_file(fp);
+	const size_t n = is_xml == 1 ? parse_shared_mime_info_db(fp)
+		: parse_mime_types_file(fp);
 
 	fclose(fp);
 
+	if (n > 0)
+		mimetypes_table_init(n);
+
 	return FUNC_SUCCESS;
 }
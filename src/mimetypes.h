@@ -12,7 +12,9 @@
 
 __BEGIN_DECLS
 
+void free_user_mimetypes(void);
 int load_user_mimetypes(void);
+const char *user_mimetypes_lookup(const size_t ext_hash);
 
 __END_DECLS
 
@@ -49,17 +49,28 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 #include "autocmds.h" /* update_autocmd_opts() */
 #include "bookmarks.h"
 #include "checks.h"
+#include "colors.h" /* free_extension_colors() */
 #include "file_operations.h"
+#include "frame.h" /* frame_free() */
+#ifndef _NO_HIGHLIGHT
+# include "highlight.h" /* free_hl_cache() */
+#endif /* !_NO_HIGHLIGHT */
 #include "history.h"
+#include "idcache.h" /* free_id_cache() */
 #include "init.h"
 #include "jump.h"
 #include "listing.h"
 #include "messages.h"
+#include "mimetypes.h" /* free_user_mimetypes() */
 #include "navigation.h"
+#if !defined(_NO_LIRA) && !defined(_NO_FZF)
+# include "previewd.h" /* stop_preview_server() */
+#endif /* !_NO_LIRA && !_NO_FZF */
 #include "readline.h"
 #include "remotes.h"
 #include "spawn.h"
-#include "selset.h" /* devino_set_destroy */
+#include "selset.h" /* devino_set_destroy(), sel_index_clear() */
+#include "tags.h" /* free_tags_index() */
 
 char *
 gen_diff_str(const int diff)
@@ -447,6 +458,11 @@ validate_file_type_filter(void)
 	|| c == 'u' || c == 'x' || c == 'D' || c == 'F' || c == 'L')
 		return FUNC_SUCCESS;
 
+#ifndef _NO_TAGS
+	if (c == 'T')
+		return FUNC_SUCCESS;
+#endif /* !_NO_TAGS */
+
 	return FUNC_FAILURE;
 }
 
@@ -1029,6 +1045,10 @@ free_autocmds(const int keep_temp)
 void
 free_tags(void)
 {
+#ifndef _NO_TAGS
+	free_tags_index();
+#endif /* !_NO_TAGS */
+
 	for (size_t i = tags_n; i-- > 0;)
 		free(tags[i]);
 	free(tags);
@@ -1304,6 +1324,10 @@ free_stuff(void)
 {
 	size_t i = 0;
 
+#if !defined(_NO_LIRA) && !defined(_NO_FZF)
+	stop_preview_server();
+#endif /* !_NO_LIRA && !_NO_FZF */
+
 #ifndef _NO_MAGIC
 	if (g_magic_mime_type_cookie)
 		magic_close(g_magic_mime_type_cookie);
@@ -1320,24 +1344,9 @@ free_stuff(void)
 	free(alt_preview_file);
 	free(alt_profile);
 
-	if (user_mimetypes) {
-		for (i = 0; user_mimetypes[i].mimetype; i++) {
-			free(user_mimetypes[i].ext);
-			free(user_mimetypes[i].mimetype);
-		}
-		free(user_mimetypes);
-	}
-
-	if (sys_users) {
-		for (i = 0; sys_users[i].name; i++)
-			free(sys_users[i].name);
-		free(sys_users);
-	}
-	if (sys_groups) {
-		for (i = 0; sys_groups[i].name; i++)
-			free(sys_groups[i].name);
-		free(sys_groups);
-	}
+	free_user_mimetypes();
+	frame_free();
+	free_id_cache();
 
 #ifdef LINUX_FSINFO
 	if (ext_mnt) {
@@ -1378,6 +1387,10 @@ free_stuff(void)
 #endif /* LINUX_INOTIFY */
 
 	free_prompts();
+	free_dir_snapshots();
+#ifndef _NO_HIGHLIGHT
+	free_hl_cache();
+#endif /* !_NO_HIGHLIGHT */
 	free(prompts_file);
 	free_autocmds(0);
 	free_tags();
@@ -1445,6 +1458,7 @@ free_stuff(void)
 	}
 	free(sel_devino);
 	devino_set_destroy(&sel_set);
+	sel_index_clear();
 
 	if (bin_commands) {
 		for (i = path_progsn; i-- > 0;)
@@ -1511,13 +1525,7 @@ free_stuff(void)
 		free(messages);
 	}
 
-	if (ext_colors_n) {
-		for (i = ext_colors_n; i-- > 0;) {
-			free(ext_colors[i].name);
-			free(ext_colors[i].value);
-		}
-		free(ext_colors);
-	}
+	free_extension_colors();
 
 	if (workspaces && workspaces[0].path) {
 		for (i = MAX_WS; i-- > 0;) {
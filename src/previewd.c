@@ -0,0 +1,764 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* previewd.c -- a persistent server for file previews in fzf */
+
+/* When previews are enabled in fzf (tab completion and the 'view' command),
+ * fzf runs 'clifm --preview FILE' each time the current entry changes. Each
+ * time, a new instance is started, initialized, loads the libmagic database
+ * to get the MIME type of FILE, and reads the preview rules (preview.clifm),
+ * before actually running the previewer.
+ *
+ * Instead, the first time fzf is run with previews, a server is forked from
+ * the running instance (which is already initialized). It listens on a Unix
+ * socket, whose path is exported as CLIFM_PREVIEW_SOCKET. If this variable
+ * is set, 'clifm --preview' sends the request to the server before
+ * initializing anything (its standard file descriptors, working directory,
+ * environment, and FILE), and just waits for the exit status of the
+ * previewer. If the server cannot be reached, the file is previewed as usual.
+ *
+ * For each request, the server gets the MIME type of the file (it keeps the
+ * libmagic database loaded, and caches MIME types), and forks a process that
+ * runs the previewer exactly as 'clifm --preview' would, but using the rules
+ * in preview.clifm, which are compiled only once (and reloaded whenever the
+ * file changes). The server keeps the connection of each running worker:
+ * if the client goes away (fzf kills it as soon as the current entry
+ * changes), the process group of the worker (and thereby the previewer)
+ * is killed. */
+
+#if !defined(_NO_LIRA) && !defined(_NO_FZF)
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#ifndef _BE_POSIX
+# include <paths.h>
+# ifndef _PATH_DEVNULL
+#  define _PATH_DEVNULL "/dev/null"
+# endif /* _PATH_DEVNULL */
+#else
+# define _PATH_DEVNULL "/dev/null"
+#endif /* !_BE_POSIX */
+#include <poll.h>
+#include <readline/tilde.h> /* tilde_expand() */
+#include <signal.h>
+#include <stdint.h>         /* uint32_t */
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>       /* struct timeval */
+#include <sys/un.h>         /* struct sockaddr_un */
+#include <sys/wait.h>       /* waitpid() */
+#include <unistd.h>
+
+#include "args.h"            /* get_open_preview_path(), preview_this_file() */
+#include "aux.h"             /* clear_term_img(), xwrite() */
+#include "checks.h"          /* is_number() */
+#include "file_operations.h" /* open_file() */
+#include "mime.h"            /* load_magic_db(), load_mime_rules(), xmagic() */
+#include "misc.h"            /* xerror() */
+#include "previewd.h"
+
+#define PREVIEWD_SOCKET_ENV "CLIFM_PREVIEW_SOCKET"
+/* Max size of a request (mostly made of the client's environment). */
+#define PREVIEWD_MAX_REQ    (1024 * 1024)
+/* Seconds to wait for a client to send its whole request. */
+#define PREVIEWD_TIMEOUT    2
+/* Max number of workers whose client is watched at once. */
+#define PREVIEWD_MAX_JOBS   16
+
+extern char **environ;
+
+/* A request, as sent by the client: its standard file descriptors (via
+ * SCM_RIGHTS), plus a payload made of NUL terminated strings: the working
+ * directory, the file to be previewed, and the environment. */
+struct preview_req_t {
+	char  *buf;
+	char  *cwd;
+	char  *file;
+	char **env;
+	int    fds[3];
+	int    conn;
+};
+
+/* A running worker and the connection to its client. */
+struct preview_job_t {
+	pid_t pid;
+	int   conn;
+};
+
+static struct {
+	char *socket;
+	pid_t pid;
+	pid_t owner;     /* The process that started the server */
+	int   parent_fd; /* The server exits once this pipe is closed */
+	int   pad0;
+} server = {NULL, -1, -1, -1, 0};
+
+union fds_cmsg_t {
+	struct cmsghdr h;
+	char buf[CMSG_SPACE(sizeof(int) * 3)];
+};
+
+static int
+read_full(const int fd, void *buf, size_t len)
+{
+	char *p = buf;
+
+	while (len > 0) {
+		const ssize_t ret = read(fd, p, len);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return FUNC_FAILURE;
+
+		p += ret;
+		len -= (size_t)ret;
+	}
+
+	return FUNC_SUCCESS;
+}
+
+static void
+set_cloexec(const int fd)
+{
+	const int f = fcntl(fd, F_GETFD);
+	if (f != -1)
+		fcntl(fd, F_SETFD, f | FD_CLOEXEC);
+}
+
+/* Send the request in BUF (LEN bytes), together with our standard file
+ * descriptors, through the socket FD. */
+static int
+send_request(const int fd, char *buf, uint32_t len)
+{
+	const int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+	union fds_cmsg_t ctl;
+	memset(&ctl, 0, sizeof(ctl));
+
+	struct iovec iov[2];
+	iov[0].iov_base = &len;
+	iov[0].iov_len = sizeof(len);
+	iov[1].iov_base = buf;
+	iov[1].iov_len = len;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+
+	struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+	c->cmsg_level = SOL_SOCKET;
+	c->cmsg_type = SCM_RIGHTS;
+	c->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+	ssize_t ret;
+	while ((ret = sendmsg(fd, &msg, 0)) == -1 && errno == EINTR);
+	if (ret == -1)
+		return FUNC_FAILURE;
+
+	/* Short write: send the remaining bytes */
+	const size_t total = sizeof(len) + len;
+	if ((size_t)ret >= total)
+		return FUNC_SUCCESS;
+	if ((size_t)ret < sizeof(len))
+		return FUNC_FAILURE;
+
+	return xwrite(fd, buf + ((size_t)ret - sizeof(len)),
+		total - (size_t)ret);
+}
+
+/* Called by main() before initializing anything if running as
+ * 'clifm --preview FILE' (or 'clifm --preview -- FILE'): if a preview server
+ * is running, let it preview FILE and exit with the status of the previewer.
+ * Otherwise, just return, and FILE will be previewed as usual. */
+void
+preview_client(const int argc, char **argv)
+{
+	const char *sock = getenv(PREVIEWD_SOCKET_ENV);
+	if (!sock || !*sock)
+		return;
+
+	char *file = NULL;
+	if (argc == 3 && *argv[2] != '-')
+		file = argv[2];
+	else if (argc == 4 && strcmp(argv[2], "--") == 0)
+		file = argv[3];
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	char cwd[PATH_MAX + 1];
+	if (!file || !*file || strlen(sock) >= sizeof(addr.sun_path)
+	|| !getcwd(cwd, sizeof(cwd)))
+		return;
+
+	memcpy(addr.sun_path, sock, strlen(sock) + 1);
+
+	/* Build the payload: "CWD\0FILE\0VAR=VALUE\0VAR=VALUE\0..." */
+	const size_t cwd_len = strlen(cwd) + 1;
+	const size_t file_len = strlen(file) + 1;
+	size_t len = cwd_len + file_len;
+	size_t i;
+
+	for (i = 0; environ && environ[i]; i++)
+		len += strlen(environ[i]) + 1;
+
+	if (len > PREVIEWD_MAX_REQ)
+		return;
+
+	char *buf = malloc(len);
+	if (!buf)
+		return;
+
+	memcpy(buf, cwd, cwd_len);
+	memcpy(buf + cwd_len, file, file_len);
+	char *p = buf + cwd_len + file_len;
+	for (i = 0; environ && environ[i]; i++) {
+		const size_t l = strlen(environ[i]) + 1;
+		memcpy(p, environ[i], l);
+		p += l;
+	}
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		free(buf);
+		return;
+	}
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+	|| send_request(fd, buf, (uint32_t)len) != FUNC_SUCCESS) {
+		/* No server (or it did not get the request): preview it ourselves */
+		close(fd);
+		free(buf);
+		return;
+	}
+
+	free(buf);
+
+	/* The request was sent: the server is now in charge of the preview */
+	int status = 0;
+	if (read_full(fd, &status, sizeof(status)) != FUNC_SUCCESS)
+		status = EXIT_FAILURE;
+
+	close(fd);
+	exit(status);
+}
+
+/* Read a request from the socket FD into REQ.
+ * Returns FUNC_SUCCESS or FUNC_FAILURE. */
+static int
+recv_request(const int fd, struct preview_req_t *req)
+{
+	uint32_t len = 0;
+	union fds_cmsg_t ctl;
+	memset(&ctl, 0, sizeof(ctl));
+
+	struct iovec iov;
+	iov.iov_base = &len;
+	iov.iov_len = sizeof(len);
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+
+	ssize_t ret;
+	while ((ret = recvmsg(fd, &msg, 0)) == -1 && errno == EINTR);
+	if (ret <= 0)
+		return FUNC_FAILURE;
+
+	int nfds = 0;
+	struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+	if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+		nfds = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		if (nfds > 3)
+			nfds = 3;
+		memcpy(req->fds, CMSG_DATA(c), sizeof(int) * (size_t)nfds);
+	}
+
+	if (nfds != 3 || (msg.msg_flags & MSG_CTRUNC)
+	|| ((size_t)ret < sizeof(len)
+	&& read_full(fd, (char *)&len + ret, sizeof(len) - (size_t)ret)
+	!= FUNC_SUCCESS)
+	|| len == 0 || len > PREVIEWD_MAX_REQ)
+		goto ERROR;
+
+	req->buf = xnmalloc((size_t)len + 1, sizeof(char));
+	if (read_full(fd, req->buf, len) != FUNC_SUCCESS)
+		goto ERROR;
+	req->buf[len] = '\0';
+
+	/* Split the payload */
+	char *end = req->buf + len;
+	req->cwd = req->buf;
+	req->file = req->cwd + strlen(req->cwd) + 1;
+	if (req->file >= end || !*req->cwd || !*req->file)
+		goto ERROR;
+
+	char *p = req->file + strlen(req->file) + 1;
+	size_t n = 0;
+	for (char *q = p; q < end; q += strlen(q) + 1)
+		n++;
+
+	req->env = xnmalloc(n + 1, sizeof(char *));
+	for (n = 0; p < end; p += strlen(p) + 1)
+		req->env[n++] = p;
+	req->env[n] = NULL;
+
+	return FUNC_SUCCESS;
+
+ERROR:
+	for (int i = 0; i < nfds; i++)
+		close(req->fds[i]);
+	free(req->buf);
+	req->buf = NULL;
+	return FUNC_FAILURE;
+}
+
+/* Return the value of the variable NAME in the environment of the client
+ * that sent REQ, or NULL if not set. */
+static const char *
+req_getenv(const struct preview_req_t *req, const char *name)
+{
+	const size_t len = strlen(name);
+
+	for (size_t i = 0; req->env[i]; i++) {
+		if (strncmp(req->env[i], name, len) == 0 && req->env[i][len] == '=')
+			return req->env[i] + len + 1;
+	}
+
+	return NULL;
+}
+
+/* Set up the server to handle the request REQ, as 'clifm --preview' would
+ * (see open_preview_file() and open_reg_exit() in args.c), but using the
+ * environment of the client: set the MIME file (the preview file) and
+ * fast-magic. */
+static void
+set_preview_state(const struct preview_req_t *req)
+{
+	char file[PATH_MAX + 1];
+	const char *alt_file = req_getenv(req, "CLIFM_ALT_PREVIEW_FILE");
+
+	if (alt_file && *alt_file) {
+		xstrsncpy(file, alt_file, sizeof(file));
+	} else {
+		const char *home = req_getenv(req, "HOME");
+		snprintf(file, sizeof(file),
+			"%s/.config/clifm/profiles/default/preview.clifm",
+			home ? home : user.home);
+	}
+
+	if (!mime_file || strcmp(mime_file, file) != 0) {
+		free(mime_file);
+		mime_file = savestring(file, strlen(file));
+	}
+
+	load_mime_rules();
+
+	const char *fm = req_getenv(req, "CLIFM_FAST_MAGIC");
+	const int fast_magic = (fm && fm[0] == '1' && !fm[1]) ? 1 : DEF_FAST_MAGIC;
+	if (fast_magic != conf.fast_magic) {
+		/* Results would differ: do not use cached MIME types */
+		conf.fast_magic = fast_magic;
+		init_mime_cache();
+	}
+}
+
+/* Get the MIME type of the file in REQ (as mime_open() does), so that it is
+ * cached before forking the process running the previewer. */
+static void
+cache_mime_type(const struct preview_req_t *req)
+{
+	if (chdir(req->cwd) == -1)
+		return;
+
+	char buf[PATH_MAX + 1];
+	int url = 0;
+	char *fpath = get_open_preview_path(req->file, buf, &url);
+	if (!fpath || url == 1)
+		return;
+
+	char *p = *fpath == '~' ? tilde_expand(fpath) : NULL;
+	char *rpath = xrealpath(p ? p : fpath, NULL);
+	free(p);
+
+	if (rpath) {
+		free(xmagic(rpath, MIME_TYPE));
+		free(rpath);
+	}
+}
+
+/* Preview the file FILE, just as 'clifm --preview FILE' does. */
+static int
+preview_file(char *file)
+{
+	char buf[PATH_MAX + 1];
+	int url = 0;
+	char *fpath = get_open_preview_path(file, buf, &url);
+	if (!fpath) {
+		const int saved_errno = errno;
+		xerror("%s: '%s': %s\n", PROGRAM_NAME, file, strerror(saved_errno));
+		return saved_errno;
+	}
+
+	clear_term_img();
+
+	const char *max_size = url == 0 ? getenv("CLIFM_PREVIEW_MAX_SIZE") : NULL;
+	if (max_size && *max_size && is_number(max_size)
+	&& preview_this_file(fpath, max_size) == 0)
+		return EXIT_SUCCESS;
+
+	if (url == 1 && mime_open_url(fpath) == FUNC_SUCCESS)
+		return EXIT_SUCCESS;
+
+	char *p = *fpath == '~' ? tilde_expand(fpath) : NULL;
+	const int ret = open_file(p ? p : fpath);
+	free(p);
+	return ret;
+}
+
+static void
+set_signals(void (*handler)(int))
+{
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = handler;
+
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGQUIT, &sa, NULL);
+	sigaction(SIGTSTP, &sa, NULL);
+	sigaction(SIGTTIN, &sa, NULL);
+	sigaction(SIGTTOU, &sa, NULL);
+	sigaction(SIGPIPE, &sa, NULL);
+
+	sa.sa_handler = SIG_DFL;
+	sigaction(SIGHUP, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGCHLD, &sa, NULL);
+}
+
+/* Run the previewer for the request REQ in a child of the server, using
+ * the client's standard file descriptors, working directory, and
+ * environment, and send the exit status back to the client. */
+__attribute__ ((noreturn))
+static void
+run_worker(struct preview_req_t *req)
+{
+	set_signals(SIG_DFL);
+	/* Let the server kill the worker together with the previewer */
+	setpgid(0, 0);
+
+	for (int i = 0; i < 3; i++) {
+		dup2(req->fds[i], i);
+		close(req->fds[i]);
+	}
+
+	environ = req->env;
+
+	int status = FUNC_SUCCESS;
+	if (chdir(req->cwd) == -1) {
+		status = errno;
+		xerror("%s: '%s': %s\n", PROGRAM_NAME, req->cwd, strerror(errno));
+	} else {
+		status = preview_file(req->file);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	xwrite(req->conn, &status, sizeof(status));
+	_exit(status);
+}
+
+/* Handle the request sent over the connection CONN.
+ * Returns the PID of the worker running the previewer, or -1 on error. */
+static pid_t
+handle_request(const int conn, const int listen_fd, const int parent_fd)
+{
+	const struct timeval tv = {PREVIEWD_TIMEOUT, 0};
+	setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	struct preview_req_t req;
+	memset(&req, 0, sizeof(req));
+	req.conn = conn;
+
+	if (recv_request(conn, &req) != FUNC_SUCCESS)
+		return (-1);
+
+	set_preview_state(&req);
+	cache_mime_type(&req);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	const pid_t pid = fork();
+	if (pid == 0) {
+		close(listen_fd);
+		close(parent_fd);
+		run_worker(&req); /* noreturn */
+	}
+
+	if (pid > 0) /* Avoid racing with the worker's own setpgid() */
+		setpgid(pid, pid);
+
+	for (int i = 0; i < 3; i++)
+		close(req.fds[i]);
+	free(req.env);
+	free(req.buf);
+
+	return pid;
+}
+
+/* Forget about the finished worker PID, closing the connection to its
+ * client. */
+static void
+release_job(struct preview_job_t *jobs, const pid_t pid)
+{
+	for (size_t i = 0; i < PREVIEWD_MAX_JOBS; i++) {
+		if (jobs[i].pid == pid) {
+			if (jobs[i].conn != -1) /* -1 if already killed */
+				close(jobs[i].conn);
+			jobs[i].pid = -1;
+			jobs[i].conn = -1;
+			return;
+		}
+	}
+}
+
+/* Keep track of the worker PID running the request sent over CONN, so that
+ * it can be killed if the client goes away. If there is no room for it,
+ * the worker just runs unwatched. */
+static void
+watch_job(struct preview_job_t *jobs, const pid_t pid, const int conn)
+{
+	for (size_t i = 0; i < PREVIEWD_MAX_JOBS; i++) {
+		if (jobs[i].pid == -1) {
+			jobs[i].pid = pid;
+			jobs[i].conn = conn;
+			return;
+		}
+	}
+
+	close(conn);
+}
+
+/* Main loop of the server. */
+__attribute__ ((noreturn))
+static void
+run_server(const int listen_fd, const int parent_fd)
+{
+	set_signals(SIG_IGN);
+
+	/* Errors are printed by the worker processes (to the client's stderr) */
+	const int fd = open(_PATH_DEVNULL, O_RDWR);
+	if (fd != -1) {
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			close(fd);
+	}
+
+	/* The state of 'clifm --preview' */
+	xargs.open = 0;
+	xargs.preview = 1;
+	bg_proc = 0;
+	flags &= ~DELAYED_REFRESH;
+	free(conf.opener);
+	conf.opener = NULL;
+	conf.log_msgs = 0;
+	conf.desktop_notifications = 0;
+
+#ifndef _NO_MAGIC
+	load_magic_db(MIME_TYPE);
+#endif /* !_NO_MAGIC */
+	init_mime_cache();
+
+	struct preview_job_t jobs[PREVIEWD_MAX_JOBS];
+	size_t i;
+	for (i = 0; i < PREVIEWD_MAX_JOBS; i++) {
+		jobs[i].pid = -1;
+		jobs[i].conn = -1;
+	}
+
+	/* The listening socket, the parent pipe, and one slot per job */
+	struct pollfd pfd[2 + PREVIEWD_MAX_JOBS];
+	pfd[0].fd = listen_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = parent_fd;
+	pfd[1].events = POLLIN;
+
+	while (1) {
+		/* Reap finished workers */
+		pid_t done;
+		while ((done = waitpid(-1, NULL, WNOHANG)) > 0)
+			release_job(jobs, done);
+
+		/* The client sends nothing once the request is made: if its
+		 * connection becomes readable, it was closed. Negative FDs
+		 * (free slots) are ignored by poll(). */
+		for (i = 0; i < PREVIEWD_MAX_JOBS; i++) {
+			pfd[2 + i].fd = jobs[i].conn;
+			pfd[2 + i].events = POLLIN;
+			pfd[2 + i].revents = 0;
+		}
+
+		pfd[0].revents = pfd[1].revents = 0;
+		const int ret = poll(pfd, 2 + PREVIEWD_MAX_JOBS, 1000);
+		if (ret == -1 && errno != EINTR)
+			break;
+		if (ret <= 0)
+			continue;
+
+		if (pfd[1].revents != 0) /* Our parent is gone */
+			break;
+
+		/* The client is gone (killed by fzf): kill the worker and
+		 * the previewer. Unreaped workers keep their PID, so it cannot
+		 * have been reused. The slot is released once reaped. */
+		for (i = 0; i < PREVIEWD_MAX_JOBS; i++) {
+			if (jobs[i].conn != -1 && pfd[2 + i].revents != 0) {
+				kill(-jobs[i].pid, SIGKILL);
+				close(jobs[i].conn);
+				jobs[i].conn = -1;
+			}
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			const int conn = accept(listen_fd, NULL, NULL);
+			if (conn != -1) {
+				set_cloexec(conn);
+				const pid_t pid =
+					handle_request(conn, listen_fd, parent_fd);
+				if (pid > 0)
+					watch_job(jobs, pid, conn);
+				else
+					close(conn);
+			}
+		}
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+static void
+free_server(void)
+{
+	if (server.parent_fd != -1)
+		close(server.parent_fd);
+
+	if (server.socket) {
+		unlinkat(XAT_FDCWD, server.socket, 0);
+		free(server.socket);
+	}
+
+	unsetenv(PREVIEWD_SOCKET_ENV);
+	server.socket = NULL;
+	server.pid = server.owner = -1;
+	server.parent_fd = -1;
+}
+
+/* Start the preview server, if not already running. On error, nothing
+ * happens: files are then previewed by a new instance each time. */
+void
+start_preview_server(void)
+{
+	if (server.pid > 0) {
+		if (waitpid(server.pid, NULL, WNOHANG) == 0)
+			return; /* Still running */
+		free_server();
+	}
+
+	/* Running with restricted access to the environment or to config
+	 * files: let 'clifm --preview' handle these cases. */
+	if (xargs.stealth_mode == 1 || xargs.secure_env == 1
+	|| xargs.secure_env_full == 1 || !tmp_dir || !*tmp_dir)
+		return;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	const int n = snprintf(addr.sun_path, sizeof(addr.sun_path),
+		"%s/preview.%d.sock", tmp_dir, (int)getpid());
+	if (n < 0 || (size_t)n >= sizeof(addr.sun_path))
+		return;
+
+	unlinkat(XAT_FDCWD, addr.sun_path, 0);
+
+	int pfd[2] = {-1, -1};
+	const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd == -1)
+		return;
+
+	const mode_t old_mask = umask(0077); /* flawfinder: ignore */
+	const int ret = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(old_mask); /* flawfinder: ignore */
+
+	if (ret == -1 || listen(listen_fd, 16) == -1 || pipe(pfd) == -1)
+		goto ERROR;
+
+	set_cloexec(listen_fd);
+	set_cloexec(pfd[0]);
+	set_cloexec(pfd[1]);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	const pid_t pid = fork();
+	if (pid == -1)
+		goto ERROR;
+
+	if (pid == 0) {
+		close(pfd[1]);
+		run_server(listen_fd, pfd[0]); /* noreturn */
+	}
+
+	close(listen_fd);
+	close(pfd[0]);
+
+	server.pid = pid;
+	server.owner = getpid();
+	server.parent_fd = pfd[1];
+	server.socket = savestring(addr.sun_path, strlen(addr.sun_path));
+	setenv(PREVIEWD_SOCKET_ENV, server.socket, 1);
+	return;
+
+ERROR:
+	close(listen_fd);
+	if (pfd[0] != -1) {
+		close(pfd[0]);
+		close(pfd[1]);
+	}
+	unlinkat(XAT_FDCWD, addr.sun_path, 0);
+}
+
+/* Stop the preview server, if running. */
+void
+stop_preview_server(void)
+{
+	/* Forked children of the process running the server may exit via
+	 * exit(3), running free_stuff() as well. */
+	if (server.pid <= 0 || server.owner != getpid())
+		return;
+
+	kill(server.pid, SIGTERM);
+	while (waitpid(server.pid, NULL, 0) == -1 && errno == EINTR);
+	free_server();
+}
+
+#else
+void *_skip_me_previewd;
+#endif /* !_NO_LIRA && !_NO_FZF */
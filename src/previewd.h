@@ -0,0 +1,21 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* previewd.h */
+
+#ifndef CLIFM_PREVIEWD_H
+#define CLIFM_PREVIEWD_H
+
+__BEGIN_DECLS
+
+void preview_client(const int argc, char **argv);
+void start_preview_server(void);
+void stop_preview_server(void);
+
+__END_DECLS
+
+#endif /* CLIFM_PREVIEWD_H */
@@ -12,7 +12,13 @@
 
 #include "helpers.h"
 
+#include <fcntl.h>    /* fcntl() */
+#include <poll.h>
+#include <signal.h>   /* kill() */
 #include <string.h>
+#include <sys/wait.h> /* waitpid() */
+#include <time.h>     /* clock_gettime() */
+#include <unistd.h>   /* pipe(), fork(), setpgid(), dup2(), read(), close() */
 #if !defined(__HAIKU__) && !defined(__OpenBSD__) && !defined(__ANDROID__)
 # include <wordexp.h>
 #endif /* !__HAIKU__ && !__OpenBSD__ && !__ANDROID__ */
@@ -20,7 +26,7 @@
 #include <readline/history.h> /* history_expand() */
 #include <errno.h>
 
-#include "aux.h"
+#include "aux.h" /* xwrite() */
 #include "checks.h" /* is_number() */
 #include "colors.h" /* update_warning_prompt_text_color() */
 #include "file_operations.h"
@@ -38,6 +44,9 @@
 #ifndef _NO_SUGGESTIONS
 # include "suggestions.h"
 #endif /* !_NO_SUGGESTIONS */
+#ifndef _NO_HIGHLIGHT
+# include "highlight.h" /* recolorize_line() */
+#endif /* !_NO_HIGHLIGHT */
 
 #if defined(__HAIKU__) || defined(__OpenBSD__) || defined(__ANDROID__)
 # define NO_WORDEXP
@@ -51,6 +60,42 @@ struct p_mod_paths_t {
 };
 
 static struct p_mod_paths_t p_mod_paths[MAX_PMOD_PATHS];
+
+/* Max amount of cached values of prompt modules/command substitutions */
+# define PMOD_CACHE_MAX  32
+/* Max size of the output of a prompt module */
+# define PMOD_MAX_OUTPUT 4096
+/* Max time (in milliseconds) to wait for prompt modules before drawing the
+ * prompt with their last known values */
+# define PMOD_WAIT_MS    50
+
+struct pmod_cache_t {
+	char  *cmd;     /* Command, in the form "$(cmd)" */
+	char  *cwd;     /* Directory the command runs in */
+	char  *value;   /* Last known output of the command */
+	char  *out;     /* Output of the running job, read so far */
+	size_t out_len;
+	size_t runs;
+	size_t cycle;   /* Prompt cycle of the last run */
+	double started; /* Start time of the last run */
+	double updated; /* Time the value was last updated */
+	double elapsed; /* Duration of the last run (seconds) */
+	double total;   /* Duration of all runs (seconds) */
+	pid_t  pid;     /* PID of the running job */
+	int    fd;      /* Read end of the pipe of the running job (or -1) */
+	int    ttl;     /* Time (in seconds) the value is considered fresh */
+	int    shown;   /* The value is on the screen */
+};
+
+static struct pmod_cache_t pmod_cache[PMOD_CACHE_MAX];
+static size_t pmod_cache_n = 0;
+static size_t pmod_cycle = 1;
+static size_t pmod_running = 0;
+static double pmod_deadline = 0;
+static int pmod_repaint = 0;
+/* The prompt passed to readline(), and its amount of autocommand matches */
+static char *pmod_prompt = NULL;
+static size_t pmod_ac_matches = 0;
 #endif /* __HAIKU__ || __OpenBSD__ || __ANDROID__ */
 
 int g_prompt_ignore_empty_line = 0;
@@ -493,8 +538,347 @@ reset_ifs(const char *value)
 		unsetenv("IFS");
 }
 
+/* Perform command substitution on CMD (in the form "$(cmd)") and return
+ * the expanded value, or NULL if nothing was expanded. */
+static char *
+expand_cmd(char *cmd)
+{
+	char *old_value = xgetenv("IFS", 1);
+	setenv("IFS", "", 1);
+
+	wordexp_t wordbuf;
+	const int ret = wordexp(cmd, &wordbuf, 0);
+
+	reset_ifs(old_value);
+	free(old_value);
+
+	if (ret != 0)
+		return NULL;
+
+	if (wordbuf.we_wordc == 0) {
+		wordfree(&wordbuf);
+		return NULL;
+	}
+
+	char *buf = NULL;
+	size_t buf_len = 0;
+
+	for (size_t j = 0; j < wordbuf.we_wordc; j++) {
+		const size_t cur_buf_len = buf_len;
+
+		buf_len += strlen(wordbuf.we_wordv[j]);
+		buf = xnrealloc(buf, buf_len + 1, sizeof(char));
+		if (cur_buf_len == 0)
+			*buf = '\0';
+
+		xstrncat(buf, cur_buf_len, wordbuf.we_wordv[j], buf_len + 1);
+	}
+
+	wordfree(&wordbuf);
+	return buf;
+}
+
+/* Prompt modules and command substitutions are run asynchronously: the
+ * prompt is drawn with the last known value of each command for the
+ * current directory (waiting at most PMOD_WAIT_MS for fresh values), and
+ * repainted by wait_prompt_jobs() once fresh values arrive. Values are
+ * cached per command and directory: a value is reused without running the
+ * command again as long as it is younger than the TTL of the command
+ * ("${module:TTL}"), and a command is run at most once per prompt cycle. */
+
+static double
+pmod_now(void)
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		return 0;
+
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static struct pmod_cache_t *
+find_pmod_entry(const char *cmd, const char *cwd)
+{
+	for (size_t i = 0; i < pmod_cache_n; i++) {
+		if (strcmp(pmod_cache[i].cmd, cmd) == 0
+		&& strcmp(pmod_cache[i].cwd, cwd) == 0)
+			return &pmod_cache[i];
+	}
+
+	return NULL;
+}
+
+static void
+stop_pmod_job(struct pmod_cache_t *e)
+{
+	if (e->fd == -1)
+		return;
+
+	close(e->fd);
+	e->fd = -1;
+	/* Kill the whole process group: the command is run by a shell
+	 * (wordexp(3)), which would otherwise be left running. */
+	if (kill(-e->pid, SIGKILL) == -1)
+		kill(e->pid, SIGKILL);
+	waitpid(e->pid, NULL, 0);
+	free(e->out);
+	e->out = NULL;
+	e->out_len = 0;
+	pmod_running--;
+}
+
+/* Return a new cache entry for CMD run in CWD. If the cache is full, the
+ * least recently updated entry is reused. */
+static struct pmod_cache_t *
+new_pmod_entry(const char *cmd, const char *cwd)
+{
+	struct pmod_cache_t *e = NULL;
+
+	if (pmod_cache_n < PMOD_CACHE_MAX) {
+		e = &pmod_cache[pmod_cache_n++];
+	} else {
+		e = &pmod_cache[0];
+		for (size_t i = 1; i < pmod_cache_n; i++) {
+			if (pmod_cache[i].updated < e->updated)
+				e = &pmod_cache[i];
+		}
+
+		stop_pmod_job(e);
+		free(e->cmd);
+		free(e->cwd);
+		free(e->value);
+	}
+
+	memset(e, 0, sizeof(struct pmod_cache_t));
+	e->cmd = savestring(cmd, strlen(cmd));
+	e->cwd = savestring(cwd, strlen(cwd));
+	e->fd = -1;
+
+	return e;
+}
+
+static void
+set_pmod_value(struct pmod_cache_t *e, char *value)
+{
+	const int changed = (!value != !e->value)
+		|| (value && strcmp(value, e->value) != 0);
+
+	free(e->value);
+	e->value = value;
+	e->updated = pmod_now();
+	e->elapsed = e->updated - e->started;
+	e->total += e->elapsed;
+	e->runs++;
+
+	/* The old value is already on the screen: repaint the prompt */
+	if (changed == 1 && e->shown == 1)
+		pmod_repaint = 1;
+}
+
+/* The job running for the cache entry E is done: get its output. */
+static void
+finish_pmod_job(struct pmod_cache_t *e)
+{
+	int status = 0;
+	const pid_t ret = waitpid(e->pid, &status, 0);
+
+	close(e->fd);
+	e->fd = -1;
+	pmod_running--;
+
+	char *out = e->out;
+	if (out)
+		out[e->out_len] = '\0';
+	e->out = NULL;
+	e->out_len = 0;
+
+	if (ret != -1 && WIFSIGNALED(status)) {
+		/* Interrupted: keep the last known value */
+		free(out);
+		return;
+	}
+
+	set_pmod_value(e, out);
+}
+
+static void
+read_pmod_output(struct pmod_cache_t *e)
+{
+	char buf[4096];
+	const ssize_t n = read(e->fd, buf, sizeof(buf));
+
+	if (n == -1 && (errno == EINTR || errno == EAGAIN))
+		return;
+
+	if (n <= 0) { /* EOF */
+		finish_pmod_job(e);
+		return;
+	}
+
+	/* Excess output is dropped: this is a prompt */
+	const size_t len = e->out_len + (size_t)n > PMOD_MAX_OUTPUT
+		? PMOD_MAX_OUTPUT - e->out_len : (size_t)n;
+	if (len == 0)
+		return;
+
+	e->out = xnrealloc(e->out, e->out_len + len + 1, sizeof(char));
+	memcpy(e->out + e->out_len, buf, len);
+	e->out_len += len;
+}
+
+/* Wait at most TIMEOUT milliseconds (-1 for no limit) for output from
+ * running prompt jobs, or for FD (if not -1) to be ready for reading.
+ * Returns 1 if FD is ready for reading, -1 on error, or 0 otherwise. */
+static int
+poll_pmod_jobs(const int fd, const int timeout)
+{
+	struct pollfd pfd[PMOD_CACHE_MAX + 1];
+	size_t ids[PMOD_CACHE_MAX + 1];
+	nfds_t n = 0;
+
+	if (fd != -1) {
+		pfd[n].fd = fd;
+		pfd[n].events = POLLIN;
+		pfd[n].revents = 0;
+		ids[n++] = 0;
+	}
+
+	for (size_t i = 0; i < pmod_cache_n; i++) {
+		if (pmod_cache[i].fd == -1)
+			continue;
+		pfd[n].fd = pmod_cache[i].fd;
+		pfd[n].events = POLLIN;
+		pfd[n].revents = 0;
+		ids[n++] = i;
+	}
+
+	if (n == 0)
+		return 0;
+
+	const int ret = poll(pfd, n, timeout);
+	if (ret <= 0)
+		return ret;
+
+	nfds_t i = 0;
+	int fd_ready = 0;
+	if (fd != -1) {
+		fd_ready = pfd[0].revents != 0;
+		i++;
+	}
+
+	for (; i < n; i++) {
+		if (pfd[i].revents != 0)
+			read_pmod_output(&pmod_cache[ids[i]]);
+	}
+
+	return fd_ready;
+}
+
+static int
+start_pmod_job(struct pmod_cache_t *e)
+{
+	int fd[2];
+	if (pipe(fd) == -1)
+		return FUNC_FAILURE;
+
+	const pid_t pid = fork();
+	if (pid == -1) {
+		close(fd[0]);
+		close(fd[1]);
+		return FUNC_FAILURE;
+	}
+
+	if (pid == 0) {
+		close(fd[0]);
+		/* Run in a process group of our own, so that the shell spawned by
+		 * wordexp(3), and its children, can be killed at once (see
+		 * stop_pmod_job()). */
+		setpgid(0, 0);
+		/* Keep the command away from the user's input */
+		const int null_fd = open("/dev/null", O_RDONLY);
+		if (null_fd != -1) {
+			dup2(null_fd, STDIN_FILENO);
+			close(null_fd);
+		}
+
+		char *out = expand_cmd(e->cmd);
+		if (out)
+			xwrite(fd[1], out, strlen(out));
+
+		_exit(out ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	/* Also set here, in case the job is stopped before the child runs */
+	setpgid(pid, 0);
+	close(fd[1]);
+	const int fd_flags = fcntl(fd[0], F_GETFD);
+	if (fd_flags != -1)
+		fcntl(fd[0], F_SETFD, fd_flags | FD_CLOEXEC);
+
+	e->fd = fd[0];
+	e->pid = pid;
+	pmod_running++;
+
+	return FUNC_SUCCESS;
+}
+
+/* Start a new prompt cycle: prompt modules are run (at most) once per
+ * cycle. */
+static void
+new_pmod_cycle(void)
+{
+	pmod_cycle++;
+	pmod_repaint = 0;
+
+	for (size_t i = 0; i < pmod_cache_n; i++)
+		pmod_cache[i].shown = 0;
+}
+
+/* Return the value of the command CMD for the current directory, starting
+ * a new job to update it if needed. */
+static char *
+get_pmod_value(char *cmd, const int ttl)
+{
+	const char *cwd = (workspaces && workspaces[cur_ws].path)
+		? workspaces[cur_ws].path : "";
+
+	/* Collect the output of finished jobs */
+	if (pmod_running > 0)
+		poll_pmod_jobs(-1, 0);
+
+	struct pmod_cache_t *e = find_pmod_entry(cmd, cwd);
+	if (!e)
+		e = new_pmod_entry(cmd, cwd);
+
+	const double now = pmod_now();
+	e->ttl = ttl;
+
+	if (e->fd == -1 && e->cycle != pmod_cycle
+	&& (e->runs == 0 || now - e->updated >= (double)ttl)) {
+		e->cycle = pmod_cycle;
+		e->started = now;
+		if (start_pmod_job(e) != FUNC_SUCCESS)
+			/* Cannot run it in the background: run it here */
+			set_pmod_value(e, expand_cmd(cmd));
+	}
+
+	if (e->fd != -1) {
+		/* Give it some time before using the last known value */
+		if (pmod_deadline == 0)
+			pmod_deadline = now + (double)PMOD_WAIT_MS / 1000.0;
+
+		double left;
+		while (e->fd != -1 && (left = pmod_deadline - pmod_now()) > 0)
+			poll_pmod_jobs(-1, (int)(left * 1000.0) + 1);
+	}
+
+	e->shown = 1;
+	return e->value;
+}
+
 static void
-substitute_cmd(char *cmd, char **buf, size_t *buf_len, char **cmd_end)
+substitute_cmd(char *cmd, char **buf, size_t *buf_len, char **cmd_end,
+	const int ttl)
 {
 	if (!cmd || !buf || !buf_len)
 		return;
@@ -507,11 +891,7 @@ substitute_cmd(char *cmd, char **buf, size_t *buf_len, char **cmd_end)
 	const char c = p[1];
 	p[1] = '\0';
 
-	char *old_value = xgetenv("IFS", 1);
-	setenv("IFS", "", 1);
-
-	wordexp_t wordbuf;
-	const int ret = wordexp(cmd, &wordbuf, 0);
+	const char *value = get_pmod_value(cmd, ttl);
 
 	p[1] = c;
 
@@ -519,32 +899,20 @@ substitute_cmd(char *cmd, char **buf, size_t *buf_len, char **cmd_end)
 	if (cmd_end)
 		*cmd_end = p;
 
-	reset_ifs(old_value);
-	free(old_value);
-
-	if (ret != 0)
+	if (!value || !*value)
 		return;
 
-	if (wordbuf.we_wordc == 0) {
-		wordfree(&wordbuf);
-		return;
-	}
+	const size_t cur_buf_len = *buf_len;
 
-	for (size_t j = 0; j < wordbuf.we_wordc; j++) {
-		const size_t cur_buf_len = *buf_len;
-
-		*buf_len += strlen(wordbuf.we_wordv[j]);
-		if (!*buf) {
-			*buf = xnmalloc(*buf_len + 1, sizeof(char));
-			*(*buf) = '\0';
-		} else {
-			*buf = xnrealloc(*buf, *buf_len + 1, sizeof(char));
-		}
-
-		xstrncat(*buf, cur_buf_len, wordbuf.we_wordv[j], *buf_len + 1);
+	*buf_len += strlen(value);
+	if (!*buf) {
+		*buf = xnmalloc(*buf_len + 1, sizeof(char));
+		*(*buf) = '\0';
+	} else {
+		*buf = xnrealloc(*buf, *buf_len + 1, sizeof(char));
 	}
 
-	wordfree(&wordbuf);
+	xstrncat(*buf, cur_buf_len, value, *buf_len + 1);
 }
 #endif /* !NO_WORDEXP */
 
@@ -937,13 +1305,25 @@ run_prompt_module(char *module, char **buf, size_t *buf_len, char **end)
 
 	*p = '\0';
 
+	/* "${module:TTL}" */
+	int ttl = 0;
+	char *colon = strchr(module + 1, ':');
+	if (colon && is_number(colon + 1)) {
+		*colon = '\0';
+		ttl = xatoi(colon + 1);
+	} else {
+		colon = NULL;
+	}
+
 	const char *p_path = get_prompt_module_path(module + 1);
 	if (p_path) {
 		char cmd[PATH_MAX + 4];
 		snprintf(cmd, sizeof(cmd), "$(%s)", p_path);
-		substitute_cmd(cmd, buf, buf_len, NULL);
+		substitute_cmd(cmd, buf, buf_len, NULL, ttl);
 	}
 
+	if (colon)
+		*colon = ':';
 	*p = '}';
 
 	if (end)
@@ -998,6 +1378,10 @@ decode_prompt(char *line)
 	size_t buf_len = 0;
 	int c;
 
+#ifndef NO_WORDEXP
+	pmod_deadline = 0;
+#endif /* !NO_WORDEXP */
+
 	while ((c = (int)*line++)) {
 		/* Color notation: "%{color}" */
 		if (c == '%' && *line == '{' && line[1]) {
@@ -1157,7 +1541,7 @@ decode_prompt(char *line)
 			if (c == '$' && *line == '(') {
 				char *cmd_begin = line - 1;
 				char *cmd_end = NULL;
-				substitute_cmd(cmd_begin, &buf, &buf_len, &cmd_end);
+				substitute_cmd(cmd_begin, &buf, &buf_len, &cmd_end, 0);
 				if (cmd_end)
 					/* Line points now after the trailing parenthesis */
 					line = cmd_end + 1;
@@ -1486,6 +1870,11 @@ initialize_prompt_data(const int prompt_flag, size_t *ac_matches)
 	if (prompt_flag != PROMPT_UPDATE)
 		run_prompt_cmds();
 
+#ifndef NO_WORDEXP
+	if (prompt_flag != PROMPT_UPDATE)
+		new_pmod_cycle();
+#endif /* !NO_WORDEXP */
+
 #ifndef _NO_TRASH
 	update_trash_indicator();
 #endif /* !_NO_TRASH */
@@ -1609,6 +1998,94 @@ print_right_prompt(void)
 	free(rprompt);
 }
 
+#ifndef NO_WORDEXP
+/* Redraw the current prompt with the fresh values of prompt modules. */
+static void
+repaint_prompt(void)
+{
+	/* Repaint only the regular prompt, and only if the cursor is on its
+	 * last line. */
+	if (!pmod_prompt || !rl_prompt || strcmp(rl_prompt, pmod_prompt) != 0
+	|| RL_ISSTATE(RL_STATE_MOREINPUT | RL_STATE_MULTIKEY | RL_STATE_ISEARCH
+	| RL_STATE_NSEARCH | RL_STATE_SEARCH | RL_STATE_NUMERICARG
+	| RL_STATE_COMPLETING)
+	|| (prompt_offset != UNSET && prompt_offset + rl_end >= term_cols))
+		return;
+
+	pmod_repaint = 0;
+
+	char *decoded_prompt = decode_prompt(conf.encoded_prompt);
+	char *the_prompt = construct_prompt(decoded_prompt
+		? decoded_prompt : EMERGENCY_PROMPT, pmod_ac_matches);
+	free(decoded_prompt);
+
+	if (strcmp(the_prompt, pmod_prompt) == 0) {
+		free(the_prompt);
+		return;
+	}
+
+#ifndef _NO_SUGGESTIONS
+	if (suggestion.printed == 1 && suggestion_buf)
+		clear_suggestion(CS_FREEBUF);
+#endif /* !_NO_SUGGESTIONS */
+
+	HIDE_CURSOR;
+
+	int lines = 0;
+	for (char *p = pmod_prompt; *p; p++)
+		lines += *p == '\n';
+	if (lines > 0)
+		MOVE_CURSOR_UP(lines);
+	putchar('\r');
+	ERASE_TO_RIGHT_AND_BELOW;
+
+	if (conf.rprompt_str && *conf.rprompt_str
+	&& conf.prompt_is_multiline == 1 && term_caps.suggestions == 1)
+		print_right_prompt();
+
+	free(pmod_prompt);
+	pmod_prompt = the_prompt;
+	rl_set_prompt(the_prompt);
+	prompt_offset = UNSET;
+	rl_forced_update_display();
+
+#ifndef _NO_HIGHLIGHT
+	if (conf.highlight == 1 && rl_end > 0) {
+		const int point = rl_point;
+		rl_point = 0;
+		recolorize_line();
+		rl_point = point;
+		rl_redisplay();
+	}
+#endif /* !_NO_HIGHLIGHT */
+
+	UNHIDE_CURSOR;
+	fflush(stdout);
+}
+#endif /* !NO_WORDEXP */
+
+/* Called by readline's input function before reading from FD: while prompt
+ * modules are running, wait for input on FD, repainting the prompt whenever
+ * fresh values for prompt modules arrive. */
+void
+wait_prompt_jobs(const int fd)
+{
+#ifdef NO_WORDEXP
+	UNUSED(fd);
+#else
+	while (pmod_running > 0 || pmod_repaint == 1) {
+		if (pmod_repaint == 1) {
+			repaint_prompt();
+			if (pmod_repaint == 1) /* Not now */
+				return;
+		}
+
+		if (pmod_running == 0 || poll_pmod_jobs(fd, -1) != 0)
+			return;
+	}
+#endif /* NO_WORDEXP */
+}
+
 /* Some commands take '!' as parameter modifier: quick search, 'filter',
  * and 'sel', in which case history expansion must not be performed.
  * Return 1 if we have one of these commands or 0 otherwise. */
@@ -1714,8 +2191,18 @@ prompt(const int prompt_flag, const int screen_refresh)
 
 	UNHIDE_CURSOR;
 
+#ifndef NO_WORDEXP
+	pmod_prompt = the_prompt;
+	pmod_ac_matches = ac_matches;
+#endif /* !NO_WORDEXP */
+
 	/* Print the prompt and get user input */
 	char *input = readline(the_prompt);
+#ifndef NO_WORDEXP
+	/* The prompt might have been repainted */
+	the_prompt = pmod_prompt;
+	pmod_prompt = NULL;
+#endif /* !NO_WORDEXP */
 	free(the_prompt);
 
 	if (!input || !*input || rl_end == 0) {
@@ -1756,6 +2243,43 @@ list_prompts(void)
 	return FUNC_SUCCESS;
 }
 
+/* Print timing information about prompt modules and command
+ * substitutions. */
+static int
+list_prompt_modules(void)
+{
+#ifdef NO_WORDEXP
+	xerror("%s\n", _("prompt: Prompt modules are not supported on "
+		"this platform"));
+	return FUNC_FAILURE;
+#else
+	if (pmod_cache_n == 0) {
+		puts(_("prompt: No prompt module has been run yet"));
+		return FUNC_SUCCESS;
+	}
+
+	const double now = pmod_now();
+	for (size_t i = 0; i < pmod_cache_n; i++) {
+		const struct pmod_cache_t *e = &pmod_cache[i];
+
+		printf("%s%s%s %s(%s)%s\n", BOLD, e->cmd, df_c, dn_c, e->cwd, df_c);
+		if (e->runs == 0) {
+			puts(_("  Running (no value yet)"));
+			continue;
+		}
+
+		printf(_("  Last run: %.2f ms | Average: %.2f ms | Runs: %zu\n"),
+			e->elapsed * 1000.0, e->total * 1000.0 / (double)e->runs,
+			e->runs);
+		printf(_("  Updated: %.1f s ago | TTL: %d s%s\n"),
+			now - e->updated, e->ttl,
+			e->fd != -1 ? _(" | Running") : "");
+	}
+
+	return FUNC_SUCCESS;
+#endif /* NO_WORDEXP */
+}
+
 static int
 switch_prompt(const size_t n)
 {
@@ -1945,6 +2469,9 @@ prompt_function(char **args)
 	if (*args[0] == 'e' && strcmp(args[0], "edit") == 0)
 		return edit_prompts_file(args[1]);
 
+	if (*args[0] == 'm' && strcmp(args[0], "modules") == 0)
+		return list_prompt_modules();
+
 	if (*args[0] == 'r' && strcmp(args[0], "reload") == 0) {
 		const int ret = load_prompts();
 		if (ret == FUNC_SUCCESS) {
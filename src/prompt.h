@@ -97,6 +97,7 @@ char *decode_prompt(char *line);
 int  prompt_function(char **args);
 char *gen_color(char *color_begin, char **color_end);
 void set_prompt_options(void);
+void wait_prompt_jobs(const int fd);
 
 __END_DECLS
 
@@ -77,24 +77,9 @@
 #include "readline.h"   /* Required by the 'pc' command */
 #include "xdu.h" /* dir_info(), dir_size() */
 
-/* A few macros for nano-second precision.
- * Used to print timestamps with the 'p/pp' command. */
+/* Used to print timestamps with the 'p/pp' command. */
 #ifndef CLIFM_LEGACY
 # define NANO_SEC_MAX 999999999
-# if defined(__NetBSD__) || defined(__APPLE__)
-#  define ATIMNSEC st_atimespec.tv_nsec
-#  define CTIMNSEC st_ctimespec.tv_nsec
-#  define MTIMNSEC st_mtimespec.tv_nsec
-# else
-#  define ATIMNSEC st_atim.tv_nsec
-#  define CTIMNSEC st_ctim.tv_nsec
-#  define MTIMNSEC st_mtim.tv_nsec
-# endif /* __NetBSD__ || __APPLE__ */
-#else
-/* Let's use any valid value: it won't be used anyway */
-#  define ATIMNSEC st_atime
-#  define CTIMNSEC st_ctime
-#  define MTIMNSEC st_mtime
 #endif /* !CLIFM_LEGACY */
 
 #if defined(LINUX_FILE_ATTRS)
@@ -36,12 +36,14 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 #include "aux.h"
 #include "checks.h"
 #include "fuzzy_match.h"
+#include "init.h" /* load_file_templates() */
 #ifndef _NO_HIGHLIGHT
 # include "highlight.h"
 #endif /* !_NO_HIGHLIGHT */
 #include "keybinds.h"
 #include "mime.h" /* xmagic() */
 #include "navigation.h"
+#include "prompt.h" /* wait_prompt_jobs() */
 #include "readline.h"
 #include "sort.h" /* compare_strings() */
 #include "spawn.h"
@@ -50,6 +52,7 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 #endif /* !_NO_SUGGESTIONS */
 #include "tabcomp.h"
 #include "tags.h"
+#include "tagsdb.h" /* tagsdb_get_files() */
 
 #define DEL_EMPTY_LINE     1
 #define DEL_NON_EMPTY_LINE 2
@@ -72,8 +75,8 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 
 static char ext_opts[MAX_EXT_OPTS][MAX_EXT_OPTS_LEN];
 #ifndef _NO_TAGS
-static struct dirent **tagged_files = NULL;
-static int tagged_files_n = 0;
+static const struct tagged_file_t *tagged_files = NULL;
+static size_t tagged_files_n = 0;
 #endif /* !_NO_TAGS */
 static int cb_running = 0;
 static char rl_default_answer = 0;
@@ -622,10 +625,13 @@ my_rl_getc(FILE *stream)
 	unsigned char c;
 	static unsigned char prev = 0;
 
-	if (prompt_offset == UNSET)
-		prompt_offset = get_prompt_offset(rl_prompt);
-
 	while (1) {
+		/* Prompt modules still running: the prompt might be repainted */
+		wait_prompt_jobs(fileno(stream));
+
+		if (prompt_offset == UNSET)
+			prompt_offset = get_prompt_offset(rl_prompt);
+
 		result = (int)read(fileno(stream), &c, sizeof(unsigned char)); /* flawfinder: ignore */
 		if (result == sizeof(unsigned char)) {
 			/* Ctrl+d (empty command line only). Let's check that the previous
@@ -994,7 +1000,7 @@ check_match(const char *s1, const char *s2, const size_t s1_len)
 }
 
 static inline int
-get_best_fuzzy_match(const char *filename, const char *dirname, char *d_name,
+get_best_fuzzy_match(const char *filename, const char *dirname, const char *d_name,
 	const size_t flen, const int fuzzy_str_type, int *best_fz_score)
 {
 	const int score = fuzzy_match(filename, d_name, flen, fuzzy_str_type);
@@ -1038,6 +1044,179 @@ do_regular_matching(const char *filename)
 	|| (tabmode == STD_TAB && !(flags & STATE_SUGGESTING)));
 }
 
+/* Snapshots of recently scanned directories, reused by path completion
+ * as long as the directory is not modified (checked via its modification
+ * time). The current directory is not cached here: if the list of files
+ * is an exact copy of its contents, we read the file_info array instead. */
+#define DIRSNAP_CACHE_MAX 4
+#define DIRSNAP_ENTS_CHUNK 256
+#define DIRSNAP_NAMES_CHUNK 4096
+
+struct dirsnap_ent_t {
+	size_t name; /* Offset of the file name in the names buffer */
+	mode_t type; /* d_type value */
+};
+
+struct dirsnap_t {
+	struct dir_stamp_t stamp;
+	struct dirsnap_ent_t *ents;
+	char *names;
+	size_t n;
+	size_t last_used;
+};
+
+static struct dirsnap_t dirsnap_cache[DIRSNAP_CACHE_MAX];
+static size_t dirsnap_clock = 0;
+
+static void
+free_dir_snapshot(struct dirsnap_t *snap)
+{
+	free(snap->ents);
+	free(snap->names);
+	*snap = (struct dirsnap_t){0};
+}
+
+/* Read the directory DIR, whose attributes are A, into the snapshot SNAP.
+ * Returns FUNC_SUCCESS or FUNC_FAILURE. */
+static int
+scan_dir_snapshot(struct dirsnap_t *snap, const char *dir, const struct stat *a)
+{
+	DIR *d = opendir(dir);
+	if (!d)
+		return FUNC_FAILURE;
+
+	free_dir_snapshot(snap);
+	set_dir_stamp(&snap->stamp, a);
+
+	size_t ents_size = DIRSNAP_ENTS_CHUNK;
+	size_t names_size = DIRSNAP_NAMES_CHUNK;
+	size_t names_len = 0;
+	snap->ents = xnmalloc(ents_size, sizeof(struct dirsnap_ent_t));
+	snap->names = xnmalloc(names_size, sizeof(char));
+
+	struct dirent *ent;
+	while ((ent = readdir(d))) {
+#if !defined(_DIRENT_HAVE_D_TYPE)
+		struct stat attr;
+# ifndef CLIFM_LEGACY
+		if (fstatat(dirfd(d), ent->d_name, &attr, AT_SYMLINK_NOFOLLOW) == -1)
+			continue;
+# else /* fstatat() takes a plain path (see compat.h) */
+		char path[PATH_MAX + 1];
+		snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		if (lstat(path, &attr) == -1)
+			continue;
+# endif /* !CLIFM_LEGACY */
+		const mode_t type = get_dt(attr.st_mode);
+#else
+		const mode_t type = ent->d_type;
+#endif /* !_DIRENT_HAVE_D_TYPE */
+
+		const size_t len = strlen(ent->d_name) + 1;
+		if (names_len + len > names_size) {
+			names_size = names_len + len + DIRSNAP_NAMES_CHUNK;
+			snap->names = xnrealloc(snap->names, names_size, sizeof(char));
+		}
+
+		if (snap->n == ents_size) {
+			ents_size += DIRSNAP_ENTS_CHUNK;
+			snap->ents = xnrealloc(snap->ents, ents_size,
+				sizeof(struct dirsnap_ent_t));
+		}
+
+		memcpy(snap->names + names_len, ent->d_name, len);
+		snap->ents[snap->n].name = names_len;
+		snap->ents[snap->n].type = type;
+		snap->n++;
+		names_len += len;
+	}
+
+	closedir(d);
+	return FUNC_SUCCESS;
+}
+
+/* Return a snapshot of the directory DIR, whose attributes are A, taken
+ * from the cache if still valid, or scanning the directory otherwise (the
+ * least recently used snapshot is evicted). Returns NULL on error. */
+static struct dirsnap_t *
+get_dir_snapshot(const char *dir, const struct stat *a)
+{
+	struct dirsnap_t *lru = &dirsnap_cache[0];
+
+	for (size_t i = 0; i < DIRSNAP_CACHE_MAX; i++) {
+		struct dirsnap_t *snap = &dirsnap_cache[i];
+		if (snap->stamp.valid == 1 && snap->stamp.dev == a->st_dev
+		&& snap->stamp.ino == a->st_ino) {
+			if (check_dir_stamp(&snap->stamp, a) == 0
+			&& scan_dir_snapshot(snap, dir, a) == FUNC_FAILURE)
+				return NULL;
+			snap->last_used = ++dirsnap_clock;
+			return snap;
+		}
+
+		if (snap->last_used < lru->last_used)
+			lru = snap;
+	}
+
+	if (scan_dir_snapshot(lru, dir, a) == FUNC_FAILURE)
+		return NULL;
+
+	lru->last_used = ++dirsnap_clock;
+	return lru;
+}
+
+/* Return 1 if the file_info array holds an exact copy of the contents
+ * of the directory whose attributes are A, or 0 otherwise. */
+static int
+listing_is_dir_copy(const struct stat *a)
+{
+	return (virtual_dir == 0 && stats.excluded == 0
+	&& (file_info || g_files_num == 0)
+	&& check_dir_stamp(&listing_stamp, a) == 1);
+}
+
+void
+free_dir_snapshots(void)
+{
+	for (size_t i = 0; i < DIRSNAP_CACHE_MAX; i++)
+		free_dir_snapshot(&dirsnap_cache[i]);
+}
+
+/* Source of file names for my_rl_path_completion(): either the file_info
+ * array (plus self and parent directories, omitted from the list of files)
+ * or a directory snapshot. */
+struct path_source_t {
+	struct dirsnap_t *snap;
+	filesn_t i;
+	filesn_t n;
+	int listing;
+	int pad0;
+};
+
+/* Get the next file name (and type) from the path source SRC. Returns
+ * NULL when there are no more entries. */
+static const char *
+next_path_source_entry(struct path_source_t *src, mode_t *type)
+{
+	if (src->i >= src->n)
+		return NULL;
+
+	const filesn_t i = src->i++;
+
+	if (src->listing == 0) {
+		*type = src->snap->ents[i].type;
+		return src->snap->names + src->snap->ents[i].name;
+	}
+
+	if (i < 2) {
+		*type = DT_DIR;
+		return i == 0 ? "." : "..";
+	}
+
+	*type = file_info[i - 2].type;
+	return file_info[i - 2].name;
+}
+
 /* This is the filename_completion_function() function of an old Bash
  * release (1.14.7) modified to fit Clifm's needs */
 /* state is zero before completion, and 1 ... n after getting
@@ -1053,13 +1232,13 @@ my_rl_path_completion(const char *text, int state)
 	if (!text || !*text || alt_prompt > 1)
 		return NULL;
 
-	static DIR *directory;
+	static struct path_source_t src = {0};
 	static char *filename = NULL;
 	static char *dirname = NULL;
 	static char *users_dirname = NULL;
 	static size_t filename_len;
 	static int match;
-	struct dirent *ent = NULL;
+	const char *ename = NULL;
 	static char tmp[PATH_MAX + 1];
 	static char *tmp_text = NULL;
 
@@ -1144,7 +1323,17 @@ my_rl_path_completion(const char *text, int state)
 		|| strstr(dir_name, "/.."))
 			norm_path = normalize_path(dir_name, strlen(dir_name));
 
-		directory = opendir(norm_path);
+		src = (struct path_source_t){0};
+		struct stat a;
+		if (stat(norm_path, &a) == 0 && S_ISDIR(a.st_mode)) {
+			if (listing_is_dir_copy(&a) == 1) {
+				src.listing = 1;
+				src.n = g_files_num + 2;
+			} else if ((src.snap = get_dir_snapshot(norm_path, &a))) {
+				src.n = (filesn_t)src.snap->n;
+			}
+		}
+
 		if (norm_path != dir_name)
 			free(norm_path);
 
@@ -1167,23 +1356,7 @@ my_rl_path_completion(const char *text, int state)
 		? FUZZY_FILES_UTF8 : FUZZY_FILES_ASCII;
 	int best_fz_score = 0;
 
-	while (directory && (ent = readdir(directory))) {
-		char *ename = ent->d_name;
-
-#if !defined(_DIRENT_HAVE_D_TYPE)
-		struct stat attr;
-		if (*dirname == '.' && !dirname[1])
-			xstrsncpy(tmp, ename, sizeof(tmp));
-		else
-			snprintf(tmp, sizeof(tmp), "%s%s", dirname, ename);
-
-		if (lstat(tmp, &attr) == -1)
-			continue;
-		type = get_dt(attr.st_mode);
-#else
-		type = ent->d_type;
-#endif /* !_DIRENT_HAVE_D_TYPE */
-
+	while ((ename = next_path_source_entry(&src, &type))) {
 		/* First word: skip dirs if autocd is off, and non-dirs if
 		 * auto-open is off. */
 		if (skip_first_word(type, line_buffer_has_space) == 1)
@@ -1250,25 +1423,22 @@ my_rl_path_completion(const char *text, int state)
 
 	char *cur_match = NULL;
 
-	/* readdir() returns NULL on reaching the end of the directory stream.
-	 * So that if ENT is not NULL, we have a match. */
-	if (ent) { /* Same as match == 1 */
+	/* next_path_source_entry() returns NULL on reaching the end of the
+	 * list. So that if ENAME is not NULL, we have a match. */
+	if (ename) { /* Same as match == 1 */
 		cur_comp_type = TCMP_PATH;
 		if (dirname && (dirname[0] != '.' || dirname[1])) {
-			size_t len = strlen(users_dirname) + strlen(ent->d_name) + 1;
+			size_t len = strlen(users_dirname) + strlen(ename) + 1;
 			cur_match = xnmalloc(len, sizeof(char));
-			snprintf(cur_match, len, "%s%s", users_dirname, ent->d_name);
+			snprintf(cur_match, len, "%s%s", users_dirname, ename);
 		} else {
-			cur_match = savestring(ent->d_name, strlen(ent->d_name));
+			cur_match = savestring(ename, strlen(ename));
 		}
 	}
 
 	/* Clear state. */
-	if ((flags & STATE_SUGGESTING) || !ent) {
-		if (directory) {
-			closedir(directory);
-			directory = NULL;
-		}
+	if ((flags & STATE_SUGGESTING) || !ename) {
+		src = (struct path_source_t){0};
 
 		free(dirname); dirname = NULL;
 		free(filename); filename = NULL;
@@ -2586,8 +2756,7 @@ static char *
 tag_entries_generator(const char *text, int state)
 {
 	UNUSED(text);
-	static int i;
-	char *name;
+	static size_t i;
 
 	if (state == 0)
 		i = 0;
@@ -2595,9 +2764,9 @@ tag_entries_generator(const char *text, int state)
 	if (!tagged_files)
 		return NULL;
 
-	while (i < tagged_files_n && (name = tagged_files[i++]->d_name) != NULL) {
-		if (SELFORPARENT(name))
-			continue;
+	while (i < tagged_files_n) {
+		char name[NAME_MAX + 1];
+		xstrsncpy(name, tagged_files[i++].name, sizeof(name));
 
 		char *p = NULL, *q = name;
 		if (strchr(name, '\\')) {
@@ -2633,27 +2802,11 @@ check_tagged_files(char *tag)
 	if (!is_tag(tag))
 		return NULL;
 
-	tagged_files_n = 0;
-
-	char dir[PATH_MAX + 1];
-	snprintf(dir, sizeof(dir), "%s/%s", tags_dir, tag);
-	int n = scandir(dir, &tagged_files, NULL, alphasort);
-	if (n == -1)
-		return NULL;
-
-	if (n == 2) {
-		free(tagged_files[0]);
-		free(tagged_files[1]);
-		free(tagged_files);
-		tagged_files = NULL;
+	tagged_files = tagsdb_get_files(tag, &tagged_files_n);
+	if (!tagged_files)
 		return NULL;
-	}
 
-	tagged_files_n = n;
 	char **matches = rl_completion_matches("", &tag_entries_generator);
-	while (--n >= 0)
-		free(tagged_files[n]);
-	free(tagged_files);
 	tagged_files = NULL;
 	tagged_files_n = 0;
 
@@ -2777,7 +2930,8 @@ fill_opts(const char *cmd_name, const char *word_start, const size_t w)
 		{"mime", {"open", "info", "edit", "import", NULL}},
 		{"pf", {"set", "list", "add", "del", "rename", NULL}},
 		{"profile", {"set", "list", "add", "del", "rename", NULL}},
-		{"prompt", {"set", "list", "unset", "edit", "reload", NULL}},
+		{"prompt", {"set", "list", "unset", "edit", "reload", "modules",
+			NULL}},
 		{"pwd", {"-L", "-P", NULL}},
 		{"tag", {"add", "del", "list", "list-full", "merge", "new",
 			"rename", "untag", NULL}},
@@ -3042,6 +3196,7 @@ check_file_type_opts(const char c)
 	case 'u': return stats.suid > 0;
 	case 'g': return stats.sgid > 0;
 	case 'C': return stats.caps > 0;
+	case 'T': return stats.tagged > 0;
 	default: return 0;
 	}
 }
@@ -3067,7 +3222,7 @@ file_types_opts_generator(const char *text, int state)
 		"s (Socket)", "x (Executable)",
 		"o (Other writable)", "t (Sticky)",
 		"u (SUID)", "g (SGID)",
-		"C (Capabilities)", NULL
+		"C (Capabilities)", "T (Tagged)", NULL
 	};
 
 	const char *name;
@@ -3170,6 +3325,10 @@ file_types_generator(const char *text, int state)
 			if (file_info[i].color == sg_c)
 				ret = strdup(name);
 			break;
+		case 'T':
+			if (file_info[i].tagged == 1)
+				ret = strdup(name);
+			break;
 		default: break;
 		}
 
@@ -4371,11 +4530,14 @@ FIRST_WORD_COMP:
 	}
 
 	/* ### FILE TEMPLATES COMPLETION ('n/new' command) ### */
-	if (file_templates && s && *s == 'n' && (s[1] == ' ' || (s[1] == 'e'
+	if (s && *s == 'n' && (s[1] == ' ' || (s[1] == 'e'
 	&& s[2] == 'w' && s[3] == ' '))) {
 		const char *p = strrchr(text, '@');
-		if (p)
-			return complete_file_templates(p + 1);
+		if (p) {
+			load_file_templates();
+			if (file_templates)
+				return complete_file_templates(p + 1);
+		}
 	}
 
 	/* ### ALIASES COMPLETION ### */
@@ -21,6 +21,7 @@
 
 __BEGIN_DECLS
 
+void free_dir_snapshots(void);
 int  initialize_readline(void);
 int  is_quote_char(const char c);
 char **my_rl_completion(const char *text, int start, int end);
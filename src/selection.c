@@ -38,15 +38,210 @@
 #include "properties.h" /* get_size_color() */
 #include "readline.h"
 #include "selection.h"
-#include "selset.h" /* devino_set_contains/devino_set_insert */
+#include "selset.h" /* devino_set_insert(), sel_index_*() */
 #include "sort.h"
 #include "xdu.h" /* dir_size() */
 
+/* The selections file is a plain list of paths (plugins read and write it
+ * as well). To avoid rewriting it whenever files are selected, and other
+ * instances re-reading (and stat'ing) every selected file each time it
+ * changes, we remember the state of the file the last time we read or wrote
+ * it:
+ * - New selections are appended to the file (save_sel()).
+ * - If the file did not change, there is nothing to reload.
+ * - If it just grew (another instance appended new selections), only the
+ *   new lines are read (sync_sel_files()).
+ * - Otherwise (e.g. files were deselected, so that the file was rewritten,
+ *   or it was modified by a plugin), the whole file is reloaded
+ *   (get_sel_files()). */
+#define SELFILE_TAIL_LEN 64
+
+static struct {
+	dev_t  dev;
+	ino_t  ino;
+	off_t  size;
+	time_t mtime;
+	size_t saved_n; /* Leading entries in sel_elements found in the file */
+	size_t tail_len;
+	char   tail[SELFILE_TAIL_LEN]; /* Last bytes of the file */
+	int    valid;
+	int    pad0;
+} selfile;
+
+/* Store the current state of the selections file. */
+static void
+record_selfile_state(void)
+{
+	struct stat a;
+	selfile.valid = 0;
+	selfile.tail_len = 0;
+
+	if (!sel_file || stat(sel_file, &a) == -1)
+		return;
+
+	selfile.dev = a.st_dev;
+	selfile.ino = a.st_ino;
+	selfile.size = a.st_size;
+	selfile.mtime = a.st_mtime;
+	selfile.valid = 1;
+
+	if (a.st_size <= 0)
+		return;
+
+	const int fd = open(sel_file, O_RDONLY);
+	if (fd == -1)
+		return;
+
+	const size_t len = a.st_size < SELFILE_TAIL_LEN
+		? (size_t)a.st_size : SELFILE_TAIL_LEN;
+	if (pread(fd, selfile.tail, len, a.st_size - (off_t)len) == (ssize_t)len)
+		selfile.tail_len = len;
+
+	close(fd);
+}
+
+/* Return 1 if the selections file, whose current attributes are A, is
+ * the one we last read or wrote, or the same file with some more bytes
+ * appended to it. Otherwise, return 0. */
+static int
+selfile_grew(const struct stat *a)
+{
+	if (selfile.valid == 0 || a->st_dev != selfile.dev
+	|| a->st_ino != selfile.ino || a->st_size < selfile.size)
+		return 0;
+
+	if (a->st_size == selfile.size)
+		return (a->st_mtime == selfile.mtime);
+
+	if (selfile.tail_len == 0)
+		return selfile.size == 0;
+
+	/* The file grew: make sure it was not rewritten (in place) by
+	 * comparing the bytes we know it ended with. */
+	char buf[SELFILE_TAIL_LEN];
+	const int fd = open(sel_file, O_RDONLY);
+	if (fd == -1)
+		return 0;
+
+	const ssize_t ret = pread(fd, buf, selfile.tail_len,
+		selfile.size - (off_t)selfile.tail_len);
+	close(fd);
+
+	return (ret == (ssize_t)selfile.tail_len
+		&& memcmp(buf, selfile.tail, selfile.tail_len) == 0);
+}
+
+/* Record that the selections file holds exactly our selected files. */
+void
+sel_file_synced(void)
+{
+	selfile.saved_n = sel_n;
+	record_selfile_state();
+}
+
+/* Load the list of selected files from FP, starting at its current
+ * position, appending them to sel_elements. Return the number of files
+ * that could not be loaded (most likely because they do not exist anymore). */
+size_t
+read_sel_file(FILE *fp)
+{
+	struct stat a;
+	size_t dropped = 0;
+	/* Since this file contains only paths, PATH_MAX should be enough. */
+	char line[PATH_MAX + 1]; *line = '\0';
+
+	while (fgets(line, (int)sizeof(line), fp) != NULL) {
+		size_t len = *line ? strnlen(line, sizeof(line)) : 0;
+		if (len == 0) continue;
+
+		if (line[len - 1] == '\n') {
+			len--;
+			line[len] = '\0';
+		}
+
+		/* Remove the ending slash: fstatat() won't take a symlink to dir as
+		 * a symlink (but as a dir), if the filename ends with a slash. */
+		if (len > 1 && line[len - 1] == '/')
+			line[--len] = '\0';
+
+		if (!*line || *line == '#' || len == 0)
+			continue;
+
+		char *l = line;
+		if (IS_FILE_URI(l, len)) l += FILE_URI_PREFIX_LEN;
+		char *file = url_decode(l);
+
+		if (!file || fstatat(XAT_FDCWD, file, &a, AT_SYMLINK_NOFOLLOW) == -1) {
+			free(file);
+			dropped++;
+			continue;
+		}
+
+		add_sel_element(file, a.st_dev, a.st_ino);
+	}
+
+	return dropped;
+}
+
+/* Read the selections appended to the selections file since we last read
+ * or wrote it. */
+static int
+read_sel_delta(void)
+{
+	int fd;
+	FILE *fp = open_fread(sel_file, &fd);
+	if (!fp)
+		return get_sel_files();
+
+	if (lseek(fd, selfile.size, SEEK_SET) == -1) {
+		fclose(fp);
+		return get_sel_files();
+	}
+
+	const size_t dropped = read_sel_file(fp);
+	fclose(fp);
+
+	set_sel_devino(0);
+
+	if (dropped > 0) {
+		/* Remove non-existent files from the selections file */
+		selfile.saved_n = 0;
+		return save_sel();
+	}
+
+	sel_file_synced();
+	return FUNC_SUCCESS;
+}
+
+/* Apply the changes made to the selections file by other instances (or
+ * plugins) since we last read or wrote it. */
+int
+sync_sel_files(void)
+{
+	if (xargs.stealth_mode == 1 || selfile_ok == 0 || !sel_file)
+		return get_sel_files();
+
+	struct stat a;
+	if (stat(sel_file, &a) == -1) /* No selections file: nothing selected */
+		return (sel_n > 0 || selfile.valid == 1) ? get_sel_files()
+			: FUNC_SUCCESS;
+
+	if (selfile.saved_n != sel_n || selfile_grew(&a) == 0)
+		return get_sel_files();
+
+	if (a.st_size == selfile.size) /* Unchanged */
+		return FUNC_SUCCESS;
+
+	return read_sel_delta();
+}
+
 /* Save selected elements into a tmp file. Returns 1 on success or 0
  * on error. This function allows the user to work with multiple
  * instances of the program: they can select some files in the
  * first instance and then execute a second one to operate on those
- * files as they wish. */
+ * files as they wish.
+ * If we only selected new files since the file was last read or written,
+ * the new files are just appended to it. */
 int
 save_sel(void)
 {
@@ -54,6 +249,8 @@ save_sel(void)
 		return (xargs.stealth_mode == 1 ? FUNC_SUCCESS : FUNC_FAILURE);
 
 	if (sel_n == 0) {
+		selfile.saved_n = 0;
+		selfile.valid = 0;
 		if (unlinkat(XAT_FDCWD, sel_file, 0) == -1 && errno != ENOENT) {
 			xerror("asel: '%s': %s\n", sel_file, strerror(errno));
 			return FUNC_FAILURE;
@@ -61,8 +258,17 @@ save_sel(void)
 		return FUNC_SUCCESS;
 	}
 
+	struct stat a;
+	const int append = (selfile.saved_n > 0 && selfile.saved_n <= sel_n
+		&& stat(sel_file, &a) != -1 && a.st_size == selfile.size
+		&& selfile_grew(&a) == 1);
+
+	if (append == 1 && selfile.saved_n == sel_n) /* Nothing new */
+		return FUNC_SUCCESS;
+
 	int fd = -1;
-	FILE *fp = open_fwrite(sel_file, &fd);
+	FILE *fp = append == 1 ? open_fappend(sel_file)
+		: open_fwrite(sel_file, &fd);
 	if (!fp) {
 		xerror("sel: '%s': %s\n", sel_file, strerror(errno));
 		return FUNC_FAILURE;
@@ -70,7 +276,7 @@ save_sel(void)
 
 	size_t buf_len = PATH_MAX * 3 + 7 + 1;
 	char *buf = xnmalloc(buf_len, sizeof(char));
-	for (size_t i = 0; i < sel_n; i++) {
+	for (size_t i = append == 1 ? selfile.saved_n : 0; i < sel_n; i++) {
 		const char *name = sel_elements[i].name;
 		if (!name)
 			continue;
@@ -92,9 +298,61 @@ save_sel(void)
 
 	free(buf);
 	fclose(fp);
+
+	sel_file_synced();
 	return FUNC_SUCCESS;
 }
 
+/* Allocated slots in the sel_elements array */
+static size_t sel_cap = 0;
+
+/* Append NAME (a malloc'ed string) to the sel_elements array, keeping it
+ * NULL terminated and updating the path index. The array grows
+ * geometrically. */
+void
+add_sel_element(char *name, const dev_t dev, const ino_t ino)
+{
+	if (sel_n + 2 > sel_cap) {
+		sel_cap = sel_cap < 16 ? 16 : sel_cap * 2;
+		sel_elements = xnrealloc(sel_elements, sel_cap, sizeof(struct sel_t));
+	}
+
+	sel_elements[sel_n].name = name;
+	sel_elements[sel_n].size = (off_t)UNSET;
+	sel_elements[sel_n].dev = dev;
+	sel_elements[sel_n].ino = ino;
+	sel_index_add(sel_n);
+	sel_n++;
+
+	sel_elements[sel_n].name = NULL;
+	sel_elements[sel_n].size = (off_t)UNSET;
+}
+
+/* Remove from the sel_elements array all entries whose name was set to NULL
+ * (deselected files), and update the path index and the list of selected
+ * devices/inodes accordingly. */
+static void
+compact_sel_elements(void)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < sel_n; i++) {
+		if (sel_elements[i].name)
+			sel_elements[n++] = sel_elements[i];
+	}
+
+	sel_n = n;
+	if (sel_elements) {
+		sel_elements[n].name = NULL;
+		sel_elements[n].size = (off_t)UNSET;
+	}
+
+	sel_index_rebuild();
+	set_sel_devino(0);
+	/* Deselected files must be removed from the selections file as well:
+	 * the next save_sel() will rewrite it. */
+	selfile.saved_n = 0;
+}
+
 int
 select_file(char *file)
 {
@@ -109,7 +367,7 @@ select_file(char *file)
 	static char buf[PATH_MAX + 1];
 	char *tfile = file;
 	struct stat a;
-	int exists = 0, new_sel = 0;
+	int new_sel = 0;
 
 	const size_t flen = strlen(file);
 	if (flen > 1 && file[flen - 1] == '/')
@@ -138,27 +396,9 @@ select_file(char *file)
 		}
 	}
 
-	if (devino_set_contains(&sel_set, a.st_dev, a.st_ino)) {
-		/* Only scan for names in case of dev/ino matches (mostly hardlinks
-		 * or names in different devices). */
-		filesn_t j = (filesn_t)sel_n;
-		while (--j >= 0) {
-			if (*tfile == *sel_elements[j].name
-			&& strcmp(sel_elements[j].name, tfile) == 0) {
-				exists = 1;
-				break;
-			}
-		}
-	}
-
-	if (exists == 0) {
-		sel_elements = xnrealloc(sel_elements, sel_n + 2, sizeof(struct sel_t));
-		sel_elements[sel_n].name = savestring(tfile, strlen(tfile));
-		sel_elements[sel_n++].size = (off_t)UNSET;
-
-		sel_elements[sel_n].name = NULL;
-		sel_elements[sel_n].size = (off_t)UNSET;
-
+	size_t idx;
+	if (sel_index_lookup(tfile, &idx) == 0) {
+		add_sel_element(savestring(tfile, strlen(tfile)), a.st_dev, a.st_ino);
 		new_sel++;
 		devino_set_insert(&sel_set, a.st_dev, a.st_ino);
 	} else {
@@ -677,7 +917,7 @@ print_sel_results(const int new_sel, const char *sel_path,
 		return FUNC_FAILURE;
 	}
 
-	get_sel_files();
+	sync_sel_files();
 	if (sel_n == 0) {
 		fputs(_("sel: No matches found\n"), stderr);
 		return FUNC_FAILURE;
@@ -803,41 +1043,22 @@ select_pattern(char *arg, const char *dir, const mode_t filetype, int *err)
 	return ret;
 }
 
-/* Reconstruct the list of selections excluding those located in the current
+/* Remove from the list of selections those files located in the current
  * directory. */
 static void
 deselect_files_in_cwd(void)
 {
-	/* Free data about selected files. It will be reconstructed later
-	 * by get_sel_files(). */
-	free(sel_devino);
-	sel_devino = NULL;
-
-	struct sel_t *sel = NULL;
-	size_t n = 0;
-
 	for (size_t i = 0; i < sel_n; i++) {
-		if (!is_file_in_cwd(sel_elements[i].name)) {
-			sel = xnrealloc(sel, n + 2, sizeof(sel[0]));
-			sel[n].name =
-				savestring(sel_elements[i].name, strlen(sel_elements[i].name));
-			sel[n++].size = (off_t)UNSET;
+		if (is_file_in_cwd(sel_elements[i].name)) {
+			free(sel_elements[i].name);
+			sel_elements[i].name = NULL;
 		}
 	}
 
-	if (n == 0) { /* All selections are in the current directory. */
-		deselect_all();
-		return;
-	}
-
-	sel[n].name = NULL;
-	sel[n].size = (off_t)UNSET;
+	compact_sel_elements();
 
-	for (size_t i = 0; i < sel_n; i++)
-		free(sel_elements[i].name);
-	free(sel_elements);
-	sel_n = n;
-	sel_elements = sel;
+	if (sel_n == 0) /* All selections were in the current directory. */
+		deselect_all();
 }
 
 static void
@@ -1081,27 +1302,15 @@ static int
 deselect_entries(char **desel_path, const size_t desel_n, int *error,
 	const int desel_screen)
 {
-	int dn = (int)desel_n;
-	int i = (int)desel_n;
-
-	while (--i >= 0) {
-		int j, desel_index = -1;
+	int dn = 0;
+	size_t i = desel_n;
 
+	while (i-- > 0) {
 		if (!desel_path[i])
 			continue;
 
-		/* Search the sel array for the path of the entry to be deselected and
-		 * store its index. */
-		size_t k = sel_n;
-		for (; k-- > 0;) {
-			if (strcmp(sel_elements[k].name, desel_path[i]) == 0) {
-				desel_index = k > INT_MAX ? INT_MAX : (int)k;
-				break;
-			}
-		}
-
-		if (desel_index == -1) {
-			dn--;
+		size_t k;
+		if (sel_index_lookup(desel_path[i], &k) == 0) {
 			*error = 1;
 			if (desel_screen == 0) {
 				xerror(_("%s: '%s': No such selected file\n"),
@@ -1110,30 +1319,16 @@ deselect_entries(char **desel_path, const size_t desel_n, int *error,
 			continue;
 		}
 
-		/* Once the index was found, rearrange the sel array removing the
-		 * deselected element (actually, moving each string after it to
-		 * the previous position). */
-		for (j = desel_index; j < (int)(sel_n - 1); j++) {
-			const size_t len = strlen(sel_elements[j + 1].name);
-			sel_elements[j].name =
-				xnrealloc(sel_elements[j].name, len + 1, sizeof(char));
-
-			xstrsncpy(sel_elements[j].name, sel_elements[j + 1].name, len + 1);
-			sel_elements[j].size = sel_elements[j + 1].size;
-		}
+		/* Just mark the entry as deselected: all marked entries are removed
+		 * at once by compact_sel_elements(). */
+		sel_index_remove(desel_path[i]);
+		free(sel_elements[k].name);
+		sel_elements[k].name = NULL;
+		dn++;
 	}
 
-	/* Free the last DN entries from the old sel array. They won't
-	 * be used anymore, since they contain the same value as the last
-	 * non-deselected element due to the above array rearrangement. */
-	for (i = 1; i <= dn; i++) {
-		const int sel_index = (int)sel_n - i;
-
-		if (sel_index >= 0 && sel_elements[sel_index].name) {
-			free(sel_elements[sel_index].name);
-			sel_elements[sel_index].size = (off_t)UNSET;
-		}
-	}
+	if (dn > 0)
+		compact_sel_elements();
 
 	return dn;
 }
@@ -1161,18 +1356,9 @@ desel_entries(char **desel_elements, const size_t desel_n, const int desel_scree
 	}
 
 	int error = 0;
+	/* deselect_entries() updates sel_n as well */
 	const int dn = deselect_entries(desel_path, desel_n, &error, desel_screen);
 
-	/* Update the number of selected files according to the number of
-	 * deselected files. */
-	sel_n = (sel_n - (size_t)dn);
-
-	if ((int)sel_n < 0)
-		sel_n = 0;
-
-	if (sel_n > 0)
-		sel_elements = xnrealloc(sel_elements, sel_n, sizeof(struct sel_t));
-
 	/* Deallocate local arrays. */
 	i = desel_n;
 	for (; i-- > 0;) {
@@ -1213,6 +1399,7 @@ deselect_all(void)
 	}
 
 	sel_n = 0;
+	sel_index_clear();
 
 	return save_sel();
 }
@@ -1346,7 +1533,7 @@ end_deselect(const int err, char ***args)
 	if (!err && save_sel() != 0)
 		exit_status = FUNC_FAILURE;
 
-	get_sel_files();
+	sync_sel_files();
 
 	/* There is still some selected file and we are in the desel
 	 * screen: reload this screen. */
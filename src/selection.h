@@ -17,11 +17,15 @@
 
 __BEGIN_DECLS
 
+void add_sel_element(char *name, const dev_t dev, const ino_t ino);
 int  deselect(char **args);
 void list_selected_files(const int clear_screen);
+size_t read_sel_file(FILE *fp);
+void sel_file_synced(void);
 int  sel_function(char **args);
 int  select_file(char *file);
 int  save_sel(void);
+int  sync_sel_files(void);
 int  deselect_all(void);
 
 __END_DECLS
@@ -11,6 +11,10 @@
 
 #include "selset.h"
 #include <stdlib.h>
+#include <string.h> /* strcmp() */
+
+#include "aux.h" /* hashme(), next_pow2() */
+#include "mem.h" /* xcalloc() */
 
 /* SplitMix64: a well-known 64-bit bit-mixing function (PRNG-style scrambler).
  * Constants are fixed parameters chosen to produce strong avalanche behavior.
@@ -47,14 +51,6 @@ devino_equal(devino_t a, devino_t b)
 	return (a.dev == b.dev && a.ino == b.ino);
 }
 
-static size_t
-next_pow2(size_t x)
-{
-	size_t p = 1;
-	while (p < x) p <<= 1;
-	return p;
-}
-
 int
 devino_set_init(devino_set_t *s, size_t initial_cap)
 {
@@ -64,7 +60,7 @@ devino_set_init(devino_set_t *s, size_t initial_cap)
 		initial_cap = 8;
 
 	s->cap = next_pow2(initial_cap);
-	s->size = 0;
+	s->size = s->deleted = 0;
 	s->state = (unsigned char *)calloc(s->cap, sizeof(unsigned char));
 	s->keys  = (devino_t *)calloc(s->cap, sizeof(devino_t));
 	if (!s->state || !s->keys) {
@@ -90,7 +86,7 @@ devino_set_destroy(devino_set_t *s)
 	s->state = NULL;
 	s->keys = NULL;
 	s->cap = 0;
-	s->size = 0;
+	s->size = s->deleted = 0;
 }
 
 void
@@ -133,39 +129,231 @@ devino_set_contains(const devino_set_t *s, const dev_t dev, const ino_t ino)
 	return 0;
 }
 
+/* Rehash all keys in the set S into a new table of capacity CAP, dropping
+ * tombstones. Return 1 on success or 0 on error (S is left untouched). */
+static int
+devino_set_rehash(devino_set_t *s, const size_t cap)
+{
+	devino_set_t new_s;
+	if (devino_set_init(&new_s, cap) == 0)
+		return 0;
+
+	for (size_t i = 0; i < s->cap; i++) {
+		if (s->state[i] == 1)
+			(void)devino_set_insert(&new_s, s->keys[i].dev, s->keys[i].ino);
+	}
+
+	devino_set_destroy(s);
+	*s = new_s;
+	return 1;
+}
+
 int
 devino_set_insert(devino_set_t *s, const dev_t dev, const ino_t ino)
 {
 	if (!s || !s->state || !s->keys)
 		return 0;
 
+	/* Files may be selected one by one (select_file()), so that the set
+	 * must grow as needed: a full table would make lookups linear.
+	 * Tombstones count as occupied slots here (they lengthen probing
+	 * sequences). If they make up most of them (e.g. files repeatedly
+	 * tagged and untagged), just drop them instead of growing the set. */
+	if ((double)(s->size + s->deleted + 1) > (double)s->cap * TABLE_LOAD_FACTOR
+	&& devino_set_rehash(s, s->deleted >= s->size ? s->cap : s->cap * 2) == 0)
+		return 0;
+
 	const devino_t key = { .dev = dev, .ino = ino };
 	const uint64_t h = hash_devino(key);
 
-	size_t first_empty = (size_t)-1;
+	size_t slot = (size_t)-1;
 
 	for (size_t probe = 0; probe < s->cap; probe++) {
 		size_t idx = idx_for(s, h, probe);
 		unsigned char st = s->state[idx];
 
 		if (st == 0) { /* Empty */
-			first_empty = idx;
+			if (slot == (size_t)-1)
+				slot = idx;
 			break;
 		}
 
 		if (st == 1 && devino_equal(s->keys[idx], key))
 			return 0; /* Already present */
 
-		/* If we later add tombstones, we'd handle DELETED here. */
+		/* Reuse the first tombstone, but keep probing: the key might
+		 * still be present further in the sequence. */
+		if (st == 2 && slot == (size_t)-1)
+			slot = idx;
 	}
 
-	if (first_empty == (size_t)-1) {
+	if (slot == (size_t)-1) {
 		/* Table full (shouldn't happen if sized reasonably). */
 		return 0;
 	}
 
-	s->state[first_empty] = 1;
-	s->keys[first_empty] = key;
+	if (s->state[slot] == 2)
+		s->deleted--;
+
+	s->state[slot] = 1;
+	s->keys[slot] = key;
 	s->size++;
 	return 1;
 }
+
+/* Remove the key (DEV, INO) from the set S. The slot is marked as deleted
+ * (a tombstone), so that probing sequences are not broken, until it is
+ * reused by devino_set_insert() or the set is rehashed.
+ * Return 1 if the key was found or 0 otherwise. */
+int
+devino_set_remove(devino_set_t *s, const dev_t dev, const ino_t ino)
+{
+	if (!s || !s->state || s->cap == 0)
+		return 0;
+
+	const devino_t key = { .dev = dev, .ino = ino };
+	const uint64_t h = hash_devino(key);
+
+	for (size_t probe = 0; probe < s->cap; probe++) {
+		size_t idx = idx_for(s, h, probe);
+		unsigned char st = s->state[idx];
+
+		if (st == 0)
+			return 0;
+		if (st == 1 && devino_equal(s->keys[idx], key)) {
+			s->state[idx] = 2;
+			s->size--;
+			s->deleted++;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Path index: map the name of each selected file to its position in the
+ * sel_elements array, so that we can tell whether a file is already
+ * selected, or find the file to be deselected, without scanning the whole
+ * array.
+ * Each slot holds the index into sel_elements plus one (0 means empty).
+ * Removed names are marked with SEL_INDEX_DELETED (a tombstone), so that
+ * probing sequences are not broken. Since removing selected files shifts
+ * positions in sel_elements, the index is rebuilt (sel_index_rebuild())
+ * once the array is compacted. */
+#define SEL_INDEX_DELETED ((size_t)-1)
+#define SEL_INDEX_INIT_SIZE 64
+
+static struct {
+	size_t *slots;
+	size_t *hashes;
+	size_t mask;
+	size_t used; /* Occupied slots, including tombstones */
+} sel_index = {NULL, NULL, 0, 0};
+
+void
+sel_index_clear(void)
+{
+	free(sel_index.slots);
+	free(sel_index.hashes);
+	sel_index.slots = sel_index.hashes = NULL;
+	sel_index.mask = sel_index.used = 0;
+}
+
+static void
+sel_index_put(const size_t i, const size_t hash)
+{
+	size_t idx = (hash * (size_t)HASH_MULTIPLIER) & sel_index.mask;
+	while (sel_index.slots[idx] != 0 && sel_index.slots[idx] != SEL_INDEX_DELETED)
+		idx = (idx + 1) & sel_index.mask;
+
+	sel_index.slots[idx] = i + 1;
+	sel_index.hashes[idx] = hash;
+	sel_index.used++;
+}
+
+/* Index the first N entries in sel_elements (entries whose name is NULL
+ * are skipped), making room for at least EXTRA more entries. */
+static void
+sel_index_build(const size_t n, const size_t extra)
+{
+	sel_index_clear();
+
+	size_t size = next_pow2((size_t)((double)(n + extra) / TABLE_LOAD_FACTOR) + 1);
+	if (size < SEL_INDEX_INIT_SIZE)
+		size = SEL_INDEX_INIT_SIZE;
+
+	sel_index.slots = xcalloc(size, sizeof(size_t));
+	sel_index.hashes = xcalloc(size, sizeof(size_t));
+	sel_index.mask = size - 1;
+
+	for (size_t i = 0; i < n; i++) {
+		if (sel_elements[i].name)
+			sel_index_put(i, hashme(sel_elements[i].name, 0));
+	}
+}
+
+/* Rebuild the index from the current content of sel_elements. */
+void
+sel_index_rebuild(void)
+{
+	sel_index_build(sel_n, 0);
+}
+
+/* Index the entry at position I in sel_elements. Entries before I are
+ * assumed to be already indexed. */
+void
+sel_index_add(const size_t i)
+{
+	if (!sel_index.slots
+	|| (double)(sel_index.used + 1) > (double)(sel_index.mask + 1)
+	* TABLE_LOAD_FACTOR)
+		/* Grow (or just get rid of tombstones) */
+		sel_index_build(i, i + 1);
+
+	sel_index_put(i, hashme(sel_elements[i].name, 0));
+}
+
+/* Return the slot holding NAME, or SEL_INDEX_DELETED if not found. */
+static size_t
+sel_index_find(const char *name)
+{
+	if (!sel_index.slots || !name)
+		return SEL_INDEX_DELETED;
+
+	const size_t hash = hashme(name, 0);
+	size_t idx = (hash * (size_t)HASH_MULTIPLIER) & sel_index.mask;
+
+	while (sel_index.slots[idx] != 0) {
+		const size_t n = sel_index.slots[idx];
+		if (n != SEL_INDEX_DELETED && sel_index.hashes[idx] == hash
+		&& n <= sel_n && sel_elements[n - 1].name
+		&& strcmp(sel_elements[n - 1].name, name) == 0)
+			return idx;
+
+		idx = (idx + 1) & sel_index.mask;
+	}
+
+	return SEL_INDEX_DELETED;
+}
+
+/* If NAME is selected, store its position in sel_elements in IDX and
+ * return 1. Otherwise, return 0. */
+int
+sel_index_lookup(const char *name, size_t *idx)
+{
+	const size_t slot = sel_index_find(name);
+	if (slot == SEL_INDEX_DELETED)
+		return 0;
+
+	*idx = sel_index.slots[slot] - 1;
+	return 1;
+}
+
+/* Remove NAME from the index. Its slot is marked as deleted. */
+void
+sel_index_remove(const char *name)
+{
+	const size_t slot = sel_index_find(name);
+	if (slot != SEL_INDEX_DELETED)
+		sel_index.slots[slot] = SEL_INDEX_DELETED;
+}
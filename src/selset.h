@@ -20,7 +20,13 @@ int  devino_set_init(devino_set_t *s, size_t initial_cap);
 void devino_set_destroy(devino_set_t *s);
 void devino_set_restart(devino_set_t *s);
 int  devino_set_insert(devino_set_t *s, const dev_t dev, const ino_t ino);
+int  devino_set_remove(devino_set_t *s, const dev_t dev, const ino_t ino);
 int  devino_set_contains(const devino_set_t *s, const dev_t dev, const ino_t ino);
+void sel_index_add(const size_t i);
+void sel_index_clear(void);
+int  sel_index_lookup(const char *name, size_t *idx);
+void sel_index_rebuild(void);
+void sel_index_remove(const char *name);
 
 __END_DECLS
 
@@ -411,6 +411,10 @@ ws2=31:ws3=38;5;228:ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define MOUNTPOINT_STR_U "+" /* Unicode */
 //#define MOUNTPOINT_STR_U "≡" /* Unicode */
 
+/* Tagged file mark for the file list (not available in light mode) */
+#define TAGGED_STR   "#" /* ASCII */
+#define TAGGED_STR_U "#" /* Unicode */
+
 #define TRUNC_FILE_CHR '~'
 
 /* Characters used in the jump list (j cmd) to mark entries as permanently
@@ -619,6 +623,7 @@ ws2=31:ws3=38;5;228:ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define DEF_SUG_FILETYPE_COLOR 0
 #define DEF_SUG_STRATEGY "ehfjac"
 #define DEF_SUGGESTIONS 1
+#define DEF_TAGS_DB 1 /* Keep a copy of the tags directory in tags/.tags.db */
 #define DEF_TERM_TITLE -1 /* auto: try to detect support */
 #define DEF_TIME_FOLLOWS_SORT 1
 #define DEF_TIME_STYLE_RECENT "%b %e %H:%M" /* Timestamps in long view mode */
@@ -338,6 +338,18 @@ alphasort_insensitive(const struct dirent **a, const struct dirent **b)
 	return conf.sort_reverse == 0 ? ret : -ret;
 }
 
+/* Sort the strings S1 and S2 the way xalphasort() and
+ * alphasort_insensitive() (depending on conf.ignore_case) sort directory
+ * entries. For qsort(3). */
+int
+alphasort_names(char **s1, char **s2)
+{
+	const int ret = conf.ignore_case == 0 ? strcmp(*s1, *s2)
+		: strcasecmp(**s1 == '.' ? *s1 + 1 : *s1, **s2 == '.' ? *s2 + 1 : *s2);
+
+	return conf.sort_reverse == 0 ? ret : -ret;
+}
+
 char *
 num_to_sort_name(const int n, const int abbrev)
 {
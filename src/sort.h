@@ -16,6 +16,7 @@ typedef int QSFUNC(const void *, const void *);
 __BEGIN_DECLS
 
 int  alphasort_insensitive(const struct dirent **a, const struct dirent **b);
+int  alphasort_names(char **s1, char **s2);
 int  compare_strings(char **s1, char **s2);
 int  entrycmp(const void *a, const void *b);
 char *num_to_sort_name(const int n, const int abbrev);
@@ -10,6 +10,7 @@
 #include "helpers.h"
 
 #include <errno.h>    /* errno */
+#include <fcntl.h>    /* fcntl */
 #ifndef _BE_POSIX
 # include <paths.h>
 # ifndef _PATH_DEVNULL
@@ -20,7 +21,7 @@
 #endif /* !_BE_POSIX */
 #include <signal.h>   /* sigaction */
 #include <string.h>   /* strerror */
-#include <unistd.h>   /* fork, execl, execvp, dup2, close, _exit */
+#include <unistd.h>   /* fork, execl, execvp, dup2, close, pipe, _exit */
 #include <sys/wait.h> /* waitpid */
 
 #include "listing.h"  /* reload_dirlist */
@@ -166,6 +167,83 @@ launch_execl(const char *cmd)
 	return exit_status;
 }
 
+/* Like launch_execl(), but do not wait for CMD: its standard input and
+ * output are connected to pipes, whose other ends (close-on-exec) are
+ * returned via IN_FD (to write to CMD) and OUT_FD (to read from CMD).
+ * Returns the PID of the new process (the caller must wait for it via
+ * wait_execl_pipe()), or -1 on error (errno is set). */
+pid_t
+launch_execl_pipe(const char *cmd, int *in_fd, int *out_fd)
+{
+	if (!cmd || !*cmd || !in_fd || !out_fd) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	const char *shell_path = user.shell;
+	const char *shell_name = user.shell_basename;
+	if (!shell_path || !*shell_path || !shell_name || !*shell_name) {
+		shell_path = "/bin/sh";
+		shell_name = "sh";
+	}
+
+	int in[2], out[2];
+	if (pipe(in) == -1)
+		return (-1);
+
+	if (pipe(out) == -1) {
+		const int saved_errno = errno;
+		close(in[0]);
+		close(in[1]);
+		errno = saved_errno;
+		return (-1);
+	}
+
+	const pid_t pid = fork();
+
+	if (pid < 0) {
+		const int saved_errno = errno;
+		close(in[0]); close(in[1]);
+		close(out[0]); close(out[1]);
+		errno = saved_errno;
+		return (-1);
+	}
+
+	if (pid == 0) {
+		set_cmd_signals();
+		dup2(in[0], STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		close(in[0]); close(in[1]);
+		close(out[0]); close(out[1]);
+		execl(shell_path, shell_name, "-c", cmd, NULL);
+		_exit(errno);
+	}
+
+	close(in[0]);
+	close(out[1]);
+	fcntl(in[1], F_SETFD, FD_CLOEXEC);
+	fcntl(out[0], F_SETFD, FD_CLOEXEC);
+
+	*in_fd = in[1];
+	*out_fd = out[0];
+	return pid;
+}
+
+/* Wait for the process PID, launched by launch_execl_pipe(), and return
+ * its exit status. */
+int
+wait_execl_pipe(const pid_t pid)
+{
+	int status = 0;
+
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR)
+			return FUNC_FAILURE;
+	}
+
+	return get_exit_code(status, EXEC_FG_PROC);
+}
+
 /* Execute a command and return the corresponding exit status. The exit
  * status could be: zero, if everything went fine, or a non-zero value
  * in case of error. The function takes as first argument an array of
@@ -14,7 +14,9 @@ __BEGIN_DECLS
 
 int get_exit_code(const int status, const int exec_flag);
 int launch_execl(const char *cmd);
+pid_t launch_execl_pipe(const char *cmd, int *in_fd, int *out_fd);
 int launch_execv(const char **cmd, const int bg, const int xflags);
+int wait_execl_pipe(const pid_t pid);
 
 __END_DECLS
 
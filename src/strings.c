@@ -49,6 +49,7 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 #include "readline.h"
 #include "sort.h"
 #include "tags.h"
+#include "tagsdb.h" /* tagsdb_get_files() */
 
 /* Macros for xstrverscmp() */
 /* states: S_N: normal, S_I: comparing integral part, S_F: comparing
@@ -1283,21 +1284,18 @@ expand_tag(char ***args, const int tag_index)
 	char dir[PATH_MAX + 1];
 	snprintf(dir, sizeof(dir), "%s/%s", tags_dir, tag);
 
-	struct dirent **t = NULL;
-	const int n = scandir(dir, &t, NULL, conf.ignore_case == 0
-		? xalphasort : alphasort_insensitive);
-	if (n == -1)
+	size_t n = 0;
+	const struct tagged_file_t *files = tagsdb_get_files(tag, &n);
+	if (n == 0)
 		return 0;
 
+	char **t = xnmalloc(n, sizeof(char *));
 	size_t i, j = 0;
-	if (n <= 2) { /* Empty dir: only self and parent */
-		for (i = 0; i < (size_t)n; i++)
-			free(t[i]);
-		free(t);
-		return 0;
-	}
+	for (i = 0; i < n; i++)
+		t[i] = files[i].name;
+	qsort(t, n, sizeof(char *), (QSFUNC *)alphasort_names);
 
-	const size_t len = args_n + 1 + ((size_t)n - 2) + 1;
+	const size_t len = args_n + 1 + n + 1;
 	char **p = xnmalloc(len, sizeof(char *));
 
 	/* Copy whatever is before the tag expression */
@@ -1306,12 +1304,9 @@ expand_tag(char ***args, const int tag_index)
 	p[j] = NULL;
 
 	/* Append all filenames pointed to by the tag expression */
-	for (i = 0; i < (size_t)n; i++) {
-		if (SELFORPARENT(t[i]->d_name))
-			continue;
-
+	for (i = 0; i < n; i++) {
 		char filename[PATH_MAX + NAME_MAX + 2];
-		snprintf(filename, sizeof(filename), "%s/%s", dir, t[i]->d_name);
+		snprintf(filename, sizeof(filename), "%s/%s", dir, t[i]);
 
 		char rpath[PATH_MAX + 1];
 		*rpath = '\0';
@@ -1337,9 +1332,6 @@ expand_tag(char ***args, const int tag_index)
 	}
 	p[j] = NULL;
 
-	/* Free the dirent struct */
-	for (i = 0; i < (size_t)n; i++)
-		free(t[i]);
 	free(t);
 
 	/* Free the original array (ARGS) and make it point to the new
@@ -1352,8 +1344,7 @@ expand_tag(char ***args, const int tag_index)
 	*args = p;
 
 	args_n = (j > 0) ? j - 1 : 0;
-	/* Do not count self and parent dirs */
-	return (size_t)n - 2;
+	return n;
 }
 
 static void
@@ -1486,6 +1477,7 @@ expand_file_type_filter(const char t)
 		case 'x': if (file_info[i].exec == 1) f[c++] = strdup(n); break;
 		case 'u': if (file_info[i].mode & S_ISUID) f[c++] = strdup(n); break;
 		case 'g': if (file_info[i].mode & S_ISGID) f[c++] = strdup(n); break;
+		case 'T': if (file_info[i].tagged == 1) f[c++] = strdup(n); break;
 		default: break;
 		}
 
@@ -657,8 +657,7 @@ print_suggestion(const char *str, size_t offset, char *color)
 }
 
 static inline char *
-get_reg_file_color(const char *filename, const struct stat *attr,
-	int *free_color)
+get_reg_file_color(const char *filename, const struct stat *attr)
 {
 	if (conf.light_mode == 1) return fi_c;
 	if (*nf_c && access(filename, R_OK) == -1) return nf_c;
@@ -683,23 +682,14 @@ get_reg_file_color(const char *filename, const struct stat *attr,
 	if (!ext || ext == filename)
 		return fi_c;
 
-	size_t color_len = 0;
-	const char *extcolor = get_ext_color(ext, &color_len);
-	if (!extcolor)
-		return fi_c;
-
-	color_len += 4;
-	char *ext_color = xnmalloc(color_len, sizeof(char));
-	snprintf(ext_color, color_len, "\x1b[%sm", extcolor);
-
-	*free_color = 1;
-	return ext_color;
+	char *ext_color = get_ext_color_seq(ext, NULL);
+	return ext_color ? ext_color : fi_c;
 }
 
 /* Used by the check_completions function to get filenames color
  * according to file type. */
 static char *
-get_comp_color(const char *filename, const struct stat *attr, int *free_color)
+get_comp_color(const char *filename, const struct stat *attr)
 {
 	switch (attr->st_mode & S_IFMT) {
 	case S_IFDIR:
@@ -707,7 +697,7 @@ get_comp_color(const char *filename, const struct stat *attr, int *free_color)
 			: get_dir_color(filename, attr, -1);
 
 	case S_IFREG:
-		return get_reg_file_color(filename, attr, free_color);
+		return get_reg_file_color(filename, attr);
 
 	case S_IFLNK: {
 		if (conf.light_mode == 1) return ln_c;
@@ -806,7 +796,7 @@ match_print(const char *match, const size_t len, char *color,
 static inline int
 print_match(char *match, const size_t len)
 {
-	int append_slash = 0, free_color = 0;
+	int append_slash = 0;
 
 	char *p = NULL, *temp_color = NULL;
 	char *color = (conf.suggest_filetype_color == 1) ? no_c : sf_c;
@@ -824,11 +814,9 @@ print_match(char *match, const size_t len)
 		}
 
 		if (conf.suggest_filetype_color == 1) {
-			temp_color = get_comp_color(p ? p : match, &attr, &free_color);
+			temp_color = get_comp_color(p ? p : match, &attr);
 			if (temp_color)
 				color = temp_color;
-			else
-				free_color = 0;
 		}
 	} else {
 		suggestion.filetype = DT_DIR;
@@ -838,8 +826,6 @@ print_match(char *match, const size_t len)
 	suggestion.type = COMP_SUG;
 	match_print(match, len, color, append_slash);
 
-	if (free_color == 1)
-		free(color);
 	return PARTIAL_MATCH;
 }
 
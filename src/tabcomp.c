@@ -31,6 +31,11 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 #endif /* __OpenBSD__ */
 
 #include <errno.h>
+#ifndef _NO_FZF
+# include <fcntl.h>  /* fcntl() */
+# include <poll.h>
+# include <signal.h> /* sigaction() */
+#endif /* !_NO_FZF */
 
 #include "aux.h"
 #include "checks.h"
@@ -40,6 +45,9 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 #endif /* !_NO_HIGHLIGHT */
 #include "misc.h"
 #include "navigation.h"
+#if !defined(_NO_LIRA) && !defined(_NO_FZF)
+# include "previewd.h" /* start_preview_server() */
+#endif /* !_NO_LIRA && !_NO_FZF */
 #include "readline.h"
 #include "selection.h"
 #include "sort.h"
@@ -55,12 +63,34 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 || (c) == TCMP_TAGS_F || (c) == TCMP_GLOB || (c) == TCMP_FILE_TYPES_FILES \
 || (c) == TCMP_BM_PATHS || (c) == TCMP_UNTRASH || (c) == TCMP_TRASHDEL)
 
-static char finder_in_file[PATH_MAX + 1];
-static char finder_out_file[PATH_MAX + 1];
+/* Amount of data written to the finder at once */
+# define FINDER_FEED_CHUNK (64 * 1024)
 
 /* We need to know the longest entry (if previewing files) to correctly
  * calculate the width of the preview window. */
 static size_t longest_prev_entry;
+
+/* State of the list of completions being fed to the finder */
+struct comp_feed_t {
+	char  **matches;
+	char   *norm_prefix;
+	char   *buf;   /* Entries not yet written to the finder */
+	size_t  len;   /* Bytes in BUF */
+	size_t  off;   /* Bytes of BUF already written */
+	size_t  size;  /* Allocated size of BUF */
+	size_t  i;     /* Next match to be fed */
+	int     no_file_comp;
+	char    end_char;
+	char    pad0[3];
+};
+
+/* Files in the current directory, hashed by name, to get the colors of
+ * completed filenames from the current list of files (file_info) instead
+ * of calling lstat(2) on each of them. */
+static struct {
+	size_t *t;   /* Indices into file_info (plus one; zero means empty) */
+	size_t mask;
+} cwd_names = {NULL, 0};
 #endif /* _NO_FZF */
 
 /* The following three functions are used to get current cursor position
@@ -292,6 +322,69 @@ fzftab_color(const char *filename, const struct stat *attr)
 	}
 }
 
+/* Hash the names of the files in the current list of files (file_info). */
+static void
+hash_cwd_names(void)
+{
+	if (conf.autols == 0 || g_files_num <= 0 || !file_info
+	|| virtual_dir == 1)
+		return;
+
+	const size_t n = (size_t)g_files_num;
+	size_t size = 1;
+	while (size < n * 2)
+		size <<= 1;
+
+	cwd_names.t = xcalloc(size, sizeof(size_t));
+	cwd_names.mask = size - 1;
+
+	for (size_t i = 0; i < n; i++) {
+		size_t h = hashme(file_info[i].name, 0) & cwd_names.mask;
+		while (cwd_names.t[h] != 0)
+			h = (h + 1) & cwd_names.mask;
+		cwd_names.t[h] = i + 1;
+	}
+}
+
+static void
+free_cwd_names(void)
+{
+	free(cwd_names.t);
+	cwd_names.t = NULL;
+	cwd_names.mask = 0;
+}
+
+/* Return the color of the file NAME (in the current directory), as taken
+ * from the current list of files, or NULL if not found. */
+static char *
+get_cwd_file_color(const char *name)
+{
+	if (!cwd_names.t || !name || !*name)
+		return NULL;
+
+	/* 'name' or 'name/' */
+	char buf[NAME_MAX + 1];
+	const char *s = strchr(name, '/');
+	if (s) {
+		if (s[1] || (size_t)(s - name) >= sizeof(buf))
+			return NULL;
+		memcpy(buf, name, (size_t)(s - name));
+		buf[s - name] = '\0';
+		name = buf;
+	}
+
+	size_t h = hashme(name, 0) & cwd_names.mask;
+	while (cwd_names.t[h] != 0) {
+		const size_t n = cwd_names.t[h] - 1;
+		if (*file_info[n].name == *name
+		&& strcmp(file_info[n].name, name) == 0)
+			return file_info[n].color;
+		h = (h + 1) & cwd_names.mask;
+	}
+
+	return NULL;
+}
+
 static char *
 get_comp_entry_color(char *entry, const char *norm_prefix)
 {
@@ -348,6 +441,10 @@ get_comp_entry_color(char *entry, const char *norm_prefix)
 			if (lstat(vt_file, &attr) != -1)
 				return fzftab_color(vt_file, &attr);
 		} else {
+			char *cl = get_cwd_file_color(entry);
+			if (cl)
+				return cl;
+
 			char tmp[PATH_MAX + 1];
 			snprintf(tmp, sizeof(tmp), "%s/%s", workspaces[cur_ws].path, entry);
 			if (lstat(tmp, &attr) != -1)
@@ -750,9 +847,269 @@ warn_fzf_error(void)
 	}
 }
 
+/* Return a normalized (absolute) path for the query string PREFIX.
+ * E.g., "./b<TAB>" -> /parent/dir
+ * The partially typed basename, here 'b', is excluded, since it will be added
+ * later using the list of matches passed to init_comp_feed(). */
+static char *
+normalize_prefix(char *prefix)
+{
+	char *s = strrchr(prefix, '/');
+	if (s && s != prefix && s[1])
+		*s = '\0';
+
+	char *norm_prefix = normalize_path(prefix, strlen(prefix));
+
+	if (s)
+		*s = '/';
+
+	return norm_prefix;
+}
+
+/* Return the number of completions in MATCHES (plus one, for the common
+ * prefix in MATCHES[0]), and set LONGEST_PREV_ENTRY. */
+static size_t
+count_completions(char **matches)
+{
+	const enum comp_type ct = cur_comp_type;
+	const int prev = (conf.fzf_preview > 0 && SHOW_PREVIEWS(ct) == 1);
+	const int get_base_name = ((ct == TCMP_PATH || ct == TCMP_GLOB)
+		&& !(flags & PREVIEWER));
+	longest_prev_entry = 0;
+
+	size_t i;
+	for (i = 1; matches[i]; i++) {
+		if (prev == 0 || !*matches[i] || SELFORPARENT(matches[i]))
+			continue;
+
+		const char *p = get_base_name == 1 ? strrchr(matches[i], '/') : NULL;
+		const size_t len = strlen((p && p[1]) ? p + 1 : matches[i]);
+		if (len > longest_prev_entry)
+			longest_prev_entry = len;
+	}
+
+	/* 'view' cmd with only one match: matches[0]. */
+	if (i == 1 && prev == 1 && (flags & PREVIEWER))
+		longest_prev_entry = strlen(matches[0]);
+
+	return i;
+}
+
+static void
+init_comp_feed(struct comp_feed_t *f, char **matches)
+{
+	const enum comp_type ct = cur_comp_type;
+
+	memset(f, 0, sizeof(struct comp_feed_t));
+	f->matches = matches;
+	/* 'view' cmd with only one match: matches[0]. */
+	f->i = ((flags & PREVIEWER) && !matches[1]) ? 0 : 1;
+	f->end_char = tabmode == SMENU_TAB ? '\n' : '\0';
+
+	f->no_file_comp = (ct == TCMP_TAGS_S || ct == TCMP_TAGS_U
+		|| ct == TCMP_SORT || ct == TCMP_BOOKMARK || ct == TCMP_CSCHEME
+		|| ct == TCMP_NET || ct == TCMP_PROF || ct == TCMP_PROMPTS
+		|| ct == TCMP_BM_PREFIX || ct == TCMP_WS_PREFIX
+		|| ct == TCMP_WORKSPACES);
+			/* We're not completing filenames. */
+
+	/* "./_", "../_", and "_/.._" */
+	if (ct == TCMP_PATH && ((*matches[0] == '.' && (matches[0][1] == '/'
+	|| (matches[0][1] == '.' && matches[0][2] == '/')))
+	|| strstr(matches[0], "/..")))
+		f->norm_prefix = normalize_prefix(matches[0]);
+
+	if (conf.colorize == 1 && ct == TCMP_PATH && !f->norm_prefix)
+		hash_cwd_names();
+
+	f->size = FINDER_FEED_CHUNK + PATH_MAX + MAX_COLOR + 16;
+	f->buf = xnmalloc(f->size, sizeof(char));
+}
+
+static void
+free_comp_feed(struct comp_feed_t *f)
+{
+	free(f->buf);
+	free(f->norm_prefix);
+	free_cwd_names();
+}
+
+/* Append the next completions in F (colorized) to the feed buffer, until
+ * FINDER_FEED_CHUNK bytes are filled.
+ * Returns the amount of bytes in the buffer (zero if there are no more
+ * completions). */
+static size_t
+fill_comp_feed(struct comp_feed_t *f)
+{
+	const enum comp_type ct = cur_comp_type;
+	char **matches = f->matches;
+
+	f->len = f->off = 0;
+
+#ifndef _NO_TRASH
+	/* Change to the trash dir so we can correctly get trashed files color. */
+	const int in_trash = (conf.colorize == 1 && matches[f->i]
+		&& (ct == TCMP_TRASHDEL || ct == TCMP_UNTRASH) && trash_files_dir);
+	if (in_trash == 1)
+		xchdir(trash_files_dir, NO_TITLE);
+#endif /* _NO_TRASH */
+
+	for (; matches[f->i] && f->len < FINDER_FEED_CHUNK; f->i++) {
+		if (!*matches[f->i] || SELFORPARENT(matches[f->i]))
+			continue;
+
+		const char *color = df_c;
+		char *entry = matches[f->i];
+
+		if (ct == TCMP_BACKDIR) {
+			color = di_c;
+		} else if (ct == TCMP_TAGS_T || ct == TCMP_BM_PREFIX) {
+			color = mi_c;
+			if (entry[2])
+				entry += 2;
+		} else if (ct == TCMP_TAGS_C) {
+			color = mi_c;
+			if (entry[1])
+				entry += 1;
+		} else if (f->no_file_comp == 1) {
+			color = mi_c;
+
+		} else if (ct != TCMP_HIST && ct != TCMP_FILE_TYPES_OPTS
+		&& ct != TCMP_MIME_LIST && ct != TCMP_CMD_DESC) {
+			char *cl = get_comp_entry_color(entry, f->norm_prefix);
+			*tmp_color = '\0';
+
+			/* If color does not start with escape, then we have a color
+			 * for a file extension. In this case, we need to properly
+			 * construct the color code. */
+			if (cl && *cl != KEY_ESC)
+				snprintf(tmp_color, sizeof(tmp_color), "\x1b[%sm", cl);
+
+			color = *tmp_color ? tmp_color : (cl ? cl : "");
+
+			if (ct != TCMP_SEL && ct != TCMP_DESEL && ct != TCMP_BM_PATHS
+			&& ct != TCMP_DIRHIST && ct != TCMP_OPENWITH
+			&& ct != TCMP_JUMP && ct != TCMP_TAGS_F
+			&& !(flags & COMP_KEEP_FULL_PATH)) {
+				char *ptr = strrchr(entry, '/');
+				entry = (ptr && *(++ptr)) ? ptr : entry;
+			}
+		}
+
+		if (!*entry)
+			continue;
+
+		const size_t need = f->len + strlen(color) + strlen(entry)
+			+ (sizeof(NC) - 1) + 2;
+		if (need > f->size) {
+			f->size = need + FINDER_FEED_CHUNK;
+			f->buf = xnrealloc(f->buf, f->size, sizeof(char));
+		}
+
+		const int n = snprintf(f->buf + f->len, f->size - f->len,
+			"%s%s%s%c", color, entry, NC, f->end_char);
+		if (n > 0)
+			f->len += (size_t)n;
+	}
+
+#ifndef _NO_TRASH
+	/* We changed to the trash dir. Change back to the current dir. */
+	if (in_trash == 1 && workspaces && workspaces[cur_ws].path)
+		xchdir(workspaces[cur_ws].path, NO_TITLE);
+#endif /* _NO_TRASH */
+
+	return f->len;
+}
+
+/* Feed the finder with the completions in F through IN_FD (as they are
+ * generated), while collecting its output from OUT_FD in OUT. Both file
+ * descriptors are closed. */
+static void
+feed_finder(struct comp_feed_t *f, int in_fd, const int out_fd, char **out)
+{
+	size_t out_len = 0, out_size = 0;
+	int out_open = 1;
+
+	/* Do not block writing to the finder: we need to read its output */
+	const int fl = fcntl(in_fd, F_GETFL);
+	if (fl != -1)
+		fcntl(in_fd, F_SETFL, fl | O_NONBLOCK);
+
+	/* The finder might exit before reading all entries */
+	struct sigaction sa, old_sa;
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, &old_sa);
+
+	while (out_open == 1) {
+		if (in_fd != -1 && f->off == f->len && fill_comp_feed(f) == 0) {
+			close(in_fd); /* Done: let the finder know */
+			in_fd = -1;
+		}
+
+		struct pollfd pfd[2];
+		nfds_t n = 1;
+		pfd[0].fd = out_fd;
+		pfd[0].events = POLLIN;
+		pfd[0].revents = 0;
+		if (in_fd != -1) {
+			pfd[1].fd = in_fd;
+			pfd[1].events = POLLOUT;
+			pfd[1].revents = 0;
+			n++;
+		}
+
+		if (poll(pfd, n, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (in_fd != -1 && pfd[1].revents != 0) {
+			const ssize_t ret = (pfd[1].revents & POLLOUT)
+				? write(in_fd, f->buf + f->off, f->len - f->off) : -1;
+			if (ret > 0) {
+				f->off += (size_t)ret;
+			} else if (ret == -1 && (pfd[1].revents & POLLOUT)
+			&& (errno == EINTR || errno == EAGAIN)) {
+				continue;
+			} else { /* The finder closed its input */
+				close(in_fd);
+				in_fd = -1;
+			}
+		}
+
+		if (pfd[0].revents == 0)
+			continue;
+
+		if (out_size - out_len < 4096) {
+			out_size += 8192;
+			*out = xnrealloc(*out, out_size, sizeof(char));
+		}
+
+		const ssize_t ret = read(out_fd, *out + out_len, out_size - out_len - 1);
+		if (ret > 0)
+			out_len += (size_t)ret;
+		else if (ret == 0 || (errno != EINTR && errno != EAGAIN))
+			out_open = 0;
+	}
+
+	sigaction(SIGPIPE, &old_sa, NULL);
+
+	if (in_fd != -1)
+		close(in_fd);
+	close(out_fd);
+
+	if (*out)
+		(*out)[out_len] = '\0';
+}
+
+/* Run the finder, feeding it with the completions in MATCHES, and store
+ * its output in OUT. Returns the exit status of the finder. */
 static int
 run_finder(const size_t height, const int offset, const char *lw,
-	const int multi)
+	const int multi, char **matches, char **out)
 {
 	int prev = (conf.fzf_preview > 0 && SHOW_PREVIEWS(cur_comp_type) == 1)
 		? FZF_INTERNAL_PREVIEWER : 0;
@@ -778,18 +1135,16 @@ run_finder(const size_t height, const int offset, const char *lw,
 		snprintf(cmd, sizeof(cmd), "fnf "
 			"--read-null --pad=%d --query='%s' --reverse "
 			"--tab-accepts --right-accepts --left-aborts "
-			"--lines=%zu %s %s < %s > %s",
+			"--lines=%zu %s %s",
 			offset, lw ? lw : "", height,
 			conf.colorize == 0 ? "--no-color" : "",
-			multi == 1 ? "--multi" : "",
-			finder_in_file, finder_out_file);
+			multi == 1 ? "--multi" : "");
 
 	} else if (tabmode == SMENU_TAB) {
 		snprintf(cmd, sizeof(cmd), "smenu %s "
-			"-t -d -n%zu -limits l:%d -W$'\n' %s < %s > %s",
+			"-t -d -n%zu -limits l:%d -W$'\n' %s",
 			smenutab_options_env ? smenutab_options_env : DEF_SMENU_OPTIONS,
-			height, PATH_MAX, multi == 1 ? "-P$'\n'" : "",
-			finder_in_file, finder_out_file);
+			height, PATH_MAX, multi == 1 ? "-P$'\n'" : "");
 
 	} else { /* FZF */
 		/* All fixed parameters are compatible with at least fzf 0.18.0 (Mar 31, 2019) */
@@ -804,11 +1159,16 @@ run_finder(const size_t height, const int offset, const char *lw,
 				snprintf(prev_opts, sizeof(prev_opts), "--preview-window=%zu", s);
 		}
 
+#ifndef _NO_LIRA
+		/* Let 'clifm --preview' be served by a persistent process */
+		if (prev == FZF_INTERNAL_PREVIEWER)
+			start_preview_server();
+#endif /* !_NO_LIRA */
+
 		snprintf(cmd, sizeof(cmd), "fzf %s %s "
 			"%s --margin=0,0,0,%d "
 			"%s --read0 --ansi "
-			"--query='%s' %s %s %s %s %s "
-			"< %s > %s",
+			"--query='%s' %s %s %s %s %s",
 			conf.fzftab_options,
 			term_caps.unicode == 0 ? "--no-unicode" : "",
 			*height_str ? height_str : "", offset,
@@ -819,8 +1179,7 @@ ctrl-d:deselect-all,ctrl-t:toggle-all" : "",
 			prev == FZF_INTERNAL_PREVIEWER ? prev_str : "",
 			(prev == FZF_INTERNAL_PREVIEWER && prev_hidden == 1)
 				? "--preview-window=hidden --bind alt-p:toggle-preview" : "",
-			*prev_opts ? prev_opts : "",
-			finder_in_file, finder_out_file);
+			*prev_opts ? prev_opts : "");
 
 		/* Skim is a nice alternative, but it currently (0.10.4) fails
 		 * clearing the screen when --height is set, which makes it unusable
@@ -831,8 +1190,7 @@ ctrl-d:deselect-all,ctrl-t:toggle-all" : "",
 //			"%s %s --margin=0,0,0,%d "
 			"%s --margin=0,0,0,%d "
 			"--read0 --ansi "
-			"--query=\"%s\" %s %s %s %s %s "
-			"< %s > %s",
+			"--query=\"%s\" %s %s %s %s %s",
 			conf.fzftab_options,
 			*height_str ? height_str : "", offset,
 //			*height_str ? "--no-clear-start" : "", offset,
@@ -842,15 +1200,27 @@ ctrl-d:deselect-all,ctrl-t:toggle-all" : "",
 			prev == 1 ? prev_str : "",
 			(prev == 1 && prev_hidden == 1)
 				? "--preview-window=hidden --bind alt-p:toggle-preview" : "",
-			*prev_opts ? prev_opts : "",
-			finder_in_file, finder_out_file); */
+			*prev_opts ? prev_opts : ""); */
 	}
 
 	const int dr = (flags & DELAYED_REFRESH) ? 1 : 0;
 	flags &= ~DELAYED_REFRESH;
-	const mode_t old_mask = umask(0077); /* flawfinder: ignore */
-	const int ret = launch_execl(cmd);
-	umask(old_mask); /* flawfinder: ignore */
+
+	/* Start the finder right away, and feed it as completions are
+	 * generated (and colorized). */
+	int ret = FUNC_FAILURE;
+	int in_fd = -1, out_fd = -1;
+	const pid_t pid = launch_execl_pipe(cmd, &in_fd, &out_fd);
+
+	if (pid == -1) {
+		xerror("%s: %s\n", PROGRAM_NAME, strerror(errno));
+	} else {
+		struct comp_feed_t feed;
+		init_comp_feed(&feed, matches);
+		feed_finder(&feed, in_fd, out_fd, out);
+		free_comp_feed(&feed);
+		ret = wait_execl_pipe(pid);
+	}
 
 	if (restore_cwd == 1) /* cppcheck-suppress knownConditionTrueFalse */
 		xchdir(workspaces[cur_ws].path, NO_TITLE);
@@ -911,14 +1281,6 @@ get_tagged_file_target(char *filename)
 	return q ? q : s;
 }
 
-static char *
-print_no_finder_file(void)
-{
-	err('e', PRINT_PROMPT, "%s: %s: %s\n", PROGRAM_NAME,
-		finder_out_file, strerror(errno));
-	return NULL;
-}
-
 /* If we are completing a path whose last component is a glob expression,
  * return the selected match for this expression (STR) preceded by
  * the initial portion of the path (everything before the glob expression):
@@ -943,34 +1305,33 @@ get_glob_file_target(char *str, const char *initial_path)
 	return p;
 }
 
-/* Recover finder (fzf/fnf/smenu) output from FINDER_OUT_FILE file.
- * Return this output (reformatted if needed) or NULL in case of error.
- * FINDER_OUT_FILE is removed immediately after use.  */
+/* Parse the output of the finder (fzf/fnf/smenu), OUTPUT.
+ * Return this output (reformatted if needed) or NULL in case of error. */
 static char *
-get_finder_output(const int multi, char *base)
+get_finder_output(const int multi, char *base, char *output)
 {
-	int fd = -1;
-	FILE *fp = open_fread(finder_out_file, &fd);
-	if (!fp) {
-		unlinkat(XAT_FDCWD, finder_out_file, 0);
-		return print_no_finder_file();
-	}
+	if (!output)
+		return NULL;
 
 	char *buf = xnmalloc(1, sizeof(char));
 	*buf = '\0';
 	const char *initial_path =
 		(cur_comp_type == TCMP_GLOB) ? base : NULL;
 
-	char *line = NULL;
-	size_t bsize = 0, line_size = 0;
-	ssize_t line_len = 0;
+	char *line = NULL, *next = NULL;
+	size_t bsize = 0;
 
-	while ((line_len = getline(&line, &line_size, fp)) > 0) {
-		if (line[line_len - 1] == '\n') {
-			line_len--;
-			line[line_len] = '\0';
+	for (line = output; *line; line = next) {
+		char *nl = strchr(line, '\n');
+		if (nl) {
+			*nl = '\0';
+			next = nl + 1;
+		} else {
+			next = line + strlen(line);
 		}
 
+		ssize_t line_len = (ssize_t)(next - line) - (nl ? 1 : 0);
+
 		if (cur_comp_type == TCMP_FILE_TYPES_OPTS && *line && line[1]) {
 			line[1] = '\0';
 			line_len = 1;
@@ -1031,10 +1392,6 @@ get_finder_output(const int multi, char *base)
 		}
 	}
 
-	free(line);
-	unlinkat(XAT_FDCWD, finder_out_file, 0);
-	fclose(fp);
-
 	if (*buf == '\0') {
 		free(buf);
 		buf = NULL;
@@ -1043,136 +1400,6 @@ get_finder_output(const int multi, char *base)
 	return buf;
 }
 
-/* Return a normalized (absolute) path for the query string PREFIX.
- * E.g., "./b<TAB>" -> /parent/dir
- * The partially typed basename, here 'b', is excluded, since it will be added
- * later using the list of matches passed to store_completions(). */
-static char *
-normalize_prefix(char *prefix)
-{
-	char *s = strrchr(prefix, '/');
-	if (s && s != prefix && s[1])
-		*s = '\0';
-
-	char *norm_prefix = normalize_path(prefix, strlen(prefix));
-
-	if (s)
-		*s = '/';
-
-	return norm_prefix;
-}
-
-/* Store possible completions (MATCHES) in FINDER_IN_FILE to pass them to the
- * finder, either FZF or FNF.
- * Return the number of stored matches. */
-static size_t
-store_completions(char **matches)
-{
-	int fd = -1;
-	FILE *fp = open_fwrite(finder_in_file, &fd);
-	if (!fp) {
-		err('e', PRINT_PROMPT, "%s: %s: %s\n", PROGRAM_NAME,
-			finder_in_file, strerror(errno));
-		return (size_t)-1;
-	}
-
-	const enum comp_type ct = cur_comp_type;
-
-	const int no_file_comp = (ct == TCMP_TAGS_S || ct == TCMP_TAGS_U
-		|| ct == TCMP_SORT || ct == TCMP_BOOKMARK || ct == TCMP_CSCHEME
-		|| ct == TCMP_NET || ct == TCMP_PROF || ct == TCMP_PROMPTS
-		|| ct == TCMP_BM_PREFIX || ct == TCMP_WS_PREFIX
-		|| ct == TCMP_WORKSPACES);
-			/* We're not completing filenames. */
-
-	char *norm_prefix = NULL;
-	/* "./_", "../_", and "_/.._" */
-	if (ct == TCMP_PATH && ((*matches[0] == '.' && (matches[0][1] == '/'
-	|| (matches[0][1] == '.' && matches[0][2] == '/')))
-	|| strstr(matches[0], "/..")))
-		norm_prefix = normalize_prefix(matches[0]);
-
-	size_t i;
-	/* 'view' cmd with only one match: matches[0]. */
-	const size_t start = ((flags & PREVIEWER) && !matches[1]) ? 0 : 1;
-	const int prev = (conf.fzf_preview > 0 && SHOW_PREVIEWS(ct) == 1);
-	const char end_char = tabmode == SMENU_TAB ? '\n' : '\0';
-	longest_prev_entry = 0;
-
-#ifndef _NO_TRASH
-	/* Change to the trash dir so we can correctly get trashed files color. */
-	if (conf.colorize == 1 && (ct == TCMP_TRASHDEL || ct == TCMP_UNTRASH)
-	&& trash_files_dir)
-		xchdir(trash_files_dir, NO_TITLE);
-#endif /* _NO_TRASH */
-
-	for (i = start; matches[i]; i++) {
-		if (!matches[i] || !*matches[i] || SELFORPARENT(matches[i]))
-			continue;
-
-		const char *color = df_c;
-		char *entry = matches[i];
-
-		if (prev == 1) {
-			const int get_base_name = ((ct == TCMP_PATH || ct == TCMP_GLOB)
-				&& !(flags & PREVIEWER));
-			const char *p = get_base_name == 1 ? strrchr(entry, '/') : NULL;
-			const size_t len = strlen((p && p[1]) ? p + 1 : entry);
-			if (len > longest_prev_entry)
-				longest_prev_entry = len;
-		}
-
-		if (ct == TCMP_BACKDIR) {
-			color = di_c;
-		} else if (ct == TCMP_TAGS_T || ct == TCMP_BM_PREFIX) {
-			color = mi_c;
-			if (entry[2])
-				entry += 2;
-		} else if (ct == TCMP_TAGS_C) {
-			color = mi_c;
-			if (entry[1])
-				entry += 1;
-		} else if (no_file_comp == 1) {
-			color = mi_c;
-
-		} else if (ct != TCMP_HIST && ct != TCMP_FILE_TYPES_OPTS
-		&& ct != TCMP_MIME_LIST && ct != TCMP_CMD_DESC) {
-			char *cl = get_comp_entry_color(entry, norm_prefix);
-			*tmp_color = '\0';
-
-			/* If color does not start with escape, then we have a color
-			 * for a file extension. In this case, we need to properly
-			 * construct the color code. */
-			if (cl && *cl != KEY_ESC)
-				snprintf(tmp_color, sizeof(tmp_color), "\x1b[%sm", cl);
-
-			color = *tmp_color ? tmp_color : (cl ? cl : "");
-
-			if (ct != TCMP_SEL && ct != TCMP_DESEL && ct != TCMP_BM_PATHS
-			&& ct != TCMP_DIRHIST && ct != TCMP_OPENWITH
-			&& ct != TCMP_JUMP && ct != TCMP_TAGS_F
-			&& !(flags & COMP_KEEP_FULL_PATH)) {
-				char *ptr = strrchr(entry, '/');
-				entry = (ptr && *(++ptr)) ? ptr : entry;
-			}
-		}
-
-		if (*entry)
-			fprintf(fp, "%s%s%s%c", color, entry, NC, end_char);
-	}
-
-#ifndef _NO_TRASH
-	/* We changed to the trash dir. Change back to the current dir. */
-	if (conf.colorize == 1 && (ct == TCMP_TRASHDEL || ct == TCMP_UNTRASH)
-	&& workspaces && workspaces[cur_ws].path)
-		xchdir(workspaces[cur_ws].path, NO_TITLE);
-#endif /* _NO_TRASH */
-
-	fclose(fp);
-	free(norm_prefix);
-	return i;
-}
-
 static char *
 get_query_str(char *lw)
 {
@@ -1756,38 +1983,6 @@ move_cursor_up(const int total_line_len)
 	MOVE_CURSOR_UP(lines);
 }
 
-/* Determine input and output files to be used by the fuzzy finder (either
- * fzf or fnf).
- * Let's do this even if fzftab is not enabled at startup, because this feature
- * can be enabled in place by editing the config file.
- *
- * NOTE: Why do the random file extensions have different lengths? If
- * compiled in POSIX mode, gen_rand_ext() uses srandom(3) and random(3) to
- * generate the string, but since both extensions are generated at the same
- * time, they happen to be the same, resulting in both filenames being
- * identical. As a workaround, we use different lengths for both extensions.
- *
- * These files are created immediately after this function returns by
- * store_completions() with permissions 600 (in a directory to which only the
- * current user has read/write access). These files are then immediately read
- * by the finder application, and deleted as soon as this latter returns. */
-static void
-set_finder_paths(void)
-{
-	const int sm = (xargs.stealth_mode == 1);
-	const char *p = sm ? P_tmpdir : tmp_dir;
-
-	char *rand_ext = gen_rand_str(RAND_SUFFIX_LEN + (sm ? 6 : 0));
-	snprintf(finder_in_file, sizeof(finder_in_file), "%s/.temp%s",
-		p, rand_ext ? rand_ext : "a3_2yu!d43");
-	free(rand_ext);
-
-	rand_ext = gen_rand_str(RAND_SUFFIX_LEN + (sm ? 10 : 4));
-	snprintf(finder_out_file, sizeof(finder_out_file), "%s/.temp%s",
-		p, rand_ext ? rand_ext : "0rNkds7++@");
-	free(rand_ext);
-}
-
 /* Display possible completions using the corresponding finder. If one of these
  * possible completions is selected, insert it into the current line buffer.
  *
@@ -1808,13 +2003,9 @@ set_finder_paths(void)
 static int
 finder_tabcomp(char **matches, const char *text, char *original_query)
 {
-	/* Set random filenames for both FINDER_IN_FILE and FINDER_OUT_FILE. */
-	set_finder_paths();
-
-	/* Store possible completions in FINDER_IN_FILE to pass them to the finder. */
-	const size_t num_matches = store_completions(matches);
-	if (num_matches == (size_t)-1)
-		return FUNC_FAILURE;
+	/* Completions are generated while feeding the finder (see
+	 * run_finder()). For now, we only need to know how many they are. */
+	const size_t num_matches = count_completions(matches);
 
 	/* Set a pointer to the last word in the query string. We use this to
 	 * highlight the matching prefix in the list of matches. */
@@ -1854,25 +2045,25 @@ finder_tabcomp(char **matches, const char *text, char *original_query)
 
 	char *deq = q ? (strchr(q, '\\') ? unescape_str(q) : q) : NULL;
 
-	/* Run the finder application and store the ouput in FINDER_OUT_FILE. */
-	const int ret = run_finder(height, finder_offset, deq, multi);
+	/* Run the finder application and store its ouput in OUT. */
+	char *out = NULL;
+	const int ret = run_finder(height, finder_offset, deq, multi,
+		matches, &out);
 
 	if (deq && deq != q)
 		free(deq);
 
-	unlinkat(XAT_FDCWD, finder_in_file, 0);
-
 	if (!(flags & PREVIEWER))
 		move_cursor_up(total_line_len);
 
 	/* No results (the user pressed ESC or the Left arrow key). */
 	if (ret != FUNC_SUCCESS) {
-		unlinkat(XAT_FDCWD, finder_out_file, 0);
+		free(out);
 		return clean_rl_buffer(text);
 	}
 
-	/* Retrieve finder's output from FINDER_OUT_FILE. */
-	char *buf = get_finder_output(multi, matches[0]);
+	char *buf = get_finder_output(multi, matches[0], out);
+	free(out);
 	if (!buf)
 		return FUNC_FAILURE;
 
@@ -21,8 +21,21 @@
 #include "init.h"
 #include "messages.h"
 #include "misc.h"
-#include "sort.h"
+#include "selset.h" /* devino_set_*() */
+#include "sort.h" /* alphasort_names() */
 #include "spawn.h"
+#include "tags.h"
+#include "tagsdb.h"
+
+/* Tags index: for each tag (in the same order as the tags array), the set
+ * of device IDs and inode numbers of the files tagged as such, plus the set
+ * of all tagged files. Built by build_tags_index() (called by load_tags())
+ * from the tags database and kept up to date by tag_file() and untag(), so
+ * that we can tell which tags a file has without reading the tags
+ * directory. */
+static devino_set_t *tag_sets = NULL;
+static devino_set_t tagged_set = {0};
+static size_t tag_sets_n = 0;
 
 /* A few printing functions */
 static int
@@ -65,23 +78,6 @@ print_usage(const int retval)
 	return retval;
 }
 
-#ifndef _DIRENT_HAVE_D_TPYE
-/* Check whether NAME is actually tagged as TAG.
- * Returns 1 if true or 0 otherwise. */
-static int
-check_tagged_file(const char *tag, const char *name)
-{
-	struct stat a;
-	char tmp[PATH_MAX + 1];
-	snprintf(tmp, sizeof(tmp), "%s/%s/%s", tags_dir, tag, name);
-
-	if (SELFORPARENT(name) || lstat(tmp, &a) == -1 || !S_ISLNK(a.st_mode))
-		return 0;
-
-	return 1;
-}
-#endif /* _DIRENT_HAVE_D_TPYE */
-
 /* Print the tagged file named NAME tagged as TAG. */
 static void
 print_tagged_file(char *name, const char *tag)
@@ -138,36 +134,33 @@ list_files_in_tag(char *name)
 	char tmp[PATH_MAX + 1];
 	snprintf(tmp, sizeof(tmp), "%s/%s", tags_dir, name);
 
-	struct dirent **t = NULL;
-	const int n = scandir(tmp, &t, NULL, conf.ignore_case == 0
-		? xalphasort : alphasort_insensitive);
-	if (n == -1) {
+	struct stat a;
+	if (stat(tmp, &a) == -1) {
 		xerror("tag: '%s': %s\n", tmp, strerror(errno));
 		return errno;
 	}
 
-	size_t i;
-	if (n <= 2) {
-		for (i = 0; i < (size_t)n; i++)
-			free(t[i]);
-		free(t);
+	size_t n = 0;
+	const struct tagged_file_t *files = tagsdb_get_files(name, &n);
+	if (n == 0)
 		return FUNC_SUCCESS;
-	}
 
-	for (i = 0; i < (size_t)n; i++) {
-#ifndef _DIRENT_HAVE_D_TPYE
-		if (check_tagged_file(name, t[i]->d_name) == 0) {
-#else
-		if (SELFORPARENT(t[i]->d_name) || t[i]->d_type != DT_LNK) {
-#endif /* !_DIRENT_HAVE_D_TYPE */
-			free(t[i]);
-			continue;
-		}
-		print_tagged_file(t[i]->d_name, name);
-		free(t[i]);
+	/* The database is sorted by name (strcmp(3)): sort a copy of the list
+	 * of names according to the current sorting options. */
+	char **names = xnmalloc(n, sizeof(char *));
+	for (size_t i = 0; i < n; i++)
+		names[i] = files[i].name;
+
+	if (conf.ignore_case == 1 || conf.sort_reverse == 1)
+		qsort(names, n, sizeof(char *), (QSFUNC *)alphasort_names);
+
+	for (size_t i = 0; i < n; i++) {
+		char link_name[NAME_MAX + 1];
+		xstrsncpy(link_name, names[i], sizeof(link_name));
+		print_tagged_file(link_name, name);
 	}
-	free(t);
 
+	free(names);
 	return FUNC_SUCCESS;
 }
 
@@ -187,38 +180,107 @@ get_longest_tag(void)
 	return longest_tag;
 }
 
-/* List all tags applied to the file whose device ID is DEV and inode number
- * is INO. */
+void
+free_tags_index(void)
+{
+	for (size_t i = 0; i < tag_sets_n; i++)
+		devino_set_destroy(&tag_sets[i]);
+
+	free(tag_sets);
+	tag_sets = NULL;
+	tag_sets_n = 0;
+	devino_set_destroy(&tagged_set);
+	free_tagsdb();
+}
+
+/* Return the index of the tag NAME in the tags array, or -1 if not found. */
+static ssize_t
+get_tag_index(const char *name)
+{
+	for (size_t i = 0; i < tags_n; i++) {
+		if (*name == *tags[i] && strcmp(name, tags[i]) == 0)
+			return (ssize_t)i;
+	}
+
+	return (-1);
+}
+
+/* Add the file whose device ID is DEV and inode number is INO to the index
+ * as tagged as the tag whose index in the tags array is T. */
 static void
-list_tags_having_file(const dev_t dev, const ino_t ino)
+index_tagged_file(const ssize_t t, const dev_t dev, const ino_t ino)
 {
-	if (!tags_dir || !tags)
+	if (t < 0 || (size_t)t >= tag_sets_n)
 		return;
 
-	for (size_t i = 0; tags[i]; i++) {
-		char tmp[PATH_MAX + 1];
-		snprintf(tmp, sizeof(tmp), "%s/%s", tags_dir, tags[i]);
+	devino_set_insert(&tag_sets[t], dev, ino);
+	devino_set_insert(&tagged_set, dev, ino);
+}
 
-		DIR *dir = opendir(tmp);
-		if (dir == NULL)
-			continue;
+/* Remove the file whose attributes are A from the index of the tag whose
+ * index in the tags array is T. */
+static void
+unindex_tagged_file(const ssize_t t, const struct stat *a)
+{
+	if (t < 0 || (size_t)t >= tag_sets_n)
+		return;
 
-		const struct dirent *ent;
-		while ((ent = readdir(dir))) {
-			char full_name[PATH_MAX + NAME_MAX + 2];
-			snprintf(full_name, sizeof(full_name), "%s/%s", tmp, ent->d_name);
+	devino_set_remove(&tag_sets[t], a->st_dev, a->st_ino);
 
-			struct stat a;
-			if (stat(full_name, &a) == -1)
-				continue;
+	for (size_t i = 0; i < tag_sets_n; i++) {
+		if (devino_set_contains(&tag_sets[i], a->st_dev, a->st_ino))
+			return;
+	}
 
-			if (a.st_dev == dev && a.st_ino == ino) {
-				printf(" %s%s%s\n", mi_c, tags[i], NC);
-				break;
-			}
+	devino_set_remove(&tagged_set, a->st_dev, a->st_ino);
+}
+
+/* Load the tags database and build the tags index from it. */
+void
+build_tags_index(void)
+{
+	free_tags_index();
+	load_tagsdb();
+
+	if (!tags_dir || tags_n == 0)
+		return;
+
+	tag_sets = xcalloc(tags_n, sizeof(devino_set_t));
+	tag_sets_n = tags_n;
+	devino_set_init(&tagged_set, 0);
+
+	for (size_t i = 0; i < tags_n; i++) {
+		size_t n = 0;
+		const struct tagged_file_t *files = tagsdb_get_files(tags[i], &n);
+
+		devino_set_init(&tag_sets[i], n * 2);
+		for (size_t j = 0; j < n; j++) {
+			if (files[j].ino != 0) /* Skip broken links */
+				index_tagged_file((ssize_t)i, files[j].dev, files[j].ino);
 		}
+	}
+}
 
-		closedir(dir);
+/* Return 1 if the file whose device ID is DEV and inode number is INO is
+ * tagged, or 0 otherwise. */
+int
+is_tagged_file(const dev_t dev, const ino_t ino)
+{
+	return (tagged_set.size > 0
+		&& devino_set_contains(&tagged_set, dev, ino) == 1);
+}
+
+/* List all tags applied to the file whose device ID is DEV and inode number
+ * is INO. */
+static void
+list_tags_having_file(const dev_t dev, const ino_t ino)
+{
+	if (!tags || is_tagged_file(dev, ino) == 0)
+		return;
+
+	for (size_t i = 0; i < tag_sets_n && tags[i]; i++) {
+		if (devino_set_contains(&tag_sets[i], dev, ino))
+			printf(" %s%s%s\n", mi_c, tags[i], NC);
 	}
 }
 
@@ -284,12 +346,10 @@ list_tags(char **args)
 		const int pad = (int)get_longest_tag();
 
 		for (i = 0; tags[i]; i++) {
-			char p[PATH_MAX + 1];
-			snprintf(p, sizeof(p), "%s/%s", tags_dir, tags[i]);
-			const filesn_t n = count_dir(p, NO_CPOP);
-			if (n > 2)
-				printf("%-*s [%s%jd%s]\n", pad, tags[i], mi_c,
-					(intmax_t)n - 2, df_c);
+			size_t n = 0;
+			tagsdb_get_files(tags[i], &n);
+			if (n > 0)
+				printf("%-*s [%s%zu%s]\n", pad, tags[i], mi_c, n, df_c);
 			else
 				printf("%-*s  -\n", pad, tags[i]);
 		}
@@ -451,6 +511,10 @@ tag_file(char *name, char *tag)
 			conf.colorize ? BOLD : "", p ? p : tag, df_c);
 		reload_tags();
 	}
+
+	char tag_name[NAME_MAX + 1];
+	xstrsncpy(tag_name, p ? p : tag, sizeof(tag_name));
+	const ssize_t tag_idx = get_tag_index(tag_name);
 	free(p);
 
 	char name_path[PATH_MAX + 1];
@@ -462,15 +526,29 @@ tag_file(char *name, char *tag)
 
 	char link[PATH_MAX + NAME_MAX], *q = NULL;
 	char *link_path = replace_slashes(*name_path ? name_path : name, ':');
+	if (!link_path)
+		return FUNC_FAILURE;
 
 	snprintf(link, sizeof(link), "%s/%s", dir, link_path);
-	free(link_path);
+	tagsdb_sync_tag(tag_name);
 
-	if (lstat(link, &a) != -1)
+	if (lstat(link, &a) != -1) {
+		free(link_path);
 		return print_tag_creation_error((q && *(++q)) ? q : name, a.st_mode);
+	}
 
-	if (symlink(*name_path ? name_path : name, link) == -1)
+	const char *target = *name_path ? name_path : name;
+	if (symlink(target, link) == -1) {
+		free(link_path);
 		return print_symlink_error(name);
+	}
+
+	const int have_target = (stat(link, &a) != -1);
+	tagsdb_add(tag_name, link_path, target, have_target == 1 ? &a : NULL);
+	free(link_path);
+
+	if (have_target == 1)
+		index_tagged_file(tag_idx, a.st_dev, a.st_ino);
 
 	return FUNC_SUCCESS;
 }
@@ -557,15 +635,19 @@ untag(char **args, const size_t n, size_t *t)
 			continue;
 
 		char *ds = unescape_str(args[n] + 1);
-		char dir[PATH_MAX + 1];
-		snprintf(dir, sizeof(dir), "%s/%s", tags_dir, ds ? ds : args[n] + 1);
+		char tag_name[NAME_MAX + 1];
+		xstrsncpy(tag_name, ds ? ds : args[n] + 1, sizeof(tag_name));
 		free(ds);
 
+		char dir[PATH_MAX + 1];
+		snprintf(dir, sizeof(dir), "%s/%s", tags_dir, tag_name);
+		const ssize_t tag_idx = get_tag_index(tag_name);
+
 		struct stat a;
 		if (lstat(dir, &a) == -1 || !S_ISDIR(a.st_mode))
 			return print_no_such_tag(args[n] + 1);
 
-		char f[PATH_MAX + NAME_MAX];
+		char f[PATH_MAX + NAME_MAX + 2];
 		char *deq = unescape_str(args[i]);
 		char *p = deq ? deq : args[i];
 		char *exp = NULL;
@@ -573,18 +655,28 @@ untag(char **args, const size_t n, size_t *t)
 			exp = tilde_expand(p);
 		const char *q = exp ? exp : p;
 		char *r = replace_slashes(q, ':');
+		char link_name[NAME_MAX + 1];
+		xstrsncpy(link_name, r ? r : q, sizeof(link_name));
 
-		snprintf(f, sizeof(f), "%s/%s", dir, r ? r : q);
+		snprintf(f, sizeof(f), "%s/%s", dir, link_name);
 		free(deq);
 		free(exp);
 		free(r);
 
+		tagsdb_sync_tag(tag_name);
+
 		if (lstat(f, &a) != -1 && S_ISLNK(a.st_mode)) {
+			struct stat target;
+			const int have_target = (stat(f, &target) != -1);
+
 			errno = 0;
 			if (unlinkat(XAT_FDCWD, f, 0) == -1) {
 				exit_status = errno;
 				xerror("tag: '%s': %s\n", args[i], strerror(errno));
 			} else {
+				tagsdb_del(tag_name, link_name);
+				if (have_target == 1)
+					unindex_tagged_file(tag_idx, &target);
 				(*t)++;
 			}
 		} else {
@@ -12,8 +12,11 @@
 
 __BEGIN_DECLS
 
-int is_tag(char *name);
-int tags_function(char **args);
+void build_tags_index(void);
+void free_tags_index(void);
+int  is_tag(char *name);
+int  is_tagged_file(const dev_t dev, const ino_t ino);
+int  tags_function(char **args);
 
 __END_DECLS
 
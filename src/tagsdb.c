@@ -0,0 +1,811 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* tagsdb.c -- a compact database of tagged files */
+
+/* The tags directory (a directory per tag, holding a symbolic link to each
+ * file tagged as such) is the reference format of the tagging system: it is
+ * what other programs see and what users may edit by hand. However, reading
+ * it means reading and sorting whole tag directories, and stat'ing every
+ * link in them.
+ *
+ * The tags database keeps a copy of the tags directory: for each tag, the
+ * name, target, device ID, and inode number of each tagged file (sorted by
+ * name), plus the identity and modification time of the tag directory.
+ *
+ * The database file (TAGSDB_FILE, in the tags directory) is an append-only
+ * log of records, mapped into memory (mmap(2)) and replayed at load time.
+ * Tagging and untagging files append a record, followed by the new stamp of
+ * the tag directory. Whenever the stamp of a tag directory does not match
+ * (e.g. it was modified by another program), the tag is read from the
+ * directory again. The log is rewritten (compacted) at load time whenever
+ * dead records outnumber live ones.
+ *
+ * The device ID and inode number of a tagged file may change without its
+ * tag directory being modified (e.g. editors saving files by renaming a new
+ * file over the old one): they are refreshed (stat'ing link targets) every
+ * time the database is loaded.
+ *
+ * The database can be disabled via the TagsDatabase option: tags are then
+ * read from the tags directory every time they are loaded. */
+
+#ifndef _NO_TAGS
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h> /* offsetof() */
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "aux.h" /* set_dir_stamp(), fnv1a_hash(), get_at_name(), xwrite() */
+#include "misc.h" /* xerror() */
+#include "tagsdb.h"
+
+#define TAGSDB_FILE    ".tags.db"
+#define TAGSDB_MAGIC   "CLIFMTDB"
+#define TAGSDB_VERSION 1
+/* Do not bother compacting logs smaller than this many records. */
+#define TAGSDB_MIN_COMPACT 1024
+
+/* Record types */
+#define TDB_ADD   1 /* Add file NAME (pointing to TARGET) to TAG */
+#define TDB_DEL   2 /* Remove file NAME from TAG */
+#define TDB_RESET 3 /* Remove all files from TAG */
+#define TDB_STAMP 4 /* Stamp (dev, ino, mtime) of the TAG directory */
+
+struct tdb_header_t {
+	char     magic[8];
+	uint32_t version;
+	uint32_t pad0;
+};
+
+/* Each record is made of this header, followed by the tag name, the file
+ * name, and the link target (not NUL terminated). */
+struct tdb_rec_t {
+	uint32_t len;  /* Length of the whole record */
+	uint32_t sum;  /* Checksum of the whole record (computed with sum = 0) */
+	uint8_t  type;
+	uint8_t  pad0;
+	uint16_t tag_len;
+	uint16_t name_len;
+	uint16_t target_len;
+	uint64_t dev;  /* Tagged file (TDB_ADD) or tag directory (TDB_STAMP) */
+	uint64_t ino;
+	int64_t  mtime;
+	int64_t  mtime_nsec;
+};
+
+struct tdb_tag_t {
+	char *name;
+	struct tagged_file_t *files;
+	size_t files_n;
+	size_t size;
+	struct dir_stamp_t stamp;
+	int sorted;
+	int pad0;
+};
+
+struct tdb_buf_t {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+static struct {
+	struct tdb_tag_t *tags;
+	size_t tags_n;
+	size_t records; /* Number of records in the database file */
+	int fd;         /* Database file, open for appending */
+	int pad0;
+} tdb = {NULL, 0, 0, -1, 0};
+
+static int
+compare_tagged_files(const void *a, const void *b)
+{
+	return strcmp(((const struct tagged_file_t *)a)->name,
+		((const struct tagged_file_t *)b)->name);
+}
+
+static void
+free_tag_files(struct tdb_tag_t *t)
+{
+	for (size_t i = 0; i < t->files_n; i++) {
+		free(t->files[i].name);
+		free(t->files[i].target);
+	}
+
+	t->files_n = 0;
+	t->sorted = 1;
+}
+
+/* Sort the files in T by name and remove duplicates. */
+static void
+sort_tag_files(struct tdb_tag_t *t)
+{
+	if (t->sorted == 1)
+		return;
+
+	qsort(t->files, t->files_n, sizeof(struct tagged_file_t),
+		compare_tagged_files);
+
+	size_t n = 0;
+	for (size_t i = 0; i < t->files_n; i++) {
+		if (n > 0 && strcmp(t->files[n - 1].name, t->files[i].name) == 0) {
+			free(t->files[n - 1].name);
+			free(t->files[n - 1].target);
+			n--;
+		}
+		t->files[n++] = t->files[i];
+	}
+
+	t->files_n = n;
+	t->sorted = 1;
+}
+
+/* Return the index of the file NAME in the (sorted) tag T, or, if not
+ * found, the index where it should be inserted, setting FOUND to 0. */
+static size_t
+find_tag_file(struct tdb_tag_t *t, const char *name, int *found)
+{
+	sort_tag_files(t);
+
+	size_t lo = 0, hi = t->files_n;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		const int ret = strcmp(t->files[mid].name, name);
+		if (ret == 0) {
+			*found = 1;
+			return mid;
+		}
+		if (ret < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*found = 0;
+	return lo;
+}
+
+/* Return the tag whose name is the first LEN bytes of NAME, creating it
+ * if CREATE is set. Returns NULL if not found. */
+static struct tdb_tag_t *
+get_tdb_tag(const char *name, const size_t len, const int create)
+{
+	for (size_t i = 0; i < tdb.tags_n; i++) {
+		if (strncmp(tdb.tags[i].name, name, len) == 0
+		&& tdb.tags[i].name[len] == '\0')
+			return &tdb.tags[i];
+	}
+
+	if (create == 0)
+		return NULL;
+
+	tdb.tags = xnrealloc(tdb.tags, tdb.tags_n + 1, sizeof(struct tdb_tag_t));
+	struct tdb_tag_t *t = &tdb.tags[tdb.tags_n++];
+	*t = (struct tdb_tag_t){0};
+	t->name = savestring(name, len);
+	t->sorted = 1;
+
+	return t;
+}
+
+/* Add the file NAME to the tag T. If SORTED is zero, the file is just
+ * appended (the list is sorted on the next lookup). */
+static void
+add_tag_file(struct tdb_tag_t *t, const struct tagged_file_t *f,
+	const int sorted)
+{
+	size_t i = t->files_n;
+
+	if (sorted == 1) {
+		int found = 0;
+		i = find_tag_file(t, f->name, &found);
+		if (found == 1) {
+			free(t->files[i].name);
+			free(t->files[i].target);
+			t->files[i] = *f;
+			return;
+		}
+	} else {
+		t->sorted = 0;
+	}
+
+	if (t->files_n == t->size) {
+		t->size = t->size == 0 ? 16 : t->size * 2;
+		t->files = xnrealloc(t->files, t->size, sizeof(struct tagged_file_t));
+	}
+
+	if (i < t->files_n) {
+		memmove(t->files + i + 1, t->files + i,
+			(t->files_n - i) * sizeof(struct tagged_file_t));
+	}
+
+	t->files[i] = *f;
+	t->files_n++;
+}
+
+static void
+del_tag_file(struct tdb_tag_t *t, const char *name)
+{
+	int found = 0;
+	const size_t i = find_tag_file(t, name, &found);
+	if (found == 0)
+		return;
+
+	free(t->files[i].name);
+	free(t->files[i].target);
+	t->files_n--;
+	if (i < t->files_n) {
+		memmove(t->files + i, t->files + i + 1,
+			(t->files_n - i) * sizeof(struct tagged_file_t));
+	}
+}
+
+/* Append a record of type TYPE to the buffer BUF. */
+static void
+encode_record(struct tdb_buf_t *buf, const uint8_t type, const char *tag,
+	const struct tagged_file_t *f, const struct dir_stamp_t *stamp)
+{
+	const size_t tag_len = strlen(tag);
+	const size_t name_len = f ? strlen(f->name) : 0;
+	const size_t target_len = (f && f->target) ? strlen(f->target) : 0;
+	if (tag_len > UINT16_MAX || name_len > UINT16_MAX
+	|| target_len > UINT16_MAX)
+		return;
+
+	struct tdb_rec_t r = {0};
+	r.len = (uint32_t)(sizeof(r) + tag_len + name_len + target_len);
+	r.type = type;
+	r.tag_len = (uint16_t)tag_len;
+	r.name_len = (uint16_t)name_len;
+	r.target_len = (uint16_t)target_len;
+
+	if (f) {
+		r.dev = (uint64_t)f->dev;
+		r.ino = (uint64_t)f->ino;
+	} else if (stamp) {
+		r.dev = (uint64_t)stamp->dev;
+		r.ino = (uint64_t)stamp->ino;
+		r.mtime = (int64_t)stamp->mtime;
+		r.mtime_nsec = (int64_t)stamp->mtime_nsec;
+	}
+
+	if (buf->len + r.len > buf->size) {
+		buf->size = buf->len + r.len + 4096;
+		buf->data = xnrealloc(buf->data, buf->size, sizeof(char));
+	}
+
+	char *p = buf->data + buf->len;
+	memcpy(p, &r, sizeof(r));
+	memcpy(p + sizeof(r), tag, tag_len);
+	if (name_len > 0)
+		memcpy(p + sizeof(r) + tag_len, f->name, name_len);
+	if (target_len > 0)
+		memcpy(p + sizeof(r) + tag_len + name_len, f->target, target_len);
+
+	r.sum = fnv1a_hash(FNV1A_INIT, p, r.len);
+	memcpy(p + offsetof(struct tdb_rec_t, sum), &r.sum, sizeof(r.sum));
+
+	buf->len += r.len;
+	tdb.records++;
+}
+
+/* Encode all files in the tag T, followed by its stamp, if valid. */
+static void
+encode_tag(struct tdb_buf_t *buf, struct tdb_tag_t *t)
+{
+	sort_tag_files(t);
+
+	encode_record(buf, TDB_RESET, t->name, NULL, NULL);
+	for (size_t i = 0; i < t->files_n; i++)
+		encode_record(buf, TDB_ADD, t->name, &t->files[i], NULL);
+
+	if (t->stamp.valid == 1)
+		encode_record(buf, TDB_STAMP, t->name, NULL, &t->stamp);
+}
+
+/* Append the content of BUF to the database file, if open. */
+static void
+flush_records(struct tdb_buf_t *buf)
+{
+	if (tdb.fd != -1 && buf->len > 0
+	&& xwrite(tdb.fd, buf->data, buf->len) == FUNC_FAILURE) {
+		xerror(_("tag: Cannot write to the tags database: %s\n"),
+			strerror(errno));
+		close(tdb.fd);
+		tdb.fd = -1;
+	}
+
+	free(buf->data);
+	*buf = (struct tdb_buf_t){0};
+}
+
+static void
+apply_record(const struct tdb_rec_t *r, const char *p)
+{
+	struct tdb_tag_t *t = get_tdb_tag(p, r->tag_len, 1);
+	const char *name = p + r->tag_len;
+
+	switch (r->type) {
+	case TDB_ADD: {
+		struct tagged_file_t f;
+		f.name = savestring(name, r->name_len);
+		f.target = r->target_len > 0
+			? savestring(name + r->name_len, r->target_len) : NULL;
+		f.dev = (dev_t)r->dev;
+		f.ino = (ino_t)r->ino;
+		add_tag_file(t, &f, 0);
+		}
+		break;
+
+	case TDB_DEL: {
+		char *n = savestring(name, r->name_len);
+		del_tag_file(t, n);
+		free(n);
+		}
+		break;
+
+	case TDB_RESET:
+		free_tag_files(t);
+		t->stamp.valid = 0;
+		break;
+
+	case TDB_STAMP:
+		t->stamp.dev = (dev_t)r->dev;
+		t->stamp.ino = (ino_t)r->ino;
+		t->stamp.mtime = (time_t)r->mtime;
+		t->stamp.mtime_nsec = (long)r->mtime_nsec;
+		t->stamp.valid = 1;
+		break;
+
+	default: break;
+	}
+}
+
+/* Replay the records in the database file FD, of size SIZE. Returns the
+ * number of valid bytes in the file. */
+static size_t
+replay_records(const int fd, const size_t size)
+{
+	if (size < sizeof(struct tdb_header_t))
+		return 0;
+
+	char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return 0;
+
+	struct tdb_header_t h;
+	memcpy(&h, data, sizeof(h));
+	if (memcmp(h.magic, TAGSDB_MAGIC, sizeof(h.magic)) != 0
+	|| h.version != TAGSDB_VERSION) {
+		munmap(data, size);
+		return 0;
+	}
+
+	size_t off = sizeof(h);
+	while (size - off >= sizeof(struct tdb_rec_t)) {
+		struct tdb_rec_t r;
+		memcpy(&r, data + off, sizeof(r));
+
+		if (r.len > size - off || r.tag_len == 0 || (size_t)r.len !=
+		sizeof(r) + r.tag_len + r.name_len + r.target_len)
+			break;
+
+		const uint32_t sum = r.sum;
+		r.sum = 0;
+		const char *p = data + off + sizeof(r);
+		const uint32_t h_sum = fnv1a_hash(fnv1a_hash(FNV1A_INIT,
+			(char *)&r, sizeof(r)), p, r.len - sizeof(r));
+		if (h_sum != sum)
+			break;
+
+		apply_record(&r, p);
+		tdb.records++;
+		off += r.len;
+	}
+
+	munmap(data, size);
+	return off;
+}
+
+/* Read the tag directory of T into T. */
+static void
+scan_tag_dir(struct tdb_tag_t *t, struct tdb_buf_t *buf)
+{
+	char dir[PATH_MAX + 1];
+	snprintf(dir, sizeof(dir), "%s/%s", tags_dir, t->name);
+
+	free_tag_files(t);
+	t->stamp.valid = 0;
+
+	DIR *d = opendir(dir);
+	if (!d)
+		return;
+
+	const int fd = dirfd(d);
+	struct stat a;
+#ifndef CLIFM_LEGACY
+	if (fstat(fd, &a) != -1)
+#else /* dirfd() is a dummy (see compat.h) */
+	if (stat(dir, &a) != -1)
+#endif /* !CLIFM_LEGACY */
+		set_dir_stamp(&t->stamp, &a);
+
+	char path[PATH_MAX + 1];
+
+	const struct dirent *ent;
+	while ((ent = readdir(d))) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (ent->d_type != DT_LNK && ent->d_type != DT_UNKNOWN)
+			continue;
+#endif /* _DIRENT_HAVE_D_TYPE */
+
+		const char *name = get_at_name(dir, ent->d_name, path, sizeof(path));
+		char target[PATH_MAX + 1];
+		const ssize_t len = readlinkat(fd, name, target, sizeof(target) - 1);
+		if (len == -1) /* Not a symbolic link */
+			continue;
+		target[len] = '\0';
+
+		struct tagged_file_t f;
+		f.name = savestring(ent->d_name, strlen(ent->d_name));
+		f.target = savestring(target, (size_t)len);
+		if (fstatat(fd, name, &a, 0) != -1) {
+			f.dev = a.st_dev;
+			f.ino = a.st_ino;
+		} else { /* Broken link */
+			f.dev = 0;
+			f.ino = 0;
+		}
+
+		add_tag_file(t, &f, 0);
+	}
+
+	closedir(d);
+
+	/* A directory modified right before being read could have been
+	 * modified again, in the same timestamp tick, while being read:
+	 * do not trust the stamp (the tag will be read again next time). */
+	if (t->stamp.valid == 1 && fstatat(XAT_FDCWD, dir, &a, 0) != -1
+	&& check_dir_stamp(&t->stamp, &a) == 0)
+		t->stamp.valid = 0;
+
+	encode_tag(buf, t);
+}
+
+/* Return 1 if the stamp of the tag T matches the attributes A of its
+ * directory, or 0 otherwise. */
+static int
+tag_stamp_matches(const struct tdb_tag_t *t, const struct stat *a)
+{
+	if (t->stamp.valid == 0 || t->stamp.dev != a->st_dev
+	|| t->stamp.ino != a->st_ino || t->stamp.mtime != a->st_mtime)
+		return 0;
+
+#ifndef CLIFM_LEGACY
+	return (t->stamp.mtime_nsec == (long)a->MTIMNSEC);
+#else
+	return 1;
+#endif /* !CLIFM_LEGACY */
+}
+
+/* Make sure the tag T reflects the content of its directory, reading it
+ * again if needed. Returns 1 if the directory was read, or 0 otherwise. */
+static int
+sync_tag(struct tdb_tag_t *t, struct tdb_buf_t *buf)
+{
+	char dir[PATH_MAX + 1];
+	snprintf(dir, sizeof(dir), "%s/%s", tags_dir, t->name);
+
+	struct stat a;
+	if (stat(dir, &a) == -1) {
+		free_tag_files(t);
+		t->stamp.valid = 0;
+		return 1;
+	}
+
+	if (tag_stamp_matches(t, &a) == 1)
+		return 0;
+
+	scan_tag_dir(t, buf);
+	return 1;
+}
+
+/* Update the device ID and inode number of the files in the tag T, whose
+ * targets may have been replaced since they were stored (the tag directory
+ * is not modified in this case). */
+static void
+refresh_tag_files(struct tdb_tag_t *t, struct tdb_buf_t *buf)
+{
+	char dir[PATH_MAX + 1];
+	snprintf(dir, sizeof(dir), "%s/%s", tags_dir, t->name);
+
+	const int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return;
+
+	struct stat a;
+	char path[PATH_MAX + 1];
+	int changed = 0;
+	for (size_t i = 0; i < t->files_n; i++) {
+		struct tagged_file_t *f = &t->files[i];
+		if (fstatat(fd, get_at_name(dir, f->name, path, sizeof(path)), &a, 0)
+		== -1) { /* Broken link */
+			a.st_dev = 0;
+			a.st_ino = 0;
+		}
+
+		if (a.st_dev == f->dev && a.st_ino == f->ino)
+			continue;
+
+		f->dev = a.st_dev;
+		f->ino = a.st_ino;
+		changed = 1;
+	}
+
+	close(fd);
+
+	if (changed == 1)
+		encode_tag(buf, t);
+}
+
+/* Restamp the tag T after modifying its directory. */
+static void
+restamp_tag(struct tdb_tag_t *t, struct tdb_buf_t *buf)
+{
+	char dir[PATH_MAX + 1];
+	snprintf(dir, sizeof(dir), "%s/%s", tags_dir, t->name);
+
+	struct stat a;
+	if (stat(dir, &a) == -1) {
+		t->stamp.valid = 0;
+		return;
+	}
+
+	set_dir_stamp(&t->stamp, &a);
+	encode_record(buf, TDB_STAMP, t->name, NULL, &t->stamp);
+}
+
+static void
+get_tagsdb_path(char *buf, const size_t size)
+{
+	snprintf(buf, size, "%s/%s", tags_dir, TAGSDB_FILE);
+}
+
+/* Write a new database file holding only live records. */
+static void
+compact_tagsdb(void)
+{
+	char db_file[PATH_MAX + 1];
+	get_tagsdb_path(db_file, sizeof(db_file));
+	char tmp_file[PATH_MAX + 8];
+	snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", db_file);
+
+	const int fd = mkstemp(tmp_file);
+	if (fd == -1)
+		return;
+
+	struct tdb_header_t h = {0};
+	memcpy(h.magic, TAGSDB_MAGIC, sizeof(h.magic));
+	h.version = TAGSDB_VERSION;
+
+	struct tdb_buf_t buf = {0};
+	tdb.records = 0;
+	for (size_t i = 0; i < tdb.tags_n; i++)
+		encode_tag(&buf, &tdb.tags[i]);
+
+	const int ret = (xwrite(fd, &h, sizeof(h)) == FUNC_SUCCESS
+		&& xwrite(fd, buf.data ? buf.data : "", buf.len) == FUNC_SUCCESS);
+	free(buf.data);
+
+	if (close(fd) == -1 || ret == 0
+	|| renameat(XAT_FDCWD, tmp_file, XAT_FDCWD, db_file) == -1)
+		unlinkat(XAT_FDCWD, tmp_file, 0);
+}
+
+/* Drop tags in the database not found in the tags array (removed or
+ * renamed). */
+static void
+drop_stale_tags(void)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < tdb.tags_n; i++) {
+		int found = 0;
+		for (size_t j = 0; j < tags_n; j++) {
+			if (strcmp(tdb.tags[i].name, tags[j]) == 0) {
+				found = 1;
+				break;
+			}
+		}
+
+		if (found == 1) {
+			tdb.tags[n++] = tdb.tags[i];
+			continue;
+		}
+
+		free_tag_files(&tdb.tags[i]);
+		free(tdb.tags[i].files);
+		free(tdb.tags[i].name);
+	}
+
+	tdb.tags_n = n;
+}
+
+/* Count the records needed to store the database as is. */
+static size_t
+count_live_records(void)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < tdb.tags_n; i++)
+		n += tdb.tags[i].files_n + 2;
+
+	return n;
+}
+
+void
+free_tagsdb(void)
+{
+	for (size_t i = 0; i < tdb.tags_n; i++) {
+		free_tag_files(&tdb.tags[i]);
+		free(tdb.tags[i].files);
+		free(tdb.tags[i].name);
+	}
+
+	free(tdb.tags);
+	tdb.tags = NULL;
+	tdb.tags_n = tdb.records = 0;
+
+	if (tdb.fd != -1) {
+		close(tdb.fd);
+		tdb.fd = -1;
+	}
+}
+
+/* Load the tags database, making sure it reflects the content of the tags
+ * directory. Called by build_tags_index() whenever tags are (re)loaded. */
+void
+load_tagsdb(void)
+{
+	free_tagsdb();
+
+	if (!tags_dir || !*tags_dir)
+		return;
+
+	char db_file[PATH_MAX + 1];
+	get_tagsdb_path(db_file, sizeof(db_file));
+
+	size_t file_size = 0, valid_size = 0;
+
+	const int fd = open(db_file, O_RDONLY | O_CLOEXEC);
+	if (fd != -1) {
+		struct stat a;
+		if (fstat(fd, &a) != -1 && S_ISREG(a.st_mode)) {
+			file_size = (size_t)a.st_size;
+			valid_size = replay_records(fd, file_size);
+		}
+		close(fd);
+	}
+
+	drop_stale_tags();
+
+	struct tdb_buf_t buf = {0};
+	for (size_t i = 0; i < tags_n; i++) {
+		struct tdb_tag_t *t = get_tdb_tag(tags[i], strlen(tags[i]), 1);
+		if (sync_tag(t, &buf) == 0)
+			refresh_tag_files(t, &buf);
+		sort_tag_files(t);
+	}
+
+	/* Keep the database in memory only */
+	if (xargs.stealth_mode == 1 || conf.tags_db == 0) {
+		free(buf.data);
+		return;
+	}
+
+	/* Rewrite the database if dead records outnumber live ones, or if the
+	 * file is missing, corrupted, or truncated. */
+	const size_t live = count_live_records();
+	const int compact = (valid_size == 0 || valid_size != file_size
+		|| (tdb.records > TAGSDB_MIN_COMPACT && tdb.records > live * 2));
+
+	if (compact == 1) {
+		free(buf.data);
+		buf = (struct tdb_buf_t){0};
+		compact_tagsdb();
+	}
+
+	tdb.fd = open(db_file, O_WRONLY | O_APPEND | O_CLOEXEC);
+	flush_records(&buf);
+}
+
+/* Make sure the tag TAG reflects the content of its directory. Call this
+ * function before modifying the tag directory via tagsdb_add() or
+ * tagsdb_del(), so that changes made by other programs are not hidden by
+ * the new stamp of the directory. */
+void
+tagsdb_sync_tag(const char *tag)
+{
+	struct tdb_tag_t *t = get_tdb_tag(tag, strlen(tag), 0);
+	if (!t)
+		return;
+
+	struct tdb_buf_t buf = {0};
+	sync_tag(t, &buf);
+	flush_records(&buf);
+}
+
+/* Record that the file NAME, a symbolic link to TARGET, has been created in
+ * the directory of the tag TAG. A are the attributes of the link target. */
+void
+tagsdb_add(const char *tag, const char *name, const char *target,
+	const struct stat *a)
+{
+	struct tdb_tag_t *t = get_tdb_tag(tag, strlen(tag), 0);
+	if (!t)
+		return;
+
+	struct tagged_file_t f;
+	f.name = savestring(name, strlen(name));
+	f.target = savestring(target, strlen(target));
+	f.dev = a ? a->st_dev : 0;
+	f.ino = a ? a->st_ino : 0;
+
+	struct tdb_buf_t buf = {0};
+	encode_record(&buf, TDB_ADD, tag, &f, NULL);
+	add_tag_file(t, &f, 1);
+	restamp_tag(t, &buf);
+	flush_records(&buf);
+}
+
+/* Record that the file NAME has been removed from the directory of the
+ * tag TAG. */
+void
+tagsdb_del(const char *tag, const char *name)
+{
+	struct tdb_tag_t *t = get_tdb_tag(tag, strlen(tag), 0);
+	if (!t)
+		return;
+
+	struct tagged_file_t f = {0};
+	f.name = (char *)name;
+
+	struct tdb_buf_t buf = {0};
+	encode_record(&buf, TDB_DEL, tag, &f, NULL);
+	del_tag_file(t, name);
+	restamp_tag(t, &buf);
+	flush_records(&buf);
+}
+
+/* Return the list of files tagged as TAG (sorted by name), storing the
+ * number of files in N. The list is valid until the database is modified.
+ * Returns NULL if TAG is not a tag or it has no files. */
+const struct tagged_file_t *
+tagsdb_get_files(const char *tag, size_t *n)
+{
+	*n = 0;
+	struct tdb_tag_t *t = get_tdb_tag(tag, strlen(tag), 0);
+	if (!t)
+		return NULL;
+
+	struct tdb_buf_t buf = {0};
+	sync_tag(t, &buf);
+	flush_records(&buf);
+
+	sort_tag_files(t);
+	*n = t->files_n;
+	return t->files_n > 0 ? t->files : NULL;
+}
+
+#else
+void *_skip_me_tagsdb;
+#endif /* !_NO_TAGS */
@@ -0,0 +1,33 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* tagsdb.h */
+
+#ifndef CLIFM_TAGSDB_H
+#define CLIFM_TAGSDB_H
+
+/* A file in a tag directory */
+struct tagged_file_t {
+	char *name;   /* Name of the link in the tag directory */
+	char *target; /* Link target */
+	dev_t dev;    /* Device ID and inode number of the target (zero if */
+	ino_t ino;    /* the link is broken) */
+};
+
+__BEGIN_DECLS
+
+void free_tagsdb(void);
+void load_tagsdb(void);
+void tagsdb_add(const char *tag, const char *name, const char *target,
+	const struct stat *a);
+void tagsdb_del(const char *tag, const char *name);
+const struct tagged_file_t *tagsdb_get_files(const char *tag, size_t *n);
+void tagsdb_sync_tag(const char *tag);
+
+__END_DECLS
+
+#endif /* CLIFM_TAGSDB_H */
@@ -0,0 +1,76 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* trace.c -- startup time tracer (--startup-trace) */
+
+/* main() calls startup_trace() right after each initialization step.
+ * Marks are always recorded (it is just a clock_gettime(2) call), since
+ * command line options are not parsed until a few steps in. If running
+ * with --startup-trace, print_startup_trace() prints the time taken by
+ * each step. */
+
+#include "helpers.h"
+
+#include <time.h> /* clock_gettime() */
+
+#include "trace.h"
+
+#define MAX_TRACE_MARKS 64
+
+struct trace_mark_t {
+	const char *step;
+	struct timespec ts;
+};
+
+static struct trace_mark_t trace_marks[MAX_TRACE_MARKS];
+static size_t trace_marks_n = 0;
+
+/* Record that the initialization step STEP has just finished. STEP must
+ * be a string literal. */
+void
+startup_trace(const char *step)
+{
+	if (trace_marks_n >= MAX_TRACE_MARKS)
+		return;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &trace_marks[trace_marks_n].ts) == -1)
+		return;
+
+	trace_marks[trace_marks_n].step = step;
+	trace_marks_n++;
+}
+
+static double
+elapsed_ms(const struct timespec *a, const struct timespec *b)
+{
+	return (double)(b->tv_sec - a->tv_sec) * 1e3
+		+ (double)(b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+/* Print the time taken by each initialization step (since the previous
+ * mark), plus the total time since the first mark, to stderr. With
+ * --startup-trace=tsv, print tab-separated values instead, one step per
+ * line and no header, to be consumed by scripts (see
+ * misc/tools/startup-bench.sh). */
+void
+print_startup_trace(void)
+{
+	if ((xargs.startup_trace != TRACE_TEXT
+	&& xargs.startup_trace != TRACE_TSV) || trace_marks_n < 2)
+		return;
+
+	const int tsv = (xargs.startup_trace == TRACE_TSV);
+	if (tsv == 0)
+		fprintf(stderr, "%-24s %10s %10s\n", "step", "ms", "total");
+
+	for (size_t i = 1; i < trace_marks_n; i++) {
+		fprintf(stderr, tsv == 1 ? "%s\t%.3f\t%.3f\n"
+			: "%-24s %10.3f %10.3f\n", trace_marks[i].step,
+			elapsed_ms(&trace_marks[i - 1].ts, &trace_marks[i].ts),
+			elapsed_ms(&trace_marks[0].ts, &trace_marks[i].ts));
+	}
+}
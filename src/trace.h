@@ -0,0 +1,20 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* trace.h */
+
+#ifndef CLIFM_TRACE_H
+#define CLIFM_TRACE_H
+
+__BEGIN_DECLS
+
+void print_startup_trace(void);
+void startup_trace(const char *step);
+
+__END_DECLS
+
+#endif /* CLIFM_TRACE_H */
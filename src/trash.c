@@ -21,7 +21,8 @@
 #endif /* MAC_OS_X_RENAMEAT_SYS_STDIO_H */
 
 #include "aux.h"        /* gen_date_suffix, count_dir, open_fwrite, open_fread,
-xatoi, url_encode, xnmalloc, print_file_name, set_max_confirm_files */
+xatoi, url_encode, xnmalloc, print_file_name, set_max_confirm_files,
+get_at_name */
 #include "checks.h"     /* is_file_in_cwd, is_number */
 #include "colors.h"     /* colors_list */
 #include "listing.h"    /* reload_dirlist */
@@ -31,7 +32,8 @@ xatoi, url_encode, xnmalloc, print_file_name, set_max_confirm_files */
 #include "readline.h"   /* rl_no_hist, rl_get_y_or_n */
 #include "sort.h"       /* skip_files, xalphasort, alphasort_insensitive */
 #include "spawn.h"      /* launch_execv */
-#include "xdu.h"        /* dir_size */
+#include "xcopy.h"      /* xmove, xmove_files */
+#include "xdu.h"        /* dir_info */
 
 /* Return the number of currently trashed files. */
 static size_t
@@ -46,6 +48,724 @@ count_trashed_files(void)
 	return n;
 }
 
+/* Cache of the sizes of trashed directories, so that computing the size of
+ * the trash can ('t list') does not require traversing every trashed
+ * directory each time.
+ * As defined by the FreeDesktop trash specification, the "directorysizes"
+ * file in the trash directory holds one line per trashed directory:
+ * "SIZE MTIME NAME", where SIZE is the disk usage of the directory in bytes,
+ * MTIME the modification time of the corresponding .trashinfo file (if it
+ * changed, the entry is stale), and NAME the percent-encoded name of the
+ * directory in the trash files directory.
+ * Since this file holds disk usage, apparent sizes (the default, see
+ * conf.apparent_size) are stored in a file of our own ("apparentsizes.clifm")
+ * using the same format. */
+#define TRASH_DIRSIZES_FILE  "directorysizes"
+#define TRASH_APPSIZES_FILE  "apparentsizes.clifm"
+
+struct trash_dirsize_t {
+	char  *name;
+	off_t  size;
+	time_t mtime;
+	int    seen;    /* The directory is still in the trash */
+	int    removed; /* Do not write this entry back to the cache file */
+};
+
+static struct {
+	struct trash_dirsize_t *e;
+	size_t n;
+	size_t sorted_n; /* Entries sorted by name (and searchable) */
+	int loaded;
+	int dirty;
+} dirsizes = {NULL, 0, 0, 0, 0};
+
+static int
+dirsize_cmp(const void *a, const void *b)
+{
+	const struct trash_dirsize_t *pa = (const struct trash_dirsize_t *)a;
+	const struct trash_dirsize_t *pb = (const struct trash_dirsize_t *)b;
+
+	return strcmp(pa->name, pb->name);
+}
+
+/* Write the path to the directory sizes cache file into BUF. */
+static void
+get_dirsizes_file(char *buf, const size_t buf_size)
+{
+	snprintf(buf, buf_size, "%s/%s", trash_dir,
+		conf.apparent_size == 1 ? TRASH_APPSIZES_FILE : TRASH_DIRSIZES_FILE);
+}
+
+static void
+add_trash_dirsize(char *name, const off_t size, const time_t mtime)
+{
+	dirsizes.e = xnrealloc(dirsizes.e, dirsizes.n + 1,
+		sizeof(struct trash_dirsize_t));
+	dirsizes.e[dirsizes.n].name = name;
+	dirsizes.e[dirsizes.n].size = size;
+	dirsizes.e[dirsizes.n].mtime = mtime;
+	dirsizes.e[dirsizes.n].seen = 0;
+	dirsizes.e[dirsizes.n].removed = 0;
+	dirsizes.n++;
+}
+
+/* Load the directory sizes cache file, if not already loaded. */
+static void
+load_trash_dirsizes(void)
+{
+	if (dirsizes.loaded == 1)
+		return;
+
+	dirsizes.loaded = 1;
+
+	char file[PATH_MAX + 1];
+	get_dirsizes_file(file, sizeof(file));
+
+	int fd;
+	FILE *fp = open_fread(file, &fd);
+	if (!fp)
+		return;
+
+	/* SIZE(20) + MTIME(20) + 2 spaces + NAME (at most 3 times NAME_MAX
+	 * bytes, if fully percent-encoded) + new line char. */
+	char line[(NAME_MAX * 3) + 64];
+	while (fgets(line, (int)sizeof(line), fp)) {
+		char *end = NULL;
+		const long long size = strtoll(line, &end, 10);
+		if (!end || *end != ' ' || size < 0)
+			continue;
+
+		const long long mtime = strtoll(end + 1, &end, 10);
+		if (!end || *end != ' ' || !end[1])
+			continue;
+
+		char *p = end + 1;
+		const size_t len = strlen(p);
+		if (len > 0 && p[len - 1] == '\n')
+			p[len - 1] = '\0';
+
+		char *name = *p ? url_decode(p) : NULL;
+		if (name)
+			add_trash_dirsize(name, (off_t)size, (time_t)mtime);
+	}
+
+	fclose(fp);
+}
+
+/* Return the cache entry for the directory NAME, or NULL if not found.
+ * Only entries loaded from the cache file are searched: entries added
+ * afterwards are not looked up again before the cache is saved. */
+static struct trash_dirsize_t *
+find_trash_dirsize(const char *name)
+{
+	if (dirsizes.n == 0)
+		return NULL;
+
+	if (dirsizes.sorted_n == 0) {
+		qsort(dirsizes.e, dirsizes.n, sizeof(struct trash_dirsize_t),
+			dirsize_cmp);
+		dirsizes.sorted_n = dirsizes.n;
+	}
+
+	struct trash_dirsize_t key = {0};
+	key.name = (char *)name;
+	return bsearch(&key, dirsizes.e, dirsizes.sorted_n,
+		sizeof(struct trash_dirsize_t), dirsize_cmp);
+}
+
+/* The trashed directory NAME was removed from the trash (or a new file
+ * named NAME was trashed): remove it from the cache. */
+static void
+forget_trash_dirsize(const char *name)
+{
+	load_trash_dirsizes();
+
+	struct trash_dirsize_t *e = find_trash_dirsize(name);
+	if (!e || e->removed == 1)
+		return;
+
+	e->removed = 1;
+	dirsizes.dirty = 1;
+}
+
+/* Write the cache back to disk, if it changed, and free it. The file is
+ * written to a temporary file which is then renamed, as required by the
+ * specification. */
+static void
+save_trash_dirsizes(void)
+{
+	char file[PATH_MAX + 1];
+	get_dirsizes_file(file, sizeof(file));
+
+	size_t n = 0;
+	for (size_t i = 0; i < dirsizes.n; i++) {
+		if (dirsizes.e[i].removed == 0)
+			n++;
+	}
+
+	if (dirsizes.dirty == 0) {
+		goto FREE;
+	} else if (n == 0) {
+		if (unlinkat(XAT_FDCWD, file, 0) == -1 && errno != ENOENT)
+			xerror("trash: '%s': %s\n", file, strerror(errno));
+		goto FREE;
+	}
+
+	char tmp_file[PATH_MAX + 8];
+	snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", file);
+
+	int fd = mkstemp(tmp_file);
+	FILE *fp = fd != -1 ? fdopen(fd, "w") : NULL;
+	if (!fp) {
+		if (fd != -1) {
+			close(fd);
+			unlinkat(XAT_FDCWD, tmp_file, 0);
+		}
+		goto FREE;
+	}
+
+	for (size_t i = 0; i < dirsizes.n; i++) {
+		if (dirsizes.e[i].removed == 1)
+			continue;
+
+		char *enc = url_encode(dirsizes.e[i].name, 0, NULL);
+		if (enc) {
+			fprintf(fp, "%jd %jd %s\n", (intmax_t)dirsizes.e[i].size,
+				(intmax_t)dirsizes.e[i].mtime, enc);
+			free(enc);
+		}
+	}
+
+	if (fclose(fp) != 0 || renameat(XAT_FDCWD, tmp_file, XAT_FDCWD, file) == -1)
+		unlinkat(XAT_FDCWD, tmp_file, 0);
+
+FREE:
+	for (size_t i = 0; i < dirsizes.n; i++)
+		free(dirsizes.e[i].name);
+	free(dirsizes.e);
+	dirsizes.e = NULL;
+	dirsizes.n = dirsizes.sorted_n = 0;
+	dirsizes.loaded = dirsizes.dirty = 0;
+}
+
+/* Return the full size of the trashed directory NAME (whose absolute path is
+ * PATH), taking it from the cache if possible. */
+static off_t
+get_trashed_dir_size(const char *name, const char *path, int *status)
+{
+	char info_file[PATH_MAX + 1];
+	snprintf(info_file, sizeof(info_file), "%s/%s.trashinfo",
+		trash_info_dir, name);
+
+	struct stat a;
+	const int have_info = stat(info_file, &a) != -1;
+
+	struct trash_dirsize_t *e = have_info == 1 ? find_trash_dirsize(name)
+		: NULL;
+	if (e && e->removed == 0 && e->mtime == a.st_mtime) {
+		e->seen = 1;
+		return e->size;
+	}
+
+	struct dir_info_t info = {0};
+	dir_info(path, 1, &info);
+	const off_t size = conf.apparent_size == 1 ? info.size
+		: (off_t)(info.blocks * S_BLKSIZE);
+
+	if (info.status != 0) {
+		*status = info.status;
+	} else if (have_info == 1) {
+		/* Do not cache sizes we could not fully compute */
+		if (e) {
+			e->size = size;
+			e->mtime = a.st_mtime;
+			e->seen = 1;
+			e->removed = 0;
+		} else {
+			add_trash_dirsize(savestring(name, strlen(name)), size,
+				a.st_mtime);
+			dirsizes.e[dirsizes.n - 1].seen = 1;
+		}
+		dirsizes.dirty = 1;
+	}
+
+	return size;
+}
+
+/* Return the full size of the trash can: the size of each trashed regular
+ * file (and other non-directory files) plus the (cached) size of each
+ * trashed directory. */
+static off_t
+get_trash_size(int *status)
+{
+	DIR *dir = opendir(trash_files_dir);
+	if (!dir) {
+		*status = errno;
+		return 0;
+	}
+
+	load_trash_dirsizes();
+
+	off_t total = 0;
+	struct stat a;
+	const struct dirent *ent;
+	char path[PATH_MAX + 1];
+
+	while ((ent = readdir(dir))) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", trash_files_dir, ent->d_name);
+		if (lstat(path, &a) == -1) {
+			*status = errno;
+			continue;
+		}
+
+		if (S_ISDIR(a.st_mode)) {
+			total += get_trashed_dir_size(ent->d_name, path, status);
+		} else if (conf.apparent_size != 1) {
+			total += (off_t)(a.st_blocks * S_BLKSIZE);
+		} else if (S_ISREG(a.st_mode) || S_ISLNK(a.st_mode)) {
+			total += a.st_size;
+		}
+	}
+
+	closedir(dir);
+
+	/* Remove entries for directories not in the trash anymore */
+	for (size_t i = 0; i < dirsizes.n; i++) {
+		if (dirsizes.e[i].seen == 0 && dirsizes.e[i].removed == 0) {
+			dirsizes.e[i].removed = 1;
+			dirsizes.dirty = 1;
+		}
+	}
+
+	save_trash_dirsizes();
+	return total;
+}
+
+/* Index of trashed files, so that restoring files ('u') does not require
+ * opening and parsing one .trashinfo file per file.
+ * The index file ("index.clifm" in the trash directory) starts with a header
+ * line holding the modification time of the trash info directory at the time
+ * the index was written. If it does not match the current one, the info
+ * directory was modified by some other program: the index is stale, and it
+ * is rebuilt from the info files the next time it is needed.
+ * Each following line describes a trashed file: "NAME DATE PATH", where NAME
+ * is the percent-encoded name of the file in the trash files directory, DATE
+ * its deletion date, and PATH its original path (percent-encoded, as found in
+ * the info file). If a name appears more than once, the last line wins.
+ * Trashing files does not rewrite the index: new lines are appended, and
+ * the header (which has a fixed length) is then updated in place. */
+#define TRASH_INDEX_FILE   "index.clifm"
+#define TRASH_INDEX_HEADER "#clifm-trash-index"
+
+struct trash_index_t {
+	char  *name;
+	char  *date;
+	char  *path;
+	size_t seq;     /* Insertion order: the last entry for a name wins */
+	int    removed; /* The file is not in the trash anymore */
+	int    pad0;
+};
+
+static struct {
+	struct trash_index_t *e;
+	size_t n;
+	size_t cap;
+	int loaded;
+	int valid;  /* The index matches the content of the info directory */
+	int sorted; /* Entries sorted by name (and searchable) */
+	int dirty;
+	int append; /* Only new entries are held: append them to the file */
+	int pad0;
+} tindex = {NULL, 0, 0, 0, 0, 0, 0, 0, 0};
+
+static int
+trash_index_cmp(const void *a, const void *b)
+{
+	const struct trash_index_t *pa = (const struct trash_index_t *)a;
+	const struct trash_index_t *pb = (const struct trash_index_t *)b;
+
+	return strcmp(pa->name, pb->name);
+}
+
+static int
+trash_index_seq_cmp(const void *a, const void *b)
+{
+	const struct trash_index_t *pa = (const struct trash_index_t *)a;
+	const struct trash_index_t *pb = (const struct trash_index_t *)b;
+
+	const int ret = strcmp(pa->name, pb->name);
+	if (ret != 0)
+		return ret;
+
+	return (pa->seq > pb->seq) - (pa->seq < pb->seq);
+}
+
+/* Entries are added unsorted: the index is sorted (once) only when an entry
+ * needs to be looked up, or when it is written back to disk. */
+static void
+add_trash_index_entry(char *name, const char *date, char *path)
+{
+	if (tindex.n == tindex.cap) {
+		tindex.cap = tindex.cap == 0 ? 64 : tindex.cap * 2;
+		tindex.e = xnrealloc(tindex.e, tindex.cap,
+			sizeof(struct trash_index_t));
+	}
+
+	tindex.e[tindex.n].name = name;
+	tindex.e[tindex.n].date = savestring(date, strlen(date));
+	tindex.e[tindex.n].path = path;
+	tindex.e[tindex.n].seq = tindex.n;
+	tindex.e[tindex.n].removed = 0;
+	tindex.n++;
+	tindex.sorted = 0;
+}
+
+static void
+free_trash_index_entry(struct trash_index_t *e)
+{
+	free(e->name);
+	free(e->date);
+	free(e->path);
+}
+
+/* Sort the index by name, keeping only the last entry for each name. */
+static void
+sort_trash_index(void)
+{
+	if (tindex.sorted == 1)
+		return;
+
+	qsort(tindex.e, tindex.n, sizeof(struct trash_index_t),
+		trash_index_seq_cmp);
+
+	size_t n = 0;
+	for (size_t i = 0; i < tindex.n; i++) {
+		if (i + 1 < tindex.n
+		&& strcmp(tindex.e[i].name, tindex.e[i + 1].name) == 0) {
+			free_trash_index_entry(&tindex.e[i]);
+			continue;
+		}
+		tindex.e[n++] = tindex.e[i];
+	}
+
+	for (size_t i = 0; i < n; i++)
+		tindex.e[i].seq = i;
+
+	tindex.n = n;
+	tindex.sorted = 1;
+}
+
+/* Write the index header for the info directory whose attributes are A
+ * into BUF. It always has the same length (see append_trash_index()). */
+static void
+set_trash_index_header(char *buf, const size_t size, const struct stat *a)
+{
+	snprintf(buf, size, "%s %020jd %020jd\n", TRASH_INDEX_HEADER,
+		(intmax_t)a->st_mtime, (intmax_t)a->MTIMNSEC);
+}
+
+/* Read the Path and DeletionDate keys from the trashinfo file FP.
+ * Return the value of Path (as is, i.e. percent-encoded), or NULL if not
+ * found. The value of DeletionDate ("-" if not found) is copied into DATE,
+ * whose size is DATE_SIZE. */
+static char *
+parse_trashinfo_file(FILE *fp, char *date, const size_t date_size)
+{
+	char *path = NULL;
+	xstrsncpy(date, "-", date_size);
+
+	/* Path=(5) + PATH_MAX (at most 3 times PATH_MAX bytes, if fully
+	 * percent-encoded) + new line char. */
+	char line[(PATH_MAX * 3) + 8];
+	while (fgets(line, (int)sizeof(line), fp)) {
+		size_t len = strlen(line);
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		if (!path && *line == 'P' && strncmp(line, "Path=", 5) == 0) {
+			if (line[5])
+				path = savestring(line + 5, len - 5);
+		} else if (*line == 'D' && strncmp(line, "DeletionDate=", 13) == 0) {
+			if (line[13] && !strchr(line + 13, ' '))
+				xstrsncpy(date, line + 13, date_size);
+		}
+	}
+
+	return path;
+}
+
+/* Build the index from the trashinfo files in the trash info directory. */
+static void
+rebuild_trash_index(void)
+{
+	DIR *dir = opendir(trash_info_dir);
+	if (!dir)
+		return;
+
+	const int dfd = dirfd(dir);
+	const struct dirent *ent;
+	char date[64];
+	char buf[PATH_MAX + 1];
+
+	while ((ent = readdir(dir))) {
+		const char *ext = strrchr(ent->d_name, '.');
+		if (!ext || ext == ent->d_name || strcmp(ext, ".trashinfo") != 0)
+			continue;
+
+		const int fd = openat(dfd, get_at_name(trash_info_dir, ent->d_name,
+			buf, sizeof(buf)), O_RDONLY);
+		FILE *fp = fd != -1 ? fdopen(fd, "r") : NULL;
+		if (!fp) {
+			if (fd != -1)
+				close(fd);
+			continue;
+		}
+
+		char *path = parse_trashinfo_file(fp, date, sizeof(date));
+		fclose(fp);
+		if (path) {
+			add_trash_index_entry(savestring(ent->d_name,
+				(size_t)(ext - ent->d_name)), date, path);
+		}
+	}
+
+	closedir(dir);
+	tindex.valid = tindex.dirty = 1;
+}
+
+/* Load the index file into TINDEX, but only if it is up to date. Return 1
+ * on success or 0 if it is stale (or does not exist). */
+static int
+read_trash_index(void)
+{
+	char file[PATH_MAX + 1];
+	snprintf(file, sizeof(file), "%s/%s", trash_dir, TRASH_INDEX_FILE);
+
+	struct stat a;
+	if (stat(trash_info_dir, &a) == -1)
+		return 0;
+
+	int fd;
+	FILE *fp = open_fread(file, &fd);
+	if (!fp)
+		return 0;
+
+	/* NAME (at most 3 times NAME_MAX bytes, if fully percent-encoded) + DATE
+	 * + PATH (at most 3 times PATH_MAX bytes) + 2 spaces + new line char. */
+	char line[(NAME_MAX * 3) + (PATH_MAX * 3) + 72];
+	char header[sizeof(TRASH_INDEX_HEADER) + 44];
+	set_trash_index_header(header, sizeof(header), &a);
+
+	if (!fgets(line, (int)sizeof(line), fp) || strcmp(line, header) != 0) {
+		fclose(fp);
+		return 0;
+	}
+
+	/* Just checking whether the index is up to date */
+	if (tindex.append == 1) {
+		fclose(fp);
+		return 1;
+	}
+
+	while (fgets(line, (int)sizeof(line), fp)) {
+		size_t len = strlen(line);
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		char *date = strchr(line, ' ');
+		char *path = date ? strchr(date + 1, ' ') : NULL;
+		if (!path || !path[1])
+			continue;
+
+		*date++ = '\0';
+		*path++ = '\0';
+		char *name = url_decode(line);
+		if (name)
+			add_trash_index_entry(name, date, savestring(path, strlen(path)));
+	}
+
+	fclose(fp);
+	return 1;
+}
+
+/* Load the trash index, if not already loaded. If stale, it is rebuilt
+ * only if REBUILD is set to 1: otherwise, the index is just not used (nor
+ * updated) by the current command.
+ * If APPEND is set to 1, only the header is checked: files will be added to
+ * the index (see index_trashed_file()), but not looked up. Once loaded in
+ * this mode, the index cannot be loaded again (until save_trash_index()). */
+static void
+load_trash_index(const int rebuild, const int append)
+{
+	if (tindex.loaded == 0) {
+		tindex.loaded = 1;
+		tindex.append = append;
+		tindex.valid = read_trash_index();
+	}
+
+	if (tindex.append == 1)
+		return;
+
+	if (tindex.valid == 0 && rebuild == 1)
+		rebuild_trash_index();
+}
+
+/* Return the index entry for the trashed file NAME, or NULL if not found. */
+static struct trash_index_t *
+find_trash_index_entry(const char *name)
+{
+	if (tindex.n == 0 || tindex.append == 1)
+		return NULL;
+
+	sort_trash_index();
+
+	struct trash_index_t key = {0};
+	key.name = (char *)name;
+	struct trash_index_t *e = bsearch(&key, tindex.e, tindex.n,
+		sizeof(struct trash_index_t), trash_index_cmp);
+
+	return (e && e->removed == 0) ? e : NULL;
+}
+
+/* The file FILE (absolute path) was trashed as NAME on DATE.
+ * NAME was just reserved in the trash can (see create_trashinfo_file()), so
+ * it is not looked up: should a stale entry for it exist, it is replaced by
+ * this one once the index is sorted. */
+static void
+index_trashed_file(const char *name, const char *file, const char *date)
+{
+	load_trash_index(0, 1);
+	if (tindex.valid == 0)
+		return;
+
+	char *path = url_encode(file, 0, NULL);
+	if (!path)
+		return;
+
+	add_trash_index_entry(savestring(name, strlen(name)), date, path);
+	tindex.dirty = 1;
+}
+
+/* The file NAME was removed from the trash can (or restored). */
+static void
+unindex_trashed_file(const char *name)
+{
+	load_trash_index(0, 0);
+	if (tindex.valid == 0)
+		return;
+
+	struct trash_index_t *e = find_trash_index_entry(name);
+	if (e) {
+		e->removed = 1;
+		tindex.dirty = 1;
+	}
+}
+
+static void
+write_trash_index_entry(FILE *fp, const struct trash_index_t *e)
+{
+	char *enc = url_encode(e->name, 0, NULL);
+	if (enc) {
+		fprintf(fp, "%s %s %s\n", enc, e->date, e->path);
+		free(enc);
+	}
+}
+
+/* Append new entries to the index file FILE, and then update its header
+ * to match the info directory, whose attributes are A. If something fails
+ * midway, the header is left as is (i.e. stale), so that the index is
+ * rebuilt the next time it is needed. */
+static void
+append_trash_index(const char *file, const struct stat *a)
+{
+	const int fd = open(file, O_WRONLY | O_APPEND | O_CLOEXEC);
+	FILE *fp = fd != -1 ? fdopen(fd, "a") : NULL;
+	if (!fp) {
+		if (fd != -1)
+			close(fd);
+		return;
+	}
+
+	for (size_t i = 0; i < tindex.n; i++)
+		write_trash_index_entry(fp, &tindex.e[i]);
+
+	if (fflush(fp) != 0) {
+		fclose(fp);
+		return;
+	}
+
+	/* On Linux, pwrite(2) ignores the offset if the file was opened with
+	 * O_APPEND: write the header using a new file descriptor. */
+	const int hfd = open(file, O_WRONLY | O_CLOEXEC);
+	if (hfd != -1) {
+		char header[sizeof(TRASH_INDEX_HEADER) + 44];
+		set_trash_index_header(header, sizeof(header), a);
+		const size_t len = strlen(header);
+		if (pwrite(hfd, header, len, 0) != (ssize_t)len)
+			ftruncate(hfd, 0); /* Invalidate the index */
+		close(hfd);
+	}
+
+	fclose(fp);
+}
+
+/* Write the index back to disk, if it changed, and free it. As with the
+ * directory sizes cache, the index is written to a temporary file which is
+ * then renamed (unless new entries are just appended). */
+static void
+save_trash_index(void)
+{
+	struct stat a;
+	if (tindex.dirty == 0 || tindex.valid == 0
+	|| stat(trash_info_dir, &a) == -1)
+		goto FREE;
+
+	char file[PATH_MAX + 1];
+	snprintf(file, sizeof(file), "%s/%s", trash_dir, TRASH_INDEX_FILE);
+	if (tindex.append == 1) {
+		append_trash_index(file, &a);
+		goto FREE;
+	}
+
+	char tmp_file[PATH_MAX + 8];
+	snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", file);
+
+	int fd = mkstemp(tmp_file);
+	FILE *fp = fd != -1 ? fdopen(fd, "w") : NULL;
+	if (!fp) {
+		if (fd != -1) {
+			close(fd);
+			unlinkat(XAT_FDCWD, tmp_file, 0);
+		}
+		goto FREE;
+	}
+
+	char header[sizeof(TRASH_INDEX_HEADER) + 44];
+	set_trash_index_header(header, sizeof(header), &a);
+	fputs(header, fp);
+
+	sort_trash_index();
+	for (size_t i = 0; i < tindex.n; i++) {
+		if (tindex.e[i].removed == 0)
+			write_trash_index_entry(fp, &tindex.e[i]);
+	}
+
+	if (fclose(fp) != 0 || renameat(XAT_FDCWD, tmp_file, XAT_FDCWD, file) == -1)
+		unlinkat(XAT_FDCWD, tmp_file, 0);
+
+FREE:
+	for (size_t i = 0; i < tindex.n; i++)
+		free_trash_index_entry(&tindex.e[i]);
+	free(tindex.e);
+	tindex.e = NULL;
+	tindex.n = tindex.cap = 0;
+	tindex.loaded = tindex.valid = tindex.sorted = tindex.dirty = 0;
+	tindex.append = 0;
+}
+
 /* Confirm the removal of N files from the trash can.
  * Return 1 if yes or 0 if not. */
 static int
@@ -100,6 +820,10 @@ remove_file_from_trash(const char *name)
 
 	const char *cmd[] = {"rm", "-rf", "--", file1, file2, NULL};
 	int ret = launch_execv(cmd, FOREGROUND, E_NOFLAG);
+	if (ret == FUNC_SUCCESS) {
+		forget_trash_dirsize(name);
+		unindex_trashed_file(name);
+	}
 
 	free(file1);
 	free(file2);
@@ -157,116 +881,246 @@ trash_clear(void)
 	return exit_status;
 }
 
+/* State shared by all files trashed by a single command (see
+ * trash_files_args()): the trash directories are opened only once (files
+ * are created and renamed relative to them), and the deletion date is
+ * computed only once. */
+static struct {
+	int files_fd;
+	int info_fd;
+	char date[64]; /* DeletionDate value */
+} batch = {-1, -1, {0}};
+
+static void
+close_trash_batch(const size_t trashed)
+{
+	/* Make sure info files are written to disk, once for the whole batch */
+	if (trashed > 0 && batch.info_fd != -1)
+		fsync(batch.info_fd);
+
+	if (batch.files_fd != -1)
+		close(batch.files_fd);
+	if (batch.info_fd != -1)
+		close(batch.info_fd);
+
+	batch.files_fd = batch.info_fd = -1;
+}
+
 static int
-gen_trashinfo_file(const char *file, const char *suffix)
+open_trash_batch(void)
 {
 	struct tm tm;
-	time_t now = time(NULL);
+	const time_t now = time(NULL);
 	if (now == (time_t)-1 || localtime_r(&now, &tm) == NULL) {
 		xerror(_("trash: Error getting current time\n"));
 		return FUNC_FAILURE;
 	}
 
-	/* Encode path to URL format (RF 2396) */
-	char *url_str = url_encode(file, 0, NULL);
-	if (!url_str) {
-		xerror(_("trash: '%s': Error encoding path\n"), file);
-		return FUNC_FAILURE;
-	}
-
-	const size_t len = strlen(trash_info_dir) + strlen(suffix) + 12;
-	char *info_file = xnmalloc(len, sizeof(char));
-	snprintf(info_file, len, "%s/%s.trashinfo", trash_info_dir, suffix);
+	snprintf(batch.date, sizeof(batch.date), "%d-%02d-%02dT%02d:%02d:%02d",
+		tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+		tm.tm_hour, tm.tm_min, tm.tm_sec);
 
-	int fd = open(info_file, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
-	FILE *fp;
-	if (fd == -1 || !(fp = fdopen(fd, "w"))) {
+	batch.files_fd = open(trash_files_dir, O_RDONLY | O_DIRECTORY);
+	if (batch.files_fd == -1) {
 		const int saved_errno = errno;
-		if (fd != -1) close(fd);
-		xerror("trash: '%s': %s\n", info_file, strerror(saved_errno));
-		free(info_file);
-		free(url_str);
+		xerror("trash: '%s': %s\n", trash_files_dir, strerror(saved_errno));
 		return saved_errno;
 	}
 
-	fprintf(fp,
-	    "[Trash Info]\nPath=%s\nDeletionDate=%d-%02d-%02dT%02d:%02d:%02d\n",
-	    url_str, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
-	    tm.tm_hour, tm.tm_min, tm.tm_sec);
-
-	free(url_str);
-	free(info_file);
-	fclose(fp);
+	batch.info_fd = open(trash_info_dir, O_RDONLY | O_DIRECTORY);
+	if (batch.info_fd == -1) {
+		const int saved_errno = errno;
+		xerror("trash: '%s': %s\n", trash_info_dir, strerror(saved_errno));
+		close_trash_batch(0);
+		return saved_errno;
+	}
 
 	return FUNC_SUCCESS;
 }
 
-static void
-remove_trashinfo_file(const char *name)
+/* Write the info file for FILE (absolute path) to FD.
+ * Return 0 on success or an errno value on error. */
+static int
+write_trashinfo_file(const int fd, const char *file)
 {
-	const size_t len = strlen(trash_info_dir) + strlen(name) + 12;
-	char *info_file = xnmalloc(len, sizeof(char));
-	snprintf(info_file, len, "%s/%s.trashinfo", trash_info_dir, name);
+	/* Encode path to URL format (RF 2396) */
+	char *url_str = url_encode(file, 0, NULL);
+	if (!url_str)
+		return EILSEQ;
 
-	if (unlinkat(XAT_FDCWD, info_file, 0) == -1) {
-		err('w', PRINT_PROMPT, "trash: Cannot remove info file '%s': %s\n",
-			info_file, strerror(errno));
+	const size_t len = strlen(url_str) + sizeof(batch.date) + 48;
+	char *buf = xnmalloc(len, sizeof(char));
+	const int n = snprintf(buf, len,
+		"[Trash Info]\nPath=%s\nDeletionDate=%s\n", url_str, batch.date);
+	free(url_str);
+
+	int ret = FUNC_SUCCESS;
+	if (n < 0) {
+		ret = EOVERFLOW;
+	} else {
+		const ssize_t w = write(fd, buf, (size_t)n);
+		if (w == -1)
+			ret = errno;
+		else if (w != (ssize_t)n)
+			ret = EIO;
 	}
 
-	free(info_file);
+	free(buf);
+	return ret;
 }
 
-/* Create the trashed filename: orig_filename-suffix, where SUFFIX is
- * the current date and time (plus an integer in case of dups).
- * Returns the absolute path to this file and updates FILE_SUFFIX to
- * its basename. */
+/* Create the info file for FILE (absolute path), reserving a name for it
+ * in the trash can: its basename, or basename-N (where N is an integer) if
+ * already taken. As per the FreeDesktop specification, the info file is
+ * created (with O_EXCL) before moving the file.
+ * Returns the reserved name, or NULL on error. */
 static char *
-gen_dest_file(char *file, char **file_suffix)
+create_trashinfo_file(const char *file)
 {
-	char *filename = strrchr(file, '/');
-	if (!filename || !*(++filename)) {
-		xerror(_("trash: '%s': Error getting file base name\n"), file);
-		return NULL;
+	const char *p = strrchr(file, '/');
+	const char *filename = (p && p[1]) ? p + 1 : file;
+
+	/* If the length of the trashed filename (plus ".trashinfo") is longer
+	 * than NAME_MAX (255), trim the original filename, terminating it with
+	 * a tilde (~) to let the user know it was truncated.
+	 * THIS IS NOT UNICODE AWARE. */
+	char name[NAME_MAX + 1];
+	size_t name_len = strlen(filename);
+	if (name_len + 11 > NAME_MAX) {
+		name_len = NAME_MAX - 11;
+		memcpy(name, filename, name_len - 1);
+		name[name_len - 1] = '~';
+		name[name_len] = '\0';
+	} else {
+		memcpy(name, filename, name_len + 1);
+	}
+
+	char tname[NAME_MAX + MAX_INT_STR + 2]; /* Trashed filename */
+	char iname[NAME_MAX + MAX_INT_STR + 13]; /* Info filename */
+	char buf[PATH_MAX + 1];
+	struct stat a;
+
+	for (size_t n = 0; n <= MAX_FILE_CREATION_TRIES; n++) {
+		if (n == 0)
+			xstrsncpy(tname, name, sizeof(tname));
+		else
+			snprintf(tname, sizeof(tname), "%s-%zu", name, n);
+
+		if (fstatat(batch.files_fd, get_at_name(trash_files_dir, tname,
+		buf, sizeof(buf)), &a, AT_SYMLINK_NOFOLLOW) == 0)
+			continue;
+
+		snprintf(iname, sizeof(iname), "%s.trashinfo", tname);
+		const char *info_file =
+			get_at_name(trash_info_dir, iname, buf, sizeof(buf));
+		const int fd = openat(batch.info_fd, info_file,
+			O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+		if (fd == -1) {
+			if (errno == EEXIST)
+				continue;
+			xerror("trash: '%s/%s': %s\n", trash_info_dir, iname,
+				strerror(errno));
+			return NULL;
+		}
+
+		int ret = write_trashinfo_file(fd, file);
+		if (close(fd) == -1 && ret == FUNC_SUCCESS)
+			ret = errno;
+
+		if (ret != FUNC_SUCCESS) {
+			xerror("trash: '%s/%s': %s\n", trash_info_dir, iname,
+				strerror(ret));
+			unlinkat(batch.info_fd, info_file, 0);
+			return NULL;
+		}
+
+		return savestring(tname, strlen(tname));
 	}
 
-	/* If the length of the trashed filename (orig_filename) is
-	 * longer than NAME_MAX (255), trim the original filename, so that
-	 * (original_filename_len + 1 (dot) + suffix_len) won't be longer
-	 * than NAME_MAX. */
-	const size_t filename_len = strlen(filename);
-	const int size = (int)(filename_len + 11) - NAME_MAX;
-	/* len = filename.trashinfo */
+	xerror(_("trash: Cannot create trashinfo file for '%s'\n"), name);
+	return NULL;
+}
 
-	if (size > 0) {
-		/* THIS IS NOT UNICODE AWARE */
-		/* If SIZE is a positive value, that is, the trashed filename
-		 * exceeds NAME_MAX by SIZE bytes, reduce the original filename
-		 * SIZE bytes. Terminate the original filename (FILENAME) with
-		 * a tilde (~), to let the user know it was truncated. */
-		filename[filename_len - (size_t)size - 1] = '~';
-		filename[filename_len - (size_t)size] = '\0';
+static void
+remove_trashinfo_file(const char *name)
+{
+	char info_file[NAME_MAX + MAX_INT_STR + 13];
+	snprintf(info_file, sizeof(info_file), "%s.trashinfo", name);
+
+	char buf[PATH_MAX + 1];
+	if (unlinkat(batch.info_fd, get_at_name(trash_info_dir, info_file,
+	buf, sizeof(buf)), 0) == -1) {
+		err('w', PRINT_PROMPT, "trash: Cannot remove info file '%s/%s': %s\n",
+			trash_info_dir, info_file, strerror(errno));
 	}
+}
+
+/* Files that could not be renamed into the trash can because they are in a
+ * different filesystem. They are moved at once (see xmove_files()) once all
+ * files have been processed by trash_file(). */
+static struct {
+	char **src;
+	char **dst;
+	char **suffix;
+	int *is_dir;
+	size_t n;
+} xdev_queue = {NULL, NULL, NULL, NULL, 0};
+
+static void
+queue_xdev_file(const char *src, char *dst, char *suffix, const int is_dir)
+{
+	const size_t n = xdev_queue.n + 1;
+	xdev_queue.src = xnrealloc(xdev_queue.src, n, sizeof(char *));
+	xdev_queue.dst = xnrealloc(xdev_queue.dst, n, sizeof(char *));
+	xdev_queue.suffix = xnrealloc(xdev_queue.suffix, n, sizeof(char *));
+	xdev_queue.is_dir = xnrealloc(xdev_queue.is_dir, n, sizeof(int));
+
+	xdev_queue.src[xdev_queue.n] = savestring(src, strlen(src));
+	xdev_queue.dst[xdev_queue.n] = dst;
+	xdev_queue.suffix[xdev_queue.n] = suffix;
+	xdev_queue.is_dir[xdev_queue.n] = is_dir;
+	xdev_queue.n = n;
+}
 
-	/* NOTE: It is guaranteed (by check_trash_file(), called before from
-	 * trash_file_args()) that FILE does not end with a slash. */
-	const size_t dlen = strlen(trash_files_dir) + strlen(filename) + 2;
-	char *dest = xnmalloc(dlen, sizeof(char));
-	snprintf(dest, dlen, "%s/%s", trash_files_dir, filename);
+/* Move all files queued by trash_file() into the trash can.
+ * Return the number of trashed files. */
+static size_t
+flush_xdev_queue(int *exit_status)
+{
+	const size_t n = xdev_queue.n;
+	if (n == 0)
+		return 0;
 
-	char *unique_name = make_filename_unique(dest);
-	free(dest);
+	int *status = xnmalloc(n, sizeof(int));
+	const size_t moved = xmove_files(xdev_queue.src, xdev_queue.dst, n,
+		status, "trash");
 
-	if (!unique_name) {
-		xerror(_("trash: Cannot create trashinfo file for '%s'\n"), filename);
-		return NULL;
+	for (size_t i = 0; i < n; i++) {
+		if (status[i] != FUNC_SUCCESS) {
+			remove_trashinfo_file(xdev_queue.suffix[i]);
+			*exit_status = FUNC_FAILURE;
+		} else {
+			if (xdev_queue.is_dir[i] == 1)
+				forget_trash_dirsize(xdev_queue.suffix[i]);
+			index_trashed_file(xdev_queue.suffix[i], xdev_queue.src[i],
+				batch.date);
+		}
+
+		free(xdev_queue.src[i]);
+		free(xdev_queue.dst[i]);
+		free(xdev_queue.suffix[i]);
 	}
 
-	dest = unique_name;
-	char *s = strrchr(dest, '/');
-	if (s && s[1])
-		*file_suffix = strdup(s + 1);
+	free(status);
+	free(xdev_queue.src);
+	free(xdev_queue.dst);
+	free(xdev_queue.suffix);
+	free(xdev_queue.is_dir);
+	xdev_queue.src = xdev_queue.dst = xdev_queue.suffix = NULL;
+	xdev_queue.is_dir = NULL;
+	xdev_queue.n = 0;
 
-	return dest;
+	return moved;
 }
 
 static int
@@ -295,40 +1149,41 @@ trash_file(char *file)
 		tmpfile = full_path;
 	}
 
-	char *file_suffix = NULL;
-	char *dest = gen_dest_file(tmpfile, &file_suffix);
-
-	/* As per the FreeDesktop specification, generate the info file first. */
-	if (!dest || !file_suffix
-	|| gen_trashinfo_file(tmpfile, file_suffix) != FUNC_SUCCESS) {
-		free(dest);
-		free(file_suffix);
+	char *name = create_trashinfo_file(tmpfile);
+	if (!name)
 		return FUNC_FAILURE;
-	}
 
 	/* Move the original file into the trash directory. */
-	int mvcmd = 0;
-	int ret = renameat(XAT_FDCWD, file, XAT_FDCWD, dest);
-	if (ret != FUNC_SUCCESS && errno == EXDEV) {
-		/* Destination file is on a different filesystem, which is why
-		 * renameat(2) fails: let's try with mv(1). */
-		const char *tmp_cmd[] = {"mv", "--", file, dest, NULL};
-		ret = launch_execv(tmp_cmd, FOREGROUND, E_NOFLAG);
-		mvcmd = 1;
-	}
-
-	free(dest);
+	char buf[PATH_MAX + 1];
+	if (renameat(XAT_FDCWD, file, batch.files_fd,
+	get_at_name(trash_files_dir, name, buf, sizeof(buf))) == -1) {
+		const int saved_errno = errno;
+		if (saved_errno == EXDEV) {
+			/* Destination file is on a different filesystem, which is why
+			 * renameat(2) fails: queue the file to be copied and removed
+			 * (together with the remaining files) by flush_xdev_queue(). */
+			const size_t len = strlen(trash_files_dir) + strlen(name) + 2;
+			char *dest = xnmalloc(len, sizeof(char));
+			snprintf(dest, len, "%s/%s", trash_files_dir, name);
+			queue_xdev_file(tmpfile, dest, name, S_ISDIR(attr.st_mode));
+			return FUNC_SUCCESS;
+		}
 
-	if (ret != FUNC_SUCCESS) {
-		remove_trashinfo_file(file_suffix);
-		free(file_suffix);
-		if (mvcmd == 0)
-			xerror(_("trash: Cannot trash '%s': %s\n"), file, strerror(errno));
-		return (mvcmd == 1 ? ret : errno);
+		remove_trashinfo_file(name);
+		free(name);
+		xerror(_("trash: Cannot trash '%s': %s\n"), file,
+			strerror(saved_errno));
+		return saved_errno;
 	}
 
-	free(file_suffix);
-	return ret;
+	/* A stale cache entry might exist for a previously trashed directory
+	 * with the same name. */
+	if (S_ISDIR(attr.st_mode))
+		forget_trash_dirsize(name);
+
+	index_trashed_file(name, tmpfile, batch.date);
+	free(name);
+	return FUNC_SUCCESS;
 }
 
 /* 't del FILE...' */
@@ -591,50 +1446,42 @@ remove_from_trash(char **args)
 	return exit_status;
 }
 
-/* Read original path from the trashinfo file FILE for the trashed file SRC.
+/* Return the original path of the trashed file NAME, taken from the trash
+ * index or, if not indexed, from its trashinfo file.
  * STATUS is updated to reflect success (0) or error. */
 static char *
-read_original_path(const char *file, const char *src, int *status)
+read_original_path(const char *name, int *status)
 {
 	*status = FUNC_SUCCESS;
 
-	int fd = -1;
-	FILE *fp = open_fread(file, &fd);
-	if (!fp) {
-		xerror(_("untrash: Info file for '%s' not found. Try restoring "
-			"the file manually.\n"), src);
-		*status = errno;
-		return NULL;
-	}
-
-	char *orig_path = NULL;
-	/* The max length for line is: Path=(5) + PATH_MAX + \n(1) */
-	char line[PATH_MAX + 6]; *line = '\0';
-
-	while (fgets(line, (int)sizeof(line), fp)) {
-		if (*line == 'P' && strncmp(line, "Path=", 5) == 0) {
-			const char *p = strchr(line, '=');
-			if (!p || !*(++p))
-				break;
-			orig_path = savestring(p, strnlen(p, sizeof(line) - 1));
-			break;
+	load_trash_index(1, 0);
+	const struct trash_index_t *e = find_trash_index_entry(name);
+	char *orig_path = e ? savestring(e->path, strlen(e->path)) : NULL;
+
+	if (!orig_path) {
+		char file[PATH_MAX + 1];
+		snprintf(file, sizeof(file), "%s/%s.trashinfo", trash_info_dir, name);
+
+		int fd = -1;
+		FILE *fp = open_fread(file, &fd);
+		if (!fp) {
+			xerror(_("untrash: Info file for '%s' not found. Try restoring "
+				"the file manually.\n"), name);
+			*status = errno;
+			return NULL;
 		}
-	}
 
-	fclose(fp);
+		char date[64];
+		orig_path = parse_trashinfo_file(fp, date, sizeof(date));
+		fclose(fp);
+	}
 
 	/* If original path is NULL or empty, return error */
-	if (!orig_path || !*orig_path) {
-		free(orig_path);
+	if (!orig_path) {
 		*status = FUNC_FAILURE;
 		return NULL;
 	}
 
-	/* Remove new line char from original path, if any */
-	const size_t orig_path_len = strlen(orig_path);
-	if (orig_path_len > 0 && orig_path[orig_path_len - 1] == '\n')
-		orig_path[orig_path_len - 1] = '\0';
-
 	/* Decode original path's URL format */
 	char *url_decoded = url_decode(orig_path);
 
@@ -713,7 +1560,7 @@ untrash_file(const char *file)
 		trash_info_dir, file);
 
 	int ret = FUNC_SUCCESS;
-	char *orig_path = read_original_path(utrash_info, file, &ret);
+	char *orig_path = read_original_path(file, &ret);
 	if (!orig_path)
 		return ret;
 
@@ -723,25 +1570,17 @@ untrash_file(const char *file)
 		return ret;
 	}
 
-	ret = renameat(XAT_FDCWD, utrash_file, XAT_FDCWD, orig_path);
-	if (ret == -1) {
-		if (errno == EXDEV) {
-			/* Destination file is on a different filesystem, which is why
-			 * rename(3) doesn't work: let's try with mv(1). */
-			const char *cmd[] = {"mv", "--", utrash_file, orig_path, NULL};
-			ret = launch_execv(cmd, FOREGROUND, E_NOFLAG);
-			if (ret != FUNC_SUCCESS) {
-				free(orig_path);
-				return ret;
-			}
-		} else {
-			xerror("untrash: '%s': %s\n", utrash_file, strerror(errno));
-			free(orig_path);
-			return errno;
-		}
+	/* xmove() falls back to copying the file if the destination is on a
+	 * different filesystem. */
+	ret = xmove(utrash_file, orig_path, "untrash");
+	if (ret != FUNC_SUCCESS) {
+		free(orig_path);
+		return ret;
 	}
 
 	free(orig_path);
+	forget_trash_dirsize(file);
+	unindex_trashed_file(file);
 
 	if (unlinkat(XAT_FDCWD, utrash_info, 0) == -1) {
 		xerror(_("untrash: '%s': %s\n"), utrash_info, strerror(errno));
@@ -825,17 +1664,9 @@ untrash_files(char **args)
 	return status;
 }
 
-int
-untrash_function(char **args)
+static int
+untrash_cmd(char **args)
 {
-	if (!args)
-		return FUNC_FAILURE;
-
-	if (trash_ok == 0 || !trash_dir || !trash_files_dir || !trash_info_dir) {
-		xerror(_("%s: Trash function disabled\n"), PROGRAM_NAME);
-		return FUNC_FAILURE;
-	}
-
 	int exit_status = FUNC_SUCCESS;
 
 	if (args[1] && *args[1] != '*' && strcmp(args[1], "a") != 0
@@ -910,7 +1741,7 @@ untrash_function(char **args)
 	if (n > 0) {
 		if (conf.clear_screen > 0) CLEAR;
 		trash_n = n;
-		untrash_function(args);
+		untrash_cmd(args);
 	} else {
 		if (conf.autols == 1)
 			reload_dirlist();
@@ -920,6 +1751,25 @@ untrash_function(char **args)
 	return exit_status;
 }
 
+int
+untrash_function(char **args)
+{
+	if (!args)
+		return FUNC_FAILURE;
+
+	if (trash_ok == 0 || !trash_dir || !trash_files_dir || !trash_info_dir) {
+		xerror(_("%s: Trash function disabled\n"), PROGRAM_NAME);
+		return FUNC_FAILURE;
+	}
+
+	const int ret = untrash_cmd(args);
+	/* Remove restored files from the directory sizes cache and the index */
+	save_trash_dirsizes();
+	save_trash_index();
+
+	return ret;
+}
+
 static void
 print_trashdir_size(void)
 {
@@ -929,7 +1779,7 @@ print_trashdir_size(void)
 	if (term_caps.suggestions == 1)
 		{fputs("Calculating...", stdout); fflush(stdout);}
 
-	const off_t full_size = dir_size(trash_files_dir, 0, &status);
+	const off_t full_size = get_trash_size(&status);
 	const char *human_size = construct_human_size(full_size);
 
 	char err_str[sizeof(xf_cb) + 6]; *err_str = '\0';
@@ -1114,8 +1964,11 @@ trash_files_args(char **args)
 			return FUNC_SUCCESS;
 	}
 
+	if (open_trash_batch() != FUNC_SUCCESS)
+		return FUNC_FAILURE;
+
 	for (i = 1; args[i]; i++) {
-		if (trash_n + trashed_files >= MAX_TRASH) {
+		if (trash_n + trashed_files + xdev_queue.n >= MAX_TRASH) {
 			xerror("%s\n", _("trash: Cannot trash any more files"));
 			exit_status = FUNC_FAILURE;
 			break;
@@ -1137,9 +1990,12 @@ trash_files_args(char **args)
 		if (cwd == 0)
 			cwd = is_file_in_cwd(deq_file);
 
-		/* Once here, everything is fine: trash the file */
+		/* Once here, everything is fine: trash the file. Files queued to
+		 * be moved across filesystems are counted by flush_xdev_queue(). */
+		const size_t queued = xdev_queue.n;
 		if (trash_file(deq_file) == FUNC_SUCCESS) {
-			trashed_files++;
+			if (xdev_queue.n == queued)
+				trashed_files++;
 		} else {
 			cwd = 0;
 			exit_status = FUNC_FAILURE;
@@ -1148,6 +2004,9 @@ trash_files_args(char **args)
 		free(deq_file);
 	}
 
+	trashed_files += flush_xdev_queue(&exit_status);
+	close_trash_batch(trashed_files);
+
 	if (exit_status == FUNC_SUCCESS) {
 		if (conf.autols == 1 && cwd == 1)
 			reload_dirlist();
@@ -1194,13 +2053,26 @@ trash_function(char **args)
 
 	trash_n = count_trashed_files();
 
-	if (*args[1] == 'd' && strcmp(args[1], "del") == 0)
-		return remove_from_trash(args);
+	/* The index must be loaded before modifying the info directory:
+	 * otherwise, it would be considered stale. Trashing files just adds
+	 * entries to it, so that it is not fully loaded in this case. */
+	int ret;
+	if (*args[1] == 'd' && strcmp(args[1], "del") == 0) {
+		load_trash_index(0, 0);
+		ret = remove_from_trash(args);
+	} else if (*args[1] == 'e' && strcmp(args[1], "empty") == 0) {
+		load_trash_index(0, 0);
+		ret = trash_clear();
+	} else {
+		load_trash_index(0, 1);
+		ret = trash_files_args(args);
+	}
 
-	if (*args[1] == 'e' && strcmp(args[1], "empty") == 0)
-		return trash_clear();
+	/* Write changes to the directory sizes cache and the index, if any */
+	save_trash_dirsizes();
+	save_trash_index();
 
-	return trash_files_args(args);
+	return ret;
 }
 #else
 void *_skip_me_trash;
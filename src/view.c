@@ -30,11 +30,10 @@ typedef void rl_macro_print_func_t (const char *, const char *, int, const char
 #include "aux.h" /* open_f functions, is_cmd_in_path, construct_human_size */
 #include "checks.h" /* is_file_in_cwd */
 #include "file_operations.h" /* open_file */
-#include "init.h" /* get_sel_files */
 #include "listing.h" /* reload_dirlist */
 #include "messages.h" /* VIEW_USAGE */
 #include "misc.h" /* xerror, print_reload_msg */
-#include "selection.h" /* save_sel */
+#include "selection.h" /* save_sel(), sync_sel_files() */
 #include "spawn.h" /* launch_execve */
 #include "tabcomp.h" /* tab_complete */
 
@@ -458,7 +457,7 @@ preview_function(char **args)
 
 	if (sel_n > seln_bk) {
 		save_sel();
-		get_sel_files();
+		sync_sel_files();
 	}
 
 	if (conf.autols == 1) {
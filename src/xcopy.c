@@ -0,0 +1,1700 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* xcopy.c -- copy, move, and remove files without spawning cp/mv/rm */
+
+/* This is the built-in copy engine. It is used:
+ * 1. To move files across filesystems, where rename(2) fails with EXDEV
+ * (xmove() and xmove_files(), used by the trash and untrash commands).
+ * 2. By the c and m commands, if cpCmd/mvCmd are set to the built-in
+ * engine (xcopy_files()).
+ *
+ * Files are recursively copied, including permissions, ownership,
+ * timestamps, extended attributes, hard links, symbolic links, and special
+ * files. The main thread walks the source tree creating directories, links,
+ * and special files, while regular files are handed to a bounded pool of
+ * worker threads (at most XCOPY_MAX_THREADS), so that copying lots of small
+ * files is not serialized. Directory attributes are set once all files
+ * inside them were copied.
+ *
+ * File contents are cloned via FICLONE whenever possible (reflinks, on
+ * filesystems supporting them), and otherwise copied via copy_file_range(2)
+ * or sendfile(2) (so that data does not go through user space), falling
+ * back to read(2)/write(2) with a large buffer. Holes in sparse files are
+ * preserved (via SEEK_DATA/SEEK_HOLE).
+ *
+ * xremove_files() (used by the r command) removes files using the same
+ * worker threads: the main thread removes the first level of each
+ * directory, and each subdirectory found there is removed (via
+ * openat(2)/unlinkat(2)) by a worker thread.
+ *
+ * Progress (files, bytes, and throughput) is reported on stderr, if it is
+ * a terminal. Errors are reported by the main thread only.
+ *
+ * Ctrl+c cancels the current operation: the main thread and the workers
+ * stop at the next file (or chunk of data), and the partial result is
+ * reported. */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h> /* sigaction(), sigfillset(), pthread_sigmask() */
+#include <string.h>
+#include <time.h>   /* clock_gettime() */
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(_BE_POSIX)
+# include <sys/ioctl.h>    /* ioctl(2) */
+# include <linux/fs.h>     /* FICLONE */
+# include <sys/sendfile.h>
+# define HAVE_SENDFILE
+# if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#  if __GLIBC_PREREQ(2, 27)
+#   define HAVE_COPY_FILE_RANGE
+#  endif /* glibc >= 2.27 */
+# endif /* __GLIBC__ && __GLIBC_PREREQ */
+#endif /* __linux__ && !_BE_POSIX */
+
+#ifdef LINUX_FILE_XATTRS
+# include <sys/xattr.h>
+#endif /* LINUX_FILE_XATTRS */
+
+#include "aux.h"     /* construct_human_size() */
+#include "mem.h"     /* xnmalloc(), xnrealloc() */
+#include "misc.h"    /* err() */
+#include "strings.h" /* savestring(), xstrsncpy() */
+#include "xcopy.h"
+
+/* Size of each chunk copied at once: progress is updated after each one. */
+#define XCOPY_CHUNK_SIZE (8 * 1024 * 1024)
+/* Buffer used by the read(2)/write(2) fallback (one per thread). */
+#define XCOPY_BUF_SIZE   (1024 * 1024)
+/* Minimum interval between progress updates, in milliseconds. */
+#define PROGRESS_INTERVAL 100
+/* Removed files counted by each thread before updating the progress. */
+#define REMOVE_BATCH 256
+
+#define XCOPY_MAX_THREADS 8
+/* Maximum number of regular files waiting to be copied. When the queue is
+ * full, the main thread waits before walking any further. */
+#define XCOPY_QUEUE_SIZE  256
+
+/* Flags for struct xcopy_t */
+#define XCOPY_OVERWRITE 0x01 /* Replace existing files, merge directories */
+
+struct xcopy_hlink_t {
+	char *dst;
+	dev_t dev;
+	ino_t ino;
+};
+
+/* A regular file copied by a worker thread, a directory removed by a
+ * worker thread, or a directory whose attributes are set once its contents
+ * were copied. */
+struct xcopy_job_t {
+	char *src;
+	char *dst; /* If removing, the first file that could not be removed */
+	struct stat a;
+	int error; /* errno value set by the worker thread */
+	int remove; /* 1 if removing SRC, 0 if copying SRC as DST */
+};
+
+/* State of a removal (run by a worker thread). */
+struct xremove_t {
+	char path[PATH_MAX + 1]; /* Path of the file being removed */
+	char *errpath; /* First file that could not be removed */
+	size_t removed; /* Removed files not yet added to the progress */
+	int error;
+	int pad0;
+};
+
+/* State of the current copy operation. Paths are built in place in the
+ * SRC and DST buffers while traversing directories. */
+struct xcopy_t {
+	char src[PATH_MAX + 1];
+	char dst[PATH_MAX + 1];
+	char *buf; /* Used by the read(2)/write(2) fallback */
+	struct xcopy_hlink_t *hlinks; /* Copied files with several hard links */
+	struct xcopy_job_t *dirs; /* Copied directories */
+	size_t hlinks_n;
+	size_t dirs_n;
+	const char *errname;
+	int flags;
+	int pad0;
+};
+
+/* The worker threads pool. All fields (and the progress counters below)
+ * are protected by pool_mutex. */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond_job = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_cond_done = PTHREAD_COND_INITIALIZER;
+
+static struct {
+	pthread_t threads[XCOPY_MAX_THREADS];
+	struct xcopy_job_t *queue[XCOPY_QUEUE_SIZE]; /* Ring buffer */
+	struct xcopy_job_t **failed;
+	size_t head;
+	size_t count; /* Jobs in the queue */
+	size_t pending; /* Jobs either queued or being copied */
+	size_t failed_n;
+	int nthreads;
+	int stop;
+} pool;
+
+static struct {
+	const char *label;
+	off_t total_bytes;
+	off_t done_bytes;
+	size_t done_files;
+	struct timespec start;
+	struct timespec last;
+	pthread_t owner; /* The thread printing progress */
+	int active;
+	int shown;
+} progress;
+
+/* Set by SIGINT while an operation is running (see cancel_start()). */
+static volatile sig_atomic_t xcopy_cancelled = 0;
+
+static void
+cancel_handler(int sig)
+{
+	UNUSED(sig);
+	xcopy_cancelled = 1;
+}
+
+/* Let Ctrl+c cancel the operation about to start. The previous SIGINT
+ * action is stored in OLD, to be restored by cancel_end(). */
+static void
+cancel_start(struct sigaction *old)
+{
+	xcopy_cancelled = 0;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = cancel_handler;
+	sigaction(SIGINT, &sa, old);
+}
+
+/* Restore the SIGINT action OLD. If the operation was cancelled, report
+ * how many files were processed (DONE, e.g. "removed"). Return 1 if
+ * cancelled, or 0 otherwise. */
+static int
+cancel_end(const struct sigaction *old, const char *errname,
+	const char *done)
+{
+	sigaction(SIGINT, old, NULL);
+
+	if (xcopy_cancelled == 0)
+		return 0;
+
+	xerror(_("%s: Interrupted: %zu %s %s\n"), errname, progress.done_files,
+		progress.done_files == 1 ? _("file") : _("files"), done);
+	return 1;
+}
+
+static long long
+elapsed_ms(const struct timespec *from, const struct timespec *to)
+{
+	return (long long)(to->tv_sec - from->tv_sec) * 1000
+		+ (to->tv_nsec - from->tv_nsec) / 1000000;
+}
+
+/* Must be called with pool_mutex held. */
+static void
+print_progress(const struct timespec *now)
+{
+	char total[MAX_HUMAN_SIZE + 2];
+	xstrsncpy(total, construct_human_size(progress.total_bytes),
+		sizeof(total));
+
+	const long long ms = elapsed_ms(&progress.start, now);
+	char rate[MAX_HUMAN_SIZE + 2];
+	xstrsncpy(rate, construct_human_size(ms > 0
+		? (off_t)((long long)progress.done_bytes * 1000 / ms) : 0),
+		sizeof(rate));
+
+	if (progress.total_bytes < 0) { /* Removing files */
+		fprintf(stderr, "\r%s: %zu %s removed (%lld/s)\x1b[0K", progress.label,
+			progress.done_files, progress.done_files == 1 ? _("file")
+			: _("files"), ms > 0 ? (long long)progress.done_files * 1000 / ms
+			: 0);
+		progress.shown = 1;
+		return;
+	}
+
+	const int percent = progress.total_bytes > 0
+		? (int)((progress.done_bytes * 100) / progress.total_bytes) : 100;
+
+	fprintf(stderr, "\r%s: %zu %s, %s/%s (%d%%) %s/s\x1b[0K", progress.label,
+		progress.done_files, progress.done_files == 1 ? _("file") : _("files"),
+		construct_human_size(progress.done_bytes), total,
+		percent > 100 ? 100 : percent, rate);
+
+	progress.shown = 1;
+}
+
+/* Remove the progress line, if any, so that error messages are not printed
+ * next to it. */
+static void
+clear_progress(void)
+{
+	if (progress.shown == 1) {
+		fputs("\r\x1b[0K", stderr);
+		progress.shown = 0;
+	}
+}
+
+/* Print progress if at least PROGRESS_INTERVAL milliseconds elapsed since
+ * the last update. Must be called from the main thread with pool_mutex
+ * held. */
+static void
+progress_tick(void)
+{
+	if (progress.active == 0)
+		return;
+
+	struct timespec now;
+	if (clock_gettime(CLOCK_MONOTONIC, &now) == -1
+	|| elapsed_ms(&progress.last, &now) < PROGRESS_INTERVAL)
+		return;
+
+	progress.last = now;
+	print_progress(&now);
+}
+
+static void
+update_progress(const off_t bytes, const size_t files)
+{
+	pthread_mutex_lock(&pool_mutex);
+
+	progress.done_bytes += bytes;
+	progress.done_files += files;
+	if (pthread_equal(pthread_self(), progress.owner))
+		progress_tick();
+
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+static void
+progress_start(const char *label, const off_t total_bytes)
+{
+	pthread_mutex_lock(&pool_mutex);
+
+	progress.label = label;
+	progress.total_bytes = total_bytes;
+	progress.done_bytes = 0;
+	progress.done_files = 0;
+	progress.shown = 0;
+	progress.owner = pthread_self();
+	progress.active = isatty(STDERR_FILENO)
+		&& clock_gettime(CLOCK_MONOTONIC, &progress.start) != -1;
+	progress.last = progress.start;
+
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+static void
+progress_end(void)
+{
+	pthread_mutex_lock(&pool_mutex);
+
+	struct timespec now;
+	if (progress.active == 1 && progress.shown == 1
+	&& clock_gettime(CLOCK_MONOTONIC, &now) != -1) {
+		print_progress(&now);
+		fputc('\n', stderr);
+	}
+
+	progress.active = 0;
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+/* Copy LEN bytes (or, if LEN is negative, everything up to the end of the
+ * file) from the file IN into the file OUT, starting at their current
+ * offsets. BUF is a buffer of XCOPY_BUF_SIZE bytes, allocated if needed,
+ * used by the read(2)/write(2) fallback. */
+static int
+copy_data(char **buf, const int in, const int out, const off_t len)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+	int use_cfr = 1;
+#endif /* HAVE_COPY_FILE_RANGE */
+#ifdef HAVE_SENDFILE
+	int use_sendfile = 1;
+#endif /* HAVE_SENDFILE */
+	off_t rem = len;
+
+	while (len < 0 || rem > 0) {
+		if (xcopy_cancelled == 1)
+			return ECANCELED;
+
+		const size_t chunk = (len >= 0 && rem < XCOPY_CHUNK_SIZE)
+			? (size_t)rem : XCOPY_CHUNK_SIZE;
+		ssize_t n = -1;
+
+#ifdef HAVE_COPY_FILE_RANGE
+		if (use_cfr == 1) {
+			n = copy_file_range(in, NULL, out, NULL, chunk, 0);
+			if (n == -1 && (errno == EXDEV || errno == ENOSYS
+			|| errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF)) {
+				/* Not supported between these filesystems */
+				use_cfr = 0;
+				continue;
+			}
+		} else
+#endif /* HAVE_COPY_FILE_RANGE */
+#ifdef HAVE_SENDFILE
+		if (use_sendfile == 1) {
+			n = sendfile(out, in, NULL, chunk);
+			if (n == -1 && (errno == EINVAL || errno == ENOSYS)) {
+				use_sendfile = 0;
+				continue;
+			}
+		} else
+#endif /* HAVE_SENDFILE */
+		{
+			if (!*buf)
+				*buf = xnmalloc(XCOPY_BUF_SIZE, sizeof(char));
+
+			n = read(in, *buf, chunk < XCOPY_BUF_SIZE ? chunk : XCOPY_BUF_SIZE);
+			if (n > 0) {
+				ssize_t w = 0;
+				while (w < n) {
+					const ssize_t ret = write(out, *buf + w, (size_t)(n - w));
+					if (ret == -1) {
+						if (errno == EINTR)
+							continue;
+						return errno;
+					}
+					w += ret;
+				}
+			}
+		}
+
+		if (n == 0) /* End of file */
+			break;
+
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		rem -= n;
+		update_progress((off_t)n, 0);
+	}
+
+	return FUNC_SUCCESS;
+}
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+/* Copy only the data segments of the sparse file IN into OUT, leaving
+ * holes unallocated. Return -1 if holes cannot be detected on this
+ * filesystem (the file should then be copied as usual). */
+static int
+copy_sparse_data(char **buf, const int in, const int out,
+	const struct stat *a)
+{
+	off_t data = 0;
+	int first = 1;
+
+	while ((data = lseek(in, data, SEEK_DATA)) != -1) {
+		first = 0;
+		const off_t hole = lseek(in, data, SEEK_HOLE);
+		if (hole == -1 || lseek(in, data, SEEK_SET) == -1
+		|| lseek(out, data, SEEK_SET) == -1)
+			return errno;
+
+		const int ret = copy_data(buf, in, out, hole - data);
+		if (ret != FUNC_SUCCESS)
+			return ret;
+
+		data = hole;
+	}
+
+	/* ENXIO: no more data after this offset */
+	if (errno != ENXIO)
+		return first == 1 ? -1 : errno;
+
+	return ftruncate(out, a->st_size) == -1 ? errno : FUNC_SUCCESS;
+}
+#endif /* SEEK_DATA && SEEK_HOLE */
+
+static void
+set_times(struct timespec *ts, const struct stat *a)
+{
+	ts[0].tv_sec = a->st_atime;
+	ts[1].tv_sec = a->st_mtime;
+#ifndef CLIFM_LEGACY
+	ts[0].tv_nsec = a->ATIMNSEC;
+	ts[1].tv_nsec = a->MTIMNSEC;
+#else
+	ts[0].tv_nsec = ts[1].tv_nsec = 0;
+#endif /* !CLIFM_LEGACY */
+}
+
+#ifdef LINUX_FILE_XATTRS
+/* Copy extended attributes from the file IN to the file OUT. Errors are
+ * ignored: the destination filesystem may not support them. */
+static void
+copy_xattrs(const int in, const int out)
+{
+	ssize_t len = flistxattr(in, NULL, 0);
+	if (len <= 0)
+		return;
+
+	char *list = xnmalloc((size_t)len, sizeof(char));
+	len = flistxattr(in, list, (size_t)len);
+
+	for (ssize_t i = 0; i < len; i += (ssize_t)strlen(list + i) + 1) {
+		const char *name = list + i;
+		const ssize_t vlen = fgetxattr(in, name, NULL, 0);
+		if (vlen < 0)
+			continue;
+
+		char *val = xnmalloc((size_t)vlen + 1, sizeof(char));
+		const ssize_t ret = fgetxattr(in, name, val, (size_t)vlen);
+		if (ret >= 0)
+			fsetxattr(out, name, val, (size_t)ret, 0);
+		free(val);
+	}
+
+	free(list);
+}
+#endif /* LINUX_FILE_XATTRS */
+
+/* Set ownership, permissions, extended attributes, and timestamps of the
+ * file OUT (whose source file is IN) according to A. */
+static void
+copy_attrs(const int in, const int out, const struct stat *a)
+{
+	mode_t mode = a->st_mode & 07777;
+	/* If we cannot preserve ownership, do not keep the SUID/SGID bits (this
+	 * is what cp(1) does). */
+	if (fchown(out, a->st_uid, a->st_gid) == -1)
+		mode &= (mode_t)~(S_ISUID | S_ISGID);
+
+#ifdef LINUX_FILE_XATTRS
+	copy_xattrs(in, out);
+#else
+	UNUSED(in);
+#endif /* LINUX_FILE_XATTRS */
+
+	fchmod(out, mode);
+
+	struct timespec ts[2];
+	set_times(ts, a);
+	futimens(out, ts);
+}
+
+/* Same as copy_attrs(), but for files we cannot open (symbolic links and
+ * special files). */
+static void
+copy_attrs_path(const char *dst, const struct stat *a)
+{
+	const int is_link = S_ISLNK(a->st_mode);
+
+	const int ret = fchownat(XAT_FDCWD, dst, a->st_uid, a->st_gid,
+		AT_SYMLINK_NOFOLLOW);
+
+	if (is_link == 0) {
+		mode_t mode = a->st_mode & 07777;
+		if (ret == -1)
+			mode &= (mode_t)~(S_ISUID | S_ISGID);
+		fchmodat(XAT_FDCWD, dst, mode, 0);
+	}
+
+	struct timespec ts[2];
+	set_times(ts, a);
+	utimensat(XAT_FDCWD, dst, ts, AT_SYMLINK_NOFOLLOW);
+}
+
+/* Copy the regular file SRC (described by A) as DST, which must not exist.
+ * This function is thread safe: it is run by the worker threads. */
+static int
+copy_file_contents(const char *src, const char *dst, const struct stat *a,
+	char **buf)
+{
+	const int in = open(src, O_RDONLY);
+	if (in == -1)
+		return errno;
+
+	const int out = open(dst, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (out == -1) {
+		const int saved_errno = errno;
+		close(in);
+		return saved_errno;
+	}
+
+	int ret = -1;
+#ifdef FICLONE
+	/* Share data blocks with the source file (copy-on-write) */
+	if (a->st_size > 0 && ioctl(out, FICLONE, in) == 0) {
+		update_progress(a->st_size, 0);
+		ret = FUNC_SUCCESS;
+	}
+#endif /* FICLONE */
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	if (ret == -1 && (off_t)a->st_blocks * S_BLKSIZE < a->st_size)
+		ret = copy_sparse_data(buf, in, out, a);
+#endif /* SEEK_DATA && SEEK_HOLE */
+
+	if (ret == -1) {
+		posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+		ret = copy_data(buf, in, out, -1);
+	}
+
+	if (ret == FUNC_SUCCESS)
+		copy_attrs(in, out, a);
+
+	close(in);
+	if (close(out) == -1 && ret == FUNC_SUCCESS)
+		ret = errno;
+
+	if (ret == ECANCELED) /* Do not leave a truncated copy behind */
+		unlink(dst);
+
+	return ret;
+}
+
+static void
+remove_error(struct xremove_t *r, const int error)
+{
+	if (r->error != FUNC_SUCCESS) /* Only the first error is reported */
+		return;
+
+	r->error = error;
+	r->errpath = savestring(r->path, strlen(r->path));
+}
+
+static void
+count_removed(struct xremove_t *r)
+{
+	if (++r->removed >= REMOVE_BATCH) {
+		update_progress(0, r->removed);
+		r->removed = 0;
+	}
+}
+
+/* In legacy builds, *at() functions ignore the directory file descriptor
+ * (see compat.h): use the full path of the file instead of its name. */
+#ifndef CLIFM_LEGACY
+# define AT_NAME(name, path) (name)
+#else
+# define AT_NAME(name, path) (path)
+#endif /* !CLIFM_LEGACY */
+
+/* Open the directory NAME, in the directory DFD (PATH is its full path). */
+static DIR *
+open_dir_at(const int dfd, const char *name, const char *path)
+{
+#ifndef CLIFM_LEGACY
+	UNUSED(path);
+	const int fd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+	DIR *dir = fd != -1 ? fdopendir(fd) : NULL;
+	if (!dir && fd != -1) {
+		const int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+	}
+
+	return dir;
+#else
+	UNUSED(dfd); UNUSED(name);
+	return opendir(path);
+#endif /* !CLIFM_LEGACY */
+}
+
+/* Return 1 if the entry ENT, in the directory DFD, is a directory. PATH
+ * is its full path. */
+static int
+is_dir_at(const int dfd, const struct dirent *ent, const char *path)
+{
+#ifdef _DIRENT_HAVE_D_TYPE
+	if (ent->d_type != DT_UNKNOWN)
+		return (ent->d_type == DT_DIR);
+#endif /* _DIRENT_HAVE_D_TYPE */
+
+	UNUSED(path);
+	struct stat a;
+	return (fstatat(dfd, AT_NAME(ent->d_name, path), &a,
+		AT_SYMLINK_NOFOLLOW) != -1 && S_ISDIR(a.st_mode));
+}
+
+/* Recursively remove the directory NAME, in the directory DFD. R->PATH
+ * holds its path (for error messages). Like 'rm -rf', files removed
+ * meanwhile are ignored. This function is thread safe.
+ * Return 0 if the directory was removed, or 1 otherwise. */
+static int
+remove_dir_at(struct xremove_t *r, const int dfd, const char *name)
+{
+	DIR *dir = open_dir_at(dfd, name, r->path);
+	if (!dir) {
+		if (errno == ENOENT)
+			return FUNC_SUCCESS;
+		remove_error(r, errno);
+		return FUNC_FAILURE;
+	}
+
+	const int fd = dirfd(dir);
+
+	const size_t len = strlen(r->path);
+	int ret = FUNC_SUCCESS;
+	const struct dirent *ent;
+
+	while ((ent = readdir(dir))) {
+		if (xcopy_cancelled == 1) {
+			remove_error(r, ECANCELED);
+			ret = FUNC_FAILURE;
+			break;
+		}
+
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		const size_t nlen = strlen(ent->d_name);
+		if (len + nlen + 2 > sizeof(r->path)) {
+			remove_error(r, ENAMETOOLONG);
+			ret = FUNC_FAILURE;
+			continue;
+		}
+
+		r->path[len] = '/';
+		memcpy(r->path + len + 1, ent->d_name, nlen + 1);
+
+		if (is_dir_at(fd, ent, r->path) == 1) {
+			if (remove_dir_at(r, fd, ent->d_name) != FUNC_SUCCESS)
+				ret = FUNC_FAILURE;
+		} else if (unlinkat(fd, AT_NAME(ent->d_name, r->path), 0) == 0
+		|| errno == ENOENT) {
+			count_removed(r);
+		} else {
+			remove_error(r, errno);
+			ret = FUNC_FAILURE;
+		}
+
+		r->path[len] = '\0';
+	}
+
+	closedir(dir);
+
+	if (ret != FUNC_SUCCESS)
+		return ret;
+
+#ifndef CLIFM_LEGACY
+	if (unlinkat(dfd, name, AT_REMOVEDIR) == -1 && errno != ENOENT) {
+#else
+	if (rmdir(r->path) == -1 && errno != ENOENT) {
+#endif /* !CLIFM_LEGACY */
+		remove_error(r, errno);
+		return FUNC_FAILURE;
+	}
+
+	count_removed(r);
+	return FUNC_SUCCESS;
+}
+
+/* Recursively remove the directory PATH. On error, the first file that
+ * could not be removed is stored in ERRPATH. Return 0 on success or an
+ * errno value on error. */
+static int
+remove_dir(const char *path, char **errpath)
+{
+	struct xremove_t *r = xnmalloc(1, sizeof(struct xremove_t));
+	xstrsncpy(r->path, path, sizeof(r->path));
+	r->errpath = NULL;
+	r->removed = 0;
+	r->error = FUNC_SUCCESS;
+
+	remove_dir_at(r, XAT_FDCWD, path);
+	if (r->removed > 0)
+		update_progress(0, r->removed);
+
+	const int ret = r->error;
+	*errpath = r->errpath;
+	free(r);
+	return ret;
+}
+
+static void *
+pool_worker(void *arg)
+{
+	UNUSED(arg);
+	char *buf = NULL;
+
+	pthread_mutex_lock(&pool_mutex);
+
+	while (1) {
+		while (pool.count == 0 && pool.stop == 0)
+			pthread_cond_wait(&pool_cond_job, &pool_mutex);
+
+		if (pool.count == 0) /* Stopping, and nothing else to do */
+			break;
+
+		struct xcopy_job_t *job = pool.queue[pool.head];
+		pool.head = (pool.head + 1) % XCOPY_QUEUE_SIZE;
+		pool.count--;
+		pthread_mutex_unlock(&pool_mutex);
+
+		if (xcopy_cancelled == 1) /* Just drain the queue */
+			job->error = ECANCELED;
+		else if (job->remove == 1)
+			job->error = remove_dir(job->src, &job->dst);
+		else
+			job->error = copy_file_contents(job->src, job->dst, &job->a, &buf);
+
+		pthread_mutex_lock(&pool_mutex);
+		if (job->error != FUNC_SUCCESS) {
+			/* Reported by the main thread (see pool_wait()) */
+			pool.failed = xnrealloc(pool.failed, pool.failed_n + 1,
+				sizeof(struct xcopy_job_t *));
+			pool.failed[pool.failed_n++] = job;
+		} else {
+			if (job->remove == 0) /* Removed files were already counted */
+				progress.done_files++;
+			free(job->src);
+			free(job->dst);
+			free(job);
+		}
+
+		pool.pending--;
+		pthread_cond_broadcast(&pool_cond_done);
+	}
+
+	pthread_mutex_unlock(&pool_mutex);
+	free(buf);
+	return NULL;
+}
+
+/* Start the worker threads. If no thread can be created, files are copied
+ * by the main thread. */
+static void
+pool_start(void)
+{
+	const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	/* Copying is mostly I/O bound: use at least two threads */
+	const int n = ncpu < 2 ? 2
+		: (ncpu > XCOPY_MAX_THREADS ? XCOPY_MAX_THREADS : (int)ncpu);
+
+	/* Signals are handled by the main thread only */
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	pool.stop = 0;
+	for (pool.nthreads = 0; pool.nthreads < n; pool.nthreads++) {
+		if (pthread_create(&pool.threads[pool.nthreads], NULL,
+		pool_worker, NULL) != 0)
+			break;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/* Wait until all queued files were copied, printing progress meanwhile.
+ * Failed copies are reported here, except for those cancelled by the user
+ * (reported by cancel_end()). Return 0 if all files were copied, or the
+ * errno value of the first failed copy. */
+static int
+pool_wait(const char *errname)
+{
+	pthread_mutex_lock(&pool_mutex);
+
+	while (pool.pending > 0) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += PROGRESS_INTERVAL * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+
+		pthread_cond_timedwait(&pool_cond_done, &pool_mutex, &ts);
+		progress_tick();
+	}
+
+	struct xcopy_job_t **failed = pool.failed;
+	const size_t failed_n = pool.failed_n;
+	pool.failed = NULL;
+	pool.failed_n = 0;
+
+	pthread_mutex_unlock(&pool_mutex);
+
+	int ret = FUNC_SUCCESS;
+	for (size_t i = 0; i < failed_n; i++) {
+		if (ret == FUNC_SUCCESS)
+			ret = failed[i]->error;
+		if (failed[i]->error != ECANCELED) {
+			clear_progress();
+			if (failed[i]->remove == 1) {
+				xerror(_("%s: Cannot remove '%s': %s\n"), errname,
+					failed[i]->dst ? failed[i]->dst : failed[i]->src,
+					strerror(failed[i]->error));
+			} else {
+				xerror(_("%s: Cannot copy '%s' to '%s': %s\n"), errname,
+					failed[i]->src, failed[i]->dst,
+					strerror(failed[i]->error));
+			}
+		}
+		free(failed[i]->src);
+		free(failed[i]->dst);
+		free(failed[i]);
+	}
+
+	free(failed);
+	return ret;
+}
+
+static void
+pool_stop(void)
+{
+	if (pool.nthreads == 0)
+		return;
+
+	pthread_mutex_lock(&pool_mutex);
+	pool.stop = 1;
+	pthread_cond_broadcast(&pool_cond_job);
+	pthread_mutex_unlock(&pool_mutex);
+
+	for (int i = 0; i < pool.nthreads; i++)
+		pthread_join(pool.threads[i], NULL);
+
+	pool.nthreads = 0;
+}
+
+/* Queue a job for the worker threads: either copying the regular file SRC
+ * (described by A) as DST, or, if DST is NULL, removing the directory SRC.
+ * Return 0 if queued, or -1 if there are no worker threads (the caller
+ * must do the job itself). */
+static int
+pool_submit(const char *src, const char *dst, const struct stat *a)
+{
+	if (pool.nthreads == 0) {
+		pool_start();
+		if (pool.nthreads == 0)
+			return (-1);
+	}
+
+	struct xcopy_job_t *job = xcalloc(1, sizeof(struct xcopy_job_t));
+	job->src = savestring(src, strlen(src));
+	if (dst) {
+		job->dst = savestring(dst, strlen(dst));
+		job->a = *a;
+	} else {
+		job->remove = 1;
+	}
+
+	pthread_mutex_lock(&pool_mutex);
+
+	while (pool.count == XCOPY_QUEUE_SIZE) {
+		pthread_cond_wait(&pool_cond_done, &pool_mutex);
+		progress_tick();
+	}
+
+	pool.queue[(pool.head + pool.count) % XCOPY_QUEUE_SIZE] = job;
+	pool.count++;
+	pool.pending++;
+	pthread_cond_signal(&pool_cond_job);
+
+	pthread_mutex_unlock(&pool_mutex);
+	return 0;
+}
+
+/* If the file described by A was already copied (under another name),
+ * create a hard link to the copy and return 1. Otherwise, return 0. */
+static int
+link_copied_file(struct xcopy_t *x, const struct stat *a, int *status)
+{
+	for (size_t i = 0; i < x->hlinks_n; i++) {
+		if (x->hlinks[i].dev == a->st_dev && x->hlinks[i].ino == a->st_ino) {
+			*status = linkat(XAT_FDCWD, x->hlinks[i].dst, XAT_FDCWD, x->dst, 0)
+				== -1 ? errno : FUNC_SUCCESS;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+add_copied_hlink(struct xcopy_t *x, const struct stat *a)
+{
+	x->hlinks = xnrealloc(x->hlinks, x->hlinks_n + 1,
+		sizeof(struct xcopy_hlink_t));
+	x->hlinks[x->hlinks_n].dst = savestring(x->dst, strlen(x->dst));
+	x->hlinks[x->hlinks_n].dev = a->st_dev;
+	x->hlinks[x->hlinks_n].ino = a->st_ino;
+	x->hlinks_n++;
+}
+
+/* Return 0 if the file was copied (or queued to be copied), or an errno
+ * value on error. */
+static int
+copy_regular_file(struct xcopy_t *x, const struct stat *a, int *queued)
+{
+	int ret = FUNC_SUCCESS;
+
+	if (a->st_nlink > 1) {
+		if (link_copied_file(x, a, &ret) == 1)
+			return ret;
+		/* Copied right away: further links to this file must find the
+		 * copy in place. */
+		ret = copy_file_contents(x->src, x->dst, a, &x->buf);
+		if (ret == FUNC_SUCCESS)
+			add_copied_hlink(x, a);
+		return ret;
+	}
+
+	if (pool_submit(x->src, x->dst, a) == 0) {
+		*queued = 1;
+		return FUNC_SUCCESS;
+	}
+
+	return copy_file_contents(x->src, x->dst, a, &x->buf);
+}
+
+static int
+copy_symlink(struct xcopy_t *x, const struct stat *a)
+{
+	char target[PATH_MAX + 1];
+	const ssize_t len = readlink(x->src, target, sizeof(target) - 1);
+	if (len == -1)
+		return errno;
+
+	target[len] = '\0';
+	if (symlink(target, x->dst) == -1)
+		return errno;
+
+	copy_attrs_path(x->dst, a);
+	return FUNC_SUCCESS;
+}
+
+static int
+copy_special_file(struct xcopy_t *x, const struct stat *a)
+{
+	const int ret = S_ISFIFO(a->st_mode)
+		? mkfifo(x->dst, S_IRUSR | S_IWUSR)
+		: mknod(x->dst, a->st_mode, a->st_rdev);
+
+	if (ret == -1)
+		return errno;
+
+	copy_attrs_path(x->dst, a);
+	return FUNC_SUCCESS;
+}
+
+/* Attributes of copied directories are set by set_dirs_attrs(), once all
+ * files were copied: creating files in a directory changes its
+ * modification time, and a read-only directory cannot be populated. */
+static void
+add_copied_dir(struct xcopy_t *x, const struct stat *a)
+{
+	x->dirs = xnrealloc(x->dirs, x->dirs_n + 1, sizeof(struct xcopy_job_t));
+	x->dirs[x->dirs_n].src = savestring(x->src, strlen(x->src));
+	x->dirs[x->dirs_n].dst = savestring(x->dst, strlen(x->dst));
+	x->dirs[x->dirs_n].a = *a;
+	x->dirs_n++;
+}
+
+static void
+set_dir_attrs(const struct xcopy_job_t *dir)
+{
+	const int in = open(dir->src, O_RDONLY | O_DIRECTORY);
+	const int out = open(dir->dst, O_RDONLY | O_DIRECTORY);
+	if (in != -1 && out != -1)
+		copy_attrs(in, out, &dir->a);
+	if (in != -1)
+		close(in);
+	if (out != -1)
+		close(out);
+}
+
+/* Set the attributes of copied directories (if APPLY is 1) and clear the
+ * list of copied directories. */
+static void
+set_dirs_attrs(struct xcopy_t *x, const int apply)
+{
+	/* In reverse order: subdirectories first */
+	size_t i = x->dirs_n;
+	while (i-- > 0) {
+		if (apply == 1)
+			set_dir_attrs(&x->dirs[i]);
+		free(x->dirs[i].src);
+		free(x->dirs[i].dst);
+	}
+
+	free(x->dirs);
+	x->dirs = NULL;
+	x->dirs_n = 0;
+}
+
+static int copy_entry(struct xcopy_t *x);
+
+/* Copy the directory X->SRC as X->DST. If MERGE is 1, X->DST already
+ * exists. */
+static int
+copy_directory(struct xcopy_t *x, const struct stat *a, const int merge)
+{
+	int ret = FUNC_SUCCESS;
+	DIR *dir = NULL;
+
+	if ((merge == 0 && mkdir(x->dst, S_IRWXU) == -1)
+	|| !(dir = opendir(x->src))) {
+		ret = errno;
+		clear_progress();
+		xerror(_("%s: Cannot copy '%s' to '%s': %s\n"), x->errname, x->src,
+			x->dst, strerror(ret));
+		return ret;
+	}
+
+	add_copied_dir(x, a);
+
+	const size_t slen = strlen(x->src);
+	const size_t dlen = strlen(x->dst);
+	const struct dirent *ent;
+
+	while ((ent = readdir(dir))) {
+		if (xcopy_cancelled == 1) {
+			ret = ECANCELED;
+			break;
+		}
+
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		int r;
+		const size_t nlen = strlen(ent->d_name);
+		if (slen + nlen + 2 > sizeof(x->src)
+		|| dlen + nlen + 2 > sizeof(x->dst)) {
+			clear_progress();
+			xerror("%s: '%s/%s': %s\n", x->errname, x->src, ent->d_name,
+				strerror(ENAMETOOLONG));
+			r = ENAMETOOLONG;
+		} else {
+			x->src[slen] = x->dst[dlen] = '/';
+			memcpy(x->src + slen + 1, ent->d_name, nlen + 1);
+			memcpy(x->dst + dlen + 1, ent->d_name, nlen + 1);
+
+			r = copy_entry(x);
+
+			x->src[slen] = x->dst[dlen] = '\0';
+		}
+
+		if (r != FUNC_SUCCESS) {
+			ret = r;
+			/* Like cp(1), copy as much as possible. Otherwise (moving
+			 * files), the copy will be discarded anyway. */
+			if (!(x->flags & XCOPY_OVERWRITE))
+				break;
+		}
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+/* The destination file X->DST exists: remove it, unless both source and
+ * destination are directories (in which case they are merged).
+ * Return 0 on success or an errno value on error (already reported). */
+static int
+replace_dest_file(struct xcopy_t *x, const struct stat *a,
+	const struct stat *d, int *merge)
+{
+	int ret = FUNC_SUCCESS;
+
+	if (a->st_dev == d->st_dev && a->st_ino == d->st_ino) {
+		clear_progress();
+		xerror(_("%s: '%s' and '%s' are the same file\n"), x->errname,
+			x->src, x->dst);
+		return EEXIST;
+	}
+
+	if (S_ISDIR(d->st_mode))
+		ret = S_ISDIR(a->st_mode) ? FUNC_SUCCESS : EISDIR;
+	else if (S_ISDIR(a->st_mode))
+		ret = ENOTDIR;
+	else if (unlink(x->dst) == -1)
+		ret = errno;
+
+	if (ret != FUNC_SUCCESS) {
+		clear_progress();
+		xerror(_("%s: Cannot copy '%s' to '%s': %s\n"), x->errname, x->src,
+			x->dst, strerror(ret));
+		return ret;
+	}
+
+	*merge = S_ISDIR(a->st_mode);
+	return FUNC_SUCCESS;
+}
+
+/* Copy the file X->SRC (of any type, recursively for directories) as
+ * X->DST. Errors are reported here, except for regular files copied by
+ * worker threads (see pool_wait()), and for cancelled copies. */
+static int
+copy_entry(struct xcopy_t *x)
+{
+	if (xcopy_cancelled == 1)
+		return ECANCELED;
+
+	struct stat a;
+	if (lstat(x->src, &a) == -1) {
+		const int saved_errno = errno;
+		clear_progress();
+		xerror("%s: '%s': %s\n", x->errname, x->src, strerror(saved_errno));
+		return saved_errno;
+	}
+
+	int merge = 0;
+	struct stat d;
+	if ((x->flags & XCOPY_OVERWRITE) && lstat(x->dst, &d) == 0) {
+		const int ret = replace_dest_file(x, &a, &d, &merge);
+		if (ret != FUNC_SUCCESS)
+			return ret;
+	}
+
+	int ret;
+	int queued = 0;
+	switch (a.st_mode & S_IFMT) {
+	case S_IFDIR: ret = copy_directory(x, &a, merge); break;
+	case S_IFREG: ret = copy_regular_file(x, &a, &queued); break;
+	case S_IFLNK: ret = copy_symlink(x, &a); break;
+	default: ret = copy_special_file(x, &a); break;
+	}
+
+	if (ret == FUNC_SUCCESS) {
+		if (queued == 0) /* Otherwise, counted by the worker thread */
+			update_progress(0, 1);
+	} else if (!S_ISDIR(a.st_mode) && ret != ECANCELED) {
+		/* Errors copying directories were already reported */
+		clear_progress();
+		xerror(_("%s: Cannot copy '%s' to '%s': %s\n"), x->errname, x->src,
+			x->dst, strerror(ret));
+	}
+
+	return ret;
+}
+
+/* Recursively remove the file PATH (a buffer of PATH_MAX + 1 bytes, used
+ * to build the paths of subdirectories). */
+static int
+remove_tree(char *path)
+{
+	struct stat a;
+	if (lstat(path, &a) == -1)
+		return errno;
+
+	if (!S_ISDIR(a.st_mode))
+		return unlink(path) == -1 ? errno : FUNC_SUCCESS;
+
+	DIR *dir = opendir(path);
+	if (!dir)
+		return errno;
+
+	const size_t len = strlen(path);
+	int ret = FUNC_SUCCESS;
+	const struct dirent *ent;
+
+	while ((ent = readdir(dir))) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		const size_t nlen = strlen(ent->d_name);
+		if (len + nlen + 2 > PATH_MAX + 1) {
+			ret = ENAMETOOLONG;
+			continue;
+		}
+
+		path[len] = '/';
+		memcpy(path + len + 1, ent->d_name, nlen + 1);
+		const int r = remove_tree(path);
+		path[len] = '\0';
+		if (r != FUNC_SUCCESS)
+			ret = r;
+	}
+
+	closedir(dir);
+
+	if (ret == FUNC_SUCCESS && rmdir(path) == -1)
+		ret = errno;
+
+	return ret;
+}
+
+static struct xcopy_t *
+new_xcopy(const char *errname, const int xflags)
+{
+	struct xcopy_t *x = xcalloc(1, sizeof(struct xcopy_t));
+	x->errname = errname;
+	x->flags = xflags;
+	return x;
+}
+
+static void
+free_xcopy(struct xcopy_t *x)
+{
+	for (size_t i = 0; i < x->hlinks_n; i++)
+		free(x->hlinks[i].dst);
+	free(x->hlinks);
+	set_dirs_attrs(x, 0);
+	free(x->buf);
+	free(x);
+}
+
+/* Copy the file SRC as DST (see copy_entry()), and wait until all of its
+ * files were copied. Return 0 on success or an errno value on error. */
+static int
+copy_file(struct xcopy_t *x, const char *src, const char *dst)
+{
+	if (strlen(src) > PATH_MAX || strlen(dst) > PATH_MAX) {
+		clear_progress();
+		xerror("%s: '%s': %s\n", x->errname, src, strerror(ENAMETOOLONG));
+		return ENAMETOOLONG;
+	}
+
+	xstrsncpy(x->src, src, sizeof(x->src));
+	xstrsncpy(x->dst, dst, sizeof(x->dst));
+
+	int ret = copy_entry(x);
+	const int pool_ret = pool_wait(x->errname);
+	if (ret == FUNC_SUCCESS)
+		ret = pool_ret;
+
+	/* If some file could not be copied, the copy is kept only if
+	 * overwriting (like cp(1)). Otherwise, it is removed (see move_file()),
+	 * so that directories must remain writable. */
+	set_dirs_attrs(x, ret == FUNC_SUCCESS || (x->flags & XCOPY_OVERWRITE)
+		? 1 : 0);
+
+	return ret;
+}
+
+/* Move the file SRC to DST. rename(2) is tried first: if it fails because
+ * source and destination are in different filesystems, SRC is copied and
+ * then removed. Return 0 on success or an errno value on error. */
+static int
+move_file(struct xcopy_t *x, const char *src, const char *dst)
+{
+	if (renameat(XAT_FDCWD, src, XAT_FDCWD, dst) == 0) {
+		update_progress(0, 1);
+		return FUNC_SUCCESS;
+	}
+
+	if (errno != EXDEV) {
+		const int saved_errno = errno;
+		clear_progress();
+		xerror("%s: Cannot move '%s' to '%s': %s\n", x->errname, src, dst,
+			strerror(saved_errno));
+		return saved_errno;
+	}
+
+	/* Unless overwriting was requested, never overwrite (nor remove, if the
+	 * copy fails) an existing file */
+	struct stat a;
+	const int overwrite = (x->flags & XCOPY_OVERWRITE);
+	if (overwrite == 0 && lstat(dst, &a) == 0) {
+		clear_progress();
+		xerror("%s: Cannot move '%s' to '%s': %s\n", x->errname, src, dst,
+			strerror(EEXIST));
+		return EEXIST;
+	}
+
+	int ret = copy_file(x, src, dst);
+	if (ret != FUNC_SUCCESS) {
+		/* Do not leave a partial copy behind (if we created it) */
+		if (overwrite == 0) {
+			xstrsncpy(x->dst, dst, sizeof(x->dst));
+			remove_tree(x->dst);
+		}
+		return ret;
+	}
+
+	xstrsncpy(x->src, src, sizeof(x->src));
+	ret = remove_tree(x->src);
+	if (ret != FUNC_SUCCESS) {
+		clear_progress();
+		xerror(_("%s: '%s': Copied, but cannot remove the original file: "
+			"%s\n"), x->errname, src, strerror(ret));
+	}
+
+	return ret;
+}
+
+/* Move the file SRC to DST. DST must not exist. ERRNAME is used to prefix
+ * error messages. Return 0 on success or an errno value on error. */
+int
+xmove(const char *src, const char *dst, const char *errname)
+{
+	struct xcopy_t *x = new_xcopy(errname, 0);
+	const int ret = move_file(x, src, dst);
+	pool_stop();
+	free_xcopy(x);
+	return ret;
+}
+
+/* Return the total size of the regular files in PATH (a buffer of
+ * PATH_MAX + 1 bytes), recursively. Used to report progress. */
+static off_t
+get_tree_size(char *path)
+{
+	struct stat a;
+	if (lstat(path, &a) == -1)
+		return 0;
+
+	if (!S_ISDIR(a.st_mode)) {
+		if (!S_ISREG(a.st_mode))
+			return 0;
+		/* Holes in sparse files are not copied */
+		const off_t used = (off_t)a.st_blocks * S_BLKSIZE;
+		return used < a.st_size ? used : a.st_size;
+	}
+
+	DIR *dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	off_t total = 0;
+	const size_t len = strlen(path);
+	const struct dirent *ent;
+
+	while ((ent = readdir(dir)) && xcopy_cancelled == 0) {
+		const size_t nlen = strlen(ent->d_name);
+		if (SELFORPARENT(ent->d_name) || len + nlen + 2 > PATH_MAX + 1)
+			continue;
+
+		path[len] = '/';
+		memcpy(path + len + 1, ent->d_name, nlen + 1);
+		total += get_tree_size(path);
+		path[len] = '\0';
+	}
+
+	closedir(dir);
+	return total;
+}
+
+/* Return the total size of the files in SRC (N files). If DEV is not
+ * NULL, files in the device DEV are not counted: they will be renamed,
+ * not copied. */
+static off_t
+get_total_size(char *const *src, const size_t n, const dev_t *dev)
+{
+	char path[PATH_MAX + 1];
+	off_t total = 0;
+	struct stat a;
+
+	for (size_t i = 0; i < n; i++) {
+		if (dev && lstat(src[i], &a) != -1 && a.st_dev == *dev)
+			continue;
+
+		xstrsncpy(path, src[i], sizeof(path));
+		total += get_tree_size(path);
+	}
+
+	return total;
+}
+
+/* Move each file in SRC (N files) to the corresponding path in DST (see
+ * xmove()), reporting progress. The result of each move is stored in the
+ * corresponding field of STATUS (ECANCELED for files left in place because
+ * the user pressed Ctrl+c). ERRNAME is used to prefix messages.
+ * Return the number of successfully moved files. */
+size_t
+xmove_files(char *const *src, char *const *dst, const size_t n, int *status,
+	const char *errname)
+{
+	if (n == 0)
+		return 0;
+
+	struct sigaction old_sa;
+	cancel_start(&old_sa);
+
+	progress_start(errname, get_total_size(src, n, NULL));
+	struct xcopy_t *x = new_xcopy(errname, 0);
+
+	size_t moved = 0;
+	for (size_t i = 0; i < n; i++) {
+		status[i] = xcopy_cancelled == 1 ? ECANCELED
+			: move_file(x, src[i], dst[i]);
+		if (status[i] == FUNC_SUCCESS)
+			moved++;
+	}
+
+	pool_stop();
+	free_xcopy(x);
+	progress_end();
+	cancel_end(&old_sa, errname, _("processed"));
+	return moved;
+}
+
+/* Return 1 if the directory SRC is DST_DIR or one of its parents. */
+static int
+is_parent_dir(const char *src, const char *dst_dir)
+{
+	char s[PATH_MAX + 1];
+	char d[PATH_MAX + 1];
+	if (!realpath(src, s) || !realpath(dst_dir, d))
+		return 0;
+
+	const size_t len = strlen(s);
+	return (strncmp(s, d, len) == 0
+		&& (d[len] == '\0' || d[len] == '/' || (len == 1 && *s == '/')));
+}
+
+/* Write the last component of the path PATH into BUF, whose size is SIZE,
+ * ignoring trailing slashes (e.g. "dir" for "a/dir/"). Return the length
+ * of the component (0 if PATH is made only of slashes). */
+static size_t
+get_src_basename(const char *path, char *buf, const size_t size)
+{
+	size_t len = strlen(path);
+	while (len > 0 && path[len - 1] == '/')
+		len--;
+
+	size_t start = len;
+	while (start > 0 && path[start - 1] != '/')
+		start--;
+
+	len -= start;
+	if (len >= size)
+		len = size - 1;
+
+	memcpy(buf, path + start, len);
+	buf[len] = '\0';
+	return len;
+}
+
+/* Copy (or move, if MOVE is 1) files in FILES (a NULL terminated list)
+ * into the last file in the list (like 'cp -Rp SRC... DEST' and
+ * 'mv SRC... DEST'). Existing files are overwritten.
+ * Return 0 if all files were copied, or 1 otherwise (including if
+ * cancelled by the user). */
+int
+xcopy_files(char **files, const int move)
+{
+	const char *errname = move == 1 ? "m" : "c";
+
+	size_t n = 0;
+	while (files[n])
+		n++;
+
+	if (n < 2) {
+		xerror(_("%s: Missing destination file\n"), errname);
+		return FUNC_FAILURE;
+	}
+
+	const char *dest = files[--n];
+	struct stat d;
+	const int dest_is_dir = (stat(dest, &d) != -1 && S_ISDIR(d.st_mode));
+
+	if (n > 1 && dest_is_dir == 0) {
+		xerror(_("%s: '%s': %s\n"), errname, dest, strerror(ENOTDIR));
+		return FUNC_FAILURE;
+	}
+
+	/* Directory where files will be copied: used to check whether we are
+	 * copying a directory into itself, and which files will be renamed
+	 * instead of copied when moving. */
+	char dest_dir[PATH_MAX + 1];
+	xstrsncpy(dest_dir, dest, sizeof(dest_dir));
+	if (dest_is_dir == 0) {
+		char *p = strrchr(dest_dir, '/');
+		if (!p)
+			xstrsncpy(dest_dir, ".", sizeof(dest_dir));
+		else
+			p[p == dest_dir] = '\0';
+	}
+
+	struct sigaction old_sa;
+	cancel_start(&old_sa);
+
+	struct stat dd;
+	const int have_dev = (stat(dest_dir, &dd) != -1);
+	progress_start(errname, get_total_size(files, n,
+		(move == 1 && have_dev == 1) ? &dd.st_dev : NULL));
+
+	struct xcopy_t *x = new_xcopy(errname, XCOPY_OVERWRITE);
+	int exit_status = FUNC_SUCCESS;
+	char buf[PATH_MAX + 1];
+	char base[NAME_MAX + 1];
+
+	for (size_t i = 0; i < n && xcopy_cancelled == 0; i++) {
+		const char *dst = dest;
+		if (dest_is_dir == 1) {
+			/* Source files may end with a slash (e.g. "dir/") */
+			if (get_src_basename(files[i], base, sizeof(base)) == 0) {
+				clear_progress();
+				xerror("%s: '%s': %s\n", errname, files[i], strerror(EINVAL));
+				exit_status = FUNC_FAILURE;
+				continue;
+			}
+
+			const size_t len = strlen(dest);
+			snprintf(buf, sizeof(buf), "%s%s%s", dest,
+				(len > 0 && dest[len - 1] == '/') ? "" : "/", base);
+			dst = buf;
+		}
+
+		struct stat a;
+		if (move == 0 && lstat(files[i], &a) != -1 && S_ISDIR(a.st_mode)
+		&& is_parent_dir(files[i], dest_dir) == 1) {
+			clear_progress();
+			xerror(_("%s: '%s': Cannot copy a directory into itself\n"),
+				errname, files[i]);
+			exit_status = FUNC_FAILURE;
+			continue;
+		}
+
+		const int ret = move == 1 ? move_file(x, files[i], dst)
+			: copy_file(x, files[i], dst);
+		if (ret != FUNC_SUCCESS)
+			exit_status = FUNC_FAILURE;
+	}
+
+	pool_stop();
+	free_xcopy(x);
+	progress_end();
+
+	/* Files copied while moving across filesystems are counted as well */
+	if (cancel_end(&old_sa, errname, move == 1 ? _("processed")
+	: _("copied")) == 1)
+		exit_status = FUNC_FAILURE;
+
+	return exit_status;
+}
+
+static void
+report_remove_error(const char *errname, const char *path, const int error)
+{
+	clear_progress();
+	xerror(_("%s: Cannot remove '%s': %s\n"), errname, path, strerror(error));
+}
+
+/* Remove the contents of the directory PATH: files are removed right away,
+ * and subdirectories are queued to be removed by the worker threads.
+ * Return 0 on success or 1 on error (already reported). */
+static int
+dispatch_dir_removal(const char *path, const char *errname)
+{
+	DIR *dir = open_dir_at(XAT_FDCWD, path, path);
+	if (!dir) {
+		report_remove_error(errname, path, errno);
+		return FUNC_FAILURE;
+	}
+
+	const int fd = dirfd(dir);
+
+	char buf[PATH_MAX + 1];
+	const int is_root = (*path == '/' && !path[1]);
+	int ret = FUNC_SUCCESS;
+	const struct dirent *ent;
+
+	while ((ent = readdir(dir))) {
+		if (xcopy_cancelled == 1) {
+			ret = FUNC_FAILURE;
+			break;
+		}
+
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		snprintf(buf, sizeof(buf), "%s%s%s", path,
+			is_root == 1 ? "" : "/", ent->d_name);
+
+		if (is_dir_at(fd, ent, buf) == 1) {
+			if (pool_submit(buf, NULL, NULL) == 0)
+				continue;
+
+			char *errpath = NULL;
+			const int error = remove_dir(buf, &errpath);
+			if (error != FUNC_SUCCESS) {
+				if (error != ECANCELED)
+					report_remove_error(errname, errpath ? errpath : buf, error);
+				ret = FUNC_FAILURE;
+			}
+			free(errpath);
+		} else if (unlinkat(fd, AT_NAME(ent->d_name, buf), 0) == 0
+		|| errno == ENOENT) {
+			update_progress(0, 1);
+		} else {
+			report_remove_error(errname, buf, errno);
+			ret = FUNC_FAILURE;
+		}
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+/* Recursively remove files in FILES (a NULL terminated list), like
+ * 'rm -rf'. ERRNAME is used to prefix messages.
+ * Return 0 if all files were removed, or 1 otherwise (including if
+ * cancelled by the user). */
+int
+xremove_files(char **files, const char *errname)
+{
+	struct sigaction old_sa;
+	cancel_start(&old_sa);
+	progress_start(errname, -1);
+
+	int exit_status = FUNC_SUCCESS;
+	/* Directories whose contents are being removed by worker threads */
+	size_t *dirs = NULL;
+	size_t dirs_n = 0;
+
+	for (size_t i = 0; files[i] && xcopy_cancelled == 0; i++) {
+		struct stat a;
+		if (lstat(files[i], &a) == -1) {
+			if (errno != ENOENT) {
+				report_remove_error(errname, files[i], errno);
+				exit_status = FUNC_FAILURE;
+			}
+			continue;
+		}
+
+		if (!S_ISDIR(a.st_mode)) {
+			if (unlink(files[i]) == 0 || errno == ENOENT) {
+				update_progress(0, 1);
+			} else {
+				report_remove_error(errname, files[i], errno);
+				exit_status = FUNC_FAILURE;
+			}
+			continue;
+		}
+
+		if (dispatch_dir_removal(files[i], errname) != FUNC_SUCCESS)
+			exit_status = FUNC_FAILURE;
+
+		dirs = xnrealloc(dirs, dirs_n + 1, sizeof(size_t));
+		dirs[dirs_n++] = i;
+	}
+
+	if (pool_wait(errname) != FUNC_SUCCESS)
+		exit_status = FUNC_FAILURE;
+
+	for (size_t i = 0; i < dirs_n && xcopy_cancelled == 0; i++) {
+		if (rmdir(files[dirs[i]]) == 0 || errno == ENOENT) {
+			update_progress(0, 1);
+		} else if (exit_status == FUNC_SUCCESS || errno != ENOTEMPTY) {
+			/* If not empty because some file could not be removed, the
+			 * error was already reported. */
+			report_remove_error(errname, files[dirs[i]], errno);
+			exit_status = FUNC_FAILURE;
+		}
+	}
+
+	free(dirs);
+	pool_stop();
+	progress_end();
+
+	if (cancel_end(&old_sa, errname, _("removed")) == 1)
+		exit_status = FUNC_FAILURE;
+
+	return exit_status;
+}
@@ -0,0 +1,23 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * SPDX-FileCopyrightText: 2016-2026 L. Abramovich <leo.clifm@outlook.com>
+*/
+
+/* xcopy.h */
+
+#ifndef CLIFM_XCOPY_H
+#define CLIFM_XCOPY_H
+
+__BEGIN_DECLS
+
+int    xcopy_files(char **files, const int move);
+int    xmove(const char *src, const char *dst, const char *errname);
+int    xremove_files(char **files, const char *errname);
+size_t xmove_files(char *const *src, char *const *dst, const size_t n,
+	int *status, const char *errname);
+
+__END_DECLS
+
+#endif /* CLIFM_XCOPY_H */